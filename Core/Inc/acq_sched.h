@@ -0,0 +1,60 @@
+#ifndef __ACQ_SCHED_H__
+#define __ACQ_SCHED_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Multi-rate acquisition: every sensor stream is read at its own rate instead of all of
+ * them at the rate of the loop. This keeps the due times and the counts, the reads are in
+ * Icm20948Driver::imuStreamPoll. Times are passed in ticks of the caller's clock (DWT on the
+ * target, microseconds on the host), compared wrap-safe. Streams whose periods are multiples
+ * of each other fall due in the same poll, so accel at a multiple of the gyro period is read
+ * in the gyro burst.
+ */
+
+typedef enum
+{
+	ACQ_SCHED_STREAM_GYRO = 0,
+	ACQ_SCHED_STREAM_ACCEL,
+	ACQ_SCHED_STREAM_MAGN,
+	ACQ_SCHED_STREAM_BARO,
+	ACQ_SCHED_STREAM_NUM
+} ACQ_SCHED_EN_STREAM;
+
+#define ACQ_SCHED_BIT(stream)       (1u << (stream))
+#define ACQ_SCHED_ALL               (ACQ_SCHED_BIT(ACQ_SCHED_STREAM_NUM) - 1u)
+
+// bytes the driver reads per stream; accel and gyro due together are one burst of both
+#define ACQ_SCHED_LEN_GYRO          (6)
+#define ACQ_SCHED_LEN_ACCEL         (6)
+#define ACQ_SCHED_LEN_MAGN          (9)     /*<EXT_SENS_DATA of the SLV0 auto-read, ST1..ST2*/
+#define ACQ_SCHED_LEN_BARO_STATUS   (1)
+#define ACQ_SCHED_LEN_BARO          (6)
+
+typedef struct
+{
+	uint32_t au32Period[ACQ_SCHED_STREAM_NUM];     /*<ticks between reads, 0: stream off*/
+} ACQ_SCHED_ST_PLAN;
+
+typedef struct
+{
+	ACQ_SCHED_ST_PLAN stPlan;
+	uint32_t au32Due[ACQ_SCHED_STREAM_NUM];
+	uint32_t au32Reads[ACQ_SCHED_STREAM_NUM];
+	uint32_t au32Missed[ACQ_SCHED_STREAM_NUM];     /*<periods that passed without a poll*/
+} ACQ_SCHED_ST_STATE;
+
+void AcqSched_Init(ACQ_SCHED_ST_STATE *pstSched, const ACQ_SCHED_ST_PLAN *pstPlan, uint32_t u32Now);
+uint8_t AcqSched_Due(ACQ_SCHED_ST_STATE *pstSched, uint32_t u32Now);
+uint32_t AcqSched_WaitGet(const ACQ_SCHED_ST_STATE *pstSched, uint32_t u32Now);
+uint32_t AcqSched_BusUs(uint8_t u8Streams, uint32_t u32SclHz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
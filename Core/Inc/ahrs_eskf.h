@@ -0,0 +1,222 @@
+#pragma once
+
+#include <cmath>
+#include "embedMath.h"
+
+/*
+ * Multiplicative error-state Kalman filter: the nominal attitude q_nb and gyro bias are
+ * integrated as they are, the filter keeps the covariance of the 6 error states, the
+ * rotation error in the body frame (q_true = q * exp(dtheta / 2)) and the bias error.
+ * Same frames and interface as the filters of ahrs_filter.h, with the bias and its
+ * uncertainty as outputs.
+ *
+ * F and G are mostly zeros and identities, so the propagation works on the 3x3 blocks of
+ * P; the measurements go in one scalar at a time and nothing is inverted.
+ */
+
+// noise densities and initial uncertainty the filter is instantiated with unless another set is given
+struct AhrsEskfNoiseDefault
+{
+    constexpr static double GYRO = 2.6e-4;      // gyro white noise, rad/s/sqrt(Hz); ICM-20948: 0.015 dps/sqrt(Hz)
+    constexpr static double GYRO_BIAS = 1e-5;   // bias random walk, rad/s/sqrt(s)
+    constexpr static double ACCEL = 0.02;       // per axis of the normalised accel, motion included
+    constexpr static double MAGN = 0.02;        // per axis of the normalised field
+    constexpr static double INIT_ATT = 0.1;     // rad
+    constexpr static double INIT_BIAS = 0.02;   // rad/s
+};
+
+template <typename Type, class Noise = AhrsEskfNoiseDefault>
+class AhrsEskf
+{
+public:
+    static constexpr size_t STATES = 6;
+    static constexpr size_t ATT = 0;            // first index of the rotation error
+    static constexpr size_t BIAS = 3;           // first index of the bias error
+
+    AhrsEskf()
+    {
+        reset();
+    }
+
+    void reset(const matrix::Quaternion<Type> &q = matrix::Quaternion<Type>())
+    {
+        _clQ = q;
+        _clBias.setZero();
+        _clP.setZero();
+        for (size_t i = 0; i < 3; i++)
+        {
+            _clP(ATT + i, ATT + i) = Type(Noise::INIT_ATT * Noise::INIT_ATT);
+            _clP(BIAS + i, BIAS + i) = Type(Noise::INIT_BIAS * Noise::INIT_BIAS);
+        }
+    }
+
+    // gyro in rad/s; the nominal state follows the bias-corrected rate
+    void predict(const matrix::Vector3<Type> &gyro, Type dt)
+    {
+        const matrix::Vector3<Type> angle((gyro - _clBias) * dt);
+
+        _clQ = _clQ * matrix::Quaternion<Type>::expq(angle * Type(0.5));
+        _clQ.normalize();
+
+        /*
+         * F = [Phi -I*dt; 0 I] with Phi = I - [angle]x, so with P = [A B; B^T C]
+         *   B' = Phi B - C dt
+         *   A' = Phi A Phi^T - (B' + B'^T) dt - C dt^2
+         * and C stays, then the noise on the diagonal.
+         */
+        matrix::SquareMatrix<Type, 3> Phi;
+        Phi.setIdentity();
+        Phi -= angle.hat();
+
+        const matrix::SquareMatrix<Type, 3> A = _clP.template slice<3, 3>(ATT, ATT);
+        const matrix::SquareMatrix<Type, 3> B = _clP.template slice<3, 3>(ATT, BIAS);
+        const matrix::SquareMatrix<Type, 3> C = _clP.template slice<3, 3>(BIAS, BIAS);
+        const matrix::SquareMatrix<Type, 3> Bn = Phi * B - C * dt;
+        matrix::SquareMatrix<Type, 3> An = Phi * A * Phi.T() - (Bn + Bn.T()) * dt - C * (dt * dt);
+
+        const Type qAtt = Type(Noise::GYRO * Noise::GYRO) * dt;
+        const Type qBias = Type(Noise::GYRO_BIAS * Noise::GYRO_BIAS) * dt;
+        for (size_t i = 0; i < 3; i++)
+        {
+            An(i, i) += qAtt;
+            _clP(BIAS + i, BIAS + i) += qBias;
+        }
+
+        _clP.template slice<3, 3>(ATT, ATT) = An;
+        _clP.template slice<3, 3>(ATT, BIAS) = Bn;
+        _clP.template slice<3, 3>(BIAS, ATT) = Bn.T();
+        _clP.template makeBlockSymmetric<3>(ATT);
+    }
+
+    // any unit; the direction of gravity, three scalar updates
+    void correctAccel(const matrix::Vector3<Type> &accel)
+    {
+        if (!(accel.norm_squared() > Type(0)))
+        {
+            return;
+        }
+
+        // predicted gravity v = R^T e_z; under the error it is v + [v]x dtheta
+        const matrix::Dcm<Type> R(_clQ);
+        const matrix::Vector3<Type> v(R(2, 0), R(2, 1), R(2, 2));
+        const matrix::Vector3<Type> r(matrix::Vector3<Type>(accel.unit()) - v);
+        const matrix::Dcm<Type> H(v.hat());
+        const Type var = Type(Noise::ACCEL * Noise::ACCEL);
+        matrix::Vector<Type, STATES> dx;
+
+        dx.setZero();
+        for (size_t i = 0; i < 3; i++)
+        {
+            correctScalar(matrix::Vector3<Type>(H(i, 0), H(i, 1), H(i, 2)), r(i), var, dx);
+        }
+        inject(dx);
+    }
+
+    // any unit; heading only, one scalar update, the tilt is left to the accel
+    void correctMag(const matrix::Vector3<Type> &mag)
+    {
+        if (!(mag.norm_squared() > Type(0)))
+        {
+            return;
+        }
+
+        // the measured field in the earth frame points north when the heading is right; its
+        // angle is minus the rotation error about the earth z axis, v^T dtheta
+        const matrix::Dcm<Type> R(_clQ);
+        const matrix::Vector3<Type> h(R * matrix::Vector3<Type>(mag.unit()));
+        const Type horiz = matrix::Vector2<Type>(h(0), h(1)).norm();
+
+        if (!(horiz > Type(1e-3)))
+        {
+            return;
+        }
+
+        const matrix::Vector3<Type> v(R(2, 0), R(2, 1), R(2, 2));
+        const Type var = Type(Noise::MAGN * Noise::MAGN) / (horiz * horiz);
+        matrix::Vector<Type, STATES> dx;
+
+        dx.setZero();
+        correctScalar(v, -std::atan2(h(1), h(0)), var, dx);
+        inject(dx);
+    }
+
+    // the interface of the filters in ahrs_filter.h: nullptr when there is no new sample
+    void update(const matrix::Vector3<Type> &gyro, const matrix::Vector3<Type> *accel,
+                const matrix::Vector3<Type> *mag, Type dt)
+    {
+        predict(gyro, dt);
+        if (accel != nullptr)
+        {
+            correctAccel(*accel);
+        }
+        if (mag != nullptr)
+        {
+            correctMag(*mag);
+        }
+    }
+
+    const matrix::Quaternion<Type> &attitude(void) const
+    {
+        return _clQ;
+    }
+
+    const matrix::Vector3<Type> &biasGet(void) const
+    {
+        return _clBias;
+    }
+
+    const matrix::SquareMatrix<Type, STATES> &covariance(void) const
+    {
+        return _clP;
+    }
+
+private:
+    /*
+     * z = h^T dtheta + noise with h on the rotation error only, so P h is three columns of
+     * P. dx collects the corrections of one measurement, the residual was formed before any
+     * of them. P - K h^T P = P - K (P h)^T keeps P symmetric.
+     */
+    void correctScalar(const matrix::Vector3<Type> &h, Type residual, Type var, matrix::Vector<Type, STATES> &dx)
+    {
+        matrix::Vector<Type, STATES> Ph;
+
+        for (size_t i = 0; i < STATES; i++)
+        {
+            Ph(i) = _clP(i, ATT) * h(0) + _clP(i, ATT + 1) * h(1) + _clP(i, ATT + 2) * h(2);
+        }
+
+        const Type s = h(0) * Ph(ATT) + h(1) * Ph(ATT + 1) + h(2) * Ph(ATT + 2) + var;
+        if (!(s > Type(0)))
+        {
+            return;
+        }
+
+        const matrix::Vector<Type, STATES> K(Ph / s);
+        const Type innov = residual - (h(0) * dx(ATT) + h(1) * dx(ATT + 1) + h(2) * dx(ATT + 2));
+
+        dx += K * innov;
+        for (size_t i = 0; i < STATES; i++)
+        {
+            for (size_t j = i; j < STATES; j++)
+            {
+                _clP(i, j) -= K(i) * Ph(j);
+                _clP(j, i) = _clP(i, j);
+            }
+        }
+    }
+
+    // move the error into the nominal state; the covariance is kept as it is, the reset
+    // Jacobian is I to first order
+    void inject(const matrix::Vector<Type, STATES> &dx)
+    {
+        const matrix::Vector3<Type> dtheta(dx(ATT), dx(ATT + 1), dx(ATT + 2));
+
+        _clQ = _clQ * matrix::Quaternion<Type>::expq(dtheta * Type(0.5));
+        _clQ.normalize();
+        _clBias += matrix::Vector3<Type>(dx(BIAS), dx(BIAS + 1), dx(BIAS + 2));
+    }
+
+    matrix::Quaternion<Type> _clQ;
+    matrix::Vector3<Type> _clBias;
+    matrix::SquareMatrix<Type, STATES> _clP;
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <type_traits>
+#include "embedMath.h"
+
+/*
+ * Attitude fusion on the embedMath types, independent of the sensor driver. The filter
+ * owns its state and takes dt with every update; the attitude is q_nb, body to a z-up
+ * earth frame, so a level board at rest measures accel (0, 0, 1). The gains are a type,
+ * the constants fold into the update and nothing is allocated.
+ */
+
+// the gains the filters are instantiated with unless another set is given
+struct AhrsGainsDefault
+{
+    constexpr static double KP = 1.0;    // Mahony: rad/s of correction per unit of error
+    constexpr static double KI = 0.1;    // Mahony: integral gain, learns the gyro bias
+    constexpr static double BETA = 0.05; // Madgwick: gyro error the gradient step covers, rad/s
+};
+
+template <typename Type, class Gains = AhrsGainsDefault>
+class MahonyAhrs
+{
+public:
+    MahonyAhrs()
+    {
+        reset();
+    }
+
+    void reset(const matrix::Quaternion<Type> &q = matrix::Quaternion<Type>())
+    {
+        _clQ = q;
+        _clIntegral.setZero();
+    }
+
+    // gyro in rad/s, accel and mag in any unit, nullptr when there is no new sample
+    void update(const matrix::Vector3<Type> &gyro, const matrix::Vector3<Type> *accel,
+                const matrix::Vector3<Type> *mag, Type dt)
+    {
+        matrix::Vector3<Type> rate = gyro;
+
+        rate += correction(accel, mag, dt);
+        _clQ = _clQ * matrix::Quaternion<Type>::expq(rate * (Type(0.5) * dt));
+        _clQ.normalize();
+    }
+
+    // the slow stage of a two-rate loop: dq is the gyro rotation since the last call, as
+    // ConingIntegrator::get() gives it, and the correction is held over the dt it spans
+    void updateDelta(const matrix::Quaternion<Type> &dq, const matrix::Vector3<Type> *accel,
+                     const matrix::Vector3<Type> *mag, Type dt)
+    {
+        _clQ = _clQ * dq;
+        _clQ.normalize();
+        _clQ = _clQ * matrix::Quaternion<Type>::expq(correction(accel, mag, dt) * (Type(0.5) * dt));
+        _clQ.normalize();
+    }
+
+    const matrix::Quaternion<Type> &attitude(void) const
+    {
+        return _clQ;
+    }
+
+    // the integral term cancels the gyro bias, its negative is the estimate
+    matrix::Vector3<Type> biasGet(void) const
+    {
+        return -_clIntegral;
+    }
+
+private:
+    // the rate that turns the estimate toward the references, integral included
+    matrix::Vector3<Type> correction(const matrix::Vector3<Type> *accel, const matrix::Vector3<Type> *mag, Type dt)
+    {
+        const matrix::Dcm<Type> R(_clQ);
+        matrix::Vector3<Type> e;
+        matrix::Vector3<Type> v, h, w;
+        bool bCorrect = false;
+
+        e.setZero();
+        if ((accel != nullptr) && (accel->norm_squared() > Type(0)))
+        {
+            // estimated direction of gravity: the earth z axis in the body frame
+            v = matrix::Vector3<Type>(R(2, 0), R(2, 1), R(2, 2));
+            e += matrix::Vector3<Type>(accel->unit()).cross(v);
+            bCorrect = true;
+        }
+
+        if ((mag != nullptr) && (mag->norm_squared() > Type(0)))
+        {
+            // the measured field in the earth frame, turned into the horizontal plane of
+            // north, then back: only the heading is corrected, never the tilt
+            const matrix::Vector3<Type> m(mag->unit());
+            h = R * m;
+            w = R.transpose() * matrix::Vector3<Type>(matrix::Vector2<Type>(h(0), h(1)).norm(), Type(0), h(2));
+            e += m.cross(w);
+            bCorrect = true;
+        }
+
+        if (!bCorrect)
+        {
+            return e;
+        }
+
+        _clIntegral += e * (Type(Gains::KI) * dt);
+        return e * Type(Gains::KP) + _clIntegral;
+    }
+
+    matrix::Quaternion<Type> _clQ;
+    matrix::Vector3<Type> _clIntegral;
+};
+
+template <typename Type, class Gains = AhrsGainsDefault>
+class MadgwickAhrs
+{
+public:
+    MadgwickAhrs()
+    {
+        reset();
+    }
+
+    void reset(const matrix::Quaternion<Type> &q = matrix::Quaternion<Type>())
+    {
+        _clQ = q;
+    }
+
+    // gyro in rad/s, accel and mag in any unit, nullptr when there is no new sample; the
+    // mag is only used together with the accel
+    void update(const matrix::Vector3<Type> &gyro, const matrix::Vector3<Type> *accel,
+                const matrix::Vector3<Type> *mag, Type dt)
+    {
+        matrix::Quaternion<Type> &q = _clQ;
+        matrix::Quaternion<Type> qDot(q.derivative1(gyro));
+        const Type q0 = q(0), q1 = q(1), q2 = q(2), q3 = q(3);
+        Type s0, s1, s2, s3, f0, f1, f2, norm;
+
+        if ((accel != nullptr) && (accel->norm_squared() > Type(0)))
+        {
+            const matrix::Vector3<Type> a(accel->unit());
+
+            // gradient J^T f of the gravity objective f = C^T (0, 0, 1) - a
+            f0 = Type(2) * (q1 * q3 - q0 * q2) - a(0);
+            f1 = Type(2) * (q0 * q1 + q2 * q3) - a(1);
+            f2 = Type(1) - Type(2) * (q1 * q1 + q2 * q2) - a(2);
+            s0 = Type(2) * (-q2 * f0 + q1 * f1);
+            s1 = Type(2) * (q3 * f0 + q0 * f1) - Type(4) * q1 * f2;
+            s2 = Type(2) * (-q0 * f0 + q3 * f1) - Type(4) * q2 * f2;
+            s3 = Type(2) * (q1 * f0 + q2 * f1);
+
+            if ((mag != nullptr) && (mag->norm_squared() > Type(0)))
+            {
+                // flux objective f = C^T (bx, 0, bz) - m, b the measured field in the earth
+                // frame turned into the plane of north
+                const matrix::Vector3<Type> m(mag->unit());
+                const matrix::Dcm<Type> R(q);
+                const matrix::Vector3<Type> h(R * m);
+                const Type bx = matrix::Vector2<Type>(h(0), h(1)).norm();
+                const Type bz = h(2);
+
+                f0 = Type(2) * bx * (Type(0.5) - q2 * q2 - q3 * q3) + Type(2) * bz * (q1 * q3 - q0 * q2) - m(0);
+                f1 = Type(2) * bx * (q1 * q2 - q0 * q3) + Type(2) * bz * (q0 * q1 + q2 * q3) - m(1);
+                f2 = Type(2) * bx * (q0 * q2 + q1 * q3) + Type(2) * bz * (Type(0.5) - q1 * q1 - q2 * q2) - m(2);
+                s0 += Type(2) * (-bz * q2 * f0 + (-bx * q3 + bz * q1) * f1 + bx * q2 * f2);
+                s1 += Type(2) * (bz * q3 * f0 + (bx * q2 + bz * q0) * f1 + (bx * q3 - Type(2) * bz * q1) * f2);
+                s2 += Type(2) * ((-Type(2) * bx * q2 - bz * q0) * f0 + (bx * q1 + bz * q3) * f1 +
+                                 (bx * q0 - Type(2) * bz * q2) * f2);
+                s3 += Type(2) * ((-Type(2) * bx * q3 + bz * q1) * f0 + (-bx * q0 + bz * q2) * f1 + bx * q1 * f2);
+            }
+
+            norm = matrix::Vector4<Type>(s0, s1, s2, s3).norm();
+            if (norm > Type(0))
+            {
+                norm = Type(Gains::BETA) / norm;
+                qDot(0) -= s0 * norm;
+                qDot(1) -= s1 * norm;
+                qDot(2) -= s2 * norm;
+                qDot(3) -= s3 * norm;
+            }
+        }
+
+        q += qDot * dt;
+        q.normalize();
+    }
+
+    const matrix::Quaternion<Type> &attitude(void) const
+    {
+        return _clQ;
+    }
+
+private:
+    matrix::Quaternion<Type> _clQ;
+};
+
+// the variant is picked at compile time, both have the same interface
+enum class AhrsAlgo
+{
+    MAHONY,
+    MADGWICK
+};
+
+template <AhrsAlgo Algo, typename Type = float, class Gains = AhrsGainsDefault>
+using Ahrs = typename std::conditional<Algo == AhrsAlgo::MAHONY, MahonyAhrs<Type, Gains>, MadgwickAhrs<Type, Gains>>::type;
@@ -0,0 +1,118 @@
+#ifndef __AHRS_FIXED_H__
+#define __AHRS_FIXED_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// fusion of the raw int16 path in imuDataGet(); the stream, FIFO, two-rate and DMP paths
+// stay float, and the fixed-point state takes over whatever attitude they leave behind
+// 0: single-precision float  1: fixed point, Q31 quaternion and Q15 unit vectors
+#ifndef AHRS_FUSION
+#define AHRS_FUSION (0)
+#endif
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#include "cmsis_compiler.h"
+#define AHRS_FIXED_DSP (1)
+#else
+#define AHRS_FIXED_DSP (0)
+#endif
+
+#define AHRS_FIXED_Q31_ONE          (INT32_MAX)   /*<1.0 does not fit, the largest below it*/
+
+// rad/s per LSB in Q36 for a gyro range of the given LSB per dps; a constant expression
+#define AHRS_FIXED_GYRO_SCALE(lsbPerDps) \
+	((int32_t)(3.14159265358979 / 180.0 / (lsbPerDps) * 68719476736.0 + 0.5))
+
+/*
+ * Mahony filter in integers. Rates are rad/s in Q20 (+-2048 rad/s), the integral rad/s in
+ * Q28 (+-8 rad/s, a gyro bias is far below), the error of the references Q28; dt is taken
+ * in us and turned into Q32 seconds, so nothing in the update is float and nothing is
+ * divided but the normalisation of the references.
+ */
+typedef struct
+{
+	int32_t as32Q[4];               /*<attitude q_nb, Q31*/
+	int32_t as32Integral[3];        /*<integral term, rad/s in Q28*/
+	int32_t s32KpQ16;
+	int32_t s32KiQ16;
+} AHRS_ST_FIXED;
+
+void AhrsFixed_Init(AHRS_ST_FIXED *pstAhrs, float fKp, float fKi);
+void AhrsFixed_Reset(AHRS_ST_FIXED *pstAhrs);
+// new gains, attitude and integral are kept
+void AhrsFixed_GainsSet(AHRS_ST_FIXED *pstAhrs, float fKp, float fKi);
+/*
+ * ps16Gyro in LSB of the range s32GyroScaleQ36 belongs to, accel and magnetometer in any
+ * unit or NULL without a sample; all in the board axes
+ */
+void AhrsFixed_Update(AHRS_ST_FIXED *pstAhrs, const int16_t *ps16Gyro, int32_t s32GyroScaleQ36,
+                      const int16_t *ps16Accel, const int16_t *ps16Magn, uint32_t u32DtUs);
+void AhrsFixed_QuatGet(const AHRS_ST_FIXED *pstAhrs, float *pfQ);
+// an attitude from elsewhere, normalised; the integral is kept
+void AhrsFixed_QuatSet(AHRS_ST_FIXED *pstAhrs, const float *pfQ);
+// direction of a vector in Q15, false for the zero vector
+bool AhrsFixed_Unit(const int16_t *ps16V, int32_t *ps32U);
+uint32_t AhrsFixed_Sqrt(uint32_t u32X);
+
+static inline int32_t AhrsFixed_Sat(int64_t s64X)
+{
+	if (s64X > INT32_MAX)
+	{
+		return INT32_MAX;
+	}
+	if (s64X < INT32_MIN)
+	{
+		return INT32_MIN;
+	}
+	return (int32_t)s64X;
+}
+
+static inline int32_t AhrsFixed_SatQ15(int32_t s32X)
+{
+#if AHRS_FIXED_DSP
+	return __SSAT(s32X, 16);
+#else
+	return (s32X > INT16_MAX) ? INT16_MAX : ((s32X < INT16_MIN) ? INT16_MIN : s32X);
+#endif
+}
+
+static inline int32_t AhrsFixed_Add(int32_t s32A, int32_t s32B)
+{
+#if AHRS_FIXED_DSP
+	return __QADD(s32A, s32B);
+#else
+	return AhrsFixed_Sat((int64_t)s32A + s32B);
+#endif
+}
+
+static inline int32_t AhrsFixed_Sub(int32_t s32A, int32_t s32B)
+{
+#if AHRS_FIXED_DSP
+	return __QSUB(s32A, s32B);
+#else
+	return AhrsFixed_Sat((int64_t)s32A - s32B);
+#endif
+}
+
+// Q31 x Q31; -1 x -1 saturates. SMMLA keeps the high word, one bit short of rounding
+static inline int32_t AhrsFixed_MulQ31(int32_t s32A, int32_t s32B)
+{
+#if AHRS_FIXED_DSP
+	const int32_t s32High = __SMMLA(s32A, s32B, 0);
+
+	return __QADD(s32High, s32High);
+#else
+	return AhrsFixed_Sat(((int64_t)s32A * s32B + (1 << 30)) >> 31);
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
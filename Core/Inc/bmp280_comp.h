@@ -0,0 +1,63 @@
+#ifndef __BMP280_COMP_H__
+#define __BMP280_COMP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// 0: 64-bit integer (datasheet reference)  1: 32-bit integer  2: single-precision float
+#ifndef BMP280_COMPENSATION
+#define BMP280_COMPENSATION (1)
+#endif
+
+typedef struct
+{
+	uint16_t T1;    /*<calibration T1 data*/
+	int16_t T2;     /*<calibration T2 data*/
+	int16_t T3;     /*<calibration T3 data*/
+	uint16_t P1;    /*<calibration P1 data*/
+	int16_t P2;     /*<calibration P2 data*/
+	int16_t P3;     /*<calibration P3 data*/
+	int16_t P4;     /*<calibration P4 data*/
+	int16_t P5;     /*<calibration P5 data*/
+	int16_t P6;     /*<calibration P6 data*/
+	int16_t P7;     /*<calibration P7 data*/
+	int16_t P8;     /*<calibration P8 data*/
+	int16_t P9;     /*<calibration P9 data*/
+	int32_t T_fine; /*<calibration t_fine data*/
+} BMP280_HandleTypeDef;
+
+/*
+ * All backends return temperature in 0.01 degC and pressure in Pa, and take
+ * t_fine from the last temperature call, so temperature goes first.
+ * 64-bit: pressure in Q24.8, exact to the datasheet.
+ * 32-bit: pressure resolution 1 Pa, no int64 arithmetic.
+ * float:  no integer division at all, uses the FPU.
+ */
+float Bmp280Comp_Temperature64(BMP280_HandleTypeDef *pstCal, int32_t s32AdcT);
+float Bmp280Comp_Pressure64(const BMP280_HandleTypeDef *pstCal, int32_t s32AdcP);
+float Bmp280Comp_Temperature32(BMP280_HandleTypeDef *pstCal, int32_t s32AdcT);
+float Bmp280Comp_Pressure32(const BMP280_HandleTypeDef *pstCal, int32_t s32AdcP);
+float Bmp280Comp_TemperatureF(BMP280_HandleTypeDef *pstCal, int32_t s32AdcT);
+float Bmp280Comp_PressureF(const BMP280_HandleTypeDef *pstCal, int32_t s32AdcP);
+
+#if BMP280_COMPENSATION == 0
+#define Bmp280Comp_Temperature Bmp280Comp_Temperature64
+#define Bmp280Comp_Pressure Bmp280Comp_Pressure64
+#elif BMP280_COMPENSATION == 1
+#define Bmp280Comp_Temperature Bmp280Comp_Temperature32
+#define Bmp280Comp_Pressure Bmp280Comp_Pressure32
+#elif BMP280_COMPENSATION == 2
+#define Bmp280Comp_Temperature Bmp280Comp_TemperatureF
+#define Bmp280Comp_Pressure Bmp280Comp_PressureF
+#else
+#error "BMP280_COMPENSATION must be 0, 1 or 2"
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Delta angle of the gyro samples between two reads of the slow fusion stage. A rate
+ * vector that turns while it is sampled does not add up to the rotation that happened;
+ * the two-sample coning term (alpha + dalpha_prev / 6) x dalpha / 2 puts back what the
+ * plain sum leaves out. Each sample is the mean rate over its dt, as the gyro DLPF gives
+ * it, in rad/s on the board axes.
+ */
+class ConingIntegrator
+{
+public:
+    ConingIntegrator();
+    ~ConingIntegrator() = default;
+
+    void reset(void);
+    void put(const float *pfGyro, float fDt);
+    // the rotation since the last get as a quaternion (w, x, y, z) and the time it spans;
+    // starts the next interval, the last sample stays for its coning term
+    float get(float *pfDeltaQ);
+    void deltaAngleGet(float *pfAngle) const;
+    float dtGet(void) const;
+    uint16_t samplesGet(void) const;
+
+private:
+    float _fAlpha[3];   // sum of the sample rotations
+    float _fBeta[3];    // coning correction
+    float _fLast[3];    // rotation of the previous sample
+    float _fDt;
+    uint16_t _u16Samples;
+};
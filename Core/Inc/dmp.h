@@ -0,0 +1,108 @@
+#ifndef __DMP_H__
+#define __DMP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * ICM-20948 digital motion processor: memory map of the InvenSense DMP3 image
+ * (icm20948_img.dmp3a.h of the eMD package, not redistributable, supplied by the
+ * application) and the packets it writes to the FIFO.
+ */
+
+// the image is loaded from DMP_LOAD_START and started at DMP_START_ADDR
+#define DMP_LOAD_START              (0x0090)
+#define DMP_START_ADDR              (0x1000)
+#define DMP_MEM_BANK_SIZE           (256)
+#define DMP_MEM_CHUNK               (16)      /*<MEM_R_W burst, must not cross a memory bank*/
+
+// DMP memory, all values big-endian
+#define DMP_MEM_DATA_OUT_CTL1       (4 * 16)       /*<DMP_HDR_x of the packets written to the FIFO*/
+#define DMP_MEM_DATA_OUT_CTL2       (4 * 16 + 2)   /*<DMP_HDR2_x*/
+#define DMP_MEM_DATA_INTR_CTL       (4 * 16 + 12)
+#define DMP_MEM_MOTION_EVENT_CTL    (4 * 16 + 14)
+#define DMP_MEM_DATA_RDY_STATUS     (8 * 16 + 10)
+#define DMP_MEM_ODR_CNTR_QUAT9      (8 * 16 + 8)
+#define DMP_MEM_ODR_CNTR_QUAT6      (8 * 16 + 12)
+#define DMP_MEM_ODR_QUAT9           (10 * 16 + 8)  /*<output every ODR + 1 DMP samples*/
+#define DMP_MEM_ODR_QUAT6           (10 * 16 + 12)
+#define DMP_MEM_B2S_MTX             (13 * 16)      /*<body to sensor mounting, 3x3 Q30 row-major*/
+#define DMP_MEM_GYRO_SF             (19 * 16)
+#define DMP_MEM_CPASS_MTX           (23 * 16)      /*<compass to sensor axes and scale, 3x3 Q30*/
+#define DMP_MEM_ACC_SCALE           (30 * 16)
+#define DMP_MEM_GYRO_FULLSCALE      (72 * 16 + 12)
+#define DMP_MEM_ACC_SCALE2          (79 * 16 + 4)
+
+#define DMP_MOTION_ACCEL_CAL        (0x0200)
+#define DMP_MOTION_GYRO_CAL         (0x0100)
+#define DMP_MOTION_COMPASS_CAL      (0x0080)
+#define DMP_MOTION_9AXIS            (0x0040)
+
+#define DMP_DATA_RDY_GYRO           (0x0001)
+#define DMP_DATA_RDY_ACCEL          (0x0002)
+#define DMP_DATA_RDY_SECONDARY      (0x0008)
+
+// scaling the image expects for 2000 dps and 4 g, and the AK09916 in uT (0.15 uT/LSB)
+#define DMP_GYRO_FULLSCALE_2000DPS  (0x10000000)
+#define DMP_ACC_SCALE_4G            (0x04000000)
+#define DMP_ACC_SCALE2_4G           (0x00040000)
+#define DMP_Q30_ONE                 (0x40000000)
+#define DMP_CPASS_SCALE             (0x09999999)   /*<0.15 in Q30*/
+
+// packet header, the payloads follow in this order from the most significant bit
+#define DMP_HDR_ACCEL               (0x8000)
+#define DMP_HDR_GYRO                (0x4000)
+#define DMP_HDR_CPASS               (0x2000)
+#define DMP_HDR_ALS                 (0x1000)
+#define DMP_HDR_QUAT6               (0x0800)
+#define DMP_HDR_QUAT9               (0x0400)
+#define DMP_HDR_PQUAT6              (0x0200)
+#define DMP_HDR_GEOMAG              (0x0100)
+#define DMP_HDR_PRESSURE            (0x0080)
+#define DMP_HDR_GYRO_CALIBR         (0x0040)
+#define DMP_HDR_CPASS_CALIBR        (0x0020)
+#define DMP_HDR_STEP_DETECTOR       (0x0010)
+#define DMP_HDR_HEADER2             (0x0008)   /*<a second header follows the first*/
+
+// second header, its payloads follow those of the first
+#define DMP_HDR2_ACCEL_ACCURACY     (0x4000)
+#define DMP_HDR2_GYRO_ACCURACY      (0x2000)
+#define DMP_HDR2_CPASS_ACCURACY     (0x1000)
+#define DMP_HDR2_FSYNC              (0x0800)
+#define DMP_HDR2_PICKUP             (0x0400)
+#define DMP_HDR2_BATCH_MODE         (0x0100)   /*<flag only, no payload*/
+#define DMP_HDR2_ACT_RECOG          (0x0080)
+#define DMP_HDR2_SECONDARY_ON_OFF   (0x0040)
+
+#define DMP_HDR_LEN                 (2)
+#define DMP_FOOTER_LEN              (2)        /*<gyro ODR counter, after every packet*/
+#define DMP_PACKET_INVALID          (0xFFFF)
+
+typedef struct
+{
+	uint16_t u16Header;
+	uint16_t u16Header2;
+	int16_t as16Accel[3];           /*<sensor axes, LSB of the 4 g range*/
+	int16_t as16Gyro[3];            /*<sensor axes, LSB of the 2000 dps range*/
+	int16_t as16GyroBias[3];
+	int16_t as16Cpass[3];
+	int32_t as32Quat6[3];           /*<game rotation vector q1..q3 in Q30, q0 >= 0 is implied*/
+	int32_t as32Quat9[3];           /*<rotation vector, heading from the compass*/
+	int16_t s16Quat9Accuracy;       /*<heading accuracy estimate*/
+	uint16_t au16Accuracy[3];       /*<accel, gyro, compass calibration state 0..3*/
+	uint16_t u16Footer;
+} DMP_ST_PACKET;
+
+uint16_t Dmp_PacketLen(const uint8_t *pu8Buf, uint16_t u16Len);
+uint16_t Dmp_PacketParse(const uint8_t *pu8Buf, uint16_t u16Len, DMP_ST_PACKET *pstPacket);
+void Dmp_QuatFromQ30(const int32_t *ps32Q30, float *pfQuat);
+uint32_t Dmp_GyroSf(uint8_t u8SmplrtDiv, uint8_t u8PllTrim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef __GYRO_CAL_H__
+#define __GYRO_CAL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// samples per stillness window, 2 s at the 225 Hz sample rate
+#ifndef GYRO_CAL_WINDOW
+#define GYRO_CAL_WINDOW             (450)
+#endif
+// a window is still when every axis stays below these variances
+#define GYRO_CAL_GYRO_VAR_MAX       (0.04f)   /*<dps^2, 0.2 dps rms*/
+#define GYRO_CAL_ACCEL_VAR_MAX      (1e-4f)   /*<g^2, 0.01 g rms*/
+// zero-rate offset is +-5 dps, a larger mean is a slow steady turn
+#define GYRO_CAL_BIAS_MAX_DPS       (10.0f)
+// the stored bias is only rewritten when it moved by more than this
+#define GYRO_CAL_SAVE_DELTA_DPS     (0.05f)
+
+#define GYRO_CAL_RECORD_MAGIC       (0x47434231u) /*<"GCB1"*/
+#define GYRO_CAL_RECORD_VERSION     (1)
+
+// Welford running mean and sum of squared deviations, per axis
+typedef struct
+{
+	uint16_t u16Count;
+	float afMean[3];
+	float afM2[3];
+} GYRO_CAL_ST_WELFORD;
+
+// one slot in non-volatile storage, a multiple of the 8-byte flash program unit
+typedef struct
+{
+	uint32_t u32Magic;
+	uint16_t u16Version;
+	uint16_t u16Seq;                /*<incremented on every save*/
+	float afBiasDps[3];
+	uint32_t u32Crc;                /*<CRC-32 of everything above*/
+} GYRO_CAL_ST_RECORD;
+
+// byte-addressed storage that erases to 0xFF and programs in GYRO_CAL_ST_RECORD slots,
+// functions return 1 on success
+typedef struct
+{
+	uint32_t u32Size;
+	uint8_t (*pfnRead)(uint32_t u32Offset, void *pvBuf, uint32_t u32Len);
+	uint8_t (*pfnProgram)(uint32_t u32Offset, const void *pvBuf, uint32_t u32Len);
+	uint8_t (*pfnErase)(void);
+} GYRO_CAL_ST_NV;
+
+typedef struct
+{
+	GYRO_CAL_ST_WELFORD stGyro;
+	GYRO_CAL_ST_WELFORD stAccel;
+	float afBiasDps[3];
+	float fTempC;                   /*<mean die temperature of the window afBiasDps came from*/
+	float fTempSum;                 /*<over the current window*/
+	uint8_t u8Valid;                /*<afBiasDps came from storage or a still window*/
+	uint8_t u8SavePending;
+	uint16_t u16Seq;
+	uint32_t u32Slot;               /*<next free record slot, only meaningful after a load*/
+	float afSavedDps[3];
+	uint32_t u32Accepted;           /*<still windows*/
+	uint32_t u32Rejected;           /*<windows with motion*/
+	uint32_t u32Saves;
+	const GYRO_CAL_ST_NV *pstNv;
+} GYRO_CAL_ST_STATE;
+
+// firmware backend on the last flash page, see gyro_cal_flash.c
+extern const GYRO_CAL_ST_NV gyroCalFlash;
+
+void GyroCal_Init(GYRO_CAL_ST_STATE *pstCal, const GYRO_CAL_ST_NV *pstNv);
+uint8_t GyroCal_Update(GYRO_CAL_ST_STATE *pstCal, const float *pfGyroDps, const float *pfAccelG, float fTempC);
+void GyroCal_Restart(GYRO_CAL_ST_STATE *pstCal);
+uint8_t GyroCal_Save(GYRO_CAL_ST_STATE *pstCal);
+void GyroCal_WelfordReset(GYRO_CAL_ST_WELFORD *pstW);
+void GyroCal_WelfordUpdate(GYRO_CAL_ST_WELFORD *pstW, const float *pfIn);
+float GyroCal_WelfordVar(const GYRO_CAL_ST_WELFORD *pstW, uint8_t u8Axis);
+uint32_t GyroCal_Crc32(const void *pvData, uint32_t u32Len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
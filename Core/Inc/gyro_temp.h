@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Gyro bias as a function of die temperature. Every still window of the background
+ * calibration adds a (temperature, bias) point; the points are fitted per axis with a
+ * polynomial in (T - REF_TEMP_C) and baked into a table of nodes, so the sample path
+ * only does one clamped linear interpolation.
+ */
+class GyroTempModel
+{
+public:
+    constexpr static uint8_t POINTS = 24;            // still windows kept for the fit
+    constexpr static uint8_t NODES = 21;             // -20..80 degC
+    constexpr static float NODE_T0_C = -20.0f;
+    constexpr static float NODE_STEP_C = 5.0f;
+    constexpr static float REF_TEMP_C = 25.0f;
+    constexpr static float TABLE_DPS_PER_LSB = 0.001f;
+    // a point this close to a kept one replaces it rather than taking a slot
+    constexpr static float POINT_MERGE_C = 0.5f;
+    // temperature span the points must cover before a slope, then a curvature, is fitted
+    constexpr static float SPAN_LINEAR_C = 2.0f;
+    constexpr static float SPAN_QUADRATIC_C = 10.0f;
+
+    GyroTempModel();
+    ~GyroTempModel() = default;
+
+    void reset(void);
+    void pointAdd(float fTempC, const float *pfBiasDps);
+    void biasGet(float fTempC, float *pfBiasDps) const;
+    bool valid(void) const;
+    uint8_t pointsGet(void) const;
+    uint8_t orderGet(void) const;
+
+private:
+    float _fPointTemp[POINTS];
+    float _fPointBias[POINTS][3];
+    uint8_t _u8Points;
+    uint8_t _u8Order; // polynomial order of the last fit
+    bool _bValid;
+    int16_t _s16Table[NODES][3]; // bias in TABLE_DPS_PER_LSB at NODE_T0_C + i * NODE_STEP_C
+
+    void fit(void);
+    template <size_t N>
+    void fitOrder(float fTempMin, float fTempMax);
+};
@@ -0,0 +1,94 @@
+#ifndef __I2C_BUS_H__
+#define __I2C_BUS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "main.h"
+#include "i2c_timing.h"
+
+// buses with a timing profile at the same time
+#define I2C_BUS_MAX_BUSES           2
+
+// I2C3 lines, measured with the 2.2 kOhm pull-ups; a slower bus has no Fm+ profile.
+// The ICM20948 is specified up to 400 kHz, Fm+ is for buses without it
+#define I2C_BUS_I2C3_RISE_NS        (100)
+#define I2C_BUS_I2C3_FALL_NS        (20)
+#define I2C_BUS_I2C3_SPEED          I2C_TIMING_SPEED_400K
+
+// recovery clock-out: up to 9 SCL pulses at 100 kHz, a slave stretching the clock longer
+// than I2C_BUS_RECOVER_STRETCH_US ends it
+#define I2C_BUS_RECOVER_HALF_US     (5)
+#define I2C_BUS_RECOVER_PULSES      (9)
+#define I2C_BUS_RECOVER_STRETCH_US  (1000)
+
+typedef enum
+{
+	I2C_BUS_REC_IDLE = 0,
+	I2C_BUS_REC_CLOCK_LOW,          /*<SCL pulled low*/
+	I2C_BUS_REC_CLOCK_HIGH,         /*<SCL released, SDA sampled at the end*/
+	I2C_BUS_REC_STOP_SCL_LOW,       /*<SDA free: STOP, SCL low first*/
+	I2C_BUS_REC_STOP_SDA_LOW,
+	I2C_BUS_REC_STOP_SCL_HIGH,
+	I2C_BUS_REC_STOP_SDA_HIGH,      /*<STOP on the wire, the peripheral comes back next*/
+	I2C_BUS_REC_NUM
+} I2C_BUS_EN_RECOVER;
+
+typedef struct
+{
+	GPIO_TypeDef *pstSclPort;
+	uint16_t u16SclPin;
+	GPIO_TypeDef *pstSdaPort;
+	uint16_t u16SdaPin;
+} I2C_BUS_ST_PINS;
+
+typedef struct
+{
+	uint32_t u32Xfers;              /*<completed transfers*/
+	uint32_t u32Errors;             /*<NACK, arbitration lost, bus error*/
+	uint32_t u32Timeouts;
+	uint32_t u32Recoveries;
+	uint32_t u32RecoverFails;       /*<SDA or SCL still held after the clock-out*/
+	uint32_t u32LastUs;             /*<start to completion of the last transfer*/
+	uint32_t u32MaxUs;
+	uint64_t u64SumUs;
+	uint64_t u64WireSumUs;          /*<the same transfers at the SCL rate, I2cTiming_XferUs*/
+} I2C_BUS_ST_STATS;
+
+typedef struct
+{
+	I2C_HandleTypeDef *phi2c;
+	I2C_BUS_ST_PINS stPins;
+	I2C_TIMING_ST_BUS stLines;
+	uint8_t u8Speed;                /*<I2C_TIMING_EN_SPEED*/
+	uint32_t u32ClkHz;              /*<kernel clock TIMINGR was computed for*/
+	uint32_t u32Timingr;
+	uint32_t u32SclHz;              /*<what u32Timingr gives on stLines*/
+	volatile uint8_t u8Busy;        /*<a transfer started here is on the bus*/
+	uint8_t u8Recover;              /*<I2C_BUS_EN_RECOVER*/
+	uint8_t u8Pulses;
+	uint32_t u32RecoverStamp;       /*<Timestamp_Get() of the last line change*/
+	I2C_BUS_ST_STATS stStats;
+} I2C_BUS_ST_STATE;
+
+extern I2C_BUS_ST_STATE i2c3Bus;
+
+HAL_StatusTypeDef I2cBus_Init(I2C_BUS_ST_STATE *pstBus, I2C_HandleTypeDef *phi2c, const I2C_BUS_ST_PINS *pstPins,
+			      const I2C_TIMING_ST_BUS *pstLines, I2C_TIMING_EN_SPEED enSpeed);
+HAL_StatusTypeDef I2cBus_SpeedSet(I2C_BUS_ST_STATE *pstBus, I2C_TIMING_EN_SPEED enSpeed);
+HAL_StatusTypeDef I2cBus_MemRead(I2C_BUS_ST_STATE *pstBus, uint16_t u16DevAddr, uint8_t u8Reg, uint8_t *pu8Buf, uint16_t u16Len);
+HAL_StatusTypeDef I2cBus_MemWrite(I2C_BUS_ST_STATE *pstBus, uint16_t u16DevAddr, uint8_t u8Reg, const uint8_t *pu8Buf, uint16_t u16Len);
+void I2cBus_RecoverStart(I2C_BUS_ST_STATE *pstBus);
+uint8_t I2cBus_RecoverPoll(I2C_BUS_ST_STATE *pstBus);
+uint32_t I2cBus_AvgUs(const I2C_BUS_ST_STATS *pstStats);
+
+// 1: the completion belongs to a transfer started here, the caller ignores it
+uint8_t I2cBus_RxCpltCallback(I2C_HandleTypeDef *phi2c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef __I2C_SCHED_H__
+#define __I2C_SCHED_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "main.h"
+
+// descriptors per priority level, power of two
+#define I2C_SCHED_QUEUE_LEN         8
+// distinct device addresses tracked per bus
+#define I2C_SCHED_MAX_DEVS          4
+// buses that can be driven by a scheduler at the same time
+#define I2C_SCHED_MAX_BUSES         2
+
+typedef enum
+{
+	I2C_SCHED_PRIO_HIGH = 0,        /*<sensor sample bursts*/
+	I2C_SCHED_PRIO_NORMAL,
+	I2C_SCHED_PRIO_LOW,             /*<configuration, slow sensors*/
+	I2C_SCHED_PRIO_NUM
+} I2C_SCHED_EN_PRIO;
+
+typedef enum
+{
+	I2C_SCHED_DIR_READ = 0,
+	I2C_SCHED_DIR_WRITE
+} I2C_SCHED_EN_DIR;
+
+typedef struct I2C_SCHED_ST_XFER I2C_SCHED_ST_XFER;
+
+// runs from the I2C/DMA completion interrupt, keep it short
+typedef void (*I2C_SCHED_CALLBACK)(const I2C_SCHED_ST_XFER *pstXfer, HAL_StatusTypeDef enStatus);
+
+struct I2C_SCHED_ST_XFER
+{
+	uint16_t u16DevAddr;            /*<8-bit HAL address*/
+	uint8_t u8RegAddr;
+	uint8_t u8Dir;                  /*<I2C_SCHED_EN_DIR*/
+	uint16_t u16Len;
+	uint8_t *pu8Buf;                /*<must stay valid until the callback*/
+	uint8_t u8Prio;                 /*<I2C_SCHED_EN_PRIO*/
+	I2C_SCHED_CALLBACK pfnCallback; /*<optional*/
+	void *pvArg;
+	uint32_t u32Queued;             /*<Timestamp_Get() at submit, set by the scheduler*/
+};
+
+typedef struct
+{
+	uint16_t u16DevAddr;            /*<0: unused slot*/
+	uint32_t u32Xfers;              /*<completed transfers*/
+	uint32_t u32Errors;
+	uint32_t u32Bytes;              /*<payload bytes moved*/
+	uint32_t u32BusUs;              /*<time the bus was busy with this device*/
+	uint32_t u32LatencyUs;          /*<submit to completion of the last transfer*/
+	uint32_t u32LatencyMaxUs;
+	uint64_t u64LatencySumUs;
+} I2C_SCHED_ST_DEV_STATS;
+
+typedef struct
+{
+	I2C_HandleTypeDef *phi2c;
+	I2C_SCHED_ST_XFER astQueue[I2C_SCHED_PRIO_NUM][I2C_SCHED_QUEUE_LEN];
+	volatile uint8_t au8Head[I2C_SCHED_PRIO_NUM];
+	volatile uint8_t au8Tail[I2C_SCHED_PRIO_NUM];
+	I2C_SCHED_ST_XFER stActive;
+	volatile uint8_t u8Busy;
+	uint32_t u32Started;            /*<Timestamp_Get() when stActive went on the bus*/
+	uint32_t u32Rejected;           /*<submits refused because the queue was full*/
+	I2C_SCHED_ST_DEV_STATS astDev[I2C_SCHED_MAX_DEVS];
+} I2C_SCHED_ST_BUS;
+
+extern I2C_SCHED_ST_BUS i2c3Sched;
+
+void I2CSched_Init(I2C_SCHED_ST_BUS *pstBus, I2C_HandleTypeDef *phi2c);
+HAL_StatusTypeDef I2CSched_Submit(I2C_SCHED_ST_BUS *pstBus, const I2C_SCHED_ST_XFER *pstXfer);
+uint8_t I2CSched_Pending(const I2C_SCHED_ST_BUS *pstBus);
+const I2C_SCHED_ST_DEV_STATS *I2CSched_DevStatsGet(const I2C_SCHED_ST_BUS *pstBus, uint16_t u16DevAddr);
+uint32_t I2CSched_LatencyAvgUs(const I2C_SCHED_ST_DEV_STATS *pstStats);
+
+// HAL completion hooks; return 1 when the transfer belonged to a scheduler
+uint8_t I2CSched_RxCpltCallback(I2C_HandleTypeDef *phi2c);
+uint8_t I2CSched_TxCpltCallback(I2C_HandleTypeDef *phi2c);
+uint8_t I2CSched_ErrorCallback(I2C_HandleTypeDef *phi2c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __I2C_TIMING_H__
+#define __I2C_TIMING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * TIMINGR of the STM32L4 I2C from the kernel clock, the mode and the rise and fall times
+ * of the lines, after the timing model of RM0394 (I2C timings): analog filter on, digital
+ * filter off, the SCL edges detected 2 kernel clocks after the filter. Pure arithmetic, the
+ * register access is in i2c_bus.c.
+ */
+
+#define I2C_TIMING_PRESC_Pos        (28)
+#define I2C_TIMING_SCLDEL_Pos       (20)
+#define I2C_TIMING_SDADEL_Pos       (16)
+#define I2C_TIMING_SCLH_Pos         (8)
+#define I2C_TIMING_SCLL_Pos         (0)
+#define I2C_TIMING(presc, scldel, sdadel, sclh, scll) \
+	(((uint32_t)(presc) << I2C_TIMING_PRESC_Pos) | ((uint32_t)(scldel) << I2C_TIMING_SCLDEL_Pos) | \
+	 ((uint32_t)(sdadel) << I2C_TIMING_SDADEL_Pos) | ((uint32_t)(sclh) << I2C_TIMING_SCLH_Pos) | \
+	 ((uint32_t)(scll) << I2C_TIMING_SCLL_Pos))
+
+// analog filter delay, datasheet tAF
+#define I2C_TIMING_AF_MIN_NS        (50)
+#define I2C_TIMING_AF_MAX_NS        (260)
+
+// interrupt entry and the slave holding SCL low, added to every transfer timeout
+#define I2C_TIMING_SLACK_US         (50)
+
+typedef enum
+{
+	I2C_TIMING_SPEED_100K = 0,      /*<standard mode*/
+	I2C_TIMING_SPEED_400K,          /*<fast mode*/
+	I2C_TIMING_SPEED_1M,            /*<fast mode plus, needs the Fm+ drive on the pins*/
+	I2C_TIMING_SPEED_NUM
+} I2C_TIMING_EN_SPEED;
+
+// violated limits, I2cTiming_Check
+#define I2C_TIMING_ERR_LOW          (0x01)  /*<SCL low shorter than tLOW*/
+#define I2C_TIMING_ERR_HIGH         (0x02)  /*<SCL high shorter than tHIGH*/
+#define I2C_TIMING_ERR_SETUP        (0x04)  /*<SCLDEL below tr + tSU;DAT*/
+#define I2C_TIMING_ERR_HOLD         (0x08)  /*<SDADEL changes SDA before SCL has fallen*/
+#define I2C_TIMING_ERR_VALID        (0x10)  /*<SDADEL lets SDA settle after tVD;DAT*/
+#define I2C_TIMING_ERR_BUS          (0x20)  /*<the lines are slower than the mode allows*/
+
+typedef struct
+{
+	uint16_t u16RiseNs;             /*<SCL and SDA, 30 % to 70 %: about 0.85 R C*/
+	uint16_t u16FallNs;
+} I2C_TIMING_ST_BUS;
+
+uint8_t I2cTiming_Compute(uint32_t u32ClkHz, I2C_TIMING_EN_SPEED enSpeed, const I2C_TIMING_ST_BUS *pstBus, uint32_t *pu32Timingr);
+uint8_t I2cTiming_Check(uint32_t u32ClkHz, I2C_TIMING_EN_SPEED enSpeed, const I2C_TIMING_ST_BUS *pstBus, uint32_t u32Timingr);
+uint32_t I2cTiming_SclHz(uint32_t u32ClkHz, const I2C_TIMING_ST_BUS *pstBus, uint32_t u32Timingr);
+uint32_t I2cTiming_SpeedHz(I2C_TIMING_EN_SPEED enSpeed);
+uint32_t I2cTiming_XferUs(uint32_t u32SclHz, uint16_t u16Len, uint8_t u8Read);
+uint32_t I2cTiming_TimeoutUs(uint32_t u32SclHz, uint16_t u16Len, uint8_t u8Read);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -5,9 +5,23 @@
 extern "C" {
 #endif
 
-// 0: Polling  1: Interrupt  2: DMA
+#include <stdint.h>
+
+// 0: Polling  1: Interrupt  2: DMA  3: DMA started by the data-ready interrupt (IMU_INT)
+// 4: as 3, queued on the hi2c3 transaction scheduler so other devices can share the bus
+// 5: low power, duty-cycled sensor batching into its FIFO, MCU in STOP2 between batches
 #define I2C_TRANSMIT_MODE           (2)
 
+// mode 5: output rate 1125/(1 + div) Hz, a batch is due every period or at the watermark
+#define ICM20948_LP_SMPLRT_DIV      (10)
+#define ICM20948_LP_PERIOD_MS       (250)
+#define ICM20948_LP_WATERMARK       (32)
+
+// GYRO_FS_SEL  0: 250 dps  1: 500 dps  2: 1000 dps  3: 2000 dps
+// ACCEL_FS_SEL 0: 2 g      1: 4 g      2: 8 g       3: 16 g
+#define ICM20948_GYRO_FS_SEL        (2)
+#define ICM20948_ACCEL_FS_SEL       (0)
+
 // ADD_XXX: address     CMD_XXX: command
 #define ADD_I2C_ICM20948            0xD0
 #define ADD_REG_BANK_SEL            0x7F
@@ -17,15 +31,36 @@ extern "C" {
 #define CMD_REG_BANK_3              0x30
 // Bank 0
 #define ADD_WHO_AM_I                0x00
+#define ADD_USER_CTRL               0x03
+#define ADD_LP_CONFIG               0x05
 #define ADD_PWR_MGMT_1              0x06
+#define ADD_INT_PIN_CFG             0x0F
+#define ADD_INT_ENABLE_1            0x11
+#define ADD_INT_ENABLE_2            0x12
 #define ADD_GYRO_SMPLRT_DIV         0x00
 #define ADD_GYRO_CONFIG_1           0x01
 #define ADD_ACCEL_SMPLRT_DIV_2      0x11
 #define ADD_ACCEL_CONFIG            0x14
 #define ADD_ACCEL_XOUT_H            0x2D
 #define ADD_GYRO_XOUT_H             0x33
+#define ADD_FIFO_EN_2               0x67
+#define ADD_FIFO_RST                0x68
+#define ADD_FIFO_MODE               0x69
+#define ADD_FIFO_COUNTH             0x70
+#define ADD_FIFO_R_W                0x72
 #define CMD_DEVICE_RESET            0x80
 #define CMD_CLKSEL                  0x01
+#define CMD_GYRO_DLPF_EN            0x01
+#define CMD_ACCEL_DLPF_EN           0x01
+#define CMD_INT_ACTIVE_HIGH_PULSE   0x00
+#define CMD_RAW_DATA_0_RDY_EN       0x01
+#define CMD_FIFO_EN                 0x40
+#define CMD_LP_EN                   0x20
+#define CMD_ACCEL_GYRO_CYCLE        0x30
+#define CMD_FIFO_ACCEL_GYRO         0x1E
+#define CMD_FIFO_RESET              0x1F
+#define CMD_FIFO_SNAPSHOT           0x1F
+#define CMD_FIFO_OVERFLOW_EN        0x01
 // Bank 1
 // Bank 2
 // Bank 3
@@ -42,6 +77,12 @@ void ICM20948_Read_Gyro(void);
 void ICM20948_Read_Accel_Polling(void);
 void ICM20948_Read_Gyro_Polling(void);
 void ICM20948_Read_Magn_Polling(void);
+uint32_t ICM20948_Sample_Get(uint32_t *pu32Stamp);
+uint16_t ICM20948_Fifo_Drain(uint8_t *pu8Buf, uint16_t u16Len);
+
+// one FIFO frame: accel then gyro, the layout of imuDataBuffer
+#define ICM20948_FIFO_FRAME_LEN     (12)
+#define ICM20948_FIFO_SIZE          (512)
 
 
 #ifdef __cplusplus
@@ -1,11 +1,22 @@
 #pragma once
 
+#include "coning_integrator.h"
+#include "gyro_temp.h"
+#include "imu_transport.h"
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
 #include <cstdint>
+#include "acq_sched.h"
+#include "ahrs_fixed.h"
+#include "bmp280_comp.h"
+#include "dmp.h"
+#include "gyro_cal.h"
+#include "i2c.h"
+#include "sample_stats.h"
 
     typedef enum
     {
@@ -29,35 +40,136 @@ extern "C"
         int16_t s16Z;
     } IMU_ST_SENSOR_DATA;
 
+    typedef enum
+    {
+        IMU_EN_ACQ_MODE_SINGLE_BYTE = 0, /*<one register per I2C transaction*/
+        IMU_EN_ACQ_MODE_BURST,           /*<ACCEL_XOUT_H..GYRO_ZOUT_L in one transaction*/
+        IMU_EN_ACQ_MODE_BURST_MAGN,      /*<as BURST, plus the SLV0 magnetometer auto-read*/
+        IMU_EN_ACQ_MODE_MAX
+    } IMU_EN_ACQ_MODE;
+
+    typedef enum
+    {
+        IMU_EN_BIAS_MODE_SOFTWARE = 0, /*<subtracted from every sample by the driver*/
+        IMU_EN_BIAS_MODE_REGISTER,     /*<XG_OFFS_USR / XA_OFFS, applied by the sensor before the DLPF*/
+        IMU_EN_BIAS_MODE_MAX
+    } IMU_EN_BIAS_MODE;
+
+    typedef enum
+    {
+        IMU_EN_GYRO_FS_250DPS = 0, /*<GYRO_FS_SEL, GYRO_CONFIG_1[2:1]*/
+        IMU_EN_GYRO_FS_500DPS,
+        IMU_EN_GYRO_FS_1000DPS,
+        IMU_EN_GYRO_FS_2000DPS,
+        IMU_EN_GYRO_FS_MAX
+    } IMU_EN_GYRO_FS;
+
+    typedef enum
+    {
+        IMU_EN_ACCEL_FS_2G = 0, /*<ACCEL_FS_SEL, ACCEL_CONFIG[2:1]*/
+        IMU_EN_ACCEL_FS_4G,
+        IMU_EN_ACCEL_FS_8G,
+        IMU_EN_ACCEL_FS_16G,
+        IMU_EN_ACCEL_FS_MAX
+    } IMU_EN_ACCEL_FS;
+
+    /* register image of ACCEL_XOUT_H..GYRO_ZOUT_L, decoded to host order */
+    typedef struct icm20948_st_raw_sample_tag
+    {
+        IMU_ST_SENSOR_DATA stAccel;
+        IMU_ST_SENSOR_DATA stGyro;
+    } ICM20948_ST_RAW_SAMPLE;
+
+    /* one FIFO frame, sensor axes, before offset removal and averaging */
+    typedef struct icm20948_st_fifo_sample_tag
+    {
+        IMU_ST_SENSOR_DATA stAccel;
+        IMU_ST_SENSOR_DATA stGyro;
+        IMU_ST_SENSOR_DATA stMagn;
+        uint8_t u8MagnValid;
+        uint32_t u32Stamp; /*<Timestamp_Get() of the capture, back from the drain at the output rate*/
+    } ICM20948_ST_FIFO_SAMPLE;
+
+    typedef struct
+    {
+        uint32_t u32Drains;    /*<DMA drains started*/
+        uint32_t u32Frames;    /*<frames parsed*/
+        uint32_t u32Bytes;     /*<FIFO bytes moved over the bus*/
+        uint32_t u32Overflows; /*<FIFO resets after an overflow or a lost DMP packet boundary*/
+        uint32_t u32Dropped;   /*<frames lost to a full sample queue*/
+        uint32_t u32Errors;    /*<drains the bus failed*/
+    } ICM20948_ST_FIFO_STATS;
+
+    /* latest sample of one acquisition stream, valid until the next read of the stream */
+    typedef struct
+    {
+        int32_t as32Val[3]; /*<sensor axes in LSB; baro: pressure in Pa, temperature in 0.01 degC*/
+        uint32_t u32Stamp;  /*<Timestamp_Get() of the read*/
+        uint32_t u32Seq;    /*<new samples of the stream so far*/
+    } IMU_ST_STREAM_SAMPLE;
+
     typedef struct icm20948_st_avg_data_tag
     {
         uint8_t u8Index;
         int16_t s16AvgBuffer[8];
     } ICM20948_ST_AVG_DATA;
 
-    typedef struct
-    {
-        uint16_t T1;    /*<calibration T1 data*/
-        int16_t T2;     /*<calibration T2 data*/
-        int16_t T3;     /*<calibration T3 data*/
-        uint16_t P1;    /*<calibration P1 data*/
-        int16_t P2;     /*<calibration P2 data*/
-        int16_t P3;     /*<calibration P3 data*/
-        int16_t P4;     /*<calibration P4 data*/
-        int16_t P5;     /*<calibration P5 data*/
-        int16_t P6;     /*<calibration P6 data*/
-        int16_t P7;     /*<calibration P7 data*/
-        int16_t P8;     /*<calibration P8 data*/
-        int16_t P9;     /*<calibration P9 data*/
-        int32_t T_fine; /*<calibration t_fine data*/
-    } BMP280_HandleTypeDef;
-
     typedef struct
     {
         uint8_t Index;
         int32_t AvgBuffer[8];
     } BMP280_AvgTypeDef;
 
+    typedef enum
+    {
+        IMU_EN_BARO_OSRS_SKIP = 0, /*<measurement skipped, output 0x80000*/
+        IMU_EN_BARO_OSRS_X1,
+        IMU_EN_BARO_OSRS_X2,
+        IMU_EN_BARO_OSRS_X4,
+        IMU_EN_BARO_OSRS_X8,
+        IMU_EN_BARO_OSRS_X16,
+        IMU_EN_BARO_OSRS_MAX
+    } IMU_EN_BARO_OSRS;
+
+    typedef enum
+    {
+        IMU_EN_BARO_MODE_SLEEP = 0,
+        IMU_EN_BARO_MODE_FORCED = 1, /*<one conversion per pressSensorPoll() result*/
+        IMU_EN_BARO_MODE_NORMAL = 3  /*<free running, period is t_meas + standby*/
+    } IMU_EN_BARO_MODE;
+
+    typedef enum
+    {
+        IMU_EN_BARO_STANDBY_0_5MS = 0,
+        IMU_EN_BARO_STANDBY_62_5MS,
+        IMU_EN_BARO_STANDBY_125MS,
+        IMU_EN_BARO_STANDBY_250MS,
+        IMU_EN_BARO_STANDBY_500MS,
+        IMU_EN_BARO_STANDBY_1000MS,
+        IMU_EN_BARO_STANDBY_2000MS,
+        IMU_EN_BARO_STANDBY_4000MS,
+        IMU_EN_BARO_STANDBY_MAX
+    } IMU_EN_BARO_STANDBY;
+
+    typedef enum
+    {
+        IMU_EN_BARO_FILTER_OFF = 0,
+        IMU_EN_BARO_FILTER_2,
+        IMU_EN_BARO_FILTER_4,
+        IMU_EN_BARO_FILTER_8,
+        IMU_EN_BARO_FILTER_16,
+        IMU_EN_BARO_FILTER_MAX
+    } IMU_EN_BARO_FILTER;
+
+    typedef struct
+    {
+        IMU_EN_BARO_OSRS enTempOsrs;
+        IMU_EN_BARO_OSRS enPressOsrs;
+        IMU_EN_BARO_MODE enMode;
+        IMU_EN_BARO_STANDBY enStandby;
+        IMU_EN_BARO_FILTER enFilter;
+    } IMU_ST_BARO_CONFIG;
+
     typedef struct
     {
         float gyro[3];
@@ -65,189 +177,508 @@ extern "C"
         float magn[3];
     } IMU_DATA;
 
-    class ICM20948
-    {
-    public:
-        // icm-20948
-        constexpr static uint8_t I2C_ADD_ICM20948 = 0xD0;
-        constexpr static uint8_t I2C_ADD_ICM20948_AK09916 = 0x0C;
-        constexpr static uint8_t I2C_ADD_ICM20948_AK09916_READ = 0x80;
-        constexpr static uint8_t I2C_ADD_ICM20948_AK09916_WRITE = 0x00;
-        constexpr static uint8_t REG_ADD_WIA = 0x00;
-        constexpr static uint8_t REG_VAL_WIA = 0xEA;
-        constexpr static uint8_t REG_ADD_USER_CTRL = 0x03;
-        constexpr static uint8_t REG_VAL_BIT_DMP_EN = 0x80;
-        constexpr static uint8_t REG_VAL_BIT_FIFO_EN = 0x40;
-        constexpr static uint8_t REG_VAL_BIT_I2C_MST_EN = 0x20;
-        constexpr static uint8_t REG_VAL_BIT_I2C_IF_DIS = 0x10;
-        constexpr static uint8_t REG_VAL_BIT_DMP_RST = 0x08;
-        constexpr static uint8_t REG_VAL_BIT_DIAMOND_DMP_RST = 0x04;
-        constexpr static uint8_t REG_ADD_PWR_MIGMT_1 = 0x06;
-        constexpr static uint8_t REG_VAL_ALL_RGE_RESET = 0x80;
-        constexpr static uint8_t REG_VAL_RUN_MODE = 0x01;
-        constexpr static uint8_t REG_ADD_LP_CONFIG = 0x05;
-        constexpr static uint8_t REG_ADD_PWR_MGMT_1 = 0x06;
-        constexpr static uint8_t REG_ADD_PWR_MGMT_2 = 0x07;
-        constexpr static uint8_t REG_ADD_ACCEL_XOUT_H = 0x2D;
-        constexpr static uint8_t REG_ADD_ACCEL_XOUT_L = 0x2E;
-        constexpr static uint8_t REG_ADD_ACCEL_YOUT_H = 0x2F;
-        constexpr static uint8_t REG_ADD_ACCEL_YOUT_L = 0x30;
-        constexpr static uint8_t REG_ADD_ACCEL_ZOUT_H = 0x31;
-        constexpr static uint8_t REG_ADD_ACCEL_ZOUT_L = 0x32;
-        constexpr static uint8_t REG_ADD_GYRO_XOUT_H = 0x33;
-        constexpr static uint8_t REG_ADD_GYRO_XOUT_L = 0x34;
-        constexpr static uint8_t REG_ADD_GYRO_YOUT_H = 0x35;
-        constexpr static uint8_t REG_ADD_GYRO_YOUT_L = 0x36;
-        constexpr static uint8_t REG_ADD_GYRO_ZOUT_H = 0x37;
-        constexpr static uint8_t REG_ADD_GYRO_ZOUT_L = 0x38;
-        constexpr static uint8_t REG_ADD_EXT_SENS_DATA_00 = 0x3B;
-        constexpr static uint8_t REG_ADD_REG_BANK_SEL = 0x7F;
-        constexpr static uint8_t REG_VAL_REG_BANK_0 = 0x00;
-        constexpr static uint8_t REG_VAL_REG_BANK_1 = 0x10;
-        constexpr static uint8_t REG_VAL_REG_BANK_2 = 0x20;
-        constexpr static uint8_t REG_VAL_REG_BANK_3 = 0x30;
-        constexpr static uint8_t REG_ADD_GYRO_SMPLRT_DIV = 0x00;
-        constexpr static uint8_t REG_ADD_GYRO_CONFIG_1 = 0x01;
-        constexpr static uint8_t REG_VAL_BIT_GYRO_DLPCFG_2 = 0x10;
-        constexpr static uint8_t REG_VAL_BIT_GYRO_DLPCFG_4 = 0x20;
-        constexpr static uint8_t REG_VAL_BIT_GYRO_DLPCFG_6 = 0x30;
-        constexpr static uint8_t REG_VAL_BIT_GYRO_FS_250DPS = 0x00;
-        constexpr static uint8_t REG_VAL_BIT_GYRO_FS_500DPS = 0x02;
-        constexpr static uint8_t REG_VAL_BIT_GYRO_FS_1000DPS = 0x04;
-        constexpr static uint8_t REG_VAL_BIT_GYRO_FS_2000DPS = 0x06;
-        constexpr static uint8_t REG_VAL_BIT_GYRO_DLPF = 0x01;
-        constexpr static uint8_t REG_ADD_ACCEL_SMPLRT_DIV_2 = 0x11;
-        constexpr static uint8_t REG_ADD_ACCEL_CONFIG = 0x14;
-        constexpr static uint8_t REG_VAL_BIT_ACCEL_DLPCFG_2 = 0x10;
-        constexpr static uint8_t REG_VAL_BIT_ACCEL_DLPCFG_4 = 0x20;
-        constexpr static uint8_t REG_VAL_BIT_ACCEL_DLPCFG_6 = 0x30;
-        constexpr static uint8_t REG_VAL_BIT_ACCEL_FS_2g = 0x00;
-        constexpr static uint8_t REG_VAL_BIT_ACCEL_FS_4g = 0x02;
-        constexpr static uint8_t REG_VAL_BIT_ACCEL_FS_8g = 0x04;
-        constexpr static uint8_t REG_VAL_BIT_ACCEL_FS_16g = 0x06;
-        constexpr static uint8_t REG_VAL_BIT_ACCEL_DLPF = 0x01;
-        constexpr static uint8_t REG_ADD_I2C_SLV0_ADDR = 0x03;
-        constexpr static uint8_t REG_ADD_I2C_SLV0_REG = 0x04;
-        constexpr static uint8_t REG_ADD_I2C_SLV0_CTRL = 0x05;
-        constexpr static uint8_t REG_VAL_BIT_SLV0_EN = 0x80;
-        constexpr static uint8_t REG_VAL_BIT_MASK_LEN = 0x07;
-        constexpr static uint8_t REG_ADD_I2C_SLV0_DO = 0x06;
-        constexpr static uint8_t REG_ADD_I2C_SLV1_ADDR = 0x07;
-        constexpr static uint8_t REG_ADD_I2C_SLV1_REG = 0x08;
-        constexpr static uint8_t REG_ADD_I2C_SLV1_CTRL = 0x09;
-        constexpr static uint8_t REG_ADD_I2C_SLV1_DO = 0x0A;
-        constexpr static uint8_t REG_ADD_MAG_WIA1 = 0x00;
-        constexpr static uint8_t REG_VAL_MAG_WIA1 = 0x48;
-        constexpr static uint8_t REG_ADD_MAG_WIA2 = 0x01;
-        constexpr static uint8_t REG_VAL_MAG_WIA2 = 0x09;
-        constexpr static uint8_t REG_ADD_MAG_ST2 = 0x10;
-        constexpr static uint8_t REG_ADD_MAG_DATA = 0x11;
-        constexpr static uint8_t REG_ADD_MAG_CNTL2 = 0x31;
-        constexpr static uint8_t REG_VAL_MAG_MODE_PD = 0x00;
-        constexpr static uint8_t REG_VAL_MAG_MODE_SM = 0x01;
-        constexpr static uint8_t REG_VAL_MAG_MODE_10HZ = 0x02;
-        constexpr static uint8_t REG_VAL_MAG_MODE_20HZ = 0x04;
-        constexpr static uint8_t REG_VAL_MAG_MODE_50HZ = 0x05;
-        constexpr static uint8_t REG_VAL_MAG_MODE_100HZ = 0x08;
-        constexpr static uint8_t REG_VAL_MAG_MODE_ST = 0x10;
-        // bmp280
-        constexpr static uint8_t BMP280_AD0_LOW = 0xEC;
-        constexpr static uint8_t BMP280_AD0_HIGH = 0xEE;
-        constexpr static uint8_t BMP280_ADDR = 0xEE;
-        constexpr static uint8_t BMP280_REGISTER_DIG_T1 = 0x88;
-        constexpr static uint8_t BMP280_REGISTER_DIG_T2 = 0x8A;
-        constexpr static uint8_t BMP280_REGISTER_DIG_T3 = 0x8C;
-        constexpr static uint8_t BMP280_REGISTER_DIG_P1 = 0x8E;
-        constexpr static uint8_t BMP280_REGISTER_DIG_P2 = 0x90;
-        constexpr static uint8_t BMP280_REGISTER_DIG_P3 = 0x92;
-        constexpr static uint8_t BMP280_REGISTER_DIG_P4 = 0x94;
-        constexpr static uint8_t BMP280_REGISTER_DIG_P5 = 0x96;
-        constexpr static uint8_t BMP280_REGISTER_DIG_P6 = 0x98;
-        constexpr static uint8_t BMP280_REGISTER_DIG_P7 = 0x9A;
-        constexpr static uint8_t BMP280_REGISTER_DIG_P8 = 0x9C;
-        constexpr static uint8_t BMP280_REGISTER_DIG_P9 = 0x9E;
-        constexpr static uint8_t BMP280_REGISTER_CHIPID = 0xD0;
-        constexpr static uint8_t BMP280_REGISTER_VERSION = 0xD1;
-        constexpr static uint8_t BMP280_REGISTER_SOFTRESET = 0xE0;
-        constexpr static uint8_t BMP280_REGISTER_STATUS = 0xF3;
-        constexpr static uint8_t BMP280_REGISTER_CONTROL = 0xF4;
-        constexpr static uint8_t BMP280_REGISTER_CONFIG = 0xF5;
-        constexpr static uint8_t BMP280_TEMP_XLSB_REG = 0xFC;
-        constexpr static uint8_t BMP280_TEMP_LSB_REG = 0xFB;
-        constexpr static uint8_t BMP280_TEMP_MSB_REG = 0xFA;
-        constexpr static uint8_t BMP280_PRESS_XLSB_REG = 0xF9;
-        constexpr static uint8_t BMP280_PRESS_LSB_REG = 0xF8;
-        constexpr static uint8_t BMP280_PRESS_MSB_REG = 0xF7;
-        constexpr static uint8_t BMP280_DIG_T1_LSB_REG = 0x88;
-        constexpr static uint8_t BMP280_DIG_T1_MSB_REG = 0x89;
-        constexpr static uint8_t BMP280_DIG_T2_LSB_REG = 0x8A;
-        constexpr static uint8_t BMP280_DIG_T2_MSB_REG = 0x8B;
-        constexpr static uint8_t BMP280_DIG_T3_LSB_REG = 0x8C;
-        constexpr static uint8_t BMP280_DIG_T3_MSB_REG = 0x8D;
-        constexpr static uint8_t BMP280_DIG_P1_LSB_REG = 0x8E;
-        constexpr static uint8_t BMP280_DIG_P1_MSB_REG = 0x8F;
-        constexpr static uint8_t BMP280_DIG_P2_LSB_REG = 0x90;
-        constexpr static uint8_t BMP280_DIG_P2_MSB_REG = 0x91;
-        constexpr static uint8_t BMP280_DIG_P3_LSB_REG = 0x92;
-        constexpr static uint8_t BMP280_DIG_P3_MSB_REG = 0x93;
-        constexpr static uint8_t BMP280_DIG_P4_LSB_REG = 0x94;
-        constexpr static uint8_t BMP280_DIG_P4_MSB_REG = 0x95;
-        constexpr static uint8_t BMP280_DIG_P5_LSB_REG = 0x96;
-        constexpr static uint8_t BMP280_DIG_P5_MSB_REG = 0x97;
-        constexpr static uint8_t BMP280_DIG_P6_LSB_REG = 0x98;
-        constexpr static uint8_t BMP280_DIG_P6_MSB_REG = 0x99;
-        constexpr static uint8_t BMP280_DIG_P7_LSB_REG = 0x9A;
-        constexpr static uint8_t BMP280_DIG_P7_MSB_REG = 0x9B;
-        constexpr static uint8_t BMP280_DIG_P8_LSB_REG = 0x9C;
-        constexpr static uint8_t BMP280_DIG_P8_MSB_REG = 0x9D;
-        constexpr static uint8_t BMP280_DIG_P9_LSB_REG = 0x9E;
-        constexpr static uint8_t BMP280_DIG_P9_MSB_REG = 0x9F;
-
-        ICM20948();
-        ~ICM20948() = default;
-
-        // icm20948
-        void imuInit(IMU_EN_SENSOR_TYPE *penMotionSensorType, IMU_EN_SENSOR_TYPE *penPressureType);
-        void imuDataGet(IMU_ST_ANGLES_DATA *pstAngles,
-                        IMU_ST_SENSOR_DATA *pstGyroRawData,
-                        IMU_ST_SENSOR_DATA *pstAcceRawData,
-                        IMU_ST_SENSOR_DATA *pstMagnRawData);
-        // bmp280
-        void pressSensorDataGet(int32_t *ps32Temperature, int32_t *ps32Pressure, int32_t *ps32Altitude);
-
-    private:
-        // ahrs
-        uint8_t _attInitialized;
-
-        // i2c
-        uint8_t I2C_ReadOneByte(uint8_t DevAddr, uint8_t RegAddr);
-        void I2C_WriteOneByte(uint8_t DevAddr, uint8_t RegAddr, uint8_t value);
-
-        // icm20948
-        void icm20948init(void);
-        bool icm20948Check(void);
-        bool icm20948MagCheck(void);
-        void icm20948GyroRead(int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z);
-        void icm20948AccelRead(int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z);
-        void icm20948MagRead(int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z);
-        void icm20948ReadSecondary(uint8_t u8I2CAddr, uint8_t u8RegAddr, uint8_t u8Len, uint8_t *pu8data);
-        void icm20948WriteSecondary(uint8_t u8I2CAddr, uint8_t u8RegAddr, uint8_t u8data);
-        void icm20948GyroOffset(void);
-        void icm20948CalAvgValue(uint8_t *pIndex, int16_t *pAvgBuffer, int16_t InVal, int32_t *pOutVal);
-        void imuAHRSupdate(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz);
-        float invSqrt(float x);
-
-        // bmp280
-        void bmp280Init(void);
-        bool bmp280Check(void);
-        void bmp280ReadCalibration(void);
-        void bmp280TandPGet(float *temperature, float *pressure);
-        void bmp280CalAvgValue(uint8_t *pIndex, int32_t *pAvgBuffer, int32_t InVal, int32_t *pOutVal);
-        void bmp280CalculateAbsoluteAltitude(int32_t *pAltitude, int32_t PressureVal);
-        float bmp280CompensateTemperature(int32_t adc_T);
-        float bmp280CompensatePressure(int32_t adc_P);
-    };
-
 #ifdef __cplusplus
 }
 #endif
+
+/*
+ * Transport is one of the policies in imu_transport.h, ICM20948 below is the driver on
+ * I2C with the FIFO drained by DMA
+ */
+template <class Transport>
+class Icm20948Driver
+{
+public:
+    // icm-20948
+    constexpr static uint8_t I2C_ADD_ICM20948 = 0xD0;
+    constexpr static uint8_t I2C_ADD_ICM20948_AD0 = 0xD2; // AD0 pulled high
+    constexpr static uint8_t I2C_ADD_ICM20948_AK09916 = 0x0C;
+    constexpr static uint8_t I2C_ADD_ICM20948_AK09916_READ = 0x80;
+    constexpr static uint8_t I2C_ADD_ICM20948_AK09916_WRITE = 0x00;
+    constexpr static uint8_t REG_ADD_WIA = 0x00;
+    constexpr static uint8_t REG_VAL_WIA = 0xEA;
+    constexpr static uint8_t REG_ADD_USER_CTRL = 0x03;
+    constexpr static uint8_t REG_VAL_BIT_DMP_EN = 0x80;
+    constexpr static uint8_t REG_VAL_BIT_FIFO_EN = 0x40;
+    constexpr static uint8_t REG_VAL_BIT_I2C_MST_EN = 0x20;
+    constexpr static uint8_t REG_VAL_BIT_I2C_IF_DIS = 0x10;
+    constexpr static uint8_t REG_VAL_BIT_DMP_RST = 0x08;
+    constexpr static uint8_t REG_VAL_BIT_DIAMOND_DMP_RST = 0x04;
+    constexpr static uint8_t REG_ADD_PWR_MIGMT_1 = 0x06;
+    constexpr static uint8_t REG_VAL_ALL_RGE_RESET = 0x80;
+    constexpr static uint8_t REG_VAL_RUN_MODE = 0x01;
+    constexpr static uint8_t REG_ADD_LP_CONFIG = 0x05;
+    constexpr static uint8_t REG_VAL_BIT_I2C_MST_CYCLE = 0x40;
+    constexpr static uint8_t REG_VAL_BIT_ACCEL_CYCLE = 0x20;
+    constexpr static uint8_t REG_VAL_BIT_GYRO_CYCLE = 0x10;
+    constexpr static uint8_t REG_ADD_PWR_MGMT_1 = 0x06;
+    constexpr static uint8_t REG_VAL_BIT_LP_EN = 0x20;
+    constexpr static uint8_t REG_ADD_PWR_MGMT_2 = 0x07;
+    constexpr static uint8_t REG_ADD_I2C_MST_STATUS = 0x17;
+    constexpr static uint8_t REG_ADD_ACCEL_XOUT_H = 0x2D;
+    constexpr static uint8_t REG_ADD_ACCEL_XOUT_L = 0x2E;
+    constexpr static uint8_t REG_ADD_ACCEL_YOUT_H = 0x2F;
+    constexpr static uint8_t REG_ADD_ACCEL_YOUT_L = 0x30;
+    constexpr static uint8_t REG_ADD_ACCEL_ZOUT_H = 0x31;
+    constexpr static uint8_t REG_ADD_ACCEL_ZOUT_L = 0x32;
+    constexpr static uint8_t REG_ADD_GYRO_XOUT_H = 0x33;
+    constexpr static uint8_t REG_ADD_GYRO_XOUT_L = 0x34;
+    constexpr static uint8_t REG_ADD_GYRO_YOUT_H = 0x35;
+    constexpr static uint8_t REG_ADD_GYRO_YOUT_L = 0x36;
+    constexpr static uint8_t REG_ADD_GYRO_ZOUT_H = 0x37;
+    constexpr static uint8_t REG_ADD_GYRO_ZOUT_L = 0x38;
+    constexpr static uint8_t REG_LEN_ACCEL_GYRO = 12;
+    constexpr static uint8_t REG_ADD_TEMP_OUT_H = 0x39;
+    constexpr static uint8_t REG_LEN_ACCEL_GYRO_TEMP = REG_LEN_ACCEL_GYRO + 2;
+    // die temperature: TEMP_OUT / 333.87 + 21 degC; it moves slowly, the filter keeps the
+    // bias model from dithering on sensor noise
+    constexpr static float TEMP_LSB_PER_DEGC = 333.87f;
+    constexpr static float TEMP_OFFSET_DEGC = 21.0f;
+    constexpr static float TEMP_FILTER_ALPHA = 0.01f;
+    constexpr static uint8_t REG_ADD_EXT_SENS_DATA_00 = 0x3B;
+    constexpr static uint8_t REG_LEN_MAG_AUTO = 9; // ST1..ST2
+    constexpr static uint8_t REG_LEN_ACCEL_GYRO_MAG = REG_ADD_EXT_SENS_DATA_00 - REG_ADD_ACCEL_XOUT_H + REG_LEN_MAG_AUTO;
+    constexpr static uint8_t REG_ADD_FIFO_EN_1 = 0x66;
+    constexpr static uint8_t REG_VAL_BIT_SLV_0_FIFO_EN = 0x01;
+    constexpr static uint8_t REG_ADD_FIFO_EN_2 = 0x67;
+    constexpr static uint8_t REG_VAL_BIT_ACCEL_FIFO_EN = 0x10;
+    constexpr static uint8_t REG_VAL_BIT_GYRO_Z_FIFO_EN = 0x08;
+    constexpr static uint8_t REG_VAL_BIT_GYRO_Y_FIFO_EN = 0x04;
+    constexpr static uint8_t REG_VAL_BIT_GYRO_X_FIFO_EN = 0x02;
+    constexpr static uint8_t REG_ADD_FIFO_RST = 0x68;
+    constexpr static uint8_t REG_VAL_FIFO_RESET = 0x1F;
+    constexpr static uint8_t REG_ADD_FIFO_MODE = 0x69;
+    constexpr static uint8_t REG_VAL_FIFO_MODE_SNAPSHOT = 0x1F;
+    constexpr static uint8_t REG_ADD_FIFO_COUNTH = 0x70;
+    constexpr static uint8_t REG_ADD_FIFO_COUNTL = 0x71;
+    constexpr static uint8_t REG_ADD_FIFO_R_W = 0x72;
+    constexpr static uint16_t FIFO_SIZE = 512;
+    constexpr static uint8_t FIFO_MAGN_LEN = 9; // ST1..ST2 through SLV0
+    constexpr static uint8_t FIFO_FRAME_LEN_MAX = REG_LEN_ACCEL_GYRO + FIFO_MAGN_LEN;
+    constexpr static uint8_t FIFO_QUEUE_LEN = 64; // power of two
+    // dmp: its memory is reached through bank 0, the program counter is in bank 2
+    constexpr static uint8_t REG_ADD_SINGLE_FIFO_PRIORITY_SEL = 0x26;
+    constexpr static uint8_t REG_VAL_SINGLE_FIFO_PRIORITY = 0xE4;
+    constexpr static uint8_t REG_ADD_HW_FIX_DISABLE = 0x75;
+    constexpr static uint8_t REG_VAL_HW_FIX_DISABLE = 0x48;
+    constexpr static uint8_t REG_ADD_MEM_START_ADDR = 0x7C;
+    constexpr static uint8_t REG_ADD_MEM_R_W = 0x7D;
+    constexpr static uint8_t REG_ADD_MEM_BANK_SEL = 0x7E;
+    constexpr static uint8_t REG_ADD_TIMEBASE_CORRECTION_PLL = 0x28;
+    constexpr static uint8_t REG_ADD_PRGM_START_ADDRH = 0x50;
+    constexpr static uint8_t DMP_PACKET_LEN_QUAT6 = DMP_HDR_LEN + 12 + DMP_FOOTER_LEN;
+    constexpr static uint8_t DMP_PACKET_LEN_QUAT9 = DMP_HDR_LEN + 14 + DMP_FOOTER_LEN;
+    constexpr static uint8_t REG_ADD_REG_BANK_SEL = 0x7F;
+    constexpr static uint8_t REG_VAL_REG_BANK_0 = 0x00;
+    constexpr static uint8_t REG_VAL_REG_BANK_1 = 0x10;
+    constexpr static uint8_t REG_VAL_REG_BANK_2 = 0x20;
+    constexpr static uint8_t REG_VAL_REG_BANK_3 = 0x30;
+    constexpr static uint8_t REG_VAL_REG_BANK_UNKNOWN = 0xFF;
+    constexpr static uint8_t REG_CACHE_BANKS = 4;
+    constexpr static uint8_t REG_CACHE_LEN = 0x80;
+    constexpr static uint8_t REG_ADD_XA_OFFS_H = 0x14;
+    constexpr static uint8_t REG_ADD_YA_OFFS_H = 0x17;
+    constexpr static uint8_t REG_ADD_ZA_OFFS_H = 0x1A;
+    constexpr static uint8_t REG_VAL_BIT_ACCEL_OFFS_RSVD = 0x01; // XA_OFFS_L[0], must be preserved
+    constexpr static uint8_t REG_ADD_GYRO_SMPLRT_DIV = 0x00;
+    constexpr static uint8_t REG_ADD_XG_OFFS_USRH = 0x03;
+    constexpr static uint8_t REG_ADD_YG_OFFS_USRH = 0x05;
+    constexpr static uint8_t REG_ADD_ZG_OFFS_USRH = 0x07;
+    constexpr static uint8_t REG_ADD_GYRO_CONFIG_1 = 0x01;
+    constexpr static uint8_t REG_VAL_BIT_GYRO_DLPCFG_2 = 0x10;
+    constexpr static uint8_t REG_VAL_BIT_GYRO_DLPCFG_4 = 0x20;
+    constexpr static uint8_t REG_VAL_BIT_GYRO_DLPCFG_6 = 0x30;
+    constexpr static uint8_t REG_VAL_BIT_GYRO_FS_250DPS = 0x00;
+    constexpr static uint8_t REG_VAL_BIT_GYRO_FS_500DPS = 0x02;
+    constexpr static uint8_t REG_VAL_BIT_GYRO_FS_1000DPS = 0x04;
+    constexpr static uint8_t REG_VAL_BIT_GYRO_FS_2000DPS = 0x06;
+    constexpr static uint8_t REG_VAL_BIT_GYRO_DLPF = 0x01;
+    constexpr static uint8_t REG_VAL_BIT_GYRO_FS_MASK = 0x06;
+    constexpr static uint8_t REG_ADD_ACCEL_SMPLRT_DIV_2 = 0x11;
+    constexpr static uint8_t REG_ADD_ACCEL_CONFIG = 0x14;
+    constexpr static uint8_t REG_VAL_BIT_ACCEL_DLPCFG_2 = 0x10;
+    constexpr static uint8_t REG_VAL_BIT_ACCEL_DLPCFG_4 = 0x20;
+    constexpr static uint8_t REG_VAL_BIT_ACCEL_DLPCFG_6 = 0x30;
+    constexpr static uint8_t REG_VAL_BIT_ACCEL_FS_2g = 0x00;
+    constexpr static uint8_t REG_VAL_BIT_ACCEL_FS_4g = 0x02;
+    constexpr static uint8_t REG_VAL_BIT_ACCEL_FS_8g = 0x04;
+    constexpr static uint8_t REG_VAL_BIT_ACCEL_FS_16g = 0x06;
+    constexpr static uint8_t REG_VAL_BIT_ACCEL_DLPF = 0x01;
+    constexpr static uint8_t REG_VAL_BIT_ACCEL_FS_MASK = 0x06;
+    // sensitivity per GYRO_FS_SEL / ACCEL_FS_SEL, datasheet table 1 and 2
+    constexpr static float GYRO_LSB_PER_DPS[IMU_EN_GYRO_FS_MAX] = {131.0f, 65.5f, 32.8f, 16.4f};
+    constexpr static float ACCEL_LSB_PER_G[IMU_EN_ACCEL_FS_MAX] = {16384.0f, 8192.0f, 4096.0f, 2048.0f};
+    // the gyro ranges for the fixed-point fusion, rad/s per LSB in Q36
+    constexpr static int32_t GYRO_SCALE_Q36[IMU_EN_GYRO_FS_MAX] = {
+        AHRS_FIXED_GYRO_SCALE(131.0), AHRS_FIXED_GYRO_SCALE(65.5), AHRS_FIXED_GYRO_SCALE(32.8), AHRS_FIXED_GYRO_SCALE(16.4)};
+    // offset registers are independent of the range: gyro in 1000 dps LSB, accel in
+    // 16 g LSB with bit 0 reserved (0.98 mg steps)
+    constexpr static float GYRO_OFFS_LSB_PER_DPS = 32.8f;
+    constexpr static float ACCEL_OFFS_LSB_PER_G = 2048.0f;
+    // auto-ranging: one clipped sample widens the range, a quiet second narrows it
+    constexpr static int16_t AUTORANGE_SAT_LSB = 32000;
+    constexpr static int16_t AUTORANGE_QUIET_LSB = 12288; // 75% of the narrower range
+    constexpr static uint16_t AUTORANGE_QUIET_SAMPLES = 225;
+    // fusion step: a stall longer than this integrates only this much
+    constexpr static uint32_t FUSION_DT_MAX_US = 100000;
+    constexpr static uint8_t REG_ADD_I2C_MST_ODR_CONFIG = 0x00;
+    constexpr static uint8_t REG_VAL_I2C_MST_ODR_DMP = 0x04;
+    constexpr static uint8_t REG_ADD_I2C_MST_CTRL = 0x01;
+    constexpr static uint8_t REG_VAL_I2C_MST_CLK_345KHZ = 0x07;
+    constexpr static uint8_t REG_ADD_I2C_SLV0_ADDR = 0x03;
+    constexpr static uint8_t REG_ADD_I2C_SLV0_REG = 0x04;
+    constexpr static uint8_t REG_ADD_I2C_SLV0_CTRL = 0x05;
+    constexpr static uint8_t REG_VAL_BIT_SLV0_EN = 0x80;
+    constexpr static uint8_t REG_VAL_BIT_MASK_LEN = 0x07;
+    constexpr static uint8_t REG_VAL_BIT_SLV_BYTE_SW = 0x40;
+    constexpr static uint8_t REG_VAL_BIT_SLV_GRP = 0x10;
+    constexpr static uint8_t REG_ADD_I2C_SLV0_DO = 0x06;
+    constexpr static uint8_t REG_ADD_I2C_SLV1_ADDR = 0x07;
+    constexpr static uint8_t REG_ADD_I2C_SLV1_REG = 0x08;
+    constexpr static uint8_t REG_ADD_I2C_SLV1_CTRL = 0x09;
+    constexpr static uint8_t REG_ADD_I2C_SLV1_DO = 0x0A;
+    constexpr static uint8_t REG_ADD_I2C_SLV4_DI = 0x17;
+    constexpr static uint8_t REG_ADD_MAG_WIA1 = 0x00;
+    constexpr static uint8_t REG_VAL_MAG_WIA1 = 0x48;
+    constexpr static uint8_t REG_ADD_MAG_WIA2 = 0x01;
+    constexpr static uint8_t REG_VAL_MAG_WIA2 = 0x09;
+    constexpr static uint8_t REG_ADD_MAG_RSV2 = 0x03; // the read pointer continues at ST1
+    constexpr static uint8_t REG_LEN_MAG_DMP = 10;    // RSV2, ST1..ST2
+    constexpr static uint8_t REG_ADD_MAG_ST1 = 0x10;
+    constexpr static uint8_t REG_VAL_BIT_MAG_DRDY = 0x01;
+    constexpr static uint8_t REG_ADD_MAG_DATA = 0x11;
+    constexpr static uint8_t REG_ADD_MAG_ST2 = 0x18;
+    constexpr static uint8_t REG_VAL_BIT_MAG_HOFL = 0x08;
+    constexpr static uint8_t REG_ADD_MAG_CNTL2 = 0x31;
+    constexpr static uint8_t REG_VAL_MAG_MODE_PD = 0x00;
+    constexpr static uint8_t REG_VAL_MAG_MODE_SM = 0x01;
+    constexpr static uint8_t REG_VAL_MAG_MODE_10HZ = 0x02;
+    constexpr static uint8_t REG_VAL_MAG_MODE_20HZ = 0x04;
+    constexpr static uint8_t REG_VAL_MAG_MODE_50HZ = 0x05;
+    constexpr static uint8_t REG_VAL_MAG_MODE_100HZ = 0x08;
+    constexpr static uint8_t REG_VAL_MAG_MODE_ST = 0x10;
+    // bmp280
+    constexpr static uint8_t BMP280_AD0_LOW = 0xEC;
+    constexpr static uint8_t BMP280_AD0_HIGH = 0xEE;
+    constexpr static uint8_t BMP280_ADDR = 0xEE;
+    constexpr static uint8_t BMP280_REGISTER_DIG_T1 = 0x88;
+    constexpr static uint8_t BMP280_REGISTER_DIG_T2 = 0x8A;
+    constexpr static uint8_t BMP280_REGISTER_DIG_T3 = 0x8C;
+    constexpr static uint8_t BMP280_REGISTER_DIG_P1 = 0x8E;
+    constexpr static uint8_t BMP280_REGISTER_DIG_P2 = 0x90;
+    constexpr static uint8_t BMP280_REGISTER_DIG_P3 = 0x92;
+    constexpr static uint8_t BMP280_REGISTER_DIG_P4 = 0x94;
+    constexpr static uint8_t BMP280_REGISTER_DIG_P5 = 0x96;
+    constexpr static uint8_t BMP280_REGISTER_DIG_P6 = 0x98;
+    constexpr static uint8_t BMP280_REGISTER_DIG_P7 = 0x9A;
+    constexpr static uint8_t BMP280_REGISTER_DIG_P8 = 0x9C;
+    constexpr static uint8_t BMP280_REGISTER_DIG_P9 = 0x9E;
+    constexpr static uint8_t BMP280_REGISTER_CHIPID = 0xD0;
+    constexpr static uint8_t BMP280_REGISTER_VERSION = 0xD1;
+    constexpr static uint8_t BMP280_REGISTER_SOFTRESET = 0xE0;
+    constexpr static uint8_t BMP280_REGISTER_STATUS = 0xF3;
+    constexpr static uint8_t BMP280_VAL_BIT_STATUS_MEASURING = 0x08;
+    constexpr static uint8_t BMP280_VAL_BIT_STATUS_IM_UPDATE = 0x01;
+    constexpr static uint8_t BMP280_REGISTER_CONTROL = 0xF4;
+    constexpr static uint8_t BMP280_REGISTER_CONFIG = 0xF5;
+    constexpr static uint8_t BMP280_TEMP_XLSB_REG = 0xFC;
+    constexpr static uint8_t BMP280_TEMP_LSB_REG = 0xFB;
+    constexpr static uint8_t BMP280_TEMP_MSB_REG = 0xFA;
+    constexpr static uint8_t BMP280_PRESS_XLSB_REG = 0xF9;
+    constexpr static uint8_t BMP280_PRESS_LSB_REG = 0xF8;
+    constexpr static uint8_t BMP280_PRESS_MSB_REG = 0xF7;
+    constexpr static uint8_t BMP280_DIG_T1_LSB_REG = 0x88;
+    constexpr static uint8_t BMP280_DIG_T1_MSB_REG = 0x89;
+    constexpr static uint8_t BMP280_DIG_T2_LSB_REG = 0x8A;
+    constexpr static uint8_t BMP280_DIG_T2_MSB_REG = 0x8B;
+    constexpr static uint8_t BMP280_DIG_T3_LSB_REG = 0x8C;
+    constexpr static uint8_t BMP280_DIG_T3_MSB_REG = 0x8D;
+    constexpr static uint8_t BMP280_DIG_P1_LSB_REG = 0x8E;
+    constexpr static uint8_t BMP280_DIG_P1_MSB_REG = 0x8F;
+    constexpr static uint8_t BMP280_DIG_P2_LSB_REG = 0x90;
+    constexpr static uint8_t BMP280_DIG_P2_MSB_REG = 0x91;
+    constexpr static uint8_t BMP280_DIG_P3_LSB_REG = 0x92;
+    constexpr static uint8_t BMP280_DIG_P3_MSB_REG = 0x93;
+    constexpr static uint8_t BMP280_DIG_P4_LSB_REG = 0x94;
+    constexpr static uint8_t BMP280_DIG_P4_MSB_REG = 0x95;
+    constexpr static uint8_t BMP280_DIG_P5_LSB_REG = 0x96;
+    constexpr static uint8_t BMP280_DIG_P5_MSB_REG = 0x97;
+    constexpr static uint8_t BMP280_DIG_P6_LSB_REG = 0x98;
+    constexpr static uint8_t BMP280_DIG_P6_MSB_REG = 0x99;
+    constexpr static uint8_t BMP280_DIG_P7_LSB_REG = 0x9A;
+    constexpr static uint8_t BMP280_DIG_P7_MSB_REG = 0x9B;
+    constexpr static uint8_t BMP280_DIG_P8_LSB_REG = 0x9C;
+    constexpr static uint8_t BMP280_DIG_P8_MSB_REG = 0x9D;
+    constexpr static uint8_t BMP280_DIG_P9_LSB_REG = 0x9E;
+    constexpr static uint8_t BMP280_DIG_P9_MSB_REG = 0x9F;
+    constexpr static uint8_t BMP280_LEN_CALIBRATION = 24; // dig_T1..dig_P9
+    constexpr static uint8_t BMP280_LEN_DATA = 6;         // press_msb..temp_xlsb
+    constexpr static uint8_t BMP280_VAL_CHIPID = 0x58;
+
+    // every instance owns its device, the BMP280 is reached through the transport
+    explicit Icm20948Driver(const Transport &clBus = Transport());
+    ~Icm20948Driver() = default;
+    typename Transport::Handle *imuBusGet(void) const;
+    Transport &imuTransportGet(void);
+
+    // icm20948
+    void imuInit(IMU_EN_SENSOR_TYPE *penMotionSensorType, IMU_EN_SENSOR_TYPE *penPressureType);
+    void imuDataGet(IMU_ST_ANGLES_DATA *pstAngles,
+                    IMU_ST_SENSOR_DATA *pstGyroRawData,
+                    IMU_ST_SENSOR_DATA *pstAcceRawData,
+                    IMU_ST_SENSOR_DATA *pstMagnRawData);
+    void imuAcqModeSet(IMU_EN_ACQ_MODE enMode);
+    IMU_EN_ACQ_MODE imuAcqModeGet(void) const;
+    // fifo streaming
+    void imuFifoInit(bool bWithMagn, uint8_t u8WatermarkFrames);
+    bool imuFifoPoll(void);
+    void imuFifoRxCplt(void);
+    void imuFifoRxError(void);
+    bool imuFifoBusy(void) const;
+    bool imuFifoRead(ICM20948_ST_FIFO_SAMPLE *pstSample);
+    uint8_t imuFifoFrameLen(void) const;
+    const ICM20948_ST_FIFO_STATS *imuFifoStatsGet(void) const;
+    // duty-cycled sensors at 1125/(1 + div) Hz, for batching into the fifo
+    void imuLowPowerSet(bool bEnable, uint8_t u8SmplrtDiv);
+    void imuRegCacheEnable(bool bEnable);
+    // multi-rate acquisition, periods in us, see acq_sched.h; every sample is read once.
+    // The baro keeps the rate of its own config, a period only turns it on
+    void imuStreamInit(const ACQ_SCHED_ST_PLAN *pstPlanUs);
+    uint8_t imuStreamPoll(void);
+    bool imuStreamRead(ACQ_SCHED_EN_STREAM enStream, IMU_ST_STREAM_SAMPLE *pstSample);
+    bool imuStreamUpdate(IMU_ST_ANGLES_DATA *pstAngles);
+    const ACQ_SCHED_ST_STATE *imuStreamSchedGet(void) const;
+    // two-rate fusion for imuStreamUpdate and imuFifoUpdate: every gyro sample goes into the
+    // coning integrator, accel and magnetometer correct the attitude every u32Us on the
+    // delta of the interval. 0 steps the whole filter with every gyro sample
+    void imuCorrPeriodSet(uint32_t u32Us);
+    uint32_t imuCorrPeriodGet(void) const;
+    // gains of the driver's Mahony filter: fKp rad/s of correction per unit of accel /
+    // magnetometer error, fKi the integral that learns the gyro bias; with both 0 from the start
+    // the gyro is integrated alone
+    void imuAHRSgainsSet(float fKp, float fKi);
+    void imuAHRSgainsGet(float *pfKp, float *pfKi) const;
+    bool imuFifoUpdate(IMU_ST_ANGLES_DATA *pstAngles);
+    // full-scale range, raw data is in LSB of the range in use
+    void imuGyroFsSet(IMU_EN_GYRO_FS enFs);
+    void imuAccelFsSet(IMU_EN_ACCEL_FS enFs);
+    IMU_EN_GYRO_FS imuGyroFsGet(void) const;
+    IMU_EN_ACCEL_FS imuAccelFsGet(void) const;
+    void imuAutoRangeEnable(bool bEnable);
+    uint32_t imuRangeSwitchesGet(void) const;
+    // capture stamps, dt of the last fusion step in seconds and its jitter
+    float imuDtGet(void) const;
+    const SAMPLE_ST_DT_STATS *imuDtStatsGet(void) const;
+    // background gyro bias: loaded from pstNv, refined whenever the board is still
+    void imuGyroCalNvSet(const GYRO_CAL_ST_NV *pstNv);
+    bool imuGyroCalSave(void);
+    const GYRO_CAL_ST_STATE *imuGyroCalGet(void) const;
+    // where biases are removed, and the accel bias in g (sensor frame)
+    void imuBiasModeSet(IMU_EN_BIAS_MODE enMode);
+    IMU_EN_BIAS_MODE imuBiasModeGet(void) const;
+    void imuAccelBiasSet(const float *pfBiasG);
+    // gyro bias following the die temperature, learned from the still windows above
+    void imuTempCompEnable(bool bEnable);
+    float imuTempGet(void) const;
+    const GyroTempModel *imuTempModelGet(void) const;
+    // on-sensor fusion: the DMP image is supplied by the application, see dmp.h
+    bool imuDmpInit(const uint8_t *pu8Image, uint16_t u16Len, bool b9Axis);
+    bool imuDmpDataGet(IMU_ST_ANGLES_DATA *pstAngles);
+    bool imuDmpEnabled(void) const;
+    // bmp280
+    void pressSensorDataGet(int32_t *ps32Temperature, int32_t *ps32Pressure, int32_t *ps32Altitude);
+    void pressSensorConfigSet(const IMU_ST_BARO_CONFIG *pstConfig);
+    const IMU_ST_BARO_CONFIG *pressSensorConfigGet(void) const;
+    uint32_t pressSensorPeriodMs(void) const;
+    bool pressSensorPoll(void);
+    void pressSensorLatestGet(int32_t *ps32Temperature, int32_t *ps32Pressure) const;
+
+private:
+    Transport _clBus;
+
+    // ahrs
+    float _fQ[4];
+    float _fKp;
+    float _fKi;
+    float _fErrInt[3]; // integral term of the float paths, rad/s
+#if AHRS_FUSION == 1
+    AHRS_ST_FIXED _stAhrsFixed; // imuDataGet()'s attitude in Q31, _fQ its float image
+#endif
+    bool _bQFloatSet; // _fQ written by a float path since imuDataGet() last took it over
+    uint8_t _attInitialized;
+    IMU_EN_ACQ_MODE _enAcqMode;
+    int16_t _s16MagnRaw[3];
+
+    // fifo
+    uint8_t _u8FifoFrameLen;
+    uint8_t _u8FifoWatermark;
+    volatile uint8_t _u8FifoBusy;
+    uint16_t _u16FifoRxLen;
+    uint32_t _u32FifoRxStamp; // when the count of the drain in flight was read
+    uint32_t _u32FifoSampleUs;
+    uint8_t _u8FifoRxBuf[FIFO_SIZE];
+    ICM20948_ST_FIFO_SAMPLE _stFifoQueue[FIFO_QUEUE_LEN];
+    volatile uint8_t _u8FifoHead;
+    volatile uint8_t _u8FifoTail;
+    ICM20948_ST_FIFO_STATS _stFifoStats;
+
+    // dmp, a partial packet waits in _u8FifoRxBuf (_u16FifoRxLen bytes) for the next read
+    bool _bDmpEn;
+    uint8_t _u8DmpPacketLen;
+
+    // multi-rate streams, _u8StreamNew holds ACQ_SCHED_BIT of the samples not read yet;
+    // _u32StreamFused is the stamp of the last sample of a stream the fusion took
+    ACQ_SCHED_ST_STATE _stAcq;
+    IMU_ST_STREAM_SAMPLE _stStream[ACQ_SCHED_STREAM_NUM];
+    uint8_t _u8StreamNew;
+    uint8_t _u8StreamFusedValid;
+    uint32_t _u32StreamFused[ACQ_SCHED_STREAM_NUM];
+
+    // two-rate fusion, the latest accel and magnetometer wait for the correction
+    ConingIntegrator _clConing;
+    uint32_t _u32CorrUs;
+    float _fCorrAccel[3];
+    float _fCorrMagn[3];
+    bool _bCorrAccel;
+    bool _bCorrMagn;
+
+    // Timestamp_Get() of the previous sample
+    bool _bStampValid;
+    uint32_t _u32LastStamp;
+    float _fDt;
+    SAMPLE_ST_DT_STATS _stDtStats;
+
+    // full-scale range, averaging windows are kept in LSB of the current range
+    IMU_EN_GYRO_FS _enGyroFs;
+    IMU_EN_ACCEL_FS _enAccelFs;
+    IMU_EN_GYRO_FS _enGyroFsBase; // auto-ranging never goes below the range that was set
+    IMU_EN_ACCEL_FS _enAccelFsBase;
+    bool _bAutoRange;
+    int16_t _s16GyroPeak;
+    int16_t _s16AccelPeak;
+    uint16_t _u16GyroQuiet;
+    uint16_t _u16AccelQuiet;
+    uint8_t _u8GyroHoldoff;
+    uint8_t _u8AccelHoldoff;
+    uint32_t _u32RangeSwitches;
+    ICM20948_ST_AVG_DATA _stGyroAvg[3];
+    ICM20948_ST_AVG_DATA _stAccelAvg[3];
+    ICM20948_ST_AVG_DATA _stMagnAvg[3];
+
+    // gyro bias in dps, _stGyroOffset is its value in LSB of the current range
+    GYRO_CAL_ST_STATE _stGyroCal;
+    IMU_ST_SENSOR_DATA _stGyroOffset;
+    IMU_EN_BIAS_MODE _enBiasMode;
+    float _fGyroBiasAppliedDps[3]; // what the offset in use removes, after quantisation
+    float _fAccelBiasG[3];
+    IMU_ST_SENSOR_DATA _stAccelOffset; // software mode, LSB of the current range
+    int16_t _s16AccelTrim[3];          // factory XA/YA/ZA_OFFS, reloaded by every reset
+    bool _bAccelTrimValid;
+
+    // die temperature from the sample burst and the bias model over it
+    bool _bTempValid;
+    float _fTempC;
+    bool _bTempComp;
+    GyroTempModel _clGyroTemp;
+
+    // bmp280 measurement cycle
+    BMP280_HandleTypeDef _stBmp280;
+    int32_t _s32Pressure0; // sea level reference for the altitude
+    IMU_ST_BARO_CONFIG _stBaroConfig;
+    uint32_t _u32BaroDueTick;
+    int32_t _s32BaroTemperature; // 0.01 degC
+    int32_t _s32BaroPressure;    // Pa
+    BMP280_AvgTypeDef _stBaroAvg[3]; // pressure, altitude, temperature
+
+    // register cache, bank index is REG_VAL_REG_BANK_x >> 4
+    bool _bRegCacheEn;
+    uint8_t _u8Bank;
+    uint8_t _u8RegShadow[REG_CACHE_BANKS][REG_CACHE_LEN];
+    uint8_t _u8RegValid[REG_CACHE_BANKS][REG_CACHE_LEN / 8];
+
+    // transport
+    uint8_t busReadByte(uint8_t u8RegAddr);
+    void busReadBytes(uint8_t u8RegAddr, uint8_t *pu8Buf, uint16_t u16Len);
+    void busWriteByte(uint8_t u8RegAddr, uint8_t u8Value);
+    void busWriteBytes(uint8_t u8RegAddr, const uint8_t *pu8Buf, uint16_t u16Len);
+    uint8_t bmp280ReadByte(uint8_t u8RegAddr);
+    void bmp280ReadBytes(uint8_t u8RegAddr, uint8_t *pu8Buf, uint16_t u16Len);
+    void bmp280WriteByte(uint8_t u8RegAddr, uint8_t u8Value);
+
+    // icm20948
+    void icm20948BankSelect(uint8_t u8Bank);
+    uint8_t icm20948RegRead(uint8_t u8Bank, uint8_t u8RegAddr);
+    void icm20948RegWrite(uint8_t u8Bank, uint8_t u8RegAddr, uint8_t u8Value);
+    void icm20948RegModify(uint8_t u8Bank, uint8_t u8RegAddr, uint8_t u8Clear, uint8_t u8Set);
+    void icm20948RegCacheReset(bool bDeviceReset);
+    static bool icm20948RegCacheable(uint8_t u8Bank, uint8_t u8RegAddr);
+    void icm20948init(void);
+    bool icm20948Check(void);
+    bool icm20948MagCheck(void);
+    void icm20948GyroRead(int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z);
+    void icm20948AccelRead(int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z);
+    void icm20948AccelGyroRead(IMU_ST_SENSOR_DATA *pstAccel, IMU_ST_SENSOR_DATA *pstGyro);
+    void icm20948BurstRead(ICM20948_ST_RAW_SAMPLE *pstSample);
+    void icm20948SampleDecode(const uint8_t *pu8Buf, ICM20948_ST_RAW_SAMPLE *pstSample);
+    void icm20948GyroAvg(const int16_t *ps16In, int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z);
+    void icm20948AccelAvg(const int16_t *ps16In, int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z);
+    void icm20948MagRead(int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z);
+    void icm20948MagAvg(const int16_t *ps16In, int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z);
+    void icm20948MagAutoReadInit(void);
+    void icm20948MagAutoReadStop(void);
+    void icm20948BurstMagRead(IMU_ST_SENSOR_DATA *pstAccel, IMU_ST_SENSOR_DATA *pstGyro, int16_t *ps16Magn);
+    bool icm20948MagDecode(const uint8_t *pu8Buf, int16_t *ps16Magn);
+    void icm20948ReadSecondary(uint8_t u8I2CAddr, uint8_t u8RegAddr, uint8_t u8Len, uint8_t *pu8data);
+    void icm20948WriteSecondary(uint8_t u8I2CAddr, uint8_t u8RegAddr, uint8_t u8data);
+    void icm20948GyroOffset(void);
+    void icm20948AccelOffset(void);
+    void icm20948GyroBiasGet(float *pfBiasDps);
+    void icm20948TempDecode(const uint8_t *pu8Buf);
+    void icm20948GyroOffsRegWrite(const int16_t *ps16Reg);
+    void icm20948AccelOffsRegWrite(const int16_t *ps16Reg);
+    void icm20948AccelTrimRead(void);
+    static int16_t icm20948Sat16(int32_t s32Val);
+    void icm20948GyroCalUpdate(const IMU_ST_SENSOR_DATA *pstAccel, const IMU_ST_SENSOR_DATA *pstGyro);
+    void icm20948GyroFsWrite(IMU_EN_GYRO_FS enFs);
+    void icm20948AccelFsWrite(IMU_EN_ACCEL_FS enFs);
+    void icm20948AutoRange(void);
+    static int16_t icm20948PeakAbs(const int16_t *ps16In);
+    static int16_t icm20948AvgGet(const ICM20948_ST_AVG_DATA *pstAvg);
+    static void icm20948AvgRescale(ICM20948_ST_AVG_DATA *pstAvg, int8_t s8Shift);
+    static int16_t icm20948Rescale(int16_t s16Val, int8_t s8Shift);
+    void icm20948FifoReset(void);
+    uint16_t icm20948FifoCountGet(void);
+    void icm20948FifoParse(const uint8_t *pu8Buf, uint16_t u16Len);
+    bool icm20948DmpMemWrite(uint16_t u16Addr, const uint8_t *pu8Data, uint16_t u16Len, bool bVerify);
+    void icm20948DmpMemWrite16(uint16_t u16Addr, uint16_t u16Value);
+    void icm20948DmpMemWrite32(uint16_t u16Addr, uint32_t u32Value);
+    void icm20948DmpConfig(bool b9Axis);
+    void icm20948DmpMagInit(void);
+    void icm20948DmpQuatSet(const int32_t *ps32Q30);
+    void icm20948StreamStore(ACQ_SCHED_EN_STREAM enStream, int32_t s32X, int32_t s32Y, int32_t s32Z, uint32_t u32Stamp);
+    uint32_t icm20948StreamDtUs(ACQ_SCHED_EN_STREAM enStream, uint32_t u32Stamp);
+    void icm20948CalAvgValue(uint8_t *pIndex, int16_t *pAvgBuffer, int16_t InVal, int32_t *pOutVal);
+    void imuAHRSinit(const float *pfAccel, const float *pfMagn);
+    void imuAHRSstep(const float *pfGyro, const float *pfAccel, float fAccelDt, const float *pfMagn, float fMagnDt, float fDt);
+    void imuAHRSdelta(const float *pfDeltaQ, const float *pfAccel, const float *pfMagn, float fDt);
+    void imuAHRSerror(const float *pfAccel, float fAccelWeight, const float *pfMagn, float fMagnWeight, float *pfErr);
+    void imuAHRSfeedback(const float *pfErr, float fDt, float *pfRate);
+    bool icm20948TwoRateStep(const float *pfGyro, float fDt, const float *pfAccel, const float *pfMagn);
+    void imuAnglesFromQuat(IMU_ST_ANGLES_DATA *pstAngles);
+    float invSqrt(float x);
+
+    // bmp280
+    void bmp280Init(void);
+    bool bmp280Check(void);
+    void bmp280ReadCalibration(void);
+    void bmp280TandPGet(float *temperature, float *pressure);
+    void bmp280DataDecode(const uint8_t *pu8Buf, float *temperature, float *pressure);
+    void bmp280ConfigWrite(void);
+    static uint32_t bmp280MeasTimeUs(const IMU_ST_BARO_CONFIG *pstConfig);
+    void bmp280CalAvgValue(uint8_t *pIndex, int32_t *pAvgBuffer, int32_t InVal, int32_t *pOutVal);
+    void bmp280CalculateAbsoluteAltitude(int32_t *pAltitude, int32_t PressureVal);
+    float bmp280CompensateTemperature(int32_t adc_T);
+    float bmp280CompensatePressure(int32_t adc_P);
+};
+
+using ICM20948 = Icm20948Driver<I2cDmaTransport>;
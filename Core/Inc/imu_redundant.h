@@ -0,0 +1,106 @@
+#pragma once
+
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// called from the HAL I2C callbacks; 1 when the transfer was a drain of the attached front end
+uint8_t ImuRedundant_RxCpltCallback(I2C_HandleTypeDef *phi2c);
+uint8_t ImuRedundant_ErrorCallback(I2C_HandleTypeDef *phi2c);
+
+#ifdef __cplusplus
+}
+
+#include <cstdint>
+#include "imu.h"
+
+typedef struct
+{
+    float afGyroDps[3];
+    float afAccelG[3];
+    uint32_t u32Stamp; /*<capture stamp of the newest sample that took part*/
+    uint8_t u8Voters;  /*<bit i: sensor i took part in the vote*/
+} IMU_ST_VOTED_SAMPLE;
+
+typedef struct
+{
+    uint8_t u8Score; /*<0..SCORE_MAX, a good sample adds one*/
+    bool bExcluded;  /*<read and checked, but not voting*/
+    uint32_t u32Samples;
+    uint32_t u32Stuck;      /*<samples of an output that stopped changing*/
+    uint32_t u32Saturated;  /*<samples at full scale*/
+    uint32_t u32Missing;    /*<votes held without this sensor*/
+    uint32_t u32Misaligned; /*<samples with no counterpart on the other sensors, dropped*/
+    uint32_t u32Outvoted;   /*<samples away from the vote*/
+    uint32_t u32BusErrors;  /*<failed drains*/
+} IMU_ST_HEALTH;
+
+/*
+ * Redundant IMUs, each on its own bus so the FIFO drains run concurrently. The samples
+ * are matched by capture stamp and voted per axis: the median of three or more, the mean
+ * of two that agree, else the one that continues the previous output. Every sensor keeps
+ * a health score; a sensor below SCORE_EXCLUDE stops voting until it is back at
+ * SCORE_READMIT, the last voting sensor is never excluded.
+ */
+class ImuRedundant
+{
+public:
+    constexpr static uint8_t IMU_MAX = 3;
+    constexpr static uint8_t SCORE_MAX = 100;
+    constexpr static uint8_t SCORE_EXCLUDE = 50;
+    constexpr static uint8_t SCORE_READMIT = 80;
+    constexpr static uint8_t PENALTY_OUTVOTED = 5;
+    constexpr static uint8_t PENALTY_FAULT = 10;
+    // identical readings on all six axes, noise makes this unlikely on a working sensor
+    constexpr static uint8_t STUCK_SAMPLES = 8;
+    constexpr static int16_t SATURATED_LSB = 32000;
+    // agreement window of the vote, after bias removal
+    constexpr static float GYRO_TOL_DPS = 3.0f;
+    constexpr static float ACCEL_TOL_G = 0.1f;
+
+    // u32SampleUs: output interval of the sensors, samples further apart than half of it
+    // are not matched. u32WaitUs: how long the others wait for a sensor before voting
+    // without it, at least the drain interval
+    ImuRedundant(ICM20948 *const *ppclImu, uint8_t u8Count, uint32_t u32SampleUs, uint32_t u32WaitUs);
+    ~ImuRedundant() = default;
+
+    // the HAL callbacks reach this instance through ImuRedundant_*Callback from now on
+    void callbackAttach(void);
+    // start the drains
+    void poll(void);
+    // the completions, routed here from the HAL callbacks by bus; false when no sensor on
+    // phi2c had a drain running
+    bool rxCplt(I2C_HandleTypeDef *phi2c);
+    bool rxError(I2C_HandleTypeDef *phi2c);
+    bool read(IMU_ST_VOTED_SAMPLE *pstSample);
+    uint8_t countGet(void) const;
+    const IMU_ST_HEALTH *healthGet(uint8_t u8Index) const;
+
+private:
+    ICM20948 *_pclImu[IMU_MAX];
+    uint8_t _u8Count;
+    uint32_t _u32AlignUs;
+    uint32_t _u32WaitUs;
+
+    // the oldest sample of every sensor not consumed yet
+    bool _bPending[IMU_MAX];
+    ICM20948_ST_FIFO_SAMPLE _stPending[IMU_MAX];
+    ICM20948_ST_FIFO_SAMPLE _stPrev[IMU_MAX];
+    uint8_t _u8Same[IMU_MAX];
+
+    bool _bOutValid;
+    IMU_ST_VOTED_SAMPLE _stOut;
+    IMU_ST_HEALTH _stHealth[IMU_MAX];
+
+    void pendingFill(void);
+    bool plausible(uint8_t i);
+    void convert(uint8_t i, float *pfGyroDps, float *pfAccelG) const;
+    bool agrees(const float *pfAxis, const IMU_ST_VOTED_SAMPLE *pstOut) const;
+    float distance(const float *pfAxis, const IMU_ST_VOTED_SAMPLE *pstOut) const;
+    void scoreAdd(uint8_t i, int16_t s16Delta);
+    uint8_t votersCount(void) const;
+};
+
+#endif
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cstdint>
+#include "main.h"
+#include "i2c.h"
+
+/*
+ * Register access for the ICM20948 driver, passed to it as a template parameter so the
+ * calls inline and a change of bus is a change of type. Every transport provides:
+ *
+ *   Handle, busGet()           the peripheral the completion callbacks arrive on
+ *   Wire                       timing model of a transfer, see I2cWire/SpiWire
+ *   ASYNC                      readStart() finishes in the background, readDone() follows
+ *   USER_CTRL_BITS             kept set in every USER_CTRL write
+ *   read, write, writeByte     blocking ICM20948 register access
+ *   readStart, readDone        the FIFO drain
+ *   auxRead, auxWrite          other devices on the board I2C (the BMP280)
+ *
+ * Functions return true on success.
+ */
+
+// START, address, register, (repeated START, address), payload; 9 bits per byte
+template <uint32_t HZ>
+struct I2cWire
+{
+    constexpr static uint32_t xferNs(uint16_t u16Len, bool bRead)
+    {
+        return (uint32_t)(((bRead ? 3ull : 2ull) + u16Len) * 9ull * 1000000000ull / HZ);
+    }
+};
+
+// command byte and payload under one chip select, 8 bits per byte
+template <uint32_t HZ>
+struct SpiWire
+{
+    constexpr static uint32_t xferNs(uint16_t u16Len, bool bRead)
+    {
+        (void)bRead;
+        return (uint32_t)((1ull + u16Len) * 8ull * 1000000000ull / HZ);
+    }
+};
+
+// 80 MHz / 16, the fastest prescaler under the 7 MHz of the part
+typedef SpiWire<5000000> Icm20948SpiWire;
+
+class I2cTransport
+{
+public:
+    typedef I2C_HandleTypeDef Handle;
+    // I2C3 TIMINGR 0x00702991
+    typedef I2cWire<400000> Wire;
+    constexpr static uint8_t USER_CTRL_BITS = 0x00;
+
+    explicit I2cTransport(I2C_HandleTypeDef *phi2c = &hi2c3, uint8_t u8Addr = 0xD0) : _phi2c(phi2c), _u8Addr(u8Addr) {}
+
+    I2C_HandleTypeDef *busGet(void) const
+    {
+        return _phi2c;
+    }
+
+    uint8_t addrGet(void) const
+    {
+        return _u8Addr;
+    }
+
+    // the register pointer auto-increments, so a block is a single transaction
+    bool read(uint8_t u8Reg, uint8_t *pu8Buf, uint16_t u16Len)
+    {
+        return HAL_I2C_Mem_Read(_phi2c, _u8Addr, u8Reg, I2C_MEMADD_SIZE_8BIT, pu8Buf, u16Len, 1000) == HAL_OK;
+    }
+
+    bool write(uint8_t u8Reg, const uint8_t *pu8Buf, uint16_t u16Len)
+    {
+        return HAL_I2C_Mem_Write(_phi2c, _u8Addr, u8Reg, I2C_MEMADD_SIZE_8BIT, (uint8_t *)pu8Buf, u16Len, 1000) == HAL_OK;
+    }
+
+    bool writeByte(uint8_t u8Reg, uint8_t u8Value)
+    {
+        uint8_t u8Buf[2] = {u8Reg, u8Value};
+
+        return HAL_I2C_Master_Transmit(_phi2c, _u8Addr, u8Buf, 2, 100) == HAL_OK;
+    }
+
+    void readDone(void)
+    {
+    }
+
+    bool auxRead(uint8_t u8Dev, uint8_t u8Reg, uint8_t *pu8Buf, uint16_t u16Len)
+    {
+        return HAL_I2C_Mem_Read(_phi2c, u8Dev, u8Reg, I2C_MEMADD_SIZE_8BIT, pu8Buf, u16Len, 1000) == HAL_OK;
+    }
+
+    bool auxWrite(uint8_t u8Dev, uint8_t u8Reg, uint8_t u8Value)
+    {
+        uint8_t u8Buf[2] = {u8Reg, u8Value};
+
+        return HAL_I2C_Master_Transmit(_phi2c, u8Dev, u8Buf, 2, 100) == HAL_OK;
+    }
+
+protected:
+    I2C_HandleTypeDef *_phi2c;
+    uint8_t _u8Addr;
+};
+
+// the FIFO is drained with the CPU waiting on the bus
+class I2cBlockingTransport : public I2cTransport
+{
+public:
+    constexpr static bool ASYNC = false;
+
+    using I2cTransport::I2cTransport;
+
+    bool readStart(uint8_t u8Reg, uint8_t *pu8Buf, uint16_t u16Len)
+    {
+        return read(u8Reg, pu8Buf, u16Len);
+    }
+};
+
+// the FIFO is drained by DMA, HAL_I2C_MemRxCpltCallback ends it
+class I2cDmaTransport : public I2cTransport
+{
+public:
+    constexpr static bool ASYNC = true;
+
+    using I2cTransport::I2cTransport;
+
+    bool readStart(uint8_t u8Reg, uint8_t *pu8Buf, uint16_t u16Len)
+    {
+        return HAL_I2C_Mem_Read_DMA(_phi2c, _u8Addr, u8Reg, I2C_MEMADD_SIZE_8BIT, pu8Buf, u16Len) == HAL_OK;
+    }
+};
+
+#ifdef HAL_SPI_MODULE_ENABLED
+// mode 3, MSB first, CS on a GPIO. The BMP280 stays on the board I2C, phi2cAux, without it
+// the pressure sensor is not found. The FIFO is drained by DMA, HAL_SPI_RxCpltCallback ends it
+class SpiDmaTransport
+{
+public:
+    typedef SPI_HandleTypeDef Handle;
+    typedef Icm20948SpiWire Wire;
+    constexpr static bool ASYNC = true;
+    // I2C_IF_DIS: the serial interface stays in SPI mode
+    constexpr static uint8_t USER_CTRL_BITS = 0x10;
+    constexpr static uint8_t READ_FLAG = 0x80;
+
+    SpiDmaTransport(SPI_HandleTypeDef *phspi, GPIO_TypeDef *pstCsPort, uint16_t u16CsPin,
+                    I2C_HandleTypeDef *phi2cAux = nullptr)
+        : _phspi(phspi), _pstCsPort(pstCsPort), _u16CsPin(u16CsPin), _phi2cAux(phi2cAux)
+    {
+    }
+
+    SPI_HandleTypeDef *busGet(void) const
+    {
+        return _phspi;
+    }
+
+    bool read(uint8_t u8Reg, uint8_t *pu8Buf, uint16_t u16Len)
+    {
+        uint8_t u8Cmd = u8Reg | READ_FLAG;
+        bool bOk;
+
+        csLow();
+        bOk = (HAL_SPI_Transmit(_phspi, &u8Cmd, 1, 10) == HAL_OK) &&
+              (HAL_SPI_Receive(_phspi, pu8Buf, u16Len, 10) == HAL_OK);
+        csHigh();
+
+        return bOk;
+    }
+
+    bool write(uint8_t u8Reg, const uint8_t *pu8Buf, uint16_t u16Len)
+    {
+        bool bOk;
+
+        csLow();
+        bOk = (HAL_SPI_Transmit(_phspi, &u8Reg, 1, 10) == HAL_OK) &&
+              (HAL_SPI_Transmit(_phspi, (uint8_t *)pu8Buf, u16Len, 10) == HAL_OK);
+        csHigh();
+
+        return bOk;
+    }
+
+    bool writeByte(uint8_t u8Reg, uint8_t u8Value)
+    {
+        return write(u8Reg, &u8Value, 1);
+    }
+
+    // CS stays low until readDone()
+    bool readStart(uint8_t u8Reg, uint8_t *pu8Buf, uint16_t u16Len)
+    {
+        uint8_t u8Cmd = u8Reg | READ_FLAG;
+
+        csLow();
+        if ((HAL_SPI_Transmit(_phspi, &u8Cmd, 1, 10) != HAL_OK) ||
+            (HAL_SPI_Receive_DMA(_phspi, pu8Buf, u16Len) != HAL_OK))
+        {
+            csHigh();
+            return false;
+        }
+
+        return true;
+    }
+
+    void readDone(void)
+    {
+        csHigh();
+    }
+
+    bool auxRead(uint8_t u8Dev, uint8_t u8Reg, uint8_t *pu8Buf, uint16_t u16Len)
+    {
+        return (_phi2cAux != nullptr) &&
+               (HAL_I2C_Mem_Read(_phi2cAux, u8Dev, u8Reg, I2C_MEMADD_SIZE_8BIT, pu8Buf, u16Len, 1000) == HAL_OK);
+    }
+
+    bool auxWrite(uint8_t u8Dev, uint8_t u8Reg, uint8_t u8Value)
+    {
+        uint8_t u8Buf[2] = {u8Reg, u8Value};
+
+        return (_phi2cAux != nullptr) && (HAL_I2C_Master_Transmit(_phi2cAux, u8Dev, u8Buf, 2, 100) == HAL_OK);
+    }
+
+private:
+    SPI_HandleTypeDef *_phspi;
+    GPIO_TypeDef *_pstCsPort;
+    uint16_t _u16CsPin;
+    I2C_HandleTypeDef *_phi2cAux;
+
+    void csLow(void)
+    {
+        HAL_GPIO_WritePin(_pstCsPort, _u16CsPin, GPIO_PIN_RESET);
+    }
+
+    void csHigh(void)
+    {
+        HAL_GPIO_WritePin(_pstCsPort, _u16CsPin, GPIO_PIN_SET);
+    }
+};
+#endif
@@ -0,0 +1,23 @@
+#ifndef __LP_MODE_H__
+#define __LP_MODE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "lp_sched.h"
+
+// LPTIM1 on the LSI, divided by 8: 250 us steps, one stop lasts at most 16 s
+#define LP_MODE_LSI_HZ              (32000)
+#define LP_MODE_LPTIM_PRESC         (3)
+#define LP_MODE_TICK_US             (1000000 * (1 << LP_MODE_LPTIM_PRESC) / LP_MODE_LSI_HZ)
+
+void LpMode_Init(void);
+LP_SCHED_EN_WAKE LpMode_Stop(uint32_t u32StopUs, uint32_t *pu32SleptUs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef __LP_SCHED_H__
+#define __LP_SCHED_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Low-power acquisition: the sensor batches samples into its FIFO while the MCU stops,
+ * the MCU wakes on a timer (or an early sensor interrupt), drains and fuses the batch
+ * and stops again. This decides how long to stop and keeps the energy-relevant counts.
+ * Times are passed in, so it runs against the LPTIM and DWT on the target and against a
+ * simulated clock on the host; the DWT does not count in STOP2.
+ */
+
+typedef enum
+{
+	LP_SCHED_WAKE_TIMER = 0,        /*<the stop period ran out*/
+	LP_SCHED_WAKE_EVENT,            /*<sensor interrupt, e.g. FIFO watermark or overflow*/
+	LP_SCHED_WAKE_NUM
+} LP_SCHED_EN_WAKE;
+
+typedef struct
+{
+	uint32_t u32PeriodMs;           /*<wake at least this often*/
+	uint32_t u32SampleUs;           /*<sensor output interval*/
+	uint16_t u16FifoFrames;         /*<whole frames the sensor FIFO holds*/
+	uint16_t u16WatermarkFrames;    /*<wake once this many are batched, 0: period only*/
+} LP_SCHED_ST_CONFIG;
+
+typedef struct
+{
+	LP_SCHED_ST_CONFIG stCfg;
+	uint8_t u8Awake;
+	uint32_t au32Wakeups[LP_SCHED_WAKE_NUM];
+	uint32_t u32Batches;            /*<wakeups that drained at least one sample*/
+	uint32_t u32Samples;
+	uint32_t u32Overflows;          /*<batches that came back with a full FIFO*/
+	uint64_t u64SleptUs;
+	uint64_t u64AwakeUs;
+	uint32_t u32AwakeMaxUs;         /*<longest wake, kept as FIFO headroom*/
+} LP_SCHED_ST_STATE;
+
+typedef struct
+{
+	float fWakeupsPerSec;
+	float fAwakeUsPerBatch;
+	float fSamplesPerWakeup;
+	float fDutyPct;                 /*<share of the time the MCU was running*/
+} LP_SCHED_ST_METRICS;
+
+void LpSched_Init(LP_SCHED_ST_STATE *pstSched, const LP_SCHED_ST_CONFIG *pstCfg);
+uint32_t LpSched_StopUs(const LP_SCHED_ST_STATE *pstSched);
+void LpSched_WakeBegin(LP_SCHED_ST_STATE *pstSched, uint32_t u32SleptUs, LP_SCHED_EN_WAKE enReason);
+void LpSched_WakeEnd(LP_SCHED_ST_STATE *pstSched, uint32_t u32AwakeUs, uint16_t u16Samples);
+void LpSched_MetricsGet(const LP_SCHED_ST_STATE *pstSched, LP_SCHED_ST_METRICS *pstMetrics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
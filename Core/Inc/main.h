@@ -59,6 +59,9 @@ void Error_Handler(void);
 /* Private defines -----------------------------------------------------------*/
 #define LED_STATE_Pin GPIO_PIN_0
 #define LED_STATE_GPIO_Port GPIOA
+#define IMU_INT_Pin GPIO_PIN_2
+#define IMU_INT_GPIO_Port GPIOC
+#define IMU_INT_EXTI_IRQn EXTI2_IRQn
 
 /* USER CODE BEGIN Private defines */
 
@@ -0,0 +1,39 @@
+#ifndef __SAMPLE_BUF_H__
+#define __SAMPLE_BUF_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// ACCEL_XOUT_H..GYRO_ZOUT_L
+#define SAMPLE_BUF_LEN              12
+
+typedef struct
+{
+	uint8_t au8Data[SAMPLE_BUF_LEN];
+	uint32_t u32Seq;                /*<producer sequence number, 0: no sample yet*/
+	uint32_t u32Stamp;              /*<Timestamp_Get() of the capture*/
+} SAMPLE_ST_FRAME;
+
+// Ping-pong handoff from a DMA completion interrupt to the main loop. The DMA
+// only ever fills the back frame; publishing swaps the frames under a sequence
+// lock, so a reader that overlapped a swap sees the counter move and retries.
+typedef struct
+{
+	SAMPLE_ST_FRAME astFrame[2];
+	volatile uint32_t u32Lock;      /*<odd while a publish is in progress*/
+	volatile uint8_t u8Front;       /*<frame the consumer reads*/
+} SAMPLE_ST_PINGPONG;
+
+void SampleBuf_Init(SAMPLE_ST_PINGPONG *pstBuf);
+uint8_t *SampleBuf_WriteBuf(SAMPLE_ST_PINGPONG *pstBuf);
+void SampleBuf_Publish(SAMPLE_ST_PINGPONG *pstBuf, uint32_t u32Seq, uint32_t u32Stamp);
+uint32_t SampleBuf_Read(const SAMPLE_ST_PINGPONG *pstBuf, SAMPLE_ST_FRAME *pstFrame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
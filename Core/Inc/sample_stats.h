@@ -0,0 +1,46 @@
+#ifndef __SAMPLE_STATS_H__
+#define __SAMPLE_STATS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// acquisition quality as seen by the consumer of a sequence-numbered sample stream
+typedef struct
+{
+	uint32_t u32Samples;      /*<samples consumed*/
+	uint32_t u32Dropped;      /*<sequence numbers skipped*/
+	uint32_t u32Duplicates;   /*<same sequence number consumed again*/
+	uint32_t u32LastSeq;
+	uint32_t u32LatencyUs;    /*<capture to consumption of the last sample*/
+	uint32_t u32LatencyMinUs;
+	uint32_t u32LatencyMaxUs;
+	uint64_t u64LatencySumUs;
+} SAMPLE_ST_STATS;
+
+// spacing of consecutive capture stamps, i.e. the dt a consumer integrates with
+typedef struct
+{
+	uint32_t u32Count;        /*<intervals seen*/
+	uint32_t u32DtUs;         /*<last interval*/
+	uint32_t u32DtMinUs;
+	uint32_t u32DtMaxUs;
+	uint64_t u64DtSumUs;
+	uint64_t u64DtSqSumUs;    /*<sum of squares, for the standard deviation*/
+} SAMPLE_ST_DT_STATS;
+
+void SampleStats_Reset(SAMPLE_ST_STATS *pstStats);
+void SampleStats_Update(SAMPLE_ST_STATS *pstStats, uint32_t u32Seq, uint32_t u32LatencyUs);
+uint32_t SampleStats_LatencyAvgUs(const SAMPLE_ST_STATS *pstStats);
+void SampleStats_DtReset(SAMPLE_ST_DT_STATS *pstStats);
+void SampleStats_DtUpdate(SAMPLE_ST_DT_STATS *pstStats, uint32_t u32DtUs);
+uint32_t SampleStats_DtAvgUs(const SAMPLE_ST_DT_STATS *pstStats);
+float SampleStats_DtStdUs(const SAMPLE_ST_DT_STATS *pstStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __TIMESTAMP_H__
+#define __TIMESTAMP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// free-running DWT cycle counter, wraps after 2^32 / SystemCoreClock (53 s at 80 MHz)
+void Timestamp_Init(void);
+uint32_t Timestamp_Get(void);
+uint32_t Timestamp_ElapsedUs(uint32_t u32Since);
+uint32_t Timestamp_DeltaUs(uint32_t u32From, uint32_t u32To);
+int32_t Timestamp_DiffUs(uint32_t u32A, uint32_t u32B);
+uint32_t Timestamp_UsToTicks(uint32_t u32Us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
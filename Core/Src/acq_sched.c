@@ -0,0 +1,104 @@
+#include <string.h>
+#include "acq_sched.h"
+#include "i2c_timing.h"
+
+// every stream on is due at once, the first poll reads them all
+void AcqSched_Init(ACQ_SCHED_ST_STATE *pstSched, const ACQ_SCHED_ST_PLAN *pstPlan, uint32_t u32Now)
+{
+	uint8_t i;
+
+	memset(pstSched, 0, sizeof(*pstSched));
+	pstSched->stPlan = *pstPlan;
+	for (i = 0; i < ACQ_SCHED_STREAM_NUM; i++)
+	{
+		pstSched->au32Due[i] = u32Now;
+	}
+}
+
+// the streams to read now, ACQ_SCHED_BIT. A due stream moves on by whole periods, so a late
+// poll reads it once and the periods it slept through count as missed instead of piling up
+uint8_t AcqSched_Due(ACQ_SCHED_ST_STATE *pstSched, uint32_t u32Now)
+{
+	uint8_t u8Due = 0;
+	uint32_t u32Period, u32Late, u32Skip;
+	uint8_t i;
+
+	for (i = 0; i < ACQ_SCHED_STREAM_NUM; i++)
+	{
+		u32Period = pstSched->stPlan.au32Period[i];
+		if (u32Period == 0 || (int32_t)(u32Now - pstSched->au32Due[i]) < 0)
+		{
+			continue;
+		}
+
+		u32Late = u32Now - pstSched->au32Due[i];
+		u32Skip = u32Late / u32Period;
+		pstSched->au32Due[i] += (u32Skip + 1) * u32Period;
+		pstSched->au32Missed[i] += u32Skip;
+		pstSched->au32Reads[i]++;
+		u8Due |= ACQ_SCHED_BIT(i);
+	}
+
+	return u8Due;
+}
+
+// ticks until the next stream is due, 0: one is due now, UINT32_MAX: all streams off
+uint32_t AcqSched_WaitGet(const ACQ_SCHED_ST_STATE *pstSched, uint32_t u32Now)
+{
+	uint32_t u32Wait = UINT32_MAX;
+	int32_t s32Left;
+	uint8_t i;
+
+	for (i = 0; i < ACQ_SCHED_STREAM_NUM; i++)
+	{
+		if (pstSched->stPlan.au32Period[i] == 0)
+		{
+			continue;
+		}
+
+		s32Left = (int32_t)(pstSched->au32Due[i] - u32Now);
+		if (s32Left <= 0)
+		{
+			return 0;
+		}
+		if ((uint32_t)s32Left < u32Wait)
+		{
+			u32Wait = (uint32_t)s32Left;
+		}
+	}
+
+	return u32Wait;
+}
+
+// wire time of one poll reading u8Streams, the transactions of imuStreamPoll
+uint32_t AcqSched_BusUs(uint8_t u8Streams, uint32_t u32SclHz)
+{
+	const uint8_t u8Motion = ACQ_SCHED_BIT(ACQ_SCHED_STREAM_GYRO) | ACQ_SCHED_BIT(ACQ_SCHED_STREAM_ACCEL);
+	uint32_t u32Us = 0;
+
+	if ((u8Streams & u8Motion) == u8Motion)
+	{
+		u32Us += I2cTiming_XferUs(u32SclHz, ACQ_SCHED_LEN_ACCEL + ACQ_SCHED_LEN_GYRO, 1);
+	}
+	else if (u8Streams & ACQ_SCHED_BIT(ACQ_SCHED_STREAM_GYRO))
+	{
+		u32Us += I2cTiming_XferUs(u32SclHz, ACQ_SCHED_LEN_GYRO, 1);
+	}
+	else if (u8Streams & ACQ_SCHED_BIT(ACQ_SCHED_STREAM_ACCEL))
+	{
+		u32Us += I2cTiming_XferUs(u32SclHz, ACQ_SCHED_LEN_ACCEL, 1);
+	}
+
+	if (u8Streams & ACQ_SCHED_BIT(ACQ_SCHED_STREAM_MAGN))
+	{
+		u32Us += I2cTiming_XferUs(u32SclHz, ACQ_SCHED_LEN_MAGN, 1);
+	}
+
+	if (u8Streams & ACQ_SCHED_BIT(ACQ_SCHED_STREAM_BARO))
+	{
+		u32Us += I2cTiming_XferUs(u32SclHz, ACQ_SCHED_LEN_BARO_STATUS, 1);
+		u32Us += I2cTiming_XferUs(u32SclHz, ACQ_SCHED_LEN_BARO, 1);
+	}
+
+	return u32Us;
+}
@@ -0,0 +1,275 @@
+#include <stddef.h>
+#include "ahrs_fixed.h"
+
+#define AHRS_FIXED_Q30_ONE          (1 << 30)
+#define AHRS_FIXED_US_TO_Q48        (281474977ull)  /*<2^48 / 1e6, dt in us to Q32 seconds after >> 16*/
+
+// product of two Q15 in Q15, rounded
+static inline int32_t AhrsFixed_MulQ15(int32_t s32A, int32_t s32B)
+{
+	return (s32A * s32B + (1 << 14)) >> 15;
+}
+
+// |q|^2 in Q30, four Q31 squares
+static int64_t AhrsFixed_QuatNorm2(const int32_t *ps32Q)
+{
+	int64_t s64Sum = 0;
+	uint8_t i;
+
+	for (i = 0; i < 4; i++)
+	{
+		s64Sum += ((int64_t)ps32Q[i] * ps32Q[i]) >> 32;
+	}
+	return s64Sum;
+}
+
+/*
+ * Back to unit length: one Newton step of 1/sqrt from 1, (3 - |q|^2) / 2, squares the error,
+ * so after a step of the gyro the quaternion is unit to the last bit. A step that left it far
+ * off (a full-scale turn over the longest dt) is halved into range and iterated.
+ */
+static void AhrsFixed_Normalize(int32_t *ps32Q)
+{
+	int64_t s64Norm2 = AhrsFixed_QuatNorm2(ps32Q);
+	int64_t s64Inv;
+	uint8_t i, u8Iter;
+
+	while (s64Norm2 > (3 * (int64_t)AHRS_FIXED_Q30_ONE) / 2)
+	{
+		for (i = 0; i < 4; i++)
+		{
+			ps32Q[i] >>= 1;
+		}
+		s64Norm2 >>= 2;
+	}
+
+	for (u8Iter = 0; u8Iter < 4; u8Iter++)
+	{
+		s64Inv = (3 * (int64_t)AHRS_FIXED_Q30_ONE - s64Norm2) / 2;
+		for (i = 0; i < 4; i++)
+		{
+			ps32Q[i] = AhrsFixed_Sat(((int64_t)ps32Q[i] * s64Inv) >> 30);
+		}
+
+		// within 2^-12 the step above was the last one needed
+		if ((s64Norm2 - AHRS_FIXED_Q30_ONE < (1 << 18)) && (AHRS_FIXED_Q30_ONE - s64Norm2 < (1 << 18)))
+		{
+			break;
+		}
+		s64Norm2 = AhrsFixed_QuatNorm2(ps32Q);
+	}
+}
+
+void AhrsFixed_Init(AHRS_ST_FIXED *pstAhrs, float fKp, float fKi)
+{
+	AhrsFixed_GainsSet(pstAhrs, fKp, fKi);
+	AhrsFixed_Reset(pstAhrs);
+}
+
+void AhrsFixed_GainsSet(AHRS_ST_FIXED *pstAhrs, float fKp, float fKi)
+{
+	pstAhrs->s32KpQ16 = (int32_t)(fKp * 65536.0f + 0.5f);
+	pstAhrs->s32KiQ16 = (int32_t)(fKi * 65536.0f + 0.5f);
+}
+
+void AhrsFixed_Reset(AHRS_ST_FIXED *pstAhrs)
+{
+	pstAhrs->as32Q[0] = AHRS_FIXED_Q31_ONE;
+	pstAhrs->as32Q[1] = 0;
+	pstAhrs->as32Q[2] = 0;
+	pstAhrs->as32Q[3] = 0;
+	pstAhrs->as32Integral[0] = 0;
+	pstAhrs->as32Integral[1] = 0;
+	pstAhrs->as32Integral[2] = 0;
+}
+
+uint32_t AhrsFixed_Sqrt(uint32_t u32X)
+{
+	uint32_t u32Root = 0;
+	uint32_t u32Bit = 1u << 30;
+
+	while (u32Bit > u32X)
+	{
+		u32Bit >>= 2;
+	}
+
+	while (u32Bit != 0)
+	{
+		if (u32X >= u32Root + u32Bit)
+		{
+			u32X -= u32Root + u32Bit;
+			u32Root = (u32Root >> 1) + u32Bit;
+		}
+		else
+		{
+			u32Root >>= 1;
+		}
+		u32Bit >>= 2;
+	}
+	return u32Root;
+}
+
+/*
+ * The vector is shifted up until its largest component has bit 14 set, then the root of
+ * the squares is at least 2^14 and the quotient keeps 15 bits even for a weak field.
+ */
+bool AhrsFixed_Unit(const int16_t *ps16V, int32_t *ps32U)
+{
+	int32_t as32V[3];
+	uint32_t u32Max = 0, u32Abs, u32Norm;
+	uint8_t i, u8Shift = 0;
+
+	for (i = 0; i < 3; i++)
+	{
+		u32Abs = (ps16V[i] < 0) ? (uint32_t)(-(int32_t)ps16V[i]) : (uint32_t)ps16V[i];
+		u32Max = (u32Abs > u32Max) ? u32Abs : u32Max;
+	}
+	if (u32Max == 0)
+	{
+		return false;
+	}
+
+	while ((u32Max << u8Shift) < (1u << 14))
+	{
+		u8Shift++;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		as32V[i] = (int32_t)ps16V[i] * (1 << u8Shift);
+	}
+
+	// components up to 2^15, the squares add up below 2^32
+	u32Norm = AhrsFixed_Sqrt((uint32_t)(as32V[0] * as32V[0]) + (uint32_t)(as32V[1] * as32V[1]) +
+	                         (uint32_t)(as32V[2] * as32V[2]));
+	for (i = 0; i < 3; i++)
+	{
+		ps32U[i] = AhrsFixed_SatQ15((as32V[i] * (1 << 15)) / (int32_t)u32Norm);
+	}
+	return true;
+}
+
+/*
+ * The same error as imuAHRSerror(): measured direction cross estimated direction, for gravity
+ * and for the flux turned into the plane of north. The rotation is taken to Q15, the error
+ * comes out in Q28 so the two terms add without saturating.
+ */
+static void AhrsFixed_Error(const int32_t *ps32Q, const int16_t *ps16Accel, const int16_t *ps16Magn, int32_t *ps32Err)
+{
+	int32_t q0 = ps32Q[0] >> 16, q1 = ps32Q[1] >> 16, q2 = ps32Q[2] >> 16, q3 = ps32Q[3] >> 16;
+	int32_t r00, r01, r02, r10, r11, r12, r20, r21, r22;
+	int32_t as32U[3];
+	int32_t hx, hy, hz, bx, bz, wx, wy, wz;
+
+	ps32Err[0] = 0;
+	ps32Err[1] = 0;
+	ps32Err[2] = 0;
+
+	// rotation body to earth, Q30 products doubled and taken to Q15
+	r20 = AhrsFixed_SatQ15((q1 * q3 - q0 * q2) >> 14);
+	r21 = AhrsFixed_SatQ15((q0 * q1 + q2 * q3) >> 14);
+	r22 = AhrsFixed_SatQ15((q0 * q0 - q1 * q1 - q2 * q2 + q3 * q3) >> 15);
+
+	if ((ps16Accel != NULL) && AhrsFixed_Unit(ps16Accel, as32U))
+	{
+		ps32Err[0] += (as32U[1] * r22 - as32U[2] * r21) >> 2;
+		ps32Err[1] += (as32U[2] * r20 - as32U[0] * r22) >> 2;
+		ps32Err[2] += (as32U[0] * r21 - as32U[1] * r20) >> 2;
+	}
+
+	if ((ps16Magn != NULL) && AhrsFixed_Unit(ps16Magn, as32U))
+	{
+		r00 = AhrsFixed_SatQ15((q0 * q0 + q1 * q1 - q2 * q2 - q3 * q3) >> 15);
+		r01 = AhrsFixed_SatQ15((q1 * q2 - q0 * q3) >> 14);
+		r02 = AhrsFixed_SatQ15((q1 * q3 + q0 * q2) >> 14);
+		r10 = AhrsFixed_SatQ15((q1 * q2 + q0 * q3) >> 14);
+		r11 = AhrsFixed_SatQ15((q0 * q0 - q1 * q1 + q2 * q2 - q3 * q3) >> 15);
+		r12 = AhrsFixed_SatQ15((q2 * q3 - q0 * q1) >> 14);
+
+		hx = AhrsFixed_SatQ15((r00 * as32U[0] + r01 * as32U[1] + r02 * as32U[2]) >> 15);
+		hy = AhrsFixed_SatQ15((r10 * as32U[0] + r11 * as32U[1] + r12 * as32U[2]) >> 15);
+		hz = AhrsFixed_SatQ15((r20 * as32U[0] + r21 * as32U[1] + r22 * as32U[2]) >> 15);
+		bx = (int32_t)AhrsFixed_Sqrt((uint32_t)(hx * hx + hy * hy));
+		bz = hz;
+
+		wx = AhrsFixed_MulQ15(r00, bx) + AhrsFixed_MulQ15(r20, bz);
+		wy = AhrsFixed_MulQ15(r01, bx) + AhrsFixed_MulQ15(r21, bz);
+		wz = AhrsFixed_MulQ15(r02, bx) + AhrsFixed_MulQ15(r22, bz);
+
+		ps32Err[0] += (as32U[1] * wz - as32U[2] * wy) >> 2;
+		ps32Err[1] += (as32U[2] * wx - as32U[0] * wz) >> 2;
+		ps32Err[2] += (as32U[0] * wy - as32U[1] * wx) >> 2;
+	}
+}
+
+void AhrsFixed_Update(AHRS_ST_FIXED *pstAhrs, const int16_t *ps16Gyro, int32_t s32GyroScaleQ36,
+                      const int16_t *ps16Accel, const int16_t *ps16Magn, uint32_t u32DtUs)
+{
+	int32_t *ps32Q = pstAhrs->as32Q;
+	const bool bCorrect = (ps16Accel != NULL) || (ps16Magn != NULL);
+	const uint32_t u32DtQ32 = (uint32_t)(((uint64_t)u32DtUs * AHRS_FIXED_US_TO_Q48) >> 16);
+	int32_t as32Err[3], as32Half[3], as32Q[4];
+	int32_t s32Rate;
+	uint8_t i;
+
+	AhrsFixed_Error(ps32Q, ps16Accel, ps16Magn, as32Err);
+
+	for (i = 0; i < 3; i++)
+	{
+		// Q28 error x Q16 gain is Q44; the integral takes a few LSB of Q28 per step, in Q20
+		// the rounding of each step would add up to a bias of its own
+		if (bCorrect)
+		{
+			s32Rate = AhrsFixed_Sat(((int64_t)as32Err[i] * pstAhrs->s32KiQ16) >> 16);
+			pstAhrs->as32Integral[i] = AhrsFixed_Add(pstAhrs->as32Integral[i],
+			                                         (int32_t)(((int64_t)s32Rate * u32DtQ32 + (1ll << 31)) >> 32));
+		}
+
+		s32Rate = AhrsFixed_Sat(((int64_t)ps16Gyro[i] * s32GyroScaleQ36) >> 16);
+		s32Rate = AhrsFixed_Add(s32Rate, AhrsFixed_Sat(((int64_t)as32Err[i] * pstAhrs->s32KpQ16) >> 24));
+		s32Rate = AhrsFixed_Add(s32Rate, (pstAhrs->as32Integral[i] + (1 << 7)) >> 8);
+
+		// half the angle of the step: Q20 x Q32 is Q52, halved into Q31
+		as32Half[i] = AhrsFixed_Sat(((int64_t)s32Rate * u32DtQ32) >> 22);
+	}
+
+	// q + q x (0, half), all four from the old q
+	as32Q[0] = AhrsFixed_Sub(ps32Q[0], AhrsFixed_Add(AhrsFixed_Add(AhrsFixed_MulQ31(ps32Q[1], as32Half[0]),
+	                                                              AhrsFixed_MulQ31(ps32Q[2], as32Half[1])),
+	                                                 AhrsFixed_MulQ31(ps32Q[3], as32Half[2])));
+	as32Q[1] = AhrsFixed_Add(ps32Q[1], AhrsFixed_Sub(AhrsFixed_Add(AhrsFixed_MulQ31(ps32Q[0], as32Half[0]),
+	                                                              AhrsFixed_MulQ31(ps32Q[2], as32Half[2])),
+	                                                 AhrsFixed_MulQ31(ps32Q[3], as32Half[1])));
+	as32Q[2] = AhrsFixed_Add(ps32Q[2], AhrsFixed_Add(AhrsFixed_Sub(AhrsFixed_MulQ31(ps32Q[0], as32Half[1]),
+	                                                              AhrsFixed_MulQ31(ps32Q[1], as32Half[2])),
+	                                                 AhrsFixed_MulQ31(ps32Q[3], as32Half[0])));
+	as32Q[3] = AhrsFixed_Add(ps32Q[3], AhrsFixed_Sub(AhrsFixed_Add(AhrsFixed_MulQ31(ps32Q[0], as32Half[2]),
+	                                                              AhrsFixed_MulQ31(ps32Q[1], as32Half[1])),
+	                                                 AhrsFixed_MulQ31(ps32Q[2], as32Half[0])));
+
+	AhrsFixed_Normalize(as32Q);
+	for (i = 0; i < 4; i++)
+	{
+		ps32Q[i] = as32Q[i];
+	}
+}
+
+void AhrsFixed_QuatGet(const AHRS_ST_FIXED *pstAhrs, float *pfQ)
+{
+	uint8_t i;
+
+	for (i = 0; i < 4; i++)
+	{
+		pfQ[i] = pstAhrs->as32Q[i] * (1.0f / 2147483648.0f);
+	}
+}
+
+void AhrsFixed_QuatSet(AHRS_ST_FIXED *pstAhrs, const float *pfQ)
+{
+	uint8_t i;
+
+	for (i = 0; i < 4; i++)
+	{
+		pstAhrs->as32Q[i] = AhrsFixed_Sat((int64_t)(pfQ[i] * 2147483648.0f));
+	}
+	AhrsFixed_Normalize(pstAhrs->as32Q);
+}
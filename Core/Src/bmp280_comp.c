@@ -0,0 +1,121 @@
+#include "bmp280_comp.h"
+
+// Bosch BMP280 datasheet, section 3.11.3 and appendix 8.1/8.2
+
+float Bmp280Comp_Temperature64(BMP280_HandleTypeDef *pstCal, int32_t s32AdcT)
+{
+	int64_t var1, var2;
+
+	var1 = ((((s32AdcT >> 3) - ((int64_t)pstCal->T1 << 1))) * ((int64_t)pstCal->T2)) >> 11;
+	var2 = (((((s32AdcT >> 4) - ((int64_t)pstCal->T1)) * ((s32AdcT >> 4) - ((int64_t)pstCal->T1))) >> 12) *
+	        ((int64_t)pstCal->T3)) >> 14;
+	pstCal->T_fine = (int32_t)(var1 + var2);
+
+	return (float)((pstCal->T_fine * 5 + 128) >> 8);
+}
+
+float Bmp280Comp_Pressure64(const BMP280_HandleTypeDef *pstCal, int32_t s32AdcP)
+{
+	int64_t var1, var2, p;
+
+	var1 = ((int64_t)pstCal->T_fine) - 128000;
+	var2 = var1 * var1 * (int64_t)pstCal->P6;
+	var2 = var2 + ((var1 * (int64_t)pstCal->P5) << 17);
+	var2 = var2 + (((int64_t)pstCal->P4) << 35);
+	var1 = ((var1 * var1 * (int64_t)pstCal->P3) >> 8) + ((var1 * (int64_t)pstCal->P2) << 12);
+	var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)pstCal->P1) >> 33;
+
+	if (var1 == 0)
+	{
+		return 0; // avoid exception caused by division by zero
+	}
+
+	p = 1048576 - s32AdcP;
+	p = (((p << 31) - var2) * 3125) / var1;
+	var1 = (((int64_t)pstCal->P9) * (p >> 13) * (p >> 13)) >> 25;
+	var2 = (((int64_t)pstCal->P8) * p) >> 19;
+	p = ((p + var1 + var2) >> 8) + (((int64_t)pstCal->P7) << 4);
+
+	return (float)p / 256;
+}
+
+float Bmp280Comp_Temperature32(BMP280_HandleTypeDef *pstCal, int32_t s32AdcT)
+{
+	int32_t var1, var2;
+
+	var1 = ((((s32AdcT >> 3) - ((int32_t)pstCal->T1 << 1))) * ((int32_t)pstCal->T2)) >> 11;
+	var2 = (((((s32AdcT >> 4) - ((int32_t)pstCal->T1)) * ((s32AdcT >> 4) - ((int32_t)pstCal->T1))) >> 12) *
+	        ((int32_t)pstCal->T3)) >> 14;
+	pstCal->T_fine = var1 + var2;
+
+	return (float)((pstCal->T_fine * 5 + 128) >> 8);
+}
+
+float Bmp280Comp_Pressure32(const BMP280_HandleTypeDef *pstCal, int32_t s32AdcP)
+{
+	int32_t var1, var2;
+	uint32_t p;
+
+	var1 = (((int32_t)pstCal->T_fine) >> 1) - (int32_t)64000;
+	var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int32_t)pstCal->P6);
+	var2 = var2 + ((var1 * ((int32_t)pstCal->P5)) << 1);
+	var2 = (var2 >> 2) + (((int32_t)pstCal->P4) << 16);
+	var1 = (((pstCal->P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + ((((int32_t)pstCal->P2) * var1) >> 1)) >> 18;
+	var1 = ((((32768 + var1)) * ((int32_t)pstCal->P1)) >> 15);
+
+	if (var1 == 0)
+	{
+		return 0; // avoid exception caused by division by zero
+	}
+
+	p = (((uint32_t)(((int32_t)1048576) - s32AdcP) - (var2 >> 12))) * 3125;
+	if (p < 0x80000000)
+	{
+		p = (p << 1) / ((uint32_t)var1);
+	}
+	else
+	{
+		p = (p / (uint32_t)var1) * 2;
+	}
+	var1 = (((int32_t)pstCal->P9) * ((int32_t)(((p >> 3) * (p >> 3)) >> 13))) >> 12;
+	var2 = (((int32_t)(p >> 2)) * ((int32_t)pstCal->P8)) >> 13;
+	p = (uint32_t)((int32_t)p + ((var1 + var2 + pstCal->P7) >> 4));
+
+	return (float)p;
+}
+
+float Bmp280Comp_TemperatureF(BMP280_HandleTypeDef *pstCal, int32_t s32AdcT)
+{
+	float var1, var2;
+
+	var1 = ((float)s32AdcT / 16384.0f - (float)pstCal->T1 / 1024.0f) * (float)pstCal->T2;
+	var2 = ((float)s32AdcT / 131072.0f - (float)pstCal->T1 / 8192.0f);
+	var2 = var2 * var2 * (float)pstCal->T3;
+	pstCal->T_fine = (int32_t)(var1 + var2);
+
+	return (var1 + var2) / 51.2f;
+}
+
+float Bmp280Comp_PressureF(const BMP280_HandleTypeDef *pstCal, int32_t s32AdcP)
+{
+	float var1, var2, p;
+
+	var1 = (float)pstCal->T_fine / 2.0f - 64000.0f;
+	var2 = var1 * var1 * (float)pstCal->P6 / 32768.0f;
+	var2 = var2 + var1 * (float)pstCal->P5 * 2.0f;
+	var2 = var2 / 4.0f + (float)pstCal->P4 * 65536.0f;
+	var1 = ((float)pstCal->P3 * var1 * var1 / 524288.0f + (float)pstCal->P2 * var1) / 524288.0f;
+	var1 = (1.0f + var1 / 32768.0f) * (float)pstCal->P1;
+
+	if (var1 == 0.0f)
+	{
+		return 0; // avoid exception caused by division by zero
+	}
+
+	p = 1048576.0f - (float)s32AdcP;
+	p = (p - var2 / 4096.0f) * 6250.0f / var1;
+	var1 = (float)pstCal->P9 * p * p / 2147483648.0f;
+	var2 = p * (float)pstCal->P8 / 32768.0f;
+
+	return p + (var1 + var2 + (float)pstCal->P7) / 16.0f;
+}
@@ -0,0 +1,77 @@
+#include <cstring>
+#include "coning_integrator.h"
+#include "embedMath.h"
+
+using namespace matrix;
+
+ConingIntegrator::ConingIntegrator()
+{
+    reset();
+}
+
+void ConingIntegrator::reset(void)
+{
+    memset(_fAlpha, 0, sizeof(_fAlpha));
+    memset(_fBeta, 0, sizeof(_fBeta));
+    memset(_fLast, 0, sizeof(_fLast));
+    _fDt = 0.0f;
+    _u16Samples = 0;
+
+    return;
+}
+
+void ConingIntegrator::put(const float *pfGyro, float fDt)
+{
+    const Vector3f clDelta(pfGyro[0] * fDt, pfGyro[1] * fDt, pfGyro[2] * fDt);
+    Vector3f clAlpha(_fAlpha), clBeta(_fBeta);
+    const Vector3f clLast(_fLast);
+
+    clBeta += (clAlpha + clLast * (1.0f / 6.0f)).cross(clDelta) * 0.5f;
+    clAlpha += clDelta;
+
+    clAlpha.copyTo(_fAlpha);
+    clBeta.copyTo(_fBeta);
+    clDelta.copyTo(_fLast);
+    _fDt += fDt;
+    _u16Samples++;
+
+    return;
+}
+
+float ConingIntegrator::get(float *pfDeltaQ)
+{
+    float afAngle[3];
+    float fDt = _fDt;
+
+    deltaAngleGet(afAngle);
+    Quatf::expq(Vector3f(afAngle) * 0.5f).copyTo(pfDeltaQ);
+
+    memset(_fAlpha, 0, sizeof(_fAlpha));
+    memset(_fBeta, 0, sizeof(_fBeta));
+    _fDt = 0.0f;
+    _u16Samples = 0;
+
+    return fDt;
+}
+
+void ConingIntegrator::deltaAngleGet(float *pfAngle) const
+{
+    uint8_t i;
+
+    for (i = 0; i < 3; i++)
+    {
+        pfAngle[i] = _fAlpha[i] + _fBeta[i];
+    }
+
+    return;
+}
+
+float ConingIntegrator::dtGet(void) const
+{
+    return _fDt;
+}
+
+uint16_t ConingIntegrator::samplesGet(void) const
+{
+    return _u16Samples;
+}
@@ -0,0 +1,235 @@
+#include <math.h>
+#include <string.h>
+#include "dmp.h"
+
+#define DMP_HDR2_KNOWN  (DMP_HDR2_ACCEL_ACCURACY | DMP_HDR2_GYRO_ACCURACY | DMP_HDR2_CPASS_ACCURACY | \
+			 DMP_HDR2_FSYNC | DMP_HDR2_PICKUP | DMP_HDR2_BATCH_MODE | DMP_HDR2_ACT_RECOG | \
+			 DMP_HDR2_SECONDARY_ON_OFF)
+
+typedef struct
+{
+	uint16_t u16Bit;
+	uint8_t u8Len;
+} DMP_ST_FIELD;
+
+// payload bytes per header bit, in FIFO order
+static const DMP_ST_FIELD astHdrField[] =
+{
+	{DMP_HDR_ACCEL, 6},
+	{DMP_HDR_GYRO, 12},             /*<rate and the bias the DMP removed from it*/
+	{DMP_HDR_CPASS, 6},
+	{DMP_HDR_ALS, 8},
+	{DMP_HDR_QUAT6, 12},
+	{DMP_HDR_QUAT9, 14},
+	{DMP_HDR_PQUAT6, 6},
+	{DMP_HDR_GEOMAG, 14},
+	{DMP_HDR_PRESSURE, 6},
+	{DMP_HDR_GYRO_CALIBR, 12},
+	{DMP_HDR_CPASS_CALIBR, 12},
+	{DMP_HDR_STEP_DETECTOR, 4},
+};
+
+static const DMP_ST_FIELD astHdr2Field[] =
+{
+	{DMP_HDR2_ACCEL_ACCURACY, 2},
+	{DMP_HDR2_GYRO_ACCURACY, 2},
+	{DMP_HDR2_CPASS_ACCURACY, 2},
+	{DMP_HDR2_FSYNC, 2},
+	{DMP_HDR2_PICKUP, 2},
+	{DMP_HDR2_ACT_RECOG, 6},
+	{DMP_HDR2_SECONDARY_ON_OFF, 2},
+};
+
+#define DMP_FIELDS(a)   (sizeof(a) / sizeof((a)[0]))
+
+static uint16_t Dmp_Be16(const uint8_t *pu8Buf)
+{
+	return (uint16_t)((pu8Buf[0] << 8) | pu8Buf[1]);
+}
+
+static int32_t Dmp_Be32(const uint8_t *pu8Buf)
+{
+	return (int32_t)(((uint32_t)pu8Buf[0] << 24) | ((uint32_t)pu8Buf[1] << 16) | ((uint32_t)pu8Buf[2] << 8) | pu8Buf[3]);
+}
+
+static void Dmp_Be16Vec(const uint8_t *pu8Buf, int16_t *ps16Out, uint8_t u8Count)
+{
+	uint8_t i;
+
+	for (i = 0; i < u8Count; i++)
+	{
+		ps16Out[i] = (int16_t)Dmp_Be16(pu8Buf + 2 * i);
+	}
+}
+
+// bytes of the packet starting at pu8Buf, 0 while its headers are incomplete; a second header
+// with bits the table does not know means the stream lost its packet boundary
+uint16_t Dmp_PacketLen(const uint8_t *pu8Buf, uint16_t u16Len)
+{
+	uint16_t u16Header, u16Header2 = 0;
+	uint16_t u16PacketLen = DMP_HDR_LEN + DMP_FOOTER_LEN;
+	uint8_t i;
+
+	if (u16Len < DMP_HDR_LEN)
+	{
+		return 0;
+	}
+
+	u16Header = Dmp_Be16(pu8Buf);
+	if (u16Header & DMP_HDR_HEADER2)
+	{
+		if (u16Len < 2 * DMP_HDR_LEN)
+		{
+			return 0;
+		}
+
+		u16Header2 = Dmp_Be16(pu8Buf + DMP_HDR_LEN);
+		if (u16Header2 & ~DMP_HDR2_KNOWN)
+		{
+			return DMP_PACKET_INVALID;
+		}
+		u16PacketLen += DMP_HDR_LEN;
+	}
+
+	for (i = 0; i < DMP_FIELDS(astHdrField); i++)
+	{
+		if (u16Header & astHdrField[i].u16Bit)
+		{
+			u16PacketLen += astHdrField[i].u8Len;
+		}
+	}
+
+	for (i = 0; i < DMP_FIELDS(astHdr2Field); i++)
+	{
+		if (u16Header2 & astHdr2Field[i].u16Bit)
+		{
+			u16PacketLen += astHdr2Field[i].u8Len;
+		}
+	}
+
+	return u16PacketLen;
+}
+
+// returns the bytes consumed, 0 when the packet is not complete yet or DMP_PACKET_INVALID;
+// payloads this driver does not use are skipped
+uint16_t Dmp_PacketParse(const uint8_t *pu8Buf, uint16_t u16Len, DMP_ST_PACKET *pstPacket)
+{
+	uint16_t u16PacketLen = Dmp_PacketLen(pu8Buf, u16Len);
+	const uint8_t *pu8Field;
+	uint8_t i;
+
+	if (u16PacketLen == DMP_PACKET_INVALID)
+	{
+		return DMP_PACKET_INVALID;
+	}
+
+	if ((u16PacketLen == 0) || (u16PacketLen > u16Len))
+	{
+		return 0;
+	}
+
+	memset(pstPacket, 0, sizeof(*pstPacket));
+	pstPacket->u16Header = Dmp_Be16(pu8Buf);
+	pu8Field = pu8Buf + DMP_HDR_LEN;
+	if (pstPacket->u16Header & DMP_HDR_HEADER2)
+	{
+		pstPacket->u16Header2 = Dmp_Be16(pu8Field);
+		pu8Field += DMP_HDR_LEN;
+	}
+
+	for (i = 0; i < DMP_FIELDS(astHdrField); i++)
+	{
+		if ((pstPacket->u16Header & astHdrField[i].u16Bit) == 0)
+		{
+			continue;
+		}
+
+		switch (astHdrField[i].u16Bit)
+		{
+		case DMP_HDR_ACCEL:
+			Dmp_Be16Vec(pu8Field, pstPacket->as16Accel, 3);
+			break;
+		case DMP_HDR_GYRO:
+			Dmp_Be16Vec(pu8Field, pstPacket->as16Gyro, 3);
+			Dmp_Be16Vec(pu8Field + 6, pstPacket->as16GyroBias, 3);
+			break;
+		case DMP_HDR_CPASS:
+			Dmp_Be16Vec(pu8Field, pstPacket->as16Cpass, 3);
+			break;
+		case DMP_HDR_QUAT6:
+			pstPacket->as32Quat6[0] = Dmp_Be32(pu8Field);
+			pstPacket->as32Quat6[1] = Dmp_Be32(pu8Field + 4);
+			pstPacket->as32Quat6[2] = Dmp_Be32(pu8Field + 8);
+			break;
+		case DMP_HDR_QUAT9:
+			pstPacket->as32Quat9[0] = Dmp_Be32(pu8Field);
+			pstPacket->as32Quat9[1] = Dmp_Be32(pu8Field + 4);
+			pstPacket->as32Quat9[2] = Dmp_Be32(pu8Field + 8);
+			pstPacket->s16Quat9Accuracy = (int16_t)Dmp_Be16(pu8Field + 12);
+			break;
+		default:
+			break;
+		}
+		pu8Field += astHdrField[i].u8Len;
+	}
+
+	for (i = 0; i < DMP_FIELDS(astHdr2Field); i++)
+	{
+		if ((pstPacket->u16Header2 & astHdr2Field[i].u16Bit) == 0)
+		{
+			continue;
+		}
+
+		// accel, gyro and compass accuracy are the first three
+		if (i < 3)
+		{
+			pstPacket->au16Accuracy[i] = Dmp_Be16(pu8Field);
+		}
+		pu8Field += astHdr2Field[i].u8Len;
+	}
+
+	pstPacket->u16Footer = Dmp_Be16(pu8Field);
+
+	return u16PacketLen;
+}
+
+// w, x, y, z from the three Q30 components of a unit quaternion
+void Dmp_QuatFromQ30(const int32_t *ps32Q30, float *pfQuat)
+{
+	float fSum;
+	uint8_t i;
+
+	fSum = 0.0f;
+	for (i = 0; i < 3; i++)
+	{
+		pfQuat[i + 1] = ps32Q30[i] * (1.0f / DMP_Q30_ONE);
+		fSum += pfQuat[i + 1] * pfQuat[i + 1];
+	}
+
+	// rounding can take the vector part just past 1
+	pfQuat[0] = (fSum < 1.0f) ? sqrtf(1.0f - fSum) : 0.0f;
+}
+
+// DMP integration scale for the gyro, from the eMD driver: the sample period comes from the
+// divider and the internal oscillator, TIMEBASE_CORRECTION_PLL trims the latter in steps of
+// 15/1270 (sign and magnitude); the gyro level is 4 whatever the range, see GYRO_FULLSCALE
+uint32_t Dmp_GyroSf(uint8_t u8SmplrtDiv, uint8_t u8PllTrim)
+{
+	const uint64_t u64Magic = 264446880937391ULL;
+	const uint64_t u64MagicScale = 100000ULL;
+	uint32_t u32Osc;
+	uint64_t u64Sf;
+
+	if (u8PllTrim & 0x80)
+	{
+		u32Osc = 1270 - (u8PllTrim & 0x7F) * 15;
+	}
+	else
+	{
+		u32Osc = 1270 + u8PllTrim * 15;
+	}
+
+	u64Sf = u64Magic * (1u << 4) * (1u + u8SmplrtDiv) / u32Osc / u64MagicScale;
+
+	return (u64Sf > 0x7FFFFFFF) ? 0x7FFFFFFF : (uint32_t)u64Sf;
+}
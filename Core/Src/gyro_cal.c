@@ -0,0 +1,230 @@
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include "gyro_cal.h"
+
+#define GYRO_CAL_SLOT_LEN   ((uint32_t)sizeof(GYRO_CAL_ST_RECORD))
+
+_Static_assert(sizeof(GYRO_CAL_ST_RECORD) % 8 == 0, "record must be whole flash double-words");
+
+static uint8_t GyroCal_RecordValid(const GYRO_CAL_ST_RECORD *pstRecord)
+{
+	uint8_t i;
+
+	if (pstRecord->u32Magic != GYRO_CAL_RECORD_MAGIC || pstRecord->u16Version != GYRO_CAL_RECORD_VERSION)
+	{
+		return 0;
+	}
+
+	if (pstRecord->u32Crc != GyroCal_Crc32(pstRecord, offsetof(GYRO_CAL_ST_RECORD, u32Crc)))
+	{
+		return 0;
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		if (!isfinite(pstRecord->afBiasDps[i]) || fabsf(pstRecord->afBiasDps[i]) > GYRO_CAL_BIAS_MAX_DPS)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// records are appended until the page is full, the last valid one wins; a slot torn by a
+// reset during programming fails its CRC and is skipped
+static void GyroCal_Load(GYRO_CAL_ST_STATE *pstCal)
+{
+	GYRO_CAL_ST_RECORD stRecord;
+	uint32_t u32Slots = pstCal->pstNv->u32Size / GYRO_CAL_SLOT_LEN;
+	uint32_t i;
+
+	pstCal->u32Slot = u32Slots;
+
+	for (i = 0; i < u32Slots; i++)
+	{
+		if (!pstCal->pstNv->pfnRead(i * GYRO_CAL_SLOT_LEN, &stRecord, GYRO_CAL_SLOT_LEN))
+		{
+			return;
+		}
+
+		if (stRecord.u32Magic == 0xFFFFFFFFu)
+		{
+			// erased: everything from here on is free
+			pstCal->u32Slot = i;
+			return;
+		}
+
+		if (GyroCal_RecordValid(&stRecord))
+		{
+			memcpy(pstCal->afBiasDps, stRecord.afBiasDps, sizeof(pstCal->afBiasDps));
+			memcpy(pstCal->afSavedDps, stRecord.afBiasDps, sizeof(pstCal->afSavedDps));
+			pstCal->u16Seq = stRecord.u16Seq;
+			pstCal->u8Valid = 1;
+		}
+	}
+}
+
+void GyroCal_Init(GYRO_CAL_ST_STATE *pstCal, const GYRO_CAL_ST_NV *pstNv)
+{
+	memset(pstCal, 0, sizeof(*pstCal));
+	pstCal->pstNv = pstNv;
+	GyroCal_Restart(pstCal);
+
+	if (pstNv != NULL)
+	{
+		GyroCal_Load(pstCal);
+	}
+}
+
+void GyroCal_Restart(GYRO_CAL_ST_STATE *pstCal)
+{
+	GyroCal_WelfordReset(&pstCal->stGyro);
+	GyroCal_WelfordReset(&pstCal->stAccel);
+	pstCal->fTempSum = 0.0f;
+}
+
+// returns 1 when the window just completed was still and its mean became the bias
+uint8_t GyroCal_Update(GYRO_CAL_ST_STATE *pstCal, const float *pfGyroDps, const float *pfAccelG, float fTempC)
+{
+	uint8_t i, u8Still = 1, u8Moved = 0;
+
+	GyroCal_WelfordUpdate(&pstCal->stGyro, pfGyroDps);
+	GyroCal_WelfordUpdate(&pstCal->stAccel, pfAccelG);
+	pstCal->fTempSum += fTempC;
+
+	if (pstCal->stGyro.u16Count < GYRO_CAL_WINDOW)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		if (GyroCal_WelfordVar(&pstCal->stGyro, i) > GYRO_CAL_GYRO_VAR_MAX ||
+			GyroCal_WelfordVar(&pstCal->stAccel, i) > GYRO_CAL_ACCEL_VAR_MAX ||
+			fabsf(pstCal->stGyro.afMean[i]) > GYRO_CAL_BIAS_MAX_DPS)
+		{
+			u8Still = 0;
+		}
+	}
+
+	if (u8Still)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			pstCal->afBiasDps[i] = pstCal->stGyro.afMean[i];
+			u8Moved |= fabsf(pstCal->afBiasDps[i] - pstCal->afSavedDps[i]) > GYRO_CAL_SAVE_DELTA_DPS;
+		}
+		pstCal->fTempC = pstCal->fTempSum / pstCal->stGyro.u16Count;
+		pstCal->u8Valid = 1;
+		pstCal->u32Accepted++;
+
+		// limit flash wear: a bias that stays put is not written again
+		if (pstCal->u16Seq == 0 || u8Moved)
+		{
+			pstCal->u8SavePending = 1;
+		}
+	}
+	else
+	{
+		pstCal->u32Rejected++;
+	}
+
+	GyroCal_Restart(pstCal);
+
+	return u8Still;
+}
+
+// erasing stalls the CPU for ~22 ms, call from the main loop where that does not hurt;
+// returns 1 when a record was written
+uint8_t GyroCal_Save(GYRO_CAL_ST_STATE *pstCal)
+{
+	GYRO_CAL_ST_RECORD stRecord;
+	const GYRO_CAL_ST_NV *pstNv = pstCal->pstNv;
+	uint32_t u32Slots;
+
+	if (!pstCal->u8SavePending || pstNv == NULL)
+	{
+		return 0;
+	}
+
+	u32Slots = pstNv->u32Size / GYRO_CAL_SLOT_LEN;
+	if (pstCal->u32Slot >= u32Slots)
+	{
+		if (!pstNv->pfnErase())
+		{
+			return 0;
+		}
+		pstCal->u32Slot = 0;
+	}
+
+	memset(&stRecord, 0, sizeof(stRecord));
+	stRecord.u32Magic = GYRO_CAL_RECORD_MAGIC;
+	stRecord.u16Version = GYRO_CAL_RECORD_VERSION;
+	stRecord.u16Seq = (pstCal->u16Seq == UINT16_MAX) ? 1 : pstCal->u16Seq + 1;
+	memcpy(stRecord.afBiasDps, pstCal->afBiasDps, sizeof(stRecord.afBiasDps));
+	stRecord.u32Crc = GyroCal_Crc32(&stRecord, offsetof(GYRO_CAL_ST_RECORD, u32Crc));
+
+	// a failed slot may be half programmed, never reuse it
+	if (!pstNv->pfnProgram(pstCal->u32Slot++ * GYRO_CAL_SLOT_LEN, &stRecord, GYRO_CAL_SLOT_LEN))
+	{
+		return 0;
+	}
+
+	pstCal->u16Seq = stRecord.u16Seq;
+	memcpy(pstCal->afSavedDps, stRecord.afBiasDps, sizeof(pstCal->afSavedDps));
+	pstCal->u8SavePending = 0;
+	pstCal->u32Saves++;
+
+	return 1;
+}
+
+void GyroCal_WelfordReset(GYRO_CAL_ST_WELFORD *pstW)
+{
+	memset(pstW, 0, sizeof(*pstW));
+}
+
+void GyroCal_WelfordUpdate(GYRO_CAL_ST_WELFORD *pstW, const float *pfIn)
+{
+	uint8_t i;
+	float fDelta;
+
+	// windows are short, so the Kahan terms of WelfordMeanVector are not needed in float
+	pstW->u16Count++;
+	for (i = 0; i < 3; i++)
+	{
+		fDelta = pfIn[i] - pstW->afMean[i];
+		pstW->afMean[i] += fDelta / pstW->u16Count;
+		pstW->afM2[i] += fDelta * (pfIn[i] - pstW->afMean[i]);
+	}
+}
+
+float GyroCal_WelfordVar(const GYRO_CAL_ST_WELFORD *pstW, uint8_t u8Axis)
+{
+	if (pstW->u16Count < 2)
+	{
+		return 0.0f;
+	}
+
+	return pstW->afM2[u8Axis] / (pstW->u16Count - 1);
+}
+
+// CRC-32 (IEEE 802.3, reflected), bitwise: records are 20 bytes and rarely checked
+uint32_t GyroCal_Crc32(const void *pvData, uint32_t u32Len)
+{
+	const uint8_t *pu8Data = (const uint8_t *)pvData;
+	uint32_t u32Crc = 0xFFFFFFFFu;
+	uint8_t i;
+
+	while (u32Len--)
+	{
+		u32Crc ^= *pu8Data++;
+		for (i = 0; i < 8; i++)
+		{
+			u32Crc = (u32Crc >> 1) ^ (0xEDB88320u & (0u - (u32Crc & 1u)));
+		}
+	}
+
+	return ~u32Crc;
+}
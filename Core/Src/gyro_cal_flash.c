@@ -0,0 +1,64 @@
+#include <string.h>
+#include "main.h"
+#include "gyro_cal.h"
+
+// last 2 KB page of the 256 KB part, kept out of the FLASH region in the linker script
+#define GYRO_CAL_FLASH_PAGE     (127u)
+#define GYRO_CAL_FLASH_ADDR     (FLASH_BASE + GYRO_CAL_FLASH_PAGE * FLASH_PAGE_SIZE)
+
+static uint8_t GyroCalFlash_Read(uint32_t u32Offset, void *pvBuf, uint32_t u32Len)
+{
+	memcpy(pvBuf, (const void *)(GYRO_CAL_FLASH_ADDR + u32Offset), u32Len);
+
+	return 1;
+}
+
+// whole double-words only, the page must be erased there
+static uint8_t GyroCalFlash_Program(uint32_t u32Offset, const void *pvBuf, uint32_t u32Len)
+{
+	HAL_StatusTypeDef enStatus = HAL_OK;
+	uint64_t u64Word;
+	uint32_t i;
+
+	if ((u32Offset | u32Len) & 0x07u)
+	{
+		return 0;
+	}
+
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	for (i = 0; i < u32Len && enStatus == HAL_OK; i += 8)
+	{
+		memcpy(&u64Word, (const uint8_t *)pvBuf + i, sizeof(u64Word));
+		enStatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, GYRO_CAL_FLASH_ADDR + u32Offset + i, u64Word);
+	}
+	HAL_FLASH_Lock();
+
+	return enStatus == HAL_OK;
+}
+
+static uint8_t GyroCalFlash_Erase(void)
+{
+	FLASH_EraseInitTypeDef stErase;
+	uint32_t u32PageError = 0;
+	HAL_StatusTypeDef enStatus;
+
+	stErase.TypeErase = FLASH_TYPEERASE_PAGES;
+	stErase.Banks = FLASH_BANK_1;
+	stErase.Page = GYRO_CAL_FLASH_PAGE;
+	stErase.NbPages = 1;
+
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	enStatus = HAL_FLASHEx_Erase(&stErase, &u32PageError);
+	HAL_FLASH_Lock();
+
+	return enStatus == HAL_OK;
+}
+
+const GYRO_CAL_ST_NV gyroCalFlash = {
+	FLASH_PAGE_SIZE,
+	GyroCalFlash_Read,
+	GyroCalFlash_Program,
+	GyroCalFlash_Erase,
+};
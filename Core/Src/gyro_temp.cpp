@@ -0,0 +1,179 @@
+#include <cmath>
+#include <cstring>
+#include "gyro_temp.h"
+#include "embedMath.h"
+
+using namespace matrix;
+
+GyroTempModel::GyroTempModel()
+{
+    reset();
+}
+
+void GyroTempModel::reset(void)
+{
+    _u8Points = 0;
+    _u8Order = 0;
+    _bValid = false;
+    memset(_s16Table, 0, sizeof(_s16Table));
+
+    return;
+}
+
+void GyroTempModel::pointAdd(float fTempC, const float *pfBiasDps)
+{
+    uint8_t i, u8Slot = _u8Points;
+    float fDist, fBest = INFINITY;
+
+    // keep the temperature coverage: a full buffer gives up the point nearest the new one
+    for (i = 0; i < _u8Points; i++)
+    {
+        fDist = fabsf(_fPointTemp[i] - fTempC);
+        if (fDist < fBest)
+        {
+            fBest = fDist;
+            u8Slot = i;
+        }
+    }
+    if ((fBest >= POINT_MERGE_C) && (_u8Points < POINTS))
+    {
+        u8Slot = _u8Points++;
+    }
+
+    _fPointTemp[u8Slot] = fTempC;
+    for (i = 0; i < 3; i++)
+    {
+        _fPointBias[u8Slot][i] = pfBiasDps[i];
+    }
+
+    fit();
+
+    return;
+}
+
+// constant time: one clamped linear interpolation between table nodes
+void GyroTempModel::biasGet(float fTempC, float *pfBiasDps) const
+{
+    uint8_t i, u8Node;
+    float fPos = (fTempC - NODE_T0_C) * (1.0f / NODE_STEP_C);
+    float fFrac;
+
+    if (!(fPos > 0.0f))
+    {
+        fPos = 0.0f;
+    }
+    else if (fPos > NODES - 1)
+    {
+        fPos = NODES - 1;
+    }
+    u8Node = (uint8_t)fPos;
+    if (u8Node > NODES - 2)
+    {
+        u8Node = NODES - 2;
+    }
+    fFrac = fPos - u8Node;
+
+    for (i = 0; i < 3; i++)
+    {
+        pfBiasDps[i] = (_s16Table[u8Node][i] + fFrac * (_s16Table[u8Node + 1][i] - _s16Table[u8Node][i])) *
+                       TABLE_DPS_PER_LSB;
+    }
+
+    return;
+}
+
+bool GyroTempModel::valid(void) const
+{
+    return _bValid;
+}
+
+uint8_t GyroTempModel::pointsGet(void) const
+{
+    return _u8Points;
+}
+
+uint8_t GyroTempModel::orderGet(void) const
+{
+    return _u8Order;
+}
+
+void GyroTempModel::fit(void)
+{
+    uint8_t i;
+    float fTempMin = INFINITY, fTempMax = -INFINITY;
+
+    for (i = 0; i < _u8Points; i++)
+    {
+        fTempMin = fminf(fTempMin, _fPointTemp[i]);
+        fTempMax = fmaxf(fTempMax, _fPointTemp[i]);
+    }
+
+    // only fit what the points can support, a narrow span says nothing about the slope
+    if ((fTempMax - fTempMin >= SPAN_QUADRATIC_C) && (_u8Points >= 6))
+    {
+        fitOrder<3>(fTempMin, fTempMax);
+    }
+    else if ((fTempMax - fTempMin >= SPAN_LINEAR_C) && (_u8Points >= 3))
+    {
+        fitOrder<2>(fTempMin, fTempMax);
+    }
+    else
+    {
+        fitOrder<1>(fTempMin, fTempMax);
+    }
+
+    return;
+}
+
+// N coefficients in x = (T - REF_TEMP_C) / 10; unused rows stay zero and drop out of the fit
+template <size_t N>
+void GyroTempModel::fitOrder(float fTempMin, float fTempMax)
+{
+    uint8_t i, j, k;
+    Matrix<float, POINTS, N> A;
+    Vector<float, POINTS> b[3];
+    Vector<float, N> c[3];
+    float fX, fPow, fBias;
+
+    for (i = 0; i < _u8Points; i++)
+    {
+        fX = (_fPointTemp[i] - REF_TEMP_C) * 0.1f;
+        fPow = 1.0f;
+        for (j = 0; j < N; j++)
+        {
+            A(i, j) = fPow;
+            fPow *= fX;
+        }
+        for (k = 0; k < 3; k++)
+        {
+            b[k](i) = _fPointBias[i][k];
+        }
+    }
+
+    // one QR decomposition serves all three axes
+    LeastSquaresSolver<float, POINTS, N> qr(A);
+    for (k = 0; k < 3; k++)
+    {
+        c[k] = qr.solve(b[k]);
+    }
+
+    // outside the measured span the end values are held, a fit is not an extrapolation
+    for (i = 0; i < NODES; i++)
+    {
+        fX = (fminf(fmaxf(NODE_T0_C + i * NODE_STEP_C, fTempMin), fTempMax) - REF_TEMP_C) * 0.1f;
+        for (k = 0; k < 3; k++)
+        {
+            fBias = 0.0f;
+            for (j = N; j-- > 0;)
+            {
+                fBias = fBias * fX + c[k](j);
+            }
+            _s16Table[i][k] = (int16_t)lroundf(fminf(fmaxf(fBias / TABLE_DPS_PER_LSB, INT16_MIN), INT16_MAX));
+        }
+    }
+
+    _u8Order = N - 1;
+    _bValid = true;
+
+    return;
+}
@@ -0,0 +1,369 @@
+#include <string.h>
+#include "i2c_bus.h"
+#include "timestamp.h"
+
+I2C_BUS_ST_STATE i2c3Bus;
+
+static I2C_BUS_ST_STATE *apstBuses[I2C_BUS_MAX_BUSES];
+
+static I2C_BUS_ST_STATE *I2cBus_Find(I2C_HandleTypeDef *phi2c)
+{
+	uint8_t i;
+
+	for (i = 0; i < I2C_BUS_MAX_BUSES; i++)
+	{
+		if (apstBuses[i] != NULL && apstBuses[i]->phi2c == phi2c)
+		{
+			return apstBuses[i];
+		}
+	}
+
+	return NULL;
+}
+
+// the I2C kernel clock as configured in RCC->CCIPR, PCLK1 for all three on this board
+static uint32_t I2cBus_ClockHz(I2C_HandleTypeDef *phi2c)
+{
+	if (phi2c->Instance == I2C1)
+	{
+		return HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_I2C1);
+	}
+	if (phi2c->Instance == I2C2)
+	{
+		return HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_I2C2);
+	}
+
+	return HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_I2C3);
+}
+
+static uint32_t I2cBus_FmpBit(I2C_HandleTypeDef *phi2c)
+{
+	if (phi2c->Instance == I2C1)
+	{
+		return I2C_FASTMODEPLUS_I2C1;
+	}
+	if (phi2c->Instance == I2C2)
+	{
+		return I2C_FASTMODEPLUS_I2C2;
+	}
+
+	return I2C_FASTMODEPLUS_I2C3;
+}
+
+// the pins go back to the peripheral and it starts over from the settings in phi2c->Init,
+// which carry the TIMINGR of the current profile; the Fm+ drive in SYSCFG is untouched
+static void I2cBus_Reinit(I2C_BUS_ST_STATE *pstBus)
+{
+	HAL_GPIO_DeInit(pstBus->stPins.pstSclPort, pstBus->stPins.u16SclPin);
+	HAL_GPIO_DeInit(pstBus->stPins.pstSdaPort, pstBus->stPins.u16SdaPin);
+
+	pstBus->phi2c->Init.Timing = pstBus->u32Timingr;
+	HAL_I2C_Init(pstBus->phi2c);
+	HAL_I2CEx_ConfigAnalogFilter(pstBus->phi2c, I2C_ANALOGFILTER_ENABLE);
+	HAL_I2CEx_ConfigDigitalFilter(pstBus->phi2c, 0);
+
+	pstBus->u8Recover = I2C_BUS_REC_IDLE;
+}
+
+static void I2cBus_Line(I2C_BUS_ST_STATE *pstBus, uint8_t u8Scl, GPIO_PinState enState)
+{
+	if (u8Scl)
+	{
+		HAL_GPIO_WritePin(pstBus->stPins.pstSclPort, pstBus->stPins.u16SclPin, enState);
+	}
+	else
+	{
+		HAL_GPIO_WritePin(pstBus->stPins.pstSdaPort, pstBus->stPins.u16SdaPin, enState);
+	}
+	pstBus->u32RecoverStamp = Timestamp_Get();
+}
+
+// waits for the bus to go idle, at most the timeout of this transfer, and keeps the timing
+static HAL_StatusTypeDef I2cBus_Wait(I2C_BUS_ST_STATE *pstBus, uint32_t u32Start, uint16_t u16Len, uint8_t u8Read)
+{
+	I2C_BUS_ST_STATS *pstStats = &pstBus->stStats;
+	uint32_t u32TimeoutUs = I2cTiming_TimeoutUs(pstBus->u32SclHz, u16Len, u8Read);
+	uint32_t u32Us;
+
+	while (HAL_I2C_GetState(pstBus->phi2c) != HAL_I2C_STATE_READY)
+	{
+		if (Timestamp_ElapsedUs(u32Start) > u32TimeoutUs)
+		{
+			// a memory transfer cannot be aborted through the HAL, the recovery resets it
+			pstBus->u8Busy = 0;
+			pstStats->u32Timeouts++;
+			I2cBus_RecoverStart(pstBus);
+			return HAL_TIMEOUT;
+		}
+	}
+	u32Us = Timestamp_ElapsedUs(u32Start);
+	pstBus->u8Busy = 0;
+
+	if (pstBus->phi2c->ErrorCode != HAL_I2C_ERROR_NONE)
+	{
+		pstStats->u32Errors++;
+		return HAL_ERROR;
+	}
+
+	pstStats->u32Xfers++;
+	pstStats->u32LastUs = u32Us;
+	if (u32Us > pstStats->u32MaxUs)
+	{
+		pstStats->u32MaxUs = u32Us;
+	}
+	pstStats->u64SumUs += u32Us;
+	pstStats->u64WireSumUs += I2cTiming_XferUs(pstBus->u32SclHz, u16Len, u8Read);
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef I2cBus_Init(I2C_BUS_ST_STATE *pstBus, I2C_HandleTypeDef *phi2c, const I2C_BUS_ST_PINS *pstPins,
+			      const I2C_TIMING_ST_BUS *pstLines, I2C_TIMING_EN_SPEED enSpeed)
+{
+	uint8_t i;
+
+	memset(pstBus, 0, sizeof(*pstBus));
+	pstBus->phi2c = phi2c;
+	pstBus->stPins = *pstPins;
+	pstBus->stLines = *pstLines;
+	pstBus->u32Timingr = phi2c->Init.Timing;
+
+	for (i = 0; i < I2C_BUS_MAX_BUSES; i++)
+	{
+		if (apstBuses[i] == NULL || apstBuses[i] == pstBus)
+		{
+			apstBuses[i] = pstBus;
+			break;
+		}
+	}
+
+	return I2cBus_SpeedSet(pstBus, enSpeed);
+}
+
+// computes TIMINGR for the kernel clock in use and switches over between transfers; the
+// previous profile stays if the lines are too slow for the new one
+HAL_StatusTypeDef I2cBus_SpeedSet(I2C_BUS_ST_STATE *pstBus, I2C_TIMING_EN_SPEED enSpeed)
+{
+	I2C_HandleTypeDef *phi2c = pstBus->phi2c;
+	uint32_t u32ClkHz = I2cBus_ClockHz(phi2c);
+	uint32_t u32Timingr;
+
+	if ((pstBus->u8Recover != I2C_BUS_REC_IDLE) || (HAL_I2C_GetState(phi2c) != HAL_I2C_STATE_READY))
+	{
+		return HAL_BUSY;
+	}
+
+	if (!I2cTiming_Compute(u32ClkHz, enSpeed, &pstBus->stLines, &u32Timingr))
+	{
+		return HAL_ERROR;
+	}
+
+	// TIMINGR is only writable with PE clear
+	__HAL_I2C_DISABLE(phi2c);
+	phi2c->Instance->TIMINGR = u32Timingr;
+	phi2c->Init.Timing = u32Timingr;
+	if (enSpeed == I2C_TIMING_SPEED_1M)
+	{
+		HAL_I2CEx_EnableFastModePlus(I2cBus_FmpBit(phi2c));
+	}
+	else
+	{
+		HAL_I2CEx_DisableFastModePlus(I2cBus_FmpBit(phi2c));
+	}
+	__HAL_I2C_ENABLE(phi2c);
+
+	pstBus->u8Speed = enSpeed;
+	pstBus->u32ClkHz = u32ClkHz;
+	pstBus->u32Timingr = u32Timingr;
+	pstBus->u32SclHz = I2cTiming_SclHz(u32ClkHz, &pstBus->stLines, u32Timingr);
+
+	return HAL_OK;
+}
+
+// blocking register read with a deadline in microseconds, sized to the transfer: a hung
+// bus costs one timeout and starts the recovery instead of stalling for HAL_MAX_DELAY
+HAL_StatusTypeDef I2cBus_MemRead(I2C_BUS_ST_STATE *pstBus, uint16_t u16DevAddr, uint8_t u8Reg, uint8_t *pu8Buf, uint16_t u16Len)
+{
+	HAL_StatusTypeDef enStatus;
+	uint32_t u32Start;
+
+	if (pstBus->u8Recover != I2C_BUS_REC_IDLE)
+	{
+		return HAL_BUSY;
+	}
+
+	u32Start = Timestamp_Get();
+	pstBus->u8Busy = 1;
+	enStatus = HAL_I2C_Mem_Read_IT(pstBus->phi2c, u16DevAddr, u8Reg, I2C_MEMADD_SIZE_8BIT, pu8Buf, u16Len);
+	if (enStatus != HAL_OK)
+	{
+		pstBus->u8Busy = 0;
+		return enStatus;
+	}
+
+	return I2cBus_Wait(pstBus, u32Start, u16Len, 1);
+}
+
+HAL_StatusTypeDef I2cBus_MemWrite(I2C_BUS_ST_STATE *pstBus, uint16_t u16DevAddr, uint8_t u8Reg, const uint8_t *pu8Buf, uint16_t u16Len)
+{
+	HAL_StatusTypeDef enStatus;
+	uint32_t u32Start;
+
+	if (pstBus->u8Recover != I2C_BUS_REC_IDLE)
+	{
+		return HAL_BUSY;
+	}
+
+	u32Start = Timestamp_Get();
+	pstBus->u8Busy = 1;
+	enStatus = HAL_I2C_Mem_Write_IT(pstBus->phi2c, u16DevAddr, u8Reg, I2C_MEMADD_SIZE_8BIT, (uint8_t *)pu8Buf, u16Len);
+	if (enStatus != HAL_OK)
+	{
+		pstBus->u8Busy = 0;
+		return enStatus;
+	}
+
+	return I2cBus_Wait(pstBus, u32Start, u16Len, 0);
+}
+
+// a slave left holding SDA low in the middle of a byte: take the pins as open-drain GPIOs
+// and clock SCL until it lets go. Returns at once, I2cBus_RecoverPoll does the rest
+void I2cBus_RecoverStart(I2C_BUS_ST_STATE *pstBus)
+{
+	GPIO_InitTypeDef stGpio = {0};
+
+	if (pstBus->u8Recover != I2C_BUS_REC_IDLE)
+	{
+		return;
+	}
+
+	pstBus->stStats.u32Recoveries++;
+	HAL_I2C_DeInit(pstBus->phi2c);
+
+	// both lines released, the input stage still reads them
+	HAL_GPIO_WritePin(pstBus->stPins.pstSclPort, pstBus->stPins.u16SclPin, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(pstBus->stPins.pstSdaPort, pstBus->stPins.u16SdaPin, GPIO_PIN_SET);
+	stGpio.Mode = GPIO_MODE_OUTPUT_OD;
+	stGpio.Pull = GPIO_NOPULL;
+	stGpio.Speed = GPIO_SPEED_FREQ_LOW;
+	stGpio.Pin = pstBus->stPins.u16SclPin;
+	HAL_GPIO_Init(pstBus->stPins.pstSclPort, &stGpio);
+	stGpio.Pin = pstBus->stPins.u16SdaPin;
+	HAL_GPIO_Init(pstBus->stPins.pstSdaPort, &stGpio);
+
+	pstBus->u8Pulses = 0;
+	pstBus->u8Recover = I2C_BUS_REC_CLOCK_HIGH;
+	pstBus->u32RecoverStamp = Timestamp_Get();
+}
+
+// one line change per half period at most; 1 while the recovery runs, the bus is usable
+// again once it returns 0
+uint8_t I2cBus_RecoverPoll(I2C_BUS_ST_STATE *pstBus)
+{
+	uint32_t u32Us;
+
+	if (pstBus->u8Recover == I2C_BUS_REC_IDLE)
+	{
+		return 0;
+	}
+
+	u32Us = Timestamp_ElapsedUs(pstBus->u32RecoverStamp);
+	switch (pstBus->u8Recover)
+	{
+	case I2C_BUS_REC_CLOCK_HIGH:
+		// released but still low: a slave stretching the clock
+		if (HAL_GPIO_ReadPin(pstBus->stPins.pstSclPort, pstBus->stPins.u16SclPin) == GPIO_PIN_RESET)
+		{
+			if (u32Us > I2C_BUS_RECOVER_STRETCH_US)
+			{
+				pstBus->stStats.u32RecoverFails++;
+				I2cBus_Reinit(pstBus);
+			}
+			break;
+		}
+		if (u32Us < I2C_BUS_RECOVER_HALF_US)
+		{
+			break;
+		}
+		if (HAL_GPIO_ReadPin(pstBus->stPins.pstSdaPort, pstBus->stPins.u16SdaPin) == GPIO_PIN_SET)
+		{
+			I2cBus_Line(pstBus, 1, GPIO_PIN_RESET);
+			pstBus->u8Recover = I2C_BUS_REC_STOP_SCL_LOW;
+			break;
+		}
+		if (pstBus->u8Pulses >= I2C_BUS_RECOVER_PULSES)
+		{
+			pstBus->stStats.u32RecoverFails++;
+			I2cBus_Reinit(pstBus);
+			break;
+		}
+		I2cBus_Line(pstBus, 1, GPIO_PIN_RESET);
+		pstBus->u8Pulses++;
+		pstBus->u8Recover = I2C_BUS_REC_CLOCK_LOW;
+		break;
+
+	case I2C_BUS_REC_CLOCK_LOW:
+		if (u32Us >= I2C_BUS_RECOVER_HALF_US)
+		{
+			I2cBus_Line(pstBus, 1, GPIO_PIN_SET);
+			pstBus->u8Recover = I2C_BUS_REC_CLOCK_HIGH;
+		}
+		break;
+
+	case I2C_BUS_REC_STOP_SCL_LOW:
+		if (u32Us >= I2C_BUS_RECOVER_HALF_US)
+		{
+			I2cBus_Line(pstBus, 0, GPIO_PIN_RESET);
+			pstBus->u8Recover = I2C_BUS_REC_STOP_SDA_LOW;
+		}
+		break;
+
+	case I2C_BUS_REC_STOP_SDA_LOW:
+		if (u32Us >= I2C_BUS_RECOVER_HALF_US)
+		{
+			I2cBus_Line(pstBus, 1, GPIO_PIN_SET);
+			pstBus->u8Recover = I2C_BUS_REC_STOP_SCL_HIGH;
+		}
+		break;
+
+	case I2C_BUS_REC_STOP_SCL_HIGH:
+		if (u32Us >= I2C_BUS_RECOVER_HALF_US)
+		{
+			// SDA rising with SCL high
+			I2cBus_Line(pstBus, 0, GPIO_PIN_SET);
+			pstBus->u8Recover = I2C_BUS_REC_STOP_SDA_HIGH;
+		}
+		break;
+
+	case I2C_BUS_REC_STOP_SDA_HIGH:
+		if (u32Us >= I2C_BUS_RECOVER_HALF_US)
+		{
+			I2cBus_Reinit(pstBus);
+		}
+		break;
+
+	default:
+		I2cBus_Reinit(pstBus);
+		break;
+	}
+
+	return (pstBus->u8Recover != I2C_BUS_REC_IDLE) ? 1 : 0;
+}
+
+// achieved time per transfer; against u64WireSumUs it shows the gaps between the bytes
+uint32_t I2cBus_AvgUs(const I2C_BUS_ST_STATS *pstStats)
+{
+	if (pstStats->u32Xfers == 0)
+	{
+		return 0;
+	}
+
+	return (uint32_t)(pstStats->u64SumUs / pstStats->u32Xfers);
+}
+
+uint8_t I2cBus_RxCpltCallback(I2C_HandleTypeDef *phi2c)
+{
+	I2C_BUS_ST_STATE *pstBus = I2cBus_Find(phi2c);
+
+	return (pstBus != NULL && pstBus->u8Busy) ? 1 : 0;
+}
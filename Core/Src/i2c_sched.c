@@ -0,0 +1,294 @@
+#include "i2c_sched.h"
+#include "timestamp.h"
+
+I2C_SCHED_ST_BUS i2c3Sched;
+
+static I2C_SCHED_ST_BUS *apstBuses[I2C_SCHED_MAX_BUSES];
+
+// submit is called from thread context and from EXTI, completion from the I2C/DMA IRQ
+static uint32_t I2CSched_Lock(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+}
+
+static void I2CSched_Unlock(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
+
+static I2C_SCHED_ST_BUS *I2CSched_Find(I2C_HandleTypeDef *phi2c)
+{
+	uint8_t i;
+
+	for (i = 0; i < I2C_SCHED_MAX_BUSES; i++)
+	{
+		if (apstBuses[i] != NULL && apstBuses[i]->phi2c == phi2c)
+		{
+			return apstBuses[i];
+		}
+	}
+
+	return NULL;
+}
+
+static I2C_SCHED_ST_DEV_STATS *I2CSched_DevSlot(I2C_SCHED_ST_BUS *pstBus, uint16_t u16DevAddr, uint8_t u8Alloc)
+{
+	uint8_t i;
+
+	for (i = 0; i < I2C_SCHED_MAX_DEVS; i++)
+	{
+		if (pstBus->astDev[i].u16DevAddr == u16DevAddr)
+		{
+			return &pstBus->astDev[i];
+		}
+	}
+
+	if (u8Alloc)
+	{
+		for (i = 0; i < I2C_SCHED_MAX_DEVS; i++)
+		{
+			if (pstBus->astDev[i].u16DevAddr == 0)
+			{
+				pstBus->astDev[i].u16DevAddr = u16DevAddr;
+				return &pstBus->astDev[i];
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void I2CSched_Account(I2C_SCHED_ST_BUS *pstBus, const I2C_SCHED_ST_XFER *pstXfer, HAL_StatusTypeDef enStatus)
+{
+	I2C_SCHED_ST_DEV_STATS *pstDev;
+	uint32_t u32LatencyUs;
+
+	pstDev = I2CSched_DevSlot(pstBus, pstXfer->u16DevAddr, 0);
+	if (pstDev == NULL)
+	{
+		return;
+	}
+
+	if (enStatus != HAL_OK)
+	{
+		pstDev->u32Errors++;
+		return;
+	}
+
+	u32LatencyUs = Timestamp_ElapsedUs(pstXfer->u32Queued);
+	pstDev->u32Xfers++;
+	pstDev->u32Bytes += pstXfer->u16Len;
+	pstDev->u32BusUs += Timestamp_ElapsedUs(pstBus->u32Started);
+	pstDev->u32LatencyUs = u32LatencyUs;
+	pstDev->u64LatencySumUs += u32LatencyUs;
+
+	if (u32LatencyUs > pstDev->u32LatencyMaxUs)
+	{
+		pstDev->u32LatencyMaxUs = u32LatencyUs;
+	}
+}
+
+// called with interrupts masked; puts the highest-priority queued descriptor on the bus
+static void I2CSched_StartNext(I2C_SCHED_ST_BUS *pstBus)
+{
+	I2C_SCHED_ST_XFER *pstXfer = &pstBus->stActive;
+	HAL_StatusTypeDef enStatus;
+	uint8_t u8Prio;
+	uint8_t u8Tail;
+
+	while (!pstBus->u8Busy)
+	{
+		for (u8Prio = 0; u8Prio < I2C_SCHED_PRIO_NUM; u8Prio++)
+		{
+			if (pstBus->au8Head[u8Prio] != pstBus->au8Tail[u8Prio])
+			{
+				break;
+			}
+		}
+
+		if (u8Prio == I2C_SCHED_PRIO_NUM)
+		{
+			return;
+		}
+
+		u8Tail = pstBus->au8Tail[u8Prio];
+		*pstXfer = pstBus->astQueue[u8Prio][u8Tail];
+		pstBus->au8Tail[u8Prio] = (u8Tail + 1) & (I2C_SCHED_QUEUE_LEN - 1);
+
+		pstBus->u8Busy = 1;
+		pstBus->u32Started = Timestamp_Get();
+
+		if (pstXfer->u8Dir == I2C_SCHED_DIR_READ)
+		{
+			enStatus = HAL_I2C_Mem_Read_DMA(pstBus->phi2c, pstXfer->u16DevAddr, pstXfer->u8RegAddr,
+			                                I2C_MEMADD_SIZE_8BIT, pstXfer->pu8Buf, pstXfer->u16Len);
+		}
+		else
+		{
+			enStatus = HAL_I2C_Mem_Write_DMA(pstBus->phi2c, pstXfer->u16DevAddr, pstXfer->u8RegAddr,
+			                                 I2C_MEMADD_SIZE_8BIT, pstXfer->pu8Buf, pstXfer->u16Len);
+		}
+
+		if (enStatus != HAL_OK)
+		{
+			// never reached the bus: report it and move on to the next descriptor
+			pstBus->u8Busy = 0;
+			I2CSched_Account(pstBus, pstXfer, enStatus);
+			if (pstXfer->pfnCallback != NULL)
+			{
+				pstXfer->pfnCallback(pstXfer, enStatus);
+			}
+		}
+	}
+}
+
+static uint8_t I2CSched_Complete(I2C_HandleTypeDef *phi2c, HAL_StatusTypeDef enStatus)
+{
+	I2C_SCHED_ST_BUS *pstBus = I2CSched_Find(phi2c);
+	I2C_SCHED_ST_XFER stDone;
+	uint32_t primask;
+
+	if (pstBus == NULL || !pstBus->u8Busy)
+	{
+		return 0;
+	}
+
+	primask = I2CSched_Lock();
+	stDone = pstBus->stActive;
+	I2CSched_Account(pstBus, &stDone, enStatus);
+	pstBus->u8Busy = 0;
+	// chain the next transfer before running the callback to keep the bus gap short
+	I2CSched_StartNext(pstBus);
+	I2CSched_Unlock(primask);
+
+	if (stDone.pfnCallback != NULL)
+	{
+		stDone.pfnCallback(&stDone, enStatus);
+	}
+
+	return 1;
+}
+
+void I2CSched_Init(I2C_SCHED_ST_BUS *pstBus, I2C_HandleTypeDef *phi2c)
+{
+	uint8_t i;
+	uint8_t u8Free = I2C_SCHED_MAX_BUSES;
+
+	*pstBus = (I2C_SCHED_ST_BUS){0};
+	pstBus->phi2c = phi2c;
+
+	for (i = 0; i < I2C_SCHED_MAX_BUSES; i++)
+	{
+		if (apstBuses[i] == pstBus || (apstBuses[i] != NULL && apstBuses[i]->phi2c == phi2c))
+		{
+			apstBuses[i] = pstBus;
+			return;
+		}
+
+		if (apstBuses[i] == NULL && u8Free == I2C_SCHED_MAX_BUSES)
+		{
+			u8Free = i;
+		}
+	}
+
+	if (u8Free < I2C_SCHED_MAX_BUSES)
+	{
+		apstBuses[u8Free] = pstBus;
+	}
+}
+
+HAL_StatusTypeDef I2CSched_Submit(I2C_SCHED_ST_BUS *pstBus, const I2C_SCHED_ST_XFER *pstXfer)
+{
+	uint8_t u8Prio = pstXfer->u8Prio;
+	uint8_t u8Head;
+	uint32_t primask;
+
+	if (u8Prio >= I2C_SCHED_PRIO_NUM || pstXfer->pu8Buf == NULL || pstXfer->u16Len == 0)
+	{
+		return HAL_ERROR;
+	}
+
+	primask = I2CSched_Lock();
+
+	u8Head = pstBus->au8Head[u8Prio];
+	if (((u8Head + 1) & (I2C_SCHED_QUEUE_LEN - 1)) == pstBus->au8Tail[u8Prio])
+	{
+		pstBus->u32Rejected++;
+		I2CSched_Unlock(primask);
+		return HAL_BUSY;
+	}
+
+	I2CSched_DevSlot(pstBus, pstXfer->u16DevAddr, 1);
+
+	pstBus->astQueue[u8Prio][u8Head] = *pstXfer;
+	pstBus->astQueue[u8Prio][u8Head].u32Queued = Timestamp_Get();
+	pstBus->au8Head[u8Prio] = (u8Head + 1) & (I2C_SCHED_QUEUE_LEN - 1);
+
+	I2CSched_StartNext(pstBus);
+	I2CSched_Unlock(primask);
+
+	return HAL_OK;
+}
+
+// queued descriptors, not counting the one on the bus
+uint8_t I2CSched_Pending(const I2C_SCHED_ST_BUS *pstBus)
+{
+	uint8_t u8Prio;
+	uint8_t u8Count = 0;
+
+	for (u8Prio = 0; u8Prio < I2C_SCHED_PRIO_NUM; u8Prio++)
+	{
+		u8Count += (pstBus->au8Head[u8Prio] - pstBus->au8Tail[u8Prio]) & (I2C_SCHED_QUEUE_LEN - 1);
+	}
+
+	return u8Count;
+}
+
+const I2C_SCHED_ST_DEV_STATS *I2CSched_DevStatsGet(const I2C_SCHED_ST_BUS *pstBus, uint16_t u16DevAddr)
+{
+	uint8_t i;
+
+	for (i = 0; i < I2C_SCHED_MAX_DEVS; i++)
+	{
+		if (pstBus->astDev[i].u16DevAddr == u16DevAddr)
+		{
+			return &pstBus->astDev[i];
+		}
+	}
+
+	return NULL;
+}
+
+uint32_t I2CSched_LatencyAvgUs(const I2C_SCHED_ST_DEV_STATS *pstStats)
+{
+	if (pstStats->u32Xfers == 0)
+	{
+		return 0;
+	}
+
+	return (uint32_t)(pstStats->u64LatencySumUs / pstStats->u32Xfers);
+}
+
+uint8_t I2CSched_RxCpltCallback(I2C_HandleTypeDef *phi2c)
+{
+	return I2CSched_Complete(phi2c, HAL_OK);
+}
+
+uint8_t I2CSched_TxCpltCallback(I2C_HandleTypeDef *phi2c)
+{
+	return I2CSched_Complete(phi2c, HAL_OK);
+}
+
+uint8_t I2CSched_ErrorCallback(I2C_HandleTypeDef *phi2c)
+{
+	return I2CSched_Complete(phi2c, HAL_ERROR);
+}
+
+// HAL_I2C_MemRxCpltCallback and HAL_I2C_ErrorCallback live in icm20948.c and forward to
+// I2CSched_RxCpltCallback and I2CSched_ErrorCallback
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	I2CSched_TxCpltCallback(hi2c);
+}
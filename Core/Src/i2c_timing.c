@@ -0,0 +1,232 @@
+#include "i2c_timing.h"
+
+#define I2C_TIMING_PS_PER_NS        (1000ull)
+#define I2C_TIMING_PS_PER_S         (1000000000000ull)
+
+typedef struct
+{
+	uint32_t u32Hz;
+	uint16_t u16LowNs;              /*<tLOW min*/
+	uint16_t u16HighNs;             /*<tHIGH min*/
+	uint16_t u16SuDatNs;            /*<tSU;DAT min*/
+	uint16_t u16VdDatNs;            /*<tVD;DAT max*/
+	uint16_t u16RiseMaxNs;          /*<tr max*/
+	uint16_t u16FallMaxNs;          /*<tf max*/
+} I2C_TIMING_ST_SPEC;
+
+// UM10204 table 10
+static const I2C_TIMING_ST_SPEC astSpec[I2C_TIMING_SPEED_NUM] = {
+	{100000, 4700, 4000, 250, 3450, 1000, 300},
+	{400000, 1300, 600, 100, 900, 300, 300},
+	{1000000, 500, 260, 50, 450, 120, 120},
+};
+
+// u32Clocks kernel clock periods in ps
+static uint64_t I2cTiming_Ps(uint32_t u32ClkHz, uint32_t u32Clocks)
+{
+	return (uint64_t)u32Clocks * I2C_TIMING_PS_PER_S / u32ClkHz;
+}
+
+// edge, analog filter and the 2-clock synchronisation before the SCL counters start
+static uint64_t I2cTiming_SyncPs(uint32_t u32ClkHz, uint16_t u16EdgeNs)
+{
+	return (u16EdgeNs + I2C_TIMING_AF_MIN_NS) * I2C_TIMING_PS_PER_NS + I2cTiming_Ps(u32ClkHz, 2);
+}
+
+static uint64_t I2cTiming_LowPs(uint32_t u32ClkHz, const I2C_TIMING_ST_BUS *pstBus, uint32_t u32Presc, uint32_t u32Scll)
+{
+	return I2cTiming_Ps(u32ClkHz, (u32Scll + 1) * (u32Presc + 1)) + I2cTiming_SyncPs(u32ClkHz, pstBus->u16FallNs);
+}
+
+static uint64_t I2cTiming_HighPs(uint32_t u32ClkHz, const I2C_TIMING_ST_BUS *pstBus, uint32_t u32Presc, uint32_t u32Sclh)
+{
+	return I2cTiming_Ps(u32ClkHz, (u32Sclh + 1) * (u32Presc + 1)) + I2cTiming_SyncPs(u32ClkHz, pstBus->u16RiseNs);
+}
+
+// SDADEL and SCLDEL against the data hold and setup limits, I2C_TIMING_ERR_*
+static uint8_t I2cTiming_DataCheck(uint32_t u32ClkHz, const I2C_TIMING_ST_SPEC *pstSpec, const I2C_TIMING_ST_BUS *pstBus,
+				   uint32_t u32Presc, uint32_t u32Scldel, uint32_t u32Sdadel)
+{
+	uint64_t u64SdadelPs = I2cTiming_Ps(u32ClkHz, u32Sdadel * (u32Presc + 1));
+	uint8_t u8Err = 0;
+
+	if (I2cTiming_Ps(u32ClkHz, (u32Scldel + 1) * (u32Presc + 1)) <
+	    (uint64_t)(pstBus->u16RiseNs + pstSpec->u16SuDatNs) * I2C_TIMING_PS_PER_NS)
+	{
+		u8Err |= I2C_TIMING_ERR_SETUP;
+	}
+
+	// RM0394: tSDADEL >= tf - tAF(min) - 3 tI2CCLK, tHD;DAT(min) is 0
+	if (u64SdadelPs + I2C_TIMING_AF_MIN_NS * I2C_TIMING_PS_PER_NS + I2cTiming_Ps(u32ClkHz, 3) <
+	    pstBus->u16FallNs * I2C_TIMING_PS_PER_NS)
+	{
+		u8Err |= I2C_TIMING_ERR_HOLD;
+	}
+
+	// the controller drives SDA up to 3 clocks after SDADEL from its own SCL falling edge
+	if (u64SdadelPs + I2cTiming_Ps(u32ClkHz, 3) + pstBus->u16RiseNs * I2C_TIMING_PS_PER_NS >
+	    pstSpec->u16VdDatNs * I2C_TIMING_PS_PER_NS)
+	{
+		u8Err |= I2C_TIMING_ERR_VALID;
+	}
+
+	return u8Err;
+}
+
+// 1: *pu32Timingr holds the fastest setting at or below the nominal rate that meets every
+// limit of the mode on this bus, the smallest prescaler on a tie; 0: there is none
+uint8_t I2cTiming_Compute(uint32_t u32ClkHz, I2C_TIMING_EN_SPEED enSpeed, const I2C_TIMING_ST_BUS *pstBus, uint32_t *pu32Timingr)
+{
+	const I2C_TIMING_ST_SPEC *pstSpec;
+	uint64_t u64PeriodPs, u64SyncPs, u64StepPs, u64ErrPs, u64BestPs = UINT64_MAX;
+	uint32_t u32Presc, u32Scldel, u32Sdadel;
+	uint32_t u32Steps, u32Low, u32High, u32LowMin, u32HighMin;
+
+	if ((u32ClkHz == 0) || (enSpeed >= I2C_TIMING_SPEED_NUM))
+	{
+		return 0;
+	}
+
+	pstSpec = &astSpec[enSpeed];
+	if ((pstBus->u16RiseNs > pstSpec->u16RiseMaxNs) || (pstBus->u16FallNs > pstSpec->u16FallMaxNs))
+	{
+		return 0;
+	}
+
+	u64PeriodPs = I2C_TIMING_PS_PER_S / pstSpec->u32Hz;
+	u64SyncPs = I2cTiming_SyncPs(u32ClkHz, pstBus->u16FallNs) + I2cTiming_SyncPs(u32ClkHz, pstBus->u16RiseNs);
+	if (u64SyncPs >= u64PeriodPs)
+	{
+		return 0;
+	}
+
+	for (u32Presc = 0; u32Presc < 16; u32Presc++)
+	{
+		for (u32Scldel = 0; u32Scldel < 16; u32Scldel++)
+		{
+			if ((I2cTiming_DataCheck(u32ClkHz, pstSpec, pstBus, u32Presc, u32Scldel, 0) & I2C_TIMING_ERR_SETUP) == 0)
+			{
+				break;
+			}
+		}
+		for (u32Sdadel = 0; u32Sdadel < 16; u32Sdadel++)
+		{
+			if ((I2cTiming_DataCheck(u32ClkHz, pstSpec, pstBus, u32Presc, 0, u32Sdadel) & I2C_TIMING_ERR_HOLD) == 0)
+			{
+				break;
+			}
+		}
+		if ((u32Scldel == 16) || (u32Sdadel == 16) ||
+		    (I2cTiming_DataCheck(u32ClkHz, pstSpec, pstBus, u32Presc, u32Scldel, u32Sdadel) != 0))
+		{
+			continue;
+		}
+
+		// SCLL + 1 and SCLH + 1 prescaler steps, rounded up so the rate stays at or below
+		// nominal, split in the ratio of tLOW to tHIGH
+		u64StepPs = I2cTiming_Ps(u32ClkHz, u32Presc + 1);
+		u32Steps = (uint32_t)((u64PeriodPs - u64SyncPs + u64StepPs - 1) / u64StepPs);
+		u32LowMin = 1;
+		while (I2cTiming_LowPs(u32ClkHz, pstBus, u32Presc, u32LowMin - 1) < pstSpec->u16LowNs * I2C_TIMING_PS_PER_NS)
+		{
+			u32LowMin++;
+		}
+		u32HighMin = 1;
+		while (I2cTiming_HighPs(u32ClkHz, pstBus, u32Presc, u32HighMin - 1) < pstSpec->u16HighNs * I2C_TIMING_PS_PER_NS)
+		{
+			u32HighMin++;
+		}
+
+		u32Low = (u32Steps * pstSpec->u16LowNs + (pstSpec->u16LowNs + pstSpec->u16HighNs) / 2) /
+			 (pstSpec->u16LowNs + pstSpec->u16HighNs);
+		if (u32Low < u32LowMin)
+		{
+			u32Low = u32LowMin;
+		}
+		u32High = (u32Steps > u32Low) ? u32Steps - u32Low : 0;
+		if (u32High < u32HighMin)
+		{
+			u32High = u32HighMin;
+		}
+		if ((u32Low > 256) || (u32High > 256))
+		{
+			continue;
+		}
+
+		u64ErrPs = I2cTiming_Ps(u32ClkHz, (u32Low + u32High) * (u32Presc + 1)) + u64SyncPs - u64PeriodPs;
+		if (u64ErrPs < u64BestPs)
+		{
+			u64BestPs = u64ErrPs;
+			*pu32Timingr = I2C_TIMING(u32Presc, u32Scldel, u32Sdadel, u32High - 1, u32Low - 1);
+		}
+	}
+
+	return (u64BestPs != UINT64_MAX) ? 1 : 0;
+}
+
+// the limits of the mode u32Timingr violates on this bus, I2C_TIMING_ERR_*; 0: none
+uint8_t I2cTiming_Check(uint32_t u32ClkHz, I2C_TIMING_EN_SPEED enSpeed, const I2C_TIMING_ST_BUS *pstBus, uint32_t u32Timingr)
+{
+	const I2C_TIMING_ST_SPEC *pstSpec = &astSpec[enSpeed];
+	uint32_t u32Presc = (u32Timingr >> I2C_TIMING_PRESC_Pos) & 0xF;
+	uint8_t u8Err;
+
+	u8Err = I2cTiming_DataCheck(u32ClkHz, pstSpec, pstBus, u32Presc,
+				    (u32Timingr >> I2C_TIMING_SCLDEL_Pos) & 0xF, (u32Timingr >> I2C_TIMING_SDADEL_Pos) & 0xF);
+
+	if (I2cTiming_LowPs(u32ClkHz, pstBus, u32Presc, (u32Timingr >> I2C_TIMING_SCLL_Pos) & 0xFF) <
+	    pstSpec->u16LowNs * I2C_TIMING_PS_PER_NS)
+	{
+		u8Err |= I2C_TIMING_ERR_LOW;
+	}
+	if (I2cTiming_HighPs(u32ClkHz, pstBus, u32Presc, (u32Timingr >> I2C_TIMING_SCLH_Pos) & 0xFF) <
+	    pstSpec->u16HighNs * I2C_TIMING_PS_PER_NS)
+	{
+		u8Err |= I2C_TIMING_ERR_HIGH;
+	}
+	if ((pstBus->u16RiseNs > pstSpec->u16RiseMaxNs) || (pstBus->u16FallNs > pstSpec->u16FallMaxNs))
+	{
+		u8Err |= I2C_TIMING_ERR_BUS;
+	}
+
+	return u8Err;
+}
+
+// SCL rate u32Timingr gives on this bus, with the shortest filter delay
+uint32_t I2cTiming_SclHz(uint32_t u32ClkHz, const I2C_TIMING_ST_BUS *pstBus, uint32_t u32Timingr)
+{
+	uint32_t u32Presc = (u32Timingr >> I2C_TIMING_PRESC_Pos) & 0xF;
+	uint64_t u64PeriodPs;
+
+	u64PeriodPs = I2cTiming_LowPs(u32ClkHz, pstBus, u32Presc, (u32Timingr >> I2C_TIMING_SCLL_Pos) & 0xFF) +
+		      I2cTiming_HighPs(u32ClkHz, pstBus, u32Presc, (u32Timingr >> I2C_TIMING_SCLH_Pos) & 0xFF);
+
+	return (uint32_t)((I2C_TIMING_PS_PER_S + u64PeriodPs / 2) / u64PeriodPs);
+}
+
+uint32_t I2cTiming_SpeedHz(I2C_TIMING_EN_SPEED enSpeed)
+{
+	return (enSpeed < I2C_TIMING_SPEED_NUM) ? astSpec[enSpeed].u32Hz : 0;
+}
+
+// register access on the wire: START, address, register, (repeated START, address), payload,
+// 9 bits per byte, rounded up
+uint32_t I2cTiming_XferUs(uint32_t u32SclHz, uint16_t u16Len, uint8_t u8Read)
+{
+	uint64_t u64Bits = ((u8Read ? 3u : 2u) + (uint64_t)u16Len) * 9u;
+
+	if (u32SclHz == 0)
+	{
+		return 0;
+	}
+
+	return (uint32_t)((u64Bits * 1000000u + u32SclHz - 1) / u32SclHz);
+}
+
+// twice the wire time for clock stretching and arbitration, plus the fixed slack: long
+// enough that a healthy slave never hits it, short enough that a hung bus is caught
+// within a sample period
+uint32_t I2cTiming_TimeoutUs(uint32_t u32SclHz, uint16_t u16Len, uint8_t u8Read)
+{
+	return 2 * I2cTiming_XferUs(u32SclHz, u16Len, u8Read) + I2C_TIMING_SLACK_US;
+}
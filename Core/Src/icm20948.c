@@ -1,11 +1,17 @@
 #include "main.h"
 #include "i2c.h"
 #include "icm20948.h"
+#include "timestamp.h"
+#include "i2c_bus.h"
+#include "i2c_sched.h"
+#include "imu_redundant.h"
+#include "sample_buf.h"
 
 #ifndef I2C_TRANSMIT_MODE
 #define I2C_TRANSMIT_MODE (1)
 #endif
 
+// consumer copy of the last sample; the DMA modes fill imuSampleBuf instead
 uint8_t imuDataBuffer[12];
 uint8_t magDataBuffer[6];
 
@@ -23,6 +29,58 @@ int16_t Magn_Z_RAW = 0;
 
 float Ax, Ay, Az, Gx, Gy, Gz;
 
+// sensitivity per FS_SEL, datasheet table 1 and 2
+static const float gyroLsbPerDps[4] = {131.0f, 65.5f, 32.8f, 16.4f};
+static const float accelLsbPerG[4] = {16384.0f, 8192.0f, 4096.0f, 2048.0f};
+
+// data-ready edges and the sample in flight
+static volatile uint32_t imuIrqSeq = 0;
+static volatile uint32_t imuRxSeq = 0;
+static volatile uint32_t imuRxStamp = 0;
+// completed samples, handed to the main loop without masking interrupts
+static SAMPLE_ST_PINGPONG imuSampleBuf;
+// mode 4: a burst is queued on or occupying the shared bus
+static volatile uint8_t imuRxPending = 0;
+
+static void ICM20948_Sample_Cplt(const I2C_SCHED_ST_XFER *pstXfer, HAL_StatusTypeDef enStatus)
+{
+	(void)pstXfer;
+
+	if (enStatus == HAL_OK)
+	{
+		SampleBuf_Publish(&imuSampleBuf, imuRxSeq, imuRxStamp);
+	}
+	imuRxPending = 0;
+}
+
+static void ICM20948_Write(uint8_t u8Reg, uint8_t u8Data)
+{
+	I2cBus_MemWrite(&i2c3Bus, ADD_I2C_ICM20948, u8Reg, &u8Data, 1);
+}
+
+// mode 5: accel and gyro wake for each sample and batch into the FIFO, which only stops
+// when full (snapshot) so a late drain loses the newest samples rather than the alignment;
+// the watermark level is only reachable through the DMP, so the wake-up is timed from the
+// output rate and the FIFO overflow interrupt on INT1 is the backstop
+static void ICM20948_LowPower_Init(void)
+{
+	ICM20948_Write(ADD_REG_BANK_SEL, CMD_REG_BANK_2);
+	ICM20948_Write(ADD_GYRO_SMPLRT_DIV, ICM20948_LP_SMPLRT_DIV);
+	ICM20948_Write(ADD_ACCEL_SMPLRT_DIV_2, ICM20948_LP_SMPLRT_DIV);
+	ICM20948_Write(ADD_REG_BANK_SEL, CMD_REG_BANK_0);
+
+	ICM20948_Write(ADD_FIFO_EN_2, CMD_FIFO_ACCEL_GYRO);
+	ICM20948_Write(ADD_FIFO_MODE, CMD_FIFO_SNAPSHOT);
+	ICM20948_Write(ADD_FIFO_RST, CMD_FIFO_RESET);
+	ICM20948_Write(ADD_FIFO_RST, 0x00);
+	ICM20948_Write(ADD_USER_CTRL, CMD_FIFO_EN);
+
+	ICM20948_Write(ADD_INT_PIN_CFG, CMD_INT_ACTIVE_HIGH_PULSE);
+	ICM20948_Write(ADD_INT_ENABLE_2, CMD_FIFO_OVERFLOW_EN);
+
+	ICM20948_Write(ADD_LP_CONFIG, CMD_ACCEL_GYRO_CYCLE);
+	ICM20948_Write(ADD_PWR_MGMT_1, CMD_CLKSEL | CMD_LP_EN);
+}
 
 void ICM20948_Init(void)
 {
@@ -50,13 +108,13 @@ void ICM20948_Init(void)
 			Data = 0x04;
 			HAL_I2C_Mem_Write(&hi2c3, ADD_I2C_ICM20948, ADD_GYRO_SMPLRT_DIV, 1, &Data, 1, HAL_MAX_DELAY);
 			HAL_Delay(10);
-			Data = 0x05;
+			Data = (ICM20948_GYRO_FS_SEL << 1) | CMD_GYRO_DLPF_EN;
 			HAL_I2C_Mem_Write(&hi2c3, ADD_I2C_ICM20948, ADD_GYRO_CONFIG_1, 1, &Data, 1, HAL_MAX_DELAY);
 			HAL_Delay(10);
 			Data = 0x04;
 			HAL_I2C_Mem_Write(&hi2c3, ADD_I2C_ICM20948, ADD_ACCEL_SMPLRT_DIV_2, 1, &Data, 1, HAL_MAX_DELAY);
 			HAL_Delay(10);
-			Data = 0x01;
+			Data = (ICM20948_ACCEL_FS_SEL << 1) | CMD_ACCEL_DLPF_EN;
 			HAL_I2C_Mem_Write(&hi2c3, ADD_I2C_ICM20948, ADD_ACCEL_CONFIG, 1, &Data, 1, HAL_MAX_DELAY);
 			HAL_Delay(10);
 			Data = CMD_REG_BANK_0;
@@ -66,13 +124,79 @@ void ICM20948_Init(void)
 			HAL_I2C_Mem_Write(&hi2c3, ADD_I2C_SLV0_ADDR_WRITE, ADD_CNTL2, 1, &Data, 1, HAL_MAX_DELAY);
 			HAL_Delay(10);
 
+			SampleBuf_Init(&imuSampleBuf);
 			if (I2C_TRANSMIT_MODE == 1)
 			{
-				HAL_I2C_Mem_Read_IT(&hi2c3, ADD_I2C_ICM20948, ADD_ACCEL_XOUT_H, I2C_MEMADD_SIZE_8BIT, imuDataBuffer, 12);
+				imuRxStamp = Timestamp_Get();
+				HAL_I2C_Mem_Read_IT(&hi2c3, ADD_I2C_ICM20948, ADD_ACCEL_XOUT_H, I2C_MEMADD_SIZE_8BIT, SampleBuf_WriteBuf(&imuSampleBuf), SAMPLE_BUF_LEN);
 			}
 			if (I2C_TRANSMIT_MODE == 2)
 			{
-				HAL_I2C_Mem_Read_DMA(&hi2c3, ADD_I2C_ICM20948, ADD_ACCEL_XOUT_H, I2C_MEMADD_SIZE_8BIT, imuDataBuffer, 12);
+				imuRxStamp = Timestamp_Get();
+				HAL_I2C_Mem_Read_DMA(&hi2c3, ADD_I2C_ICM20948, ADD_ACCEL_XOUT_H, I2C_MEMADD_SIZE_8BIT, SampleBuf_WriteBuf(&imuSampleBuf), SAMPLE_BUF_LEN);
+			}
+			if (I2C_TRANSMIT_MODE == 4)
+			{
+				I2CSched_Init(&i2c3Sched, &hi2c3);
+			}
+			if (I2C_TRANSMIT_MODE == 5)
+			{
+				ICM20948_LowPower_Init();
+			}
+			if ((I2C_TRANSMIT_MODE == 3) || (I2C_TRANSMIT_MODE == 4))
+			{
+				// 50 us active-high pulse on INT1 for every new accel/gyro sample
+				Data = CMD_INT_ACTIVE_HIGH_PULSE;
+				HAL_I2C_Mem_Write(&hi2c3, ADD_I2C_ICM20948, ADD_INT_PIN_CFG, 1, &Data, 1, HAL_MAX_DELAY);
+				Data = CMD_RAW_DATA_0_RDY_EN;
+				HAL_I2C_Mem_Write(&hi2c3, ADD_I2C_ICM20948, ADD_INT_ENABLE_1, 1, &Data, 1, HAL_MAX_DELAY);
+			}
+		}
+	}
+}
+
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+	uint32_t stamp;
+
+	if ((I2C_TRANSMIT_MODE == 3) && (GPIO_Pin == IMU_INT_Pin))
+	{
+		stamp = Timestamp_Get();
+		imuIrqSeq++;
+
+		// HAL_BUSY means the previous burst is still on the bus; the sample is lost
+		// and shows up as a sequence gap at the consumer
+		if (HAL_I2C_Mem_Read_DMA(&hi2c3, ADD_I2C_ICM20948, ADD_ACCEL_XOUT_H, I2C_MEMADD_SIZE_8BIT, SampleBuf_WriteBuf(&imuSampleBuf), SAMPLE_BUF_LEN) == HAL_OK)
+		{
+			imuRxSeq = imuIrqSeq;
+			imuRxStamp = stamp;
+		}
+	}
+
+	if ((I2C_TRANSMIT_MODE == 4) && (GPIO_Pin == IMU_INT_Pin))
+	{
+		I2C_SCHED_ST_XFER stXfer = {
+			.u16DevAddr = ADD_I2C_ICM20948,
+			.u8RegAddr = ADD_ACCEL_XOUT_H,
+			.u8Dir = I2C_SCHED_DIR_READ,
+			.u16Len = SAMPLE_BUF_LEN,
+			.pu8Buf = SampleBuf_WriteBuf(&imuSampleBuf),
+			.u8Prio = I2C_SCHED_PRIO_HIGH,
+			.pfnCallback = ICM20948_Sample_Cplt,
+		};
+
+		stamp = Timestamp_Get();
+		imuIrqSeq++;
+
+		// the previous burst still owns the back buffer; the sample is lost as in mode 3
+		if (!imuRxPending)
+		{
+			imuRxPending = 1;
+			imuRxSeq = imuIrqSeq;
+			imuRxStamp = stamp;
+			if (I2CSched_Submit(&i2c3Sched, &stXfer) != HAL_OK)
+			{
+				imuRxPending = 0;
 			}
 		}
 	}
@@ -80,18 +204,67 @@ void ICM20948_Init(void)
 
 void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
 {
+	// transfers queued through i2c3Sched complete through their own callbacks, the ones of
+	// i2c3Bus are waited for where they were started; FIFO drains of the redundant IMUs go
+	// to their front end, on whichever bus they run
+	if (I2cBus_RxCpltCallback(hi2c) || I2CSched_RxCpltCallback(hi2c) || ImuRedundant_RxCpltCallback(hi2c))
+	{
+		return;
+	}
+
 	if (hi2c->Instance == I2C3)
 	{
+		if ((I2C_TRANSMIT_MODE == 1) || (I2C_TRANSMIT_MODE == 2))
+		{
+			// free-running: the next burst starts into the other buffer right after the swap
+			SampleBuf_Publish(&imuSampleBuf, ++imuRxSeq, imuRxStamp);
+			imuRxStamp = Timestamp_Get();
+		}
+
 		if (I2C_TRANSMIT_MODE == 1)
 		{
-			HAL_I2C_Mem_Read_IT(hi2c, ADD_I2C_ICM20948, ADD_ACCEL_XOUT_H, I2C_MEMADD_SIZE_8BIT, imuDataBuffer, 12);
+			HAL_I2C_Mem_Read_IT(hi2c, ADD_I2C_ICM20948, ADD_ACCEL_XOUT_H, I2C_MEMADD_SIZE_8BIT, SampleBuf_WriteBuf(&imuSampleBuf), SAMPLE_BUF_LEN);
 		}
 
 		if (I2C_TRANSMIT_MODE == 2)
 		{
-			HAL_I2C_Mem_Read_DMA(hi2c, ADD_I2C_ICM20948, ADD_ACCEL_XOUT_H, I2C_MEMADD_SIZE_8BIT, imuDataBuffer, 12);
+			HAL_I2C_Mem_Read_DMA(hi2c, ADD_I2C_ICM20948, ADD_ACCEL_XOUT_H, I2C_MEMADD_SIZE_8BIT, SampleBuf_WriteBuf(&imuSampleBuf), SAMPLE_BUF_LEN);
 		}
+
+		if (I2C_TRANSMIT_MODE == 3)
+		{
+			SampleBuf_Publish(&imuSampleBuf, imuRxSeq, imuRxStamp);
+		}
+	}
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	if (I2CSched_ErrorCallback(hi2c) == 0)
+	{
+		ImuRedundant_ErrorCallback(hi2c);
+	}
+}
+
+// copies the last completed sample into imuDataBuffer for ICM20948_Read_Accel/Gyro and
+// returns its sequence number (0: none yet) and capture time
+uint32_t ICM20948_Sample_Get(uint32_t *pu32Stamp)
+{
+	SAMPLE_ST_FRAME stFrame;
+	uint8_t i;
+
+	if (SampleBuf_Read(&imuSampleBuf, &stFrame) == 0)
+	{
+		return 0;
 	}
+
+	for (i = 0; i < SAMPLE_BUF_LEN; i++)
+	{
+		imuDataBuffer[i] = stFrame.au8Data[i];
+	}
+	*pu32Stamp = stFrame.u32Stamp;
+
+	return stFrame.u32Seq;
 }
 
 void ICM20948_Read_Accel(void)
@@ -100,9 +273,9 @@ void ICM20948_Read_Accel(void)
 	Accel_Y_RAW = (int16_t)(imuDataBuffer[2] << 8 | imuDataBuffer[3]);
 	Accel_Z_RAW = (int16_t)(imuDataBuffer[4] << 8 | imuDataBuffer[5]);
 
-	Ax = Accel_X_RAW / 16384.0;
-	Ay = Accel_Y_RAW / 16384.0;
-	Az = Accel_Z_RAW / 16384.0;
+	Ax = Accel_X_RAW / accelLsbPerG[ICM20948_ACCEL_FS_SEL];
+	Ay = Accel_Y_RAW / accelLsbPerG[ICM20948_ACCEL_FS_SEL];
+	Az = Accel_Z_RAW / accelLsbPerG[ICM20948_ACCEL_FS_SEL];
 }
 
 void ICM20948_Read_Gyro(void)
@@ -111,9 +284,9 @@ void ICM20948_Read_Gyro(void)
 	Gyro_Y_RAW = (int16_t)(imuDataBuffer[8] << 8 | imuDataBuffer[9]);
 	Gyro_Z_RAW = (int16_t)(imuDataBuffer[10] << 8 | imuDataBuffer[11]);
 
-	Gx = Gyro_X_RAW / 32.8;
-	Gy = Gyro_Y_RAW / 32.8;
-	Gz = Gyro_Z_RAW / 32.8;
+	Gx = Gyro_X_RAW / gyroLsbPerDps[ICM20948_GYRO_FS_SEL];
+	Gy = Gyro_Y_RAW / gyroLsbPerDps[ICM20948_GYRO_FS_SEL];
+	Gz = Gyro_Z_RAW / gyroLsbPerDps[ICM20948_GYRO_FS_SEL];
 }
 
 void ICM20948_Read_Accel_Polling(void)
@@ -136,3 +309,36 @@ void ICM20948_Read_Magn_Polling(void)
     Magn_Y_RAW = (magDataBuffer[3] << 8) | magDataBuffer[2];
     Magn_Z_RAW = (magDataBuffer[5] << 8) | magDataBuffer[4];
 }
+
+// mode 5: reads the whole frames waiting in the FIFO, up to u16Len bytes, in one blocking
+// burst and returns their number; a frame still being written stays for the next drain
+uint16_t ICM20948_Fifo_Drain(uint8_t *pu8Buf, uint16_t u16Len)
+{
+	uint8_t au8Count[2];
+	uint16_t u16Count;
+	uint16_t u16Frames;
+
+	if (I2cBus_MemRead(&i2c3Bus, ADD_I2C_ICM20948, ADD_FIFO_COUNTH, au8Count, 2) != HAL_OK)
+	{
+		return 0;
+	}
+
+	u16Count = (uint16_t)(((au8Count[0] & 0x1F) << 8) | au8Count[1]);
+	u16Frames = u16Count / ICM20948_FIFO_FRAME_LEN;
+	if (u16Frames > u16Len / ICM20948_FIFO_FRAME_LEN)
+	{
+		u16Frames = u16Len / ICM20948_FIFO_FRAME_LEN;
+	}
+
+	if (u16Frames == 0)
+	{
+		return 0;
+	}
+
+	if (I2cBus_MemRead(&i2c3Bus, ADD_I2C_ICM20948, ADD_FIFO_R_W, pu8Buf, u16Frames * ICM20948_FIFO_FRAME_LEN) != HAL_OK)
+	{
+		return 0;
+	}
+
+	return u16Frames;
+}
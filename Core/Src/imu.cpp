@@ -1,49 +1,151 @@
 #include <cmath>
+#include <cstring>
 #include "imu.h"
 #include "main.h"
 #include "i2c.h"
 #include "embedMath.h"
+#include "ahrs_filter.h"
+#include "timestamp.h"
 
 using namespace matrix;
 
 #define MAG_DATA_LEN 6
-// #define Kp 4.50f // proportional gain governs rate of convergence to accelerometer/magnetometer
-// #define Ki 1.00f // integral gain governs rate of convergence of gyroscope biases
-
-#define Kp 0.00f // proportional gain governs rate of convergence to accelerometer/magnetometer
-#define Ki 0.00f // integral gain governs rate of convergence of gyroscope biases
 
 #define rad2deg (180.0f / M_PI)
 #define deg2rad (M_PI / 180.0f)
 
-#define dig_T1 bmp280.T1
-#define dig_T2 bmp280.T2
-#define dig_T3 bmp280.T3
-#define dig_P1 bmp280.P1
-#define dig_P2 bmp280.P2
-#define dig_P3 bmp280.P3
-#define dig_P4 bmp280.P4
-#define dig_P5 bmp280.P5
-#define dig_P6 bmp280.P6
-#define dig_P7 bmp280.P7
-#define dig_P8 bmp280.P8
-#define dig_P9 bmp280.P9
-#define t_fine bmp280.T_fine
+#define dig_T1 _stBmp280.T1
+#define dig_T2 _stBmp280.T2
+#define dig_T3 _stBmp280.T3
+#define dig_P1 _stBmp280.P1
+#define dig_P2 _stBmp280.P2
+#define dig_P3 _stBmp280.P3
+#define dig_P4 _stBmp280.P4
+#define dig_P5 _stBmp280.P5
+#define dig_P6 _stBmp280.P6
+#define dig_P7 _stBmp280.P7
+#define dig_P8 _stBmp280.P8
+#define dig_P9 _stBmp280.P9
 #define MSLP 101325 // Mean Sea Level Pressure = 1013.25 hPA (1hPa = 100Pa = 1mbar)
 
-float angles[3];
-float q0, q1, q2, q3;
-IMU_ST_SENSOR_DATA gstGyroOffset = {0, 0, 0};
-BMP280_HandleTypeDef bmp280;
-int32_t gs32Pressure0 = MSLP;
+// gyro and accel output interval at a SMPLRT_DIV, 1.125 kHz internal rate
+#define FIFO_SAMPLE_US(div) (1000000u * (1u + (div)) / 1125u)
+
+static_assert(sizeof(ICM20948_ST_RAW_SAMPLE) == ICM20948::REG_LEN_ACCEL_GYRO,
+              "raw sample must mirror the ACCEL_XOUT_H..GYRO_ZOUT_L register block");
 
-ICM20948::ICM20948()
+template <class Transport>
+Icm20948Driver<Transport>::Icm20948Driver(const Transport &clBus) : _clBus(clBus)
 {
+    _fQ[0] = 1.0f;
+    _fQ[1] = 0.0f;
+    _fQ[2] = 0.0f;
+    _fQ[3] = 0.0f;
+    // the gains of the filters in ahrs_filter.h
+    _fKp = (float)AhrsGainsDefault::KP;
+    _fKi = (float)AhrsGainsDefault::KI;
+    _fErrInt[0] = 0.0f;
+    _fErrInt[1] = 0.0f;
+    _fErrInt[2] = 0.0f;
+    _bQFloatSet = false;
+#if AHRS_FUSION == 1
+    AhrsFixed_Init(&_stAhrsFixed, _fKp, _fKi);
+#endif
+    _stGyroOffset = {0, 0, 0};
+    memset(&_stBmp280, 0, sizeof(_stBmp280));
+    _s32Pressure0 = MSLP;
     _attInitialized = 0;
+    _enAcqMode = IMU_EN_ACQ_MODE_BURST;
+    _s16MagnRaw[0] = 0;
+    _s16MagnRaw[1] = 0;
+    _s16MagnRaw[2] = 0;
+
+    _u8FifoFrameLen = 0;
+    _u8FifoWatermark = 1;
+    _u8FifoBusy = 0;
+    _u16FifoRxLen = 0;
+    _u32FifoRxStamp = 0;
+    _u32FifoSampleUs = FIFO_SAMPLE_US(0);
+    _u8FifoHead = 0;
+    _u8FifoTail = 0;
+    _stFifoStats = {};
+    _bDmpEn = false;
+    _u8DmpPacketLen = 0;
+
+    _bRegCacheEn = true;
+    icm20948RegCacheReset(false);
+
+    memset(&_stAcq, 0, sizeof(_stAcq));
+    memset(_stStream, 0, sizeof(_stStream));
+    _u8StreamNew = 0;
+    _u8StreamFusedValid = 0;
+    memset(_u32StreamFused, 0, sizeof(_u32StreamFused));
+
+    _u32CorrUs = 0;
+    memset(_fCorrAccel, 0, sizeof(_fCorrAccel));
+    memset(_fCorrMagn, 0, sizeof(_fCorrMagn));
+    _bCorrAccel = false;
+    _bCorrMagn = false;
+
+    _bStampValid = false;
+    _u32LastStamp = 0;
+    _fDt = 0.0f;
+    SampleStats_DtReset(&_stDtStats);
+
+    // ranges icm20948init always used
+    _enGyroFs = IMU_EN_GYRO_FS_1000DPS;
+    _enAccelFs = IMU_EN_ACCEL_FS_2G;
+    _enGyroFsBase = _enGyroFs;
+    _enAccelFsBase = _enAccelFs;
+    _bAutoRange = false;
+    _s16GyroPeak = 0;
+    _s16AccelPeak = 0;
+    _u16GyroQuiet = 0;
+    _u16AccelQuiet = 0;
+    _u8GyroHoldoff = 0;
+    _u8AccelHoldoff = 0;
+    _u32RangeSwitches = 0;
+    memset(_stGyroAvg, 0, sizeof(_stGyroAvg));
+    memset(_stAccelAvg, 0, sizeof(_stAccelAvg));
+    memset(_stMagnAvg, 0, sizeof(_stMagnAvg));
+    GyroCal_Init(&_stGyroCal, NULL);
+    _enBiasMode = IMU_EN_BIAS_MODE_SOFTWARE;
+    memset(_fGyroBiasAppliedDps, 0, sizeof(_fGyroBiasAppliedDps));
+    memset(_fAccelBiasG, 0, sizeof(_fAccelBiasG));
+    _stAccelOffset = {0, 0, 0};
+    memset(_s16AccelTrim, 0, sizeof(_s16AccelTrim));
+    _bAccelTrimValid = false;
+    _bTempValid = false;
+    _fTempC = 0.0f;
+    _bTempComp = true;
+
+    // same settings bmp280Init always wrote as CTRL_MEAS 0xFF, CONFIG 0x14
+    _stBaroConfig.enTempOsrs = IMU_EN_BARO_OSRS_X16;
+    _stBaroConfig.enPressOsrs = IMU_EN_BARO_OSRS_X16;
+    _stBaroConfig.enMode = IMU_EN_BARO_MODE_NORMAL;
+    _stBaroConfig.enStandby = IMU_EN_BARO_STANDBY_0_5MS;
+    _stBaroConfig.enFilter = IMU_EN_BARO_FILTER_16;
+    _u32BaroDueTick = 0;
+    _s32BaroTemperature = 0;
+    _s32BaroPressure = 0;
+    memset(_stBaroAvg, 0, sizeof(_stBaroAvg));
 }
 
 // public
-void ICM20948::imuInit(IMU_EN_SENSOR_TYPE *penMotionSensorType, IMU_EN_SENSOR_TYPE *penPressureType)
+template <class Transport>
+typename Transport::Handle *Icm20948Driver<Transport>::imuBusGet(void) const
+{
+    return _clBus.busGet();
+}
+
+template <class Transport>
+Transport &Icm20948Driver<Transport>::imuTransportGet(void)
+{
+    return _clBus;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::imuInit(IMU_EN_SENSOR_TYPE *penMotionSensorType, IMU_EN_SENSOR_TYPE *penPressureType)
 {
     bool bRet = false;
 
@@ -69,620 +171,2620 @@ void ICM20948::imuInit(IMU_EN_SENSOR_TYPE *penMotionSensorType, IMU_EN_SENSOR_TY
         *penPressureType = IMU_EN_SENSOR_TYPE_NULL;
     }
 
-    q0 = 1.0f;
-    q1 = 0.0f;
-    q2 = 0.0f;
-    q3 = 0.0f;
+    _fQ[0] = 1.0f;
+    _fQ[1] = 0.0f;
+    _fQ[2] = 0.0f;
+    _fQ[3] = 0.0f;
+    _fErrInt[0] = 0.0f;
+    _fErrInt[1] = 0.0f;
+    _fErrInt[2] = 0.0f;
+    _attInitialized = 0;
+    _bQFloatSet = false;
+#if AHRS_FUSION == 1
+    AhrsFixed_Reset(&_stAhrsFixed);
+#endif
 
     return;
 }
 
-void ICM20948::imuDataGet(IMU_ST_ANGLES_DATA *pstAngles,
+template <class Transport>
+void Icm20948Driver<Transport>::imuDataGet(IMU_ST_ANGLES_DATA *pstAngles,
                           IMU_ST_SENSOR_DATA *pstGyroRawData,
                           IMU_ST_SENSOR_DATA *pstAcceRawData,
                           IMU_ST_SENSOR_DATA *pstMagnRawData)
 {
-    int16_t s16Gyro[3], s16Accel[3], s16Magn[3];
+    IMU_ST_SENSOR_DATA stGyro, stAccel;
+    int16_t s16Magn[3];
+    uint32_t u32Stamp, u32DtUs = 0;
+
+    // stamp at capture, so a late main loop does not stretch or shrink the fusion step
+    u32Stamp = Timestamp_Get();
+    if (_bStampValid)
+    {
+        u32DtUs = Timestamp_DeltaUs(_u32LastStamp, u32Stamp);
+        SampleStats_DtUpdate(&_stDtStats, u32DtUs);
+        u32DtUs = (u32DtUs > FUSION_DT_MAX_US) ? FUSION_DT_MAX_US : u32DtUs;
+        _fDt = u32DtUs * 1e-6f;
+    }
+    _u32LastStamp = u32Stamp;
+    _bStampValid = true;
 
-    icm20948AccelRead(&s16Accel[0], &s16Accel[1], &s16Accel[2]);
-    icm20948GyroRead(&s16Gyro[0], &s16Gyro[1], &s16Gyro[2]);
-    icm20948MagRead(&s16Magn[0], &s16Magn[1], &s16Magn[2]);
+    if (_enAcqMode == IMU_EN_ACQ_MODE_BURST_MAGN)
+    {
+        icm20948BurstMagRead(&stAccel, &stGyro, s16Magn);
+    }
+    else
+    {
+        icm20948AccelGyroRead(&stAccel, &stGyro);
+        icm20948MagRead(&s16Magn[0], &s16Magn[1], &s16Magn[2]);
+    }
 
     // adapt imu axis with board
     {
-        pstGyroRawData->s16Y = s16Gyro[0];
-        pstGyroRawData->s16X = -s16Gyro[1];
-        pstGyroRawData->s16Z = s16Gyro[2];
+        pstGyroRawData->s16Y = stGyro.s16X;
+        pstGyroRawData->s16X = -stGyro.s16Y;
+        pstGyroRawData->s16Z = stGyro.s16Z;
 
-        pstAcceRawData->s16Y = s16Accel[0];
-        pstAcceRawData->s16X = -s16Accel[1];
-        pstAcceRawData->s16Z = s16Accel[2];
+        pstAcceRawData->s16Y = stAccel.s16X;
+        pstAcceRawData->s16X = -stAccel.s16Y;
+        pstAcceRawData->s16Z = stAccel.s16Z;
 
         pstMagnRawData->s16Y = s16Magn[0];
         pstMagnRawData->s16X = -s16Magn[1];
         pstMagnRawData->s16Z = s16Magn[2];
     }
 
+    // accel and magnetometer are directions, their scale does not matter to the filter
+    float afAccel[3] = {(float)pstAcceRawData->s16X, (float)pstAcceRawData->s16Y, (float)pstAcceRawData->s16Z};
+    float afMagn[3] = {(float)pstMagnRawData->s16X, (float)pstMagnRawData->s16Y, (float)pstMagnRawData->s16Z};
+
+    // the first sample gives the attitude, the filter then only has to follow it
     if (_attInitialized == 0)
     {
-        // TODO: initialise quaternion
+        imuAHRSinit(afAccel, afMagn);
         _attInitialized = 1;
     }
 
     if (_attInitialized == 1)
     {
-        // s16Gyro / x -> (dps)     250dps: x=131   500dps: x=65.5  1000dps: x=32.8     2000dps: x=16.4
-        // s16Accel / x -> (g)      2g: x=16384     4g: x=8192      8g: x=4096          16g: x=2048
-        // s16Magn * 0.15 -> (uT)
-        imuAHRSupdate(pstGyroRawData->s16X * deg2rad / 32.8, pstGyroRawData->s16Y * deg2rad / 32.8, pstGyroRawData->s16Z * deg2rad / 32.8,
-                      pstAcceRawData->s16X / 16384.0, pstAcceRawData->s16Y / 16384.0, pstAcceRawData->s16Z / 16384.0,
-                      pstMagnRawData->s16X * 0.15, pstMagnRawData->s16Y * 0.15, pstMagnRawData->s16Z * 0.15);
+#if AHRS_FUSION == 1
+        // a float path has moved _fQ since the last step here, carry on from there instead of
+        // the older Q31 attitude
+        if (_bQFloatSet)
+        {
+            AhrsFixed_QuatSet(&_stAhrsFixed, _fQ);
+            _bQFloatSet = false;
+        }
+        // the raw samples as they are, only the gyro range matters
+        AhrsFixed_Update(&_stAhrsFixed, &pstGyroRawData->s16X, GYRO_SCALE_Q36[_enGyroFs],
+                         &pstAcceRawData->s16X, &pstMagnRawData->s16X, u32DtUs);
+        AhrsFixed_QuatGet(&_stAhrsFixed, _fQ);
+#else
+        // s16Gyro / GYRO_LSB_PER_DPS -> (dps), for the range in use
+        float fGyroScale = deg2rad / GYRO_LSB_PER_DPS[_enGyroFs];
+        float afGyro[3] = {pstGyroRawData->s16X * fGyroScale, pstGyroRawData->s16Y * fGyroScale, pstGyroRawData->s16Z * fGyroScale};
+
+        // the first sample only sets the stamp
+        if (_fDt > 0.0f)
+        {
+            imuAHRSstep(afGyro, afAccel, _fDt, afMagn, _fDt, _fDt);
+        }
+#endif
 
-        pstAngles->fPitch = asin(-2 * q1 * q3 + 2 * q0 * q2) * 57.3;                                // pitch
-        pstAngles->fRoll = atan2(2 * q2 * q3 + 2 * q0 * q1, -2 * q1 * q1 - 2 * q2 * q2 + 1) * 57.3; // roll
-        pstAngles->fYaw = atan2(-2 * q1 * q2 - 2 * q0 * q3, 2 * q2 * q2 + 2 * q3 * q3 - 1) * 57.3;  // yaw
+        imuAnglesFromQuat(pstAngles);
     }
 
-    return;
-}
-
-void ICM20948::pressSensorDataGet(int32_t *ps32Temperature, int32_t *ps32Pressure, int32_t *ps32Altitude)
-{
-    float CurPressure, CurTemperature;
-    int32_t CurAltitude;
-    static BMP280_AvgTypeDef BMP280_Filter[3];
-
-    bmp280TandPGet(&CurTemperature, &CurPressure);
-    bmp280CalAvgValue(&BMP280_Filter[0].Index, BMP280_Filter[0].AvgBuffer, (int32_t)(CurPressure), ps32Pressure);
-    bmp280CalculateAbsoluteAltitude(&CurAltitude, (*ps32Pressure));
-    bmp280CalAvgValue(&BMP280_Filter[1].Index, BMP280_Filter[1].AvgBuffer, CurAltitude, ps32Altitude);
-    bmp280CalAvgValue(&BMP280_Filter[2].Index, BMP280_Filter[2].AvgBuffer, (int32_t)CurTemperature, ps32Temperature);
+    // after the conversion above, so this sample is still scaled with the range it was taken in
+    icm20948GyroCalUpdate(&stAccel, &stGyro);
+    icm20948AutoRange();
 
     return;
 }
 
-// private
-uint8_t ICM20948::I2C_ReadOneByte(uint8_t DevAddr, uint8_t RegAddr)
+template <class Transport>
+void Icm20948Driver<Transport>::imuAcqModeSet(IMU_EN_ACQ_MODE enMode)
 {
-    uint8_t u8Ret[1] = {0};
-    HAL_I2C_Mem_Read(&hi2c3, DevAddr, RegAddr, I2C_MEMADD_SIZE_8BIT, u8Ret, 1, 1000);
+    if ((enMode >= IMU_EN_ACQ_MODE_MAX) || (enMode == _enAcqMode))
+    {
+        return;
+    }
 
-    return u8Ret[0];
+    // SLV0 is programmed once and then runs on its own at the sample rate
+    if (enMode == IMU_EN_ACQ_MODE_BURST_MAGN)
+    {
+        icm20948MagAutoReadInit();
+    }
+    else if (_enAcqMode == IMU_EN_ACQ_MODE_BURST_MAGN)
+    {
+        icm20948MagAutoReadStop();
+    }
+
+    _enAcqMode = enMode;
 }
 
-void ICM20948::I2C_WriteOneByte(uint8_t DevAddr, uint8_t RegAddr, uint8_t value)
+template <class Transport>
+IMU_EN_ACQ_MODE Icm20948Driver<Transport>::imuAcqModeGet(void) const
 {
-    uint8_t buf[2] = {0};
-    buf[0] = RegAddr;
-    buf[1] = value;
-    HAL_I2C_Master_Transmit(&hi2c3, DevAddr, buf, 2, 100);
+    return _enAcqMode;
 }
 
-void ICM20948::icm20948init(void)
+template <class Transport>
+void Icm20948Driver<Transport>::imuFifoInit(bool bWithMagn, uint8_t u8WatermarkFrames)
 {
-    /* user bank 0 register */
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_REG_BANK_SEL, REG_VAL_REG_BANK_0);
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_PWR_MIGMT_1, REG_VAL_ALL_RGE_RESET);
-    HAL_Delay(10);
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_PWR_MIGMT_1, REG_VAL_RUN_MODE);
+    _u8FifoFrameLen = REG_LEN_ACCEL_GYRO + (bWithMagn ? FIFO_MAGN_LEN : 0);
+    _u8FifoWatermark = (u8WatermarkFrames == 0) ? 1 : u8WatermarkFrames;
+    _u8FifoBusy = 0;
+    _u8FifoHead = 0;
+    _u8FifoTail = 0;
+    _stFifoStats = {};
+    _bDmpEn = false;
+    _u32FifoSampleUs = FIFO_SAMPLE_US(0);
 
     /* user bank 2 register */
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_REG_BANK_SEL, REG_VAL_REG_BANK_2);
-    // 1.1 kHz/(1+GYRO_SMPLRT_DIV[7:0]) = 220Hz
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_GYRO_SMPLRT_DIV, 0x04);
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_GYRO_CONFIG_1,
-                     REG_VAL_BIT_GYRO_DLPCFG_6 | REG_VAL_BIT_GYRO_FS_1000DPS | REG_VAL_BIT_GYRO_DLPF);
-    // 1.125 kHz/(1+ACCEL_SMPLRT_DIV[11:0]) = 225Hz
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_ACCEL_SMPLRT_DIV_2, 0x04);
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_ACCEL_CONFIG,
-                     REG_VAL_BIT_ACCEL_DLPCFG_6 | REG_VAL_BIT_ACCEL_FS_2g | REG_VAL_BIT_ACCEL_DLPF);
-
-    /* user bank 0 register */
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_REG_BANK_SEL, REG_VAL_REG_BANK_0);
-    HAL_Delay(100);
+    // run both sensors at full rate so every frame carries one accel and one gyro sample
+    // 1.1 kHz/(1+0) gyro, 1.125 kHz/(1+0) accel
+    icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_GYRO_SMPLRT_DIV, 0x00);
+    icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_ACCEL_SMPLRT_DIV_2, 0x00);
 
-    /* offset */
-    icm20948GyroOffset();
-    icm20948MagCheck();
-    icm20948WriteSecondary(I2C_ADD_ICM20948_AK09916 | I2C_ADD_ICM20948_AK09916_WRITE,
-                           REG_ADD_MAG_CNTL2, REG_VAL_MAG_MODE_20HZ);
-
-    return;
-}
-
-bool ICM20948::icm20948Check(void)
-{
-    bool bRet = false;
-    if (REG_VAL_WIA == I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_WIA))
+    if (bWithMagn)
     {
-        bRet = true;
+        icm20948MagAutoReadInit();
     }
 
-    return bRet;
-}
+    /* user bank 0 register */
+    icm20948RegModify(REG_VAL_REG_BANK_0, REG_ADD_USER_CTRL, REG_VAL_BIT_DMP_EN | REG_VAL_BIT_FIFO_EN, 0);
 
-bool ICM20948::icm20948MagCheck(void)
-{
-    bool bRet = false;
-    uint8_t u8Ret[2];
+    // frame layout: ACCEL_XOUT_H..GYRO_ZOUT_L followed by EXT_SENS_DATA of SLV0
+    icm20948RegWrite(REG_VAL_REG_BANK_0, REG_ADD_FIFO_EN_1, bWithMagn ? REG_VAL_BIT_SLV_0_FIFO_EN : 0x00);
+    icm20948RegWrite(REG_VAL_REG_BANK_0, REG_ADD_FIFO_EN_2,
+                     REG_VAL_BIT_ACCEL_FIFO_EN | REG_VAL_BIT_GYRO_X_FIFO_EN |
+                         REG_VAL_BIT_GYRO_Y_FIFO_EN | REG_VAL_BIT_GYRO_Z_FIFO_EN);
+    // snapshot: a full FIFO stops instead of overwriting, so the data in it stays frame aligned
+    icm20948RegWrite(REG_VAL_REG_BANK_0, REG_ADD_FIFO_MODE, REG_VAL_FIFO_MODE_SNAPSHOT);
+    icm20948FifoReset();
 
-    icm20948ReadSecondary(I2C_ADD_ICM20948_AK09916 | I2C_ADD_ICM20948_AK09916_READ,
-                          REG_ADD_MAG_WIA1, 2, u8Ret);
-    if ((u8Ret[0] == REG_VAL_MAG_WIA1) && (u8Ret[1] == REG_VAL_MAG_WIA2))
-    {
-        bRet = true;
-    }
+    icm20948RegModify(REG_VAL_REG_BANK_0, REG_ADD_USER_CTRL, 0,
+                      REG_VAL_BIT_FIFO_EN | (bWithMagn ? REG_VAL_BIT_I2C_MST_EN : 0));
 
-    return bRet;
+    return;
 }
 
-void ICM20948::icm20948GyroRead(int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z)
+// the sensors wake for each sample and sleep in between instead of running continuously;
+// with the fifo enabled the host can sleep too and drain a whole batch at once
+template <class Transport>
+void Icm20948Driver<Transport>::imuLowPowerSet(bool bEnable, uint8_t u8SmplrtDiv)
 {
-    uint8_t u8Buf[6];
-    int16_t s16Buf[3] = {0};
-    uint8_t i;
-    int32_t s32OutBuf[3] = {0};
-    static ICM20948_ST_AVG_DATA sstAvgBuf[3];
-    static int16_t ss16c = 0;
-    ss16c++;
-
-    u8Buf[0] = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_GYRO_XOUT_L);
-    u8Buf[1] = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_GYRO_XOUT_H);
-    s16Buf[0] = (u8Buf[1] << 8) | u8Buf[0];
+    uint8_t u8Cycle = 0;
 
-    u8Buf[0] = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_GYRO_YOUT_L);
-    u8Buf[1] = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_GYRO_YOUT_H);
-    s16Buf[1] = (u8Buf[1] << 8) | u8Buf[0];
+    _u32FifoSampleUs = FIFO_SAMPLE_US(bEnable ? u8SmplrtDiv : 0);
 
-    u8Buf[0] = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_GYRO_ZOUT_L);
-    u8Buf[1] = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_GYRO_ZOUT_H);
-    s16Buf[2] = (u8Buf[1] << 8) | u8Buf[0];
+    /* user bank 2 register */
+    icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_GYRO_SMPLRT_DIV, bEnable ? u8SmplrtDiv : 0x00);
+    icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_ACCEL_SMPLRT_DIV_2, bEnable ? u8SmplrtDiv : 0x00);
 
-    for (i = 0; i < 3; i++)
+    /* user bank 0 register */
+    if (bEnable)
     {
-        icm20948CalAvgValue(&sstAvgBuf[i].u8Index, sstAvgBuf[i].s16AvgBuffer, s16Buf[i], s32OutBuf + i);
+        u8Cycle = REG_VAL_BIT_ACCEL_CYCLE | REG_VAL_BIT_GYRO_CYCLE;
+        // the magnetometer reads of the I2C master follow the same duty cycle
+        if (icm20948RegRead(REG_VAL_REG_BANK_0, REG_ADD_USER_CTRL) & REG_VAL_BIT_I2C_MST_EN)
+        {
+            u8Cycle |= REG_VAL_BIT_I2C_MST_CYCLE;
+        }
     }
-    *ps16X = s32OutBuf[0] - gstGyroOffset.s16X;
-    *ps16Y = s32OutBuf[1] - gstGyroOffset.s16Y;
-    *ps16Z = s32OutBuf[2] - gstGyroOffset.s16Z;
+    icm20948RegWrite(REG_VAL_REG_BANK_0, REG_ADD_LP_CONFIG, u8Cycle);
+    icm20948RegModify(REG_VAL_REG_BANK_0, REG_ADD_PWR_MGMT_1, REG_VAL_BIT_LP_EN, bEnable ? REG_VAL_BIT_LP_EN : 0);
 
     return;
 }
 
-void ICM20948::icm20948AccelRead(int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z)
+template <class Transport>
+bool Icm20948Driver<Transport>::imuFifoPoll(void)
 {
-    uint8_t u8Buf[2];
-    int16_t s16Buf[3] = {0};
-    uint8_t i;
-    int32_t s32OutBuf[3] = {0};
-    static ICM20948_ST_AVG_DATA sstAvgBuf[3];
+    uint16_t u16Count;
+    uint16_t u16Frames;
 
-    u8Buf[0] = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_ACCEL_XOUT_L);
-    u8Buf[1] = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_ACCEL_XOUT_H);
-    s16Buf[0] = (u8Buf[1] << 8) | u8Buf[0];
-
-    u8Buf[0] = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_ACCEL_YOUT_L);
-    u8Buf[1] = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_ACCEL_YOUT_H);
-    s16Buf[1] = (u8Buf[1] << 8) | u8Buf[0];
-
-    u8Buf[0] = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_ACCEL_ZOUT_L);
-    u8Buf[1] = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_ACCEL_ZOUT_H);
-    s16Buf[2] = (u8Buf[1] << 8) | u8Buf[0];
-
-    for (i = 0; i < 3; i++)
+    if ((_u8FifoFrameLen == 0) || (_u8FifoBusy != 0))
     {
-        icm20948CalAvgValue(&sstAvgBuf[i].u8Index, sstAvgBuf[i].s16AvgBuffer, s16Buf[i], s32OutBuf + i);
+        return false;
     }
-    *ps16X = s32OutBuf[0];
-    *ps16Y = s32OutBuf[1];
-    *ps16Z = s32OutBuf[2];
 
-    return;
-}
+    u16Count = icm20948FifoCountGet();
+    _u32FifoRxStamp = Timestamp_Get();
 
-void ICM20948::icm20948MagRead(int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z)
-{
-    uint8_t counter = 20;
-    uint8_t u8Data[MAG_DATA_LEN];
-    int16_t s16Buf[3] = {0};
-    uint8_t i;
-    int32_t s32OutBuf[3] = {0};
-    static ICM20948_ST_AVG_DATA sstAvgBuf[3];
-    while (counter > 0)
+    // a full FIFO has taken all it could, the write that did not fit cut a frame short and
+    // the stream is no longer frame aligned; short of that, every frame in it is intact
+    if (u16Count >= FIFO_SIZE)
     {
-        HAL_Delay(10);
-        icm20948ReadSecondary(I2C_ADD_ICM20948_AK09916 | I2C_ADD_ICM20948_AK09916_READ,
-                              REG_ADD_MAG_ST2, 1, u8Data);
-
-        if ((u8Data[0] & 0x01) != 0)
-            break;
-
-        counter--;
+        icm20948FifoReset();
+        _stFifoStats.u32Overflows++;
+        return false;
     }
 
-    if (counter != 0)
+    u16Frames = u16Count / _u8FifoFrameLen;
+    if (u16Frames < _u8FifoWatermark)
     {
-        icm20948ReadSecondary(I2C_ADD_ICM20948_AK09916 | I2C_ADD_ICM20948_AK09916_READ,
-                              REG_ADD_MAG_DATA,
-                              MAG_DATA_LEN,
-                              u8Data);
-        s16Buf[0] = ((int16_t)u8Data[1] << 8) | u8Data[0];
-        s16Buf[1] = ((int16_t)u8Data[3] << 8) | u8Data[2];
-        s16Buf[2] = ((int16_t)u8Data[5] << 8) | u8Data[4];
+        return false;
     }
 
-    for (i = 0; i < 3; i++)
+    // whole frames only, a frame still being written stays in the FIFO for the next drain
+    _u16FifoRxLen = u16Frames * _u8FifoFrameLen;
+    _u8FifoBusy = 1;
+    icm20948BankSelect(REG_VAL_REG_BANK_0);
+    if (!_clBus.readStart(REG_ADD_FIFO_R_W, _u8FifoRxBuf, _u16FifoRxLen))
     {
-        icm20948CalAvgValue(&sstAvgBuf[i].u8Index, sstAvgBuf[i].s16AvgBuffer, s16Buf[i], s32OutBuf + i);
+        _u8FifoBusy = 0;
+        return false;
     }
+    _stFifoStats.u32Drains++;
 
-    *ps16X = s32OutBuf[0];
-    *ps16Y = -s32OutBuf[1];
-    *ps16Z = -s32OutBuf[2];
+    // a blocking transport has the frames already
+    if (!Transport::ASYNC)
+    {
+        imuFifoRxCplt();
+    }
 
-    return;
+    return true;
 }
 
-void ICM20948::icm20948ReadSecondary(uint8_t u8I2CAddr, uint8_t u8RegAddr, uint8_t u8Len, uint8_t *pu8data)
+template <class Transport>
+void Icm20948Driver<Transport>::imuFifoRxCplt(void)
 {
-    uint8_t i;
-    uint8_t u8Temp;
-
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_REG_BANK_SEL, REG_VAL_REG_BANK_3); // swtich bank3
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_I2C_SLV0_ADDR, u8I2CAddr);
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_I2C_SLV0_REG, u8RegAddr);
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_I2C_SLV0_CTRL, REG_VAL_BIT_SLV0_EN | u8Len);
+    if (_u8FifoBusy == 0)
+    {
+        return;
+    }
 
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_REG_BANK_SEL, REG_VAL_REG_BANK_0); // swtich bank0
+    _clBus.readDone();
+    icm20948FifoParse(_u8FifoRxBuf, _u16FifoRxLen);
+    _stFifoStats.u32Bytes += _u16FifoRxLen;
+    _u8FifoBusy = 0;
 
-    u8Temp = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_USER_CTRL);
-    u8Temp |= REG_VAL_BIT_I2C_MST_EN;
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_USER_CTRL, u8Temp);
-    HAL_Delay(5);
-    u8Temp &= ~REG_VAL_BIT_I2C_MST_EN;
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_USER_CTRL, u8Temp);
+    return;
+}
 
-    for (i = 0; i < u8Len; i++)
+// the frames of a failed drain are gone, the next drain starts on a frame boundary again
+template <class Transport>
+void Icm20948Driver<Transport>::imuFifoRxError(void)
+{
+    if (_u8FifoBusy == 0)
     {
-        *(pu8data + i) = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_EXT_SENS_DATA_00 + i);
+        return;
     }
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_REG_BANK_SEL, REG_VAL_REG_BANK_3); // swtich bank3
 
-    u8Temp = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_I2C_SLV0_CTRL);
-    u8Temp &= ~((REG_VAL_BIT_I2C_MST_EN) & (REG_VAL_BIT_MASK_LEN));
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_I2C_SLV0_CTRL, u8Temp);
+    _clBus.readDone();
+    _stFifoStats.u32Errors++;
+    _u8FifoBusy = 0;
 
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_REG_BANK_SEL, REG_VAL_REG_BANK_0); // swtich bank0
+    return;
 }
 
-void ICM20948::icm20948WriteSecondary(uint8_t u8I2CAddr, uint8_t u8RegAddr, uint8_t u8data)
+template <class Transport>
+bool Icm20948Driver<Transport>::imuFifoBusy(void) const
 {
-    uint8_t u8Temp;
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_REG_BANK_SEL, REG_VAL_REG_BANK_3); // swtich bank3
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_I2C_SLV1_ADDR, u8I2CAddr);
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_I2C_SLV1_REG, u8RegAddr);
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_I2C_SLV1_DO, u8data);
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_I2C_SLV1_CTRL, REG_VAL_BIT_SLV0_EN | 1);
-
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_REG_BANK_SEL, REG_VAL_REG_BANK_0); // swtich bank0
+    return _u8FifoBusy != 0;
+}
 
-    u8Temp = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_USER_CTRL);
-    u8Temp |= REG_VAL_BIT_I2C_MST_EN;
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_USER_CTRL, u8Temp);
-    HAL_Delay(5);
-    u8Temp &= ~REG_VAL_BIT_I2C_MST_EN;
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_USER_CTRL, u8Temp);
+template <class Transport>
+bool Icm20948Driver<Transport>::imuFifoRead(ICM20948_ST_FIFO_SAMPLE *pstSample)
+{
+    uint8_t u8Tail = _u8FifoTail;
 
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_REG_BANK_SEL, REG_VAL_REG_BANK_3); // swtich bank3
+    if (u8Tail == _u8FifoHead)
+    {
+        return false;
+    }
 
-    u8Temp = I2C_ReadOneByte(I2C_ADD_ICM20948, REG_ADD_I2C_SLV0_CTRL);
-    u8Temp &= ~((REG_VAL_BIT_I2C_MST_EN) & (REG_VAL_BIT_MASK_LEN));
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_I2C_SLV0_CTRL, u8Temp);
+    *pstSample = _stFifoQueue[u8Tail];
+    _u8FifoTail = (u8Tail + 1) & (FIFO_QUEUE_LEN - 1);
 
-    I2C_WriteOneByte(I2C_ADD_ICM20948, REG_ADD_REG_BANK_SEL, REG_VAL_REG_BANK_0); // swtich bank0
+    return true;
+}
 
-    return;
+template <class Transport>
+uint8_t Icm20948Driver<Transport>::imuFifoFrameLen(void) const
+{
+    return _u8FifoFrameLen;
 }
 
-void ICM20948::icm20948GyroOffset(void)
+/*
+ * Every stream at its own rate: the gyro and accel output data rates follow the plan, the
+ * magnetometer measures at the next AK09916 mode at least as fast and SLV0 copies it into
+ * EXT_SENS_DATA, the baro keeps its standby setting. imuStreamPoll() reads what is due.
+ */
+template <class Transport>
+void Icm20948Driver<Transport>::imuStreamInit(const ACQ_SCHED_ST_PLAN *pstPlanUs)
 {
+    ACQ_SCHED_ST_PLAN stPlan;
+    const uint32_t *pu32Us = pstPlanUs->au32Period;
+    uint64_t u64Div;
+    uint8_t u8MagMode;
     uint8_t i;
-    int16_t s16Gx = 0, s16Gy = 0, s16Gz = 0;
-    int32_t s32TempGx = 0, s32TempGy = 0, s32TempGz = 0;
-    for (i = 0; i < 32; i++)
+
+    /* user bank 2 register */
+    // 1.1 kHz/(1 + div) gyro, 1.125 kHz/(1 + div) accel, the nearest rate to the period
+    if (pu32Us[ACQ_SCHED_STREAM_GYRO] != 0)
+    {
+        u64Div = ((uint64_t)pu32Us[ACQ_SCHED_STREAM_GYRO] * 1100u + 500000u) / 1000000u;
+        u64Div = (u64Div == 0) ? 0 : u64Div - 1;
+        icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_GYRO_SMPLRT_DIV, (uint8_t)(u64Div > 0xFF ? 0xFF : u64Div));
+    }
+    if (pu32Us[ACQ_SCHED_STREAM_ACCEL] != 0)
+    {
+        u64Div = ((uint64_t)pu32Us[ACQ_SCHED_STREAM_ACCEL] * 1125u + 500000u) / 1000000u;
+        u64Div = (u64Div == 0) ? 0 : u64Div - 1;
+        icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_ACCEL_SMPLRT_DIV_2, (uint8_t)(u64Div > 0xFF ? 0xFF : u64Div));
+    }
+
+    if (pu32Us[ACQ_SCHED_STREAM_MAGN] != 0)
+    {
+        if (pu32Us[ACQ_SCHED_STREAM_MAGN] < 20000)
+        {
+            u8MagMode = REG_VAL_MAG_MODE_100HZ;
+        }
+        else if (pu32Us[ACQ_SCHED_STREAM_MAGN] < 50000)
+        {
+            u8MagMode = REG_VAL_MAG_MODE_50HZ;
+        }
+        else if (pu32Us[ACQ_SCHED_STREAM_MAGN] < 100000)
+        {
+            u8MagMode = REG_VAL_MAG_MODE_20HZ;
+        }
+        else
+        {
+            u8MagMode = REG_VAL_MAG_MODE_10HZ;
+        }
+        // the write goes through SLV1, SLV0 must be idle for it
+        if (_enAcqMode == IMU_EN_ACQ_MODE_BURST_MAGN)
+        {
+            icm20948MagAutoReadStop();
+        }
+        icm20948WriteSecondary(I2C_ADD_ICM20948_AK09916 | I2C_ADD_ICM20948_AK09916_WRITE, REG_ADD_MAG_CNTL2, u8MagMode);
+        icm20948MagAutoReadInit();
+        // imuDataGet() finds the magnetometer in EXT_SENS_DATA as well
+        _enAcqMode = IMU_EN_ACQ_MODE_BURST_MAGN;
+    }
+
+    stPlan = *pstPlanUs;
+    // polled twice per result: the poll before it is due costs no bus time, and the
+    // millisecond tick of pressSensorPoll() never makes the stream skip one
+    if (stPlan.au32Period[ACQ_SCHED_STREAM_BARO] != 0)
+    {
+        stPlan.au32Period[ACQ_SCHED_STREAM_BARO] = pressSensorPeriodMs() * 500u;
+    }
+    for (i = 0; i < ACQ_SCHED_STREAM_NUM; i++)
     {
-        icm20948GyroRead(&s16Gx, &s16Gy, &s16Gz);
-        s32TempGx += s16Gx;
-        s32TempGy += s16Gy;
-        s32TempGz += s16Gz;
-        HAL_Delay(30);
+        stPlan.au32Period[i] = Timestamp_UsToTicks(stPlan.au32Period[i]);
     }
-    gstGyroOffset.s16X = s32TempGx >> 5;
-    gstGyroOffset.s16Y = s32TempGy >> 5;
-    gstGyroOffset.s16Z = s32TempGz >> 5;
+
+    AcqSched_Init(&_stAcq, &stPlan, Timestamp_Get());
+    memset(_stStream, 0, sizeof(_stStream));
+    _u8StreamNew = 0;
+    _u8StreamFusedValid = 0;
 
     return;
 }
 
-void ICM20948::icm20948CalAvgValue(uint8_t *pIndex, int16_t *pAvgBuffer, int16_t InVal, int32_t *pOutVal)
+// reads the due streams, accel and gyro together in one burst; returns ACQ_SCHED_BIT of
+// the streams that have a new sample
+template <class Transport>
+uint8_t Icm20948Driver<Transport>::imuStreamPoll(void)
 {
-    uint8_t i;
+    const uint8_t u8Motion = ACQ_SCHED_BIT(ACQ_SCHED_STREAM_GYRO) | ACQ_SCHED_BIT(ACQ_SCHED_STREAM_ACCEL);
+    uint8_t u8Buf[REG_LEN_ACCEL_GYRO] = {0};
+    ICM20948_ST_RAW_SAMPLE stSample;
+    int16_t s16Magn[3];
+    const int32_t *ps32Last;
+    bool bDrdy;
+    uint32_t u32Now = Timestamp_Get();
+    uint8_t u8Due = AcqSched_Due(&_stAcq, u32Now);
+    uint8_t u8New = 0;
+
+    if (u8Due & u8Motion)
+    {
+        icm20948BankSelect(REG_VAL_REG_BANK_0);
+        if ((u8Due & u8Motion) == u8Motion)
+        {
+            busReadBytes(REG_ADD_ACCEL_XOUT_H, u8Buf, REG_LEN_ACCEL_GYRO);
+        }
+        else if (u8Due & ACQ_SCHED_BIT(ACQ_SCHED_STREAM_ACCEL))
+        {
+            busReadBytes(REG_ADD_ACCEL_XOUT_H, u8Buf, ACQ_SCHED_LEN_ACCEL);
+        }
+        else
+        {
+            busReadBytes(REG_ADD_GYRO_XOUT_H, u8Buf + ACQ_SCHED_LEN_ACCEL, ACQ_SCHED_LEN_GYRO);
+        }
+        icm20948SampleDecode(u8Buf, &stSample);
+
+        if (u8Due & ACQ_SCHED_BIT(ACQ_SCHED_STREAM_ACCEL))
+        {
+            icm20948StreamStore(ACQ_SCHED_STREAM_ACCEL, stSample.stAccel.s16X, stSample.stAccel.s16Y,
+                                stSample.stAccel.s16Z, u32Now);
+            u8New |= ACQ_SCHED_BIT(ACQ_SCHED_STREAM_ACCEL);
+        }
+        if (u8Due & ACQ_SCHED_BIT(ACQ_SCHED_STREAM_GYRO))
+        {
+            icm20948StreamStore(ACQ_SCHED_STREAM_GYRO, stSample.stGyro.s16X, stSample.stGyro.s16Y,
+                                stSample.stGyro.s16Z, u32Now);
+            u8New |= ACQ_SCHED_BIT(ACQ_SCHED_STREAM_GYRO);
+        }
+    }
 
-    *(pAvgBuffer + ((*pIndex)++)) = InVal;
-    *pIndex &= 0x07;
+    if (u8Due & ACQ_SCHED_BIT(ACQ_SCHED_STREAM_MAGN))
+    {
+        icm20948BankSelect(REG_VAL_REG_BANK_0);
+        busReadBytes(REG_ADD_EXT_SENS_DATA_00, u8Buf, REG_LEN_MAG_AUTO);
+
+        // SLV0 reads ST1..ST2 at the gyro rate and that read releases DRDY: between two
+        // measurements EXT_SENS_DATA keeps the last one with DRDY clear, so a measurement
+        // is new when DRDY is set or the data has changed
+        bDrdy = (u8Buf[0] & REG_VAL_BIT_MAG_DRDY) != 0;
+        u8Buf[0] |= REG_VAL_BIT_MAG_DRDY;
+        ps32Last = _stStream[ACQ_SCHED_STREAM_MAGN].as32Val;
+        if (icm20948MagDecode(u8Buf, s16Magn) &&
+            (bDrdy || (_stStream[ACQ_SCHED_STREAM_MAGN].u32Seq == 0) ||
+             (s16Magn[0] != ps32Last[0]) || (s16Magn[1] != ps32Last[1]) || (s16Magn[2] != ps32Last[2])))
+        {
+            icm20948StreamStore(ACQ_SCHED_STREAM_MAGN, s16Magn[0], s16Magn[1], s16Magn[2], u32Now);
+            u8New |= ACQ_SCHED_BIT(ACQ_SCHED_STREAM_MAGN);
+        }
+    }
 
-    *pOutVal = 0;
-    for (i = 0; i < 8; i++)
+    if ((u8Due & ACQ_SCHED_BIT(ACQ_SCHED_STREAM_BARO)) && pressSensorPoll())
     {
-        *pOutVal += *(pAvgBuffer + i);
+        icm20948StreamStore(ACQ_SCHED_STREAM_BARO, _s32BaroPressure, _s32BaroTemperature, 0, u32Now);
+        u8New |= ACQ_SCHED_BIT(ACQ_SCHED_STREAM_BARO);
     }
-    *pOutVal >>= 3;
+
+    return u8New;
 }
 
-void ICM20948::imuAHRSupdate(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz)
+// false when the stream has nothing new since the last read
+template <class Transport>
+bool Icm20948Driver<Transport>::imuStreamRead(ACQ_SCHED_EN_STREAM enStream, IMU_ST_STREAM_SAMPLE *pstSample)
 {
-    float norm;
-    float hx, hy, hz, bx, bz;
-    float vx, vy, vz, wx, wy, wz;
-    float exInt = 0.0, eyInt = 0.0, ezInt = 0.0;
-    float ex, ey, ez, halfT = 0.024f;
-
-    float q0q0 = q0 * q0;
-    float q0q1 = q0 * q1;
-    float q0q2 = q0 * q2;
-    float q0q3 = q0 * q3;
-    float q1q1 = q1 * q1;
-    float q1q2 = q1 * q2;
-    float q1q3 = q1 * q3;
-    float q2q2 = q2 * q2;
-    float q2q3 = q2 * q3;
-    float q3q3 = q3 * q3;
+    if ((enStream >= ACQ_SCHED_STREAM_NUM) || ((_u8StreamNew & ACQ_SCHED_BIT(enStream)) == 0))
+    {
+        return false;
+    }
 
-    norm = invSqrt(ax * ax + ay * ay + az * az);
-    ax = ax * norm;
-    ay = ay * norm;
-    az = az * norm;
+    *pstSample = _stStream[enStream];
+    _u8StreamNew &= ~ACQ_SCHED_BIT(enStream);
 
-    norm = invSqrt(mx * mx + my * my + mz * mz);
-    mx = mx * norm;
-    my = my * norm;
-    mz = mz * norm;
+    return true;
+}
 
-    // compute reference direction of flux
-    hx = 2 * mx * (0.5f - q2q2 - q3q3) + 2 * my * (q1q2 - q0q3) + 2 * mz * (q1q3 + q0q2);
-    hy = 2 * mx * (q1q2 + q0q3) + 2 * my * (0.5f - q1q1 - q3q3) + 2 * mz * (q2q3 - q0q1);
-    hz = 2 * mx * (q1q3 - q0q2) + 2 * my * (q2q3 + q0q1) + 2 * mz * (0.5f - q1q1 - q2q2);
-    bx = sqrt((hx * hx) + (hy * hy));
-    bz = hz;
+/*
+ * One fusion step per new gyro sample, dt from the gyro stamps. Accel and magnetometer
+ * correct the attitude only with a new sample, weighted by the time since the one before,
+ * so a slow stream pulls as hard per second as a fast one. With a correction period set,
+ * the gyro sample only goes into the integrator and the correction runs once per period.
+ * The gyro bias calibration and auto-ranging stay with imuDataGet(). Returns true when the
+ * angles are new.
+ */
+template <class Transport>
+bool Icm20948Driver<Transport>::imuStreamUpdate(IMU_ST_ANGLES_DATA *pstAngles)
+{
+    IMU_ST_STREAM_SAMPLE stSample;
+    float afGyro[3], afAccel[3], afMagn[3];
+    float fAccelDt = 0.0f, fMagnDt = 0.0f;
+    bool bAccel = false, bMagn = false;
+    uint32_t u32DtUs;
+    float fScale;
+
+    if (!imuStreamRead(ACQ_SCHED_STREAM_GYRO, &stSample))
+    {
+        return false;
+    }
 
-    // estimated direction of gravity and flux (v and w)
-    vx = 2 * (q1q3 - q0q2);
-    vy = 2 * (q0q1 + q2q3);
-    vz = q0q0 - q1q1 - q2q2 + q3q3;
-    wx = 2 * bx * (0.5 - q2q2 - q3q3) + 2 * bz * (q1q3 - q0q2);
-    wy = 2 * bx * (q1q2 - q0q3) + 2 * bz * (q0q1 + q2q3);
-    wz = 2 * bx * (q0q2 + q1q3) + 2 * bz * (0.5 - q1q1 - q2q2);
+    u32DtUs = icm20948StreamDtUs(ACQ_SCHED_STREAM_GYRO, stSample.u32Stamp);
+    if (u32DtUs == 0)
+    {
+        return false;
+    }
+    SampleStats_DtUpdate(&_stDtStats, u32DtUs);
+    _fDt = (u32DtUs > FUSION_DT_MAX_US ? FUSION_DT_MAX_US : u32DtUs) * 1e-6f;
 
-    // error is sum of cross product between reference direction of fields and direction measured by sensors
-    ex = (ay * vz - az * vy) + (my * wz - mz * wy);
-    ey = (az * vx - ax * vz) + (mz * wx - mx * wz);
-    ez = (ax * vy - ay * vx) + (mx * wy - my * wx);
+    // sensor axes to the board axes of imuDataGet(), in rad/s, g and uT
+    fScale = deg2rad / GYRO_LSB_PER_DPS[_enGyroFs];
+    afGyro[0] = -(stSample.as32Val[1] - _stGyroOffset.s16Y) * fScale;
+    afGyro[1] = (stSample.as32Val[0] - _stGyroOffset.s16X) * fScale;
+    afGyro[2] = (stSample.as32Val[2] - _stGyroOffset.s16Z) * fScale;
 
-    if (ex != 0.0f && ey != 0.0f && ez != 0.0f)
+    if (imuStreamRead(ACQ_SCHED_STREAM_ACCEL, &stSample))
     {
-        exInt = exInt + ex * Ki * halfT;
-        eyInt = eyInt + ey * Ki * halfT;
-        ezInt = ezInt + ez * Ki * halfT;
+        u32DtUs = icm20948StreamDtUs(ACQ_SCHED_STREAM_ACCEL, stSample.u32Stamp);
+        fAccelDt = (u32DtUs > FUSION_DT_MAX_US ? FUSION_DT_MAX_US : u32DtUs) * 1e-6f;
+        fScale = 1.0f / ACCEL_LSB_PER_G[_enAccelFs];
+        afAccel[0] = -(stSample.as32Val[1] - _stAccelOffset.s16Y) * fScale;
+        afAccel[1] = (stSample.as32Val[0] - _stAccelOffset.s16X) * fScale;
+        afAccel[2] = (stSample.as32Val[2] - _stAccelOffset.s16Z) * fScale;
+        bAccel = true;
+    }
 
-        gx = gx + Kp * ex + exInt;
-        gy = gy + Kp * ey + eyInt;
-        gz = gz + Kp * ez + ezInt;
+    if (imuStreamRead(ACQ_SCHED_STREAM_MAGN, &stSample))
+    {
+        u32DtUs = icm20948StreamDtUs(ACQ_SCHED_STREAM_MAGN, stSample.u32Stamp);
+        fMagnDt = (u32DtUs > FUSION_DT_MAX_US ? FUSION_DT_MAX_US : u32DtUs) * 1e-6f;
+        // icm20948MagAvg() takes the AK09916 axes to (x, -y, -z) first
+        afMagn[0] = stSample.as32Val[1] * 0.15f;
+        afMagn[1] = stSample.as32Val[0] * 0.15f;
+        afMagn[2] = -stSample.as32Val[2] * 0.15f;
+        bMagn = true;
     }
 
-    q0 = q0 + (-q1 * gx - q2 * gy - q3 * gz) * halfT;
-    q1 = q1 + (q0 * gx + q2 * gz - q3 * gy) * halfT;
-    q2 = q2 + (q0 * gy - q1 * gz + q3 * gx) * halfT;
-    q3 = q3 + (q0 * gz + q1 * gy - q2 * gx) * halfT;
+    if (_u32CorrUs != 0)
+    {
+        if (!icm20948TwoRateStep(afGyro, _fDt, bAccel ? afAccel : NULL, bMagn ? afMagn : NULL))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        imuAHRSstep(afGyro, bAccel ? afAccel : NULL, fAccelDt, bMagn ? afMagn : NULL, fMagnDt, _fDt);
+    }
+    imuAnglesFromQuat(pstAngles);
 
-    norm = invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
-    q0 = q0 * norm;
-    q1 = q1 * norm;
-    q2 = q2 * norm;
-    q3 = q3 * norm;
+    return true;
 }
 
-float ICM20948::invSqrt(float x)
+template <class Transport>
+const ACQ_SCHED_ST_STATE *Icm20948Driver<Transport>::imuStreamSchedGet(void) const
 {
-    float halfx = 0.5f * x;
-    float y = x;
+    return &_stAcq;
+}
 
-    long i = *(long *)&y;             // get bits for floating value
-    i = 0x5f3759df - (i >> 1);        // gives initial guss you
-    y = *(float *)&i;                 // convert bits back to float
-    y = y * (1.5f - (halfx * y * y)); // newtop step, repeating increases accuracy
+// the interval in flight is dropped, the next one starts with the next gyro sample
+template <class Transport>
+void Icm20948Driver<Transport>::imuCorrPeriodSet(uint32_t u32Us)
+{
+    _u32CorrUs = u32Us;
+    _clConing.reset();
+    _bCorrAccel = false;
+    _bCorrMagn = false;
 
-    return y;
+    return;
 }
 
-void ICM20948::bmp280Init(void)
+template <class Transport>
+uint32_t Icm20948Driver<Transport>::imuCorrPeriodGet(void) const
 {
-    I2C_WriteOneByte(BMP280_ADDR, BMP280_REGISTER_CONTROL, 0xFF);
-    I2C_WriteOneByte(BMP280_ADDR, BMP280_REGISTER_CONFIG, 0x14);
-    bmp280ReadCalibration();
+    return _u32CorrUs;
 }
 
-bool ICM20948::bmp280Check(void)
+// the attitude and the learned bias are kept
+template <class Transport>
+void Icm20948Driver<Transport>::imuAHRSgainsSet(float fKp, float fKi)
 {
-    bool bRet = false;
-    if (0x58 == I2C_ReadOneByte(BMP280_ADDR, BMP280_REGISTER_CHIPID))
-    {
-        bRet = true;
-    }
+    _fKp = fKp;
+    _fKi = fKi;
+#if AHRS_FUSION == 1
+    AhrsFixed_GainsSet(&_stAhrsFixed, fKp, fKi);
+#endif
 
-    return bRet;
+    return;
 }
 
-void ICM20948::bmp280ReadCalibration(void)
-{
-    uint8_t lsb, msb;
-
-    /* read the temperature calibration parameters */
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_T1_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_T1_MSB_REG);
-    dig_T1 = msb << 8 | lsb;
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_T2_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_T2_MSB_REG);
-    dig_T2 = msb << 8 | lsb;
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_T3_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_T3_MSB_REG);
-    dig_T3 = msb << 8 | lsb;
-
-    /* read the pressure calibration parameters */
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P1_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P1_MSB_REG);
-    dig_P1 = msb << 8 | lsb;
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P2_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P2_MSB_REG);
-    dig_P2 = msb << 8 | lsb;
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P3_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P3_MSB_REG);
-    dig_P3 = msb << 8 | lsb;
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P4_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P4_MSB_REG);
-    dig_P4 = msb << 8 | lsb;
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P5_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P5_MSB_REG);
-    dig_P5 = msb << 8 | lsb;
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P6_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P6_MSB_REG);
-    dig_P6 = msb << 8 | lsb;
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P7_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P7_MSB_REG);
-    dig_P7 = msb << 8 | lsb;
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P8_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P8_MSB_REG);
-    dig_P8 = msb << 8 | lsb;
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P9_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_DIG_P9_MSB_REG);
-    dig_P9 = msb << 8 | lsb;
-}
-
-void ICM20948::bmp280TandPGet(float *temperature, float *pressure)
-{
-    uint8_t lsb, msb, xlsb;
-    int32_t adc_P, adc_T;
-
-    xlsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_TEMP_XLSB_REG);
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_TEMP_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_TEMP_MSB_REG);
-
-    // adc_T = (msb << 12) | (lsb << 4) | (xlsb >> 4);
-    adc_T = msb;
-    adc_T <<= 8;
-    adc_T |= lsb;
-    adc_T <<= 8;
-    adc_T |= xlsb;
-    adc_T >>= 4;
-
-    // adc_T = 415148;
-    *temperature = bmp280CompensateTemperature(adc_T);
+template <class Transport>
+void Icm20948Driver<Transport>::imuAHRSgainsGet(float *pfKp, float *pfKi) const
+{
+    *pfKp = _fKp;
+    *pfKi = _fKi;
 
-    xlsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_PRESS_XLSB_REG);
-    lsb = I2C_ReadOneByte(BMP280_ADDR, BMP280_PRESS_LSB_REG);
-    msb = I2C_ReadOneByte(BMP280_ADDR, BMP280_PRESS_MSB_REG);
-    // adc_P = (msb << 12) | (lsb << 4) | (xlsb >> 4);
-    adc_P = msb;
-    adc_P <<= 8;
-    adc_P |= lsb;
-    adc_P <<= 8;
-    adc_P |= xlsb;
-    adc_P >>= 4;
-
-    // adc_P = 51988;
-    *pressure = bmp280CompensatePressure(adc_P);
+    return;
 }
 
-void ICM20948::bmp280CalAvgValue(uint8_t *pIndex, int32_t *pAvgBuffer, int32_t InVal, int32_t *pOutVal)
+/*
+ * Drains the FIFO sample queue into the two-rate fusion: the gyro of every frame at the
+ * FIFO sample period, the accel of the last frame and the magnetometer of the last frame
+ * that had one with the correction. Without a correction period every frame corrects.
+ * Returns true when the angles are new.
+ */
+template <class Transport>
+bool Icm20948Driver<Transport>::imuFifoUpdate(IMU_ST_ANGLES_DATA *pstAngles)
 {
-    uint8_t i;
-
-    *(pAvgBuffer + ((*pIndex)++)) = InVal;
-    *pIndex &= 0x07;
+    ICM20948_ST_FIFO_SAMPLE stSample;
+    float afGyro[3], afAccel[3], afMagn[3];
+    float fGyroScale = deg2rad / GYRO_LSB_PER_DPS[_enGyroFs];
+    float fAccelScale = 1.0f / ACCEL_LSB_PER_G[_enAccelFs];
+    bool bNew = false;
+
+    _fDt = _u32FifoSampleUs * 1e-6f;
+    while (imuFifoRead(&stSample))
+    {
+        // sensor axes to the board axes of imuDataGet(); the frame magnetometer is (x, -y, -z)
+        afGyro[0] = -(stSample.stGyro.s16Y - _stGyroOffset.s16Y) * fGyroScale;
+        afGyro[1] = (stSample.stGyro.s16X - _stGyroOffset.s16X) * fGyroScale;
+        afGyro[2] = (stSample.stGyro.s16Z - _stGyroOffset.s16Z) * fGyroScale;
+        afAccel[0] = -(stSample.stAccel.s16Y - _stAccelOffset.s16Y) * fAccelScale;
+        afAccel[1] = (stSample.stAccel.s16X - _stAccelOffset.s16X) * fAccelScale;
+        afAccel[2] = (stSample.stAccel.s16Z - _stAccelOffset.s16Z) * fAccelScale;
+        afMagn[0] = -stSample.stMagn.s16Y * 0.15f;
+        afMagn[1] = stSample.stMagn.s16X * 0.15f;
+        afMagn[2] = stSample.stMagn.s16Z * 0.15f;
+
+        if (icm20948TwoRateStep(afGyro, _fDt, afAccel, stSample.u8MagnValid ? afMagn : NULL))
+        {
+            bNew = true;
+        }
+    }
 
-    *pOutVal = 0;
-    for (i = 0; i < 8; i++)
+    if (bNew)
     {
-        *pOutVal += *(pAvgBuffer + i);
+        imuAnglesFromQuat(pstAngles);
     }
-    *pOutVal >>= 3;
-}
 
-void ICM20948::bmp280CalculateAbsoluteAltitude(int32_t *pAltitude, int32_t PressureVal)
-{
-    *pAltitude = 4433000 * (1 - pow((PressureVal / (float)gs32Pressure0), 0.1903));
+    return bNew;
 }
 
-float ICM20948::bmp280CompensateTemperature(int32_t adc_T)
+template <class Transport>
+bool Icm20948Driver<Transport>::imuDmpInit(const uint8_t *pu8Image, uint16_t u16Len, bool b9Axis)
 {
-    int64_t var1, var2, temperature;
+    uint8_t u8Ctrl;
+
+    // the DMP and the raw frame stream share the FIFO
+    _bDmpEn = false;
+    _u8FifoFrameLen = 0;
+    _u16FifoRxLen = 0;
+    _stFifoStats = {};
 
-    var1 = ((((adc_T >> 3) - ((int64_t)dig_T1 << 1))) * ((int64_t)dig_T2)) >> 11;
-    var2 = (((((adc_T >> 4) - ((int64_t)dig_T1)) * ((adc_T >> 4) - ((int64_t)dig_T1))) >> 12) *
-            ((int64_t)dig_T3)) >>
-           14;
-    t_fine = var1 + var2;
+    /* user bank 0 register */
+    icm20948RegModify(REG_VAL_REG_BANK_0, REG_ADD_USER_CTRL, REG_VAL_BIT_DMP_EN | REG_VAL_BIT_FIFO_EN, 0);
+    // DMP_RST clears itself, so it is written around the shadow copy
+    u8Ctrl = icm20948RegRead(REG_VAL_REG_BANK_0, REG_ADD_USER_CTRL);
+    icm20948BankSelect(REG_VAL_REG_BANK_0);
+    busWriteByte(REG_ADD_USER_CTRL, u8Ctrl | REG_VAL_BIT_DMP_RST);
+    HAL_Delay(1);
+
+    if (!icm20948DmpMemWrite(DMP_LOAD_START, pu8Image, u16Len, true))
+    {
+        return false;
+    }
+
+    /* user bank 2 register */
+    icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_PRGM_START_ADDRH, DMP_START_ADDR >> 8);
+    icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_PRGM_START_ADDRH + 1, DMP_START_ADDR & 0xFF);
 
-    temperature = (t_fine * 5 + 128) >> 8;
+    // the scaling written below is for these ranges, the DMP cannot follow a range switch
+    _bAutoRange = false;
+    imuGyroFsSet(IMU_EN_GYRO_FS_2000DPS);
+    imuAccelFsSet(IMU_EN_ACCEL_FS_4G);
+    icm20948DmpConfig(b9Axis);
+    _u8DmpPacketLen = b9Axis ? DMP_PACKET_LEN_QUAT9 : DMP_PACKET_LEN_QUAT6;
 
-    return (float)temperature;
+    /* user bank 0 register */
+    // no raw sensor data in the FIFO, the DMP writes its own packets
+    icm20948RegWrite(REG_VAL_REG_BANK_0, REG_ADD_FIFO_EN_1, 0x00);
+    icm20948RegWrite(REG_VAL_REG_BANK_0, REG_ADD_FIFO_EN_2, 0x00);
+    icm20948RegWrite(REG_VAL_REG_BANK_0, REG_ADD_HW_FIX_DISABLE, REG_VAL_HW_FIX_DISABLE);
+    icm20948RegWrite(REG_VAL_REG_BANK_0, REG_ADD_SINGLE_FIFO_PRIORITY_SEL, REG_VAL_SINGLE_FIFO_PRIORITY);
+    icm20948RegWrite(REG_VAL_REG_BANK_0, REG_ADD_FIFO_MODE, REG_VAL_FIFO_MODE_SNAPSHOT);
+    icm20948FifoReset();
+
+    icm20948RegModify(REG_VAL_REG_BANK_0, REG_ADD_USER_CTRL, 0,
+                      REG_VAL_BIT_DMP_EN | REG_VAL_BIT_FIFO_EN | (b9Axis ? REG_VAL_BIT_I2C_MST_EN : 0));
+    _bDmpEn = true;
+
+    return true;
 }
 
-float ICM20948::bmp280CompensatePressure(int32_t adc_P)
+// one blocking FIFO read per call, in place of the register reads and fusion of imuDataGet();
+// returns true when at least one quaternion arrived
+template <class Transport>
+bool Icm20948Driver<Transport>::imuDmpDataGet(IMU_ST_ANGLES_DATA *pstAngles)
 {
-    int64_t var1, var2;
-    uint64_t pressure;
-#if 1
-    var1 = ((int64_t)t_fine) - 128000;
-    var2 = var1 * var1 * (int64_t)dig_P6;
-    var2 = var2 + ((var1 * (int64_t)dig_P5) << 17);
-    var2 = var2 + (((int64_t)dig_P4) << 35);
-    var1 = ((var1 * var1 * (int64_t)dig_P3) >> 8) + ((var1 * (int64_t)dig_P2) << 12);
-    var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)dig_P1) >> 33;
+    DMP_ST_PACKET stPacket;
+    uint16_t u16Count, u16Chunk, u16Used, u16Off;
+    bool bNew = false;
 
-    if (var1 == 0)
+    if (!_bDmpEn)
     {
-        return 0; // avoid exception caused by division by zero
+        return false;
     }
 
-    pressure = 1048576.0 - adc_P;
-    pressure = (((pressure << 31) - var2) * 3125) / var1;
-    var1 = (((int64_t)dig_P9) * (pressure >> 13) * (pressure >> 13)) >> 25;
-    var2 = (((int64_t)dig_P8) * pressure) >> 19;
-    pressure = ((pressure + var1 + var2) >> 8) + (((int64_t)dig_P7) << 4);
-    return (float)pressure / 256;
-#else
-    var1 = (((int64_t)t_fine) >> 1) - (int64_t)64000;
-    var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int64_t)dig_P6);
-    var2 = var2 + ((var1 * ((int64_t)dig_P5)) << 1);
-    var2 = (var2 >> 2) + (((int64_t)dig_P4) << 16);
-    var1 = (((dig_P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + ((((int64_t)dig_P2) * var1) >> 1)) >> 18;
-    var1 = ((((32768 + var1)) * ((int64_t)dig_P1)) >> 15);
-    if (var1 == 0)
+    u16Count = icm20948FifoCountGet();
+
+    // a full FIFO in snapshot mode stopped the DMP mid-packet, nothing after that is aligned;
+    // short of that, every packet in it is intact and a partial one is completed next call
+    if (u16Count >= FIFO_SIZE)
     {
-        return 0;
+        icm20948FifoReset();
+        _u16FifoRxLen = 0;
+        _stFifoStats.u32Overflows++;
+        return false;
     }
-    pressure = (1048576.0 - adc_P) - (var2 >> 12) * 3125;
-    if (pressure < 0x80000000)
+
+    // append to the partial packet left by the last call
+    if (u16Count > FIFO_SIZE - _u16FifoRxLen)
     {
-        pressure = (pressure << 1) / ((uint64_t)var1);
+        u16Count = FIFO_SIZE - _u16FifoRxLen;
     }
-    else
+    while (u16Count > 0)
     {
-        pressure = (pressure / (uint64_t)var1) * 2;
+        u16Chunk = (u16Count > UINT8_MAX) ? UINT8_MAX : u16Count;
+        busReadBytes(REG_ADD_FIFO_R_W, _u8FifoRxBuf + _u16FifoRxLen, u16Chunk);
+        _u16FifoRxLen += u16Chunk;
+        _stFifoStats.u32Bytes += u16Chunk;
+        u16Count -= u16Chunk;
     }
-    var1 = (((int64_t)dig_P9) * ((int64_t)(((pressure >> 3) * (pressure >> 3)) >> 13))) >> 12;
-    var2 = (((int64_t)(pressure >> 2)) * ((int64_t)dig_P8)) >> 13;
-    pressure = (uint64_t)((int64_t)pressure) + ((var1 + var2 + dig_P7) >> 4);
-    return (float)pressure;
-#endif
-}
+
+    for (u16Off = 0; u16Off < _u16FifoRxLen; u16Off += u16Used)
+    {
+        u16Used = Dmp_PacketParse(_u8FifoRxBuf + u16Off, _u16FifoRxLen - u16Off, &stPacket);
+        if (u16Used == 0)
+        {
+            break;
+        }
+
+        if (u16Used == DMP_PACKET_INVALID)
+        {
+            icm20948FifoReset();
+            _u16FifoRxLen = 0;
+            _stFifoStats.u32Overflows++;
+            return bNew;
+        }
+
+        _stFifoStats.u32Frames++;
+        if (stPacket.u16Header & DMP_HDR_QUAT9)
+        {
+            icm20948DmpQuatSet(stPacket.as32Quat9);
+            bNew = true;
+        }
+        else if (stPacket.u16Header & DMP_HDR_QUAT6)
+        {
+            icm20948DmpQuatSet(stPacket.as32Quat6);
+            bNew = true;
+        }
+    }
+
+    _u16FifoRxLen -= u16Off;
+    memmove(_u8FifoRxBuf, _u8FifoRxBuf + u16Off, _u16FifoRxLen);
+
+    if (bNew)
+    {
+        imuAnglesFromQuat(pstAngles);
+    }
+
+    return bNew;
+}
+
+template <class Transport>
+bool Icm20948Driver<Transport>::imuDmpEnabled(void) const
+{
+    return _bDmpEn;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::imuRegCacheEnable(bool bEnable)
+{
+    // the shadow copies are only trusted from the moment caching is (re)enabled
+    icm20948RegCacheReset(false);
+    _bRegCacheEn = bEnable;
+
+    return;
+}
+
+template <class Transport>
+const ICM20948_ST_FIFO_STATS *Icm20948Driver<Transport>::imuFifoStatsGet(void) const
+{
+    return &_stFifoStats;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::imuGyroFsSet(IMU_EN_GYRO_FS enFs)
+{
+    _enGyroFsBase = enFs;
+    icm20948GyroFsWrite(enFs);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::imuAccelFsSet(IMU_EN_ACCEL_FS enFs)
+{
+    _enAccelFsBase = enFs;
+    icm20948AccelFsWrite(enFs);
+
+    return;
+}
+
+template <class Transport>
+IMU_EN_GYRO_FS Icm20948Driver<Transport>::imuGyroFsGet(void) const
+{
+    return _enGyroFs;
+}
+
+template <class Transport>
+IMU_EN_ACCEL_FS Icm20948Driver<Transport>::imuAccelFsGet(void) const
+{
+    return _enAccelFs;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::imuAutoRangeEnable(bool bEnable)
+{
+    _bAutoRange = bEnable;
+    _u16GyroQuiet = 0;
+    _u16AccelQuiet = 0;
+
+    return;
+}
+
+template <class Transport>
+uint32_t Icm20948Driver<Transport>::imuRangeSwitchesGet(void) const
+{
+    return _u32RangeSwitches;
+}
+
+template <class Transport>
+float Icm20948Driver<Transport>::imuDtGet(void) const
+{
+    return _fDt;
+}
+
+template <class Transport>
+const SAMPLE_ST_DT_STATS *Icm20948Driver<Transport>::imuDtStatsGet(void) const
+{
+    return &_stDtStats;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::imuGyroCalNvSet(const GYRO_CAL_ST_NV *pstNv)
+{
+    GyroCal_Init(&_stGyroCal, pstNv);
+    icm20948GyroOffset();
+
+    return;
+}
+
+// writes a pending bias; an erase stalls the CPU, so call it where that is harmless
+template <class Transport>
+bool Icm20948Driver<Transport>::imuGyroCalSave(void)
+{
+    return GyroCal_Save(&_stGyroCal) != 0;
+}
+
+template <class Transport>
+const GYRO_CAL_ST_STATE *Icm20948Driver<Transport>::imuGyroCalGet(void) const
+{
+    return &_stGyroCal;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::imuBiasModeSet(IMU_EN_BIAS_MODE enMode)
+{
+    static const int16_t s16Zero[3] = {0, 0, 0};
+
+    if ((enMode >= IMU_EN_BIAS_MODE_MAX) || (enMode == _enBiasMode))
+    {
+        return;
+    }
+
+    // hand the correction back from the sensor to the driver
+    if (_enBiasMode == IMU_EN_BIAS_MODE_REGISTER)
+    {
+        icm20948GyroOffsRegWrite(s16Zero);
+        icm20948AccelOffsRegWrite(_s16AccelTrim);
+    }
+
+    _enBiasMode = enMode;
+    icm20948GyroOffset();
+    icm20948AccelOffset();
+
+    return;
+}
+
+template <class Transport>
+IMU_EN_BIAS_MODE Icm20948Driver<Transport>::imuBiasModeGet(void) const
+{
+    return _enBiasMode;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::imuTempCompEnable(bool bEnable)
+{
+    _bTempComp = bEnable;
+    icm20948GyroOffset();
+
+    return;
+}
+
+template <class Transport>
+float Icm20948Driver<Transport>::imuTempGet(void) const
+{
+    return _fTempC;
+}
+
+template <class Transport>
+const GyroTempModel *Icm20948Driver<Transport>::imuTempModelGet(void) const
+{
+    return &_clGyroTemp;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::imuAccelBiasSet(const float *pfBiasG)
+{
+    memcpy(_fAccelBiasG, pfBiasG, sizeof(_fAccelBiasG));
+    icm20948AccelOffset();
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::pressSensorDataGet(int32_t *ps32Temperature, int32_t *ps32Pressure, int32_t *ps32Altitude)
+{
+    float CurPressure, CurTemperature;
+    int32_t CurAltitude;
+
+    bmp280TandPGet(&CurTemperature, &CurPressure);
+    bmp280CalAvgValue(&_stBaroAvg[0].Index, _stBaroAvg[0].AvgBuffer, (int32_t)(CurPressure), ps32Pressure);
+    bmp280CalculateAbsoluteAltitude(&CurAltitude, (*ps32Pressure));
+    bmp280CalAvgValue(&_stBaroAvg[1].Index, _stBaroAvg[1].AvgBuffer, CurAltitude, ps32Altitude);
+    bmp280CalAvgValue(&_stBaroAvg[2].Index, _stBaroAvg[2].AvgBuffer, (int32_t)CurTemperature, ps32Temperature);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::pressSensorConfigSet(const IMU_ST_BARO_CONFIG *pstConfig)
+{
+    _stBaroConfig = *pstConfig;
+    bmp280ConfigWrite();
+
+    return;
+}
+
+template <class Transport>
+const IMU_ST_BARO_CONFIG *Icm20948Driver<Transport>::pressSensorConfigGet(void) const
+{
+    return &_stBaroConfig;
+}
+
+// time between two results: t_meas in forced mode, t_meas + t_standby in normal mode
+template <class Transport>
+uint32_t Icm20948Driver<Transport>::pressSensorPeriodMs(void) const
+{
+    static const uint32_t au32StandbyUs[IMU_EN_BARO_STANDBY_MAX] = {500, 62500, 125000, 250000,
+                                                                     500000, 1000000, 2000000, 4000000};
+    uint32_t u32Us = bmp280MeasTimeUs(&_stBaroConfig);
+
+    if (_stBaroConfig.enMode == IMU_EN_BARO_MODE_NORMAL)
+    {
+        u32Us += au32StandbyUs[_stBaroConfig.enStandby];
+    }
+
+    return (u32Us + 999) / 1000;
+}
+
+/*
+ * Never waits on the sensor: before the conversion is due it costs no bus time
+ * at all, after that one STATUS read, and only a finished conversion pays for
+ * the 6-byte burst. In forced mode the next conversion is started right away.
+ * Returns true when pressSensorLatestGet() has a new result.
+ */
+template <class Transport>
+bool Icm20948Driver<Transport>::pressSensorPoll(void)
+{
+    uint8_t u8Buf[BMP280_LEN_DATA];
+    float fTemperature, fPressure;
+    uint32_t u32Now = HAL_GetTick();
+
+    if ((int32_t)(u32Now - _u32BaroDueTick) < 0)
+    {
+        return false;
+    }
+
+    if (bmp280ReadByte(BMP280_REGISTER_STATUS) & BMP280_VAL_BIT_STATUS_MEASURING)
+    {
+        return false;
+    }
+
+    bmp280ReadBytes(BMP280_PRESS_MSB_REG, u8Buf, BMP280_LEN_DATA);
+    bmp280DataDecode(u8Buf, &fTemperature, &fPressure);
+    _s32BaroTemperature = (int32_t)fTemperature;
+    _s32BaroPressure = (int32_t)fPressure;
+
+    if (_stBaroConfig.enMode == IMU_EN_BARO_MODE_FORCED)
+    {
+        bmp280WriteByte(BMP280_REGISTER_CONTROL,
+                         (_stBaroConfig.enTempOsrs << 5) | (_stBaroConfig.enPressOsrs << 2) | IMU_EN_BARO_MODE_FORCED);
+    }
+    _u32BaroDueTick = u32Now + pressSensorPeriodMs();
+
+    return true;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::pressSensorLatestGet(int32_t *ps32Temperature, int32_t *ps32Pressure) const
+{
+    *ps32Temperature = _s32BaroTemperature;
+    *ps32Pressure = _s32BaroPressure;
+
+    return;
+}
+
+// private
+template <class Transport>
+uint8_t Icm20948Driver<Transport>::busReadByte(uint8_t u8RegAddr)
+{
+    uint8_t u8Ret[1] = {0};
+    _clBus.read(u8RegAddr, u8Ret, 1);
+
+    return u8Ret[0];
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::busReadBytes(uint8_t u8RegAddr, uint8_t *pu8Buf, uint16_t u16Len)
+{
+    _clBus.read(u8RegAddr, pu8Buf, u16Len);
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::busWriteByte(uint8_t u8RegAddr, uint8_t u8Value)
+{
+    if ((u8RegAddr == REG_ADD_USER_CTRL) && (_u8Bank == REG_VAL_REG_BANK_0))
+    {
+        u8Value |= Transport::USER_CTRL_BITS;
+    }
+    _clBus.writeByte(u8RegAddr, u8Value);
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::busWriteBytes(uint8_t u8RegAddr, const uint8_t *pu8Buf, uint16_t u16Len)
+{
+    _clBus.write(u8RegAddr, pu8Buf, u16Len);
+}
+
+template <class Transport>
+uint8_t Icm20948Driver<Transport>::bmp280ReadByte(uint8_t u8RegAddr)
+{
+    uint8_t u8Ret[1] = {0};
+    _clBus.auxRead(BMP280_ADDR, u8RegAddr, u8Ret, 1);
+
+    return u8Ret[0];
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::bmp280ReadBytes(uint8_t u8RegAddr, uint8_t *pu8Buf, uint16_t u16Len)
+{
+    _clBus.auxRead(BMP280_ADDR, u8RegAddr, pu8Buf, u16Len);
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::bmp280WriteByte(uint8_t u8RegAddr, uint8_t u8Value)
+{
+    _clBus.auxWrite(BMP280_ADDR, u8RegAddr, u8Value);
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948BankSelect(uint8_t u8Bank)
+{
+    if (_bRegCacheEn && (u8Bank == _u8Bank))
+    {
+        return;
+    }
+
+    busWriteByte(REG_ADD_REG_BANK_SEL, u8Bank);
+    _u8Bank = u8Bank;
+
+    return;
+}
+
+template <class Transport>
+uint8_t Icm20948Driver<Transport>::icm20948RegRead(uint8_t u8Bank, uint8_t u8RegAddr)
+{
+    uint8_t u8Idx = u8Bank >> 4;
+    uint8_t u8Bit = 1 << (u8RegAddr & 0x07);
+    bool bCacheable = icm20948RegCacheable(u8Bank, u8RegAddr);
+    uint8_t u8Value;
+
+    if (_bRegCacheEn && bCacheable && (_u8RegValid[u8Idx][u8RegAddr >> 3] & u8Bit))
+    {
+        return _u8RegShadow[u8Idx][u8RegAddr];
+    }
+
+    icm20948BankSelect(u8Bank);
+    u8Value = busReadByte(u8RegAddr);
+
+    if (bCacheable)
+    {
+        _u8RegShadow[u8Idx][u8RegAddr] = u8Value;
+        _u8RegValid[u8Idx][u8RegAddr >> 3] |= u8Bit;
+    }
+
+    return u8Value;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948RegWrite(uint8_t u8Bank, uint8_t u8RegAddr, uint8_t u8Value)
+{
+    uint8_t u8Idx = u8Bank >> 4;
+    uint8_t u8Bit = 1 << (u8RegAddr & 0x07);
+    bool bCacheable = icm20948RegCacheable(u8Bank, u8RegAddr);
+
+    if (_bRegCacheEn && bCacheable && (_u8RegValid[u8Idx][u8RegAddr >> 3] & u8Bit) &&
+        (_u8RegShadow[u8Idx][u8RegAddr] == u8Value))
+    {
+        return;
+    }
+
+    icm20948BankSelect(u8Bank);
+    busWriteByte(u8RegAddr, u8Value);
+
+    if (bCacheable)
+    {
+        _u8RegShadow[u8Idx][u8RegAddr] = u8Value;
+        _u8RegValid[u8Idx][u8RegAddr >> 3] |= u8Bit;
+    }
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948RegModify(uint8_t u8Bank, uint8_t u8RegAddr, uint8_t u8Clear, uint8_t u8Set)
+{
+    // a bus read only the first time, after that this is a plain write
+    uint8_t u8Value = icm20948RegRead(u8Bank, u8RegAddr);
+
+    icm20948RegWrite(u8Bank, u8RegAddr, (u8Value & ~u8Clear) | u8Set);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948RegCacheReset(bool bDeviceReset)
+{
+    uint8_t i;
+    // reset values from the register map of the registers the driver read-modify-writes
+    static const uint8_t su8ResetVal[][3] = {
+        {REG_VAL_REG_BANK_0, REG_ADD_USER_CTRL, 0x00},
+        {REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV0_CTRL, 0x00},
+        {REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV1_CTRL, 0x00},
+    };
+
+    memset(_u8RegValid, 0, sizeof(_u8RegValid));
+    _u8Bank = REG_VAL_REG_BANK_UNKNOWN;
+
+    if (bDeviceReset)
+    {
+        _u8Bank = REG_VAL_REG_BANK_0;
+        for (i = 0; i < sizeof(su8ResetVal) / sizeof(su8ResetVal[0]); i++)
+        {
+            _u8RegShadow[su8ResetVal[i][0] >> 4][su8ResetVal[i][1]] = su8ResetVal[i][2];
+            _u8RegValid[su8ResetVal[i][0] >> 4][su8ResetVal[i][1] >> 3] |= 1 << (su8ResetVal[i][1] & 0x07);
+        }
+    }
+
+    return;
+}
+
+template <class Transport>
+bool Icm20948Driver<Transport>::icm20948RegCacheable(uint8_t u8Bank, uint8_t u8RegAddr)
+{
+    switch (u8Bank)
+    {
+    case REG_VAL_REG_BANK_0:
+        // configuration only: WHO_AM_I, status, sensor data, FIFO count/data and FIFO_RST are live
+        return ((u8RegAddr > REG_ADD_WIA) && (u8RegAddr < REG_ADD_I2C_MST_STATUS)) ||
+               (u8RegAddr == REG_ADD_FIFO_EN_1) || (u8RegAddr == REG_ADD_FIFO_EN_2) ||
+               (u8RegAddr == REG_ADD_FIFO_MODE);
+    case REG_VAL_REG_BANK_1:
+    case REG_VAL_REG_BANK_2:
+        return u8RegAddr < REG_ADD_REG_BANK_SEL;
+    case REG_VAL_REG_BANK_3:
+        // I2C_SLV4_DI is data
+        return u8RegAddr < REG_ADD_I2C_SLV4_DI;
+    default:
+        return false;
+    }
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948init(void)
+{
+    /* user bank 0 register */
+    icm20948BankSelect(REG_VAL_REG_BANK_0);
+    busWriteByte(REG_ADD_PWR_MIGMT_1, REG_VAL_ALL_RGE_RESET);
+    HAL_Delay(10);
+    // every register is back at its reset value, REG_BANK_SEL included
+    icm20948RegCacheReset(true);
+    _bAccelTrimValid = false;
+    icm20948RegWrite(REG_VAL_REG_BANK_0, REG_ADD_PWR_MIGMT_1, REG_VAL_RUN_MODE);
+
+    /* user bank 2 register */
+    // 1.1 kHz/(1+GYRO_SMPLRT_DIV[7:0]) = 220Hz
+    icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_GYRO_SMPLRT_DIV, 0x04);
+    icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_GYRO_CONFIG_1,
+                     REG_VAL_BIT_GYRO_DLPCFG_6 | (_enGyroFs << 1) | REG_VAL_BIT_GYRO_DLPF);
+    // 1.125 kHz/(1+ACCEL_SMPLRT_DIV[11:0]) = 225Hz
+    icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_ACCEL_SMPLRT_DIV_2, 0x04);
+    icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_ACCEL_CONFIG,
+                     REG_VAL_BIT_ACCEL_DLPCFG_6 | (_enAccelFs << 1) | REG_VAL_BIT_ACCEL_DLPF);
+
+    /* user bank 0 register */
+    icm20948BankSelect(REG_VAL_REG_BANK_0);
+    HAL_Delay(100);
+
+    /* offset */
+    // saved bias, refined in the background by imuDataGet() instead of a blocking average
+    icm20948GyroOffset();
+    icm20948AccelOffset();
+    icm20948MagCheck();
+    icm20948WriteSecondary(I2C_ADD_ICM20948_AK09916 | I2C_ADD_ICM20948_AK09916_WRITE,
+                           REG_ADD_MAG_CNTL2, REG_VAL_MAG_MODE_20HZ);
+
+    return;
+}
+
+template <class Transport>
+bool Icm20948Driver<Transport>::icm20948Check(void)
+{
+    bool bRet = false;
+
+    // the MCU may have been reset while the sensor kept its bank selection
+    icm20948BankSelect(REG_VAL_REG_BANK_0);
+    if (REG_VAL_WIA == busReadByte(REG_ADD_WIA))
+    {
+        bRet = true;
+    }
+
+    return bRet;
+}
+
+template <class Transport>
+bool Icm20948Driver<Transport>::icm20948MagCheck(void)
+{
+    bool bRet = false;
+    uint8_t u8Ret[2];
+
+    icm20948ReadSecondary(I2C_ADD_ICM20948_AK09916 | I2C_ADD_ICM20948_AK09916_READ,
+                          REG_ADD_MAG_WIA1, 2, u8Ret);
+    if ((u8Ret[0] == REG_VAL_MAG_WIA1) && (u8Ret[1] == REG_VAL_MAG_WIA2))
+    {
+        bRet = true;
+    }
+
+    return bRet;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948GyroRead(int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z)
+{
+    uint8_t u8Buf[2];
+    int16_t s16Buf[3] = {0};
+
+    icm20948BankSelect(REG_VAL_REG_BANK_0);
+    u8Buf[0] = busReadByte(REG_ADD_GYRO_XOUT_L);
+    u8Buf[1] = busReadByte(REG_ADD_GYRO_XOUT_H);
+    s16Buf[0] = (u8Buf[1] << 8) | u8Buf[0];
+
+    u8Buf[0] = busReadByte(REG_ADD_GYRO_YOUT_L);
+    u8Buf[1] = busReadByte(REG_ADD_GYRO_YOUT_H);
+    s16Buf[1] = (u8Buf[1] << 8) | u8Buf[0];
+
+    u8Buf[0] = busReadByte(REG_ADD_GYRO_ZOUT_L);
+    u8Buf[1] = busReadByte(REG_ADD_GYRO_ZOUT_H);
+    s16Buf[2] = (u8Buf[1] << 8) | u8Buf[0];
+
+    icm20948GyroAvg(s16Buf, ps16X, ps16Y, ps16Z);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948GyroAvg(const int16_t *ps16In, int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z)
+{
+    uint8_t i;
+    int32_t s32OutBuf[3] = {0};
+    int16_t s16In[3];
+
+    // the first sample after a range switch may still be at the old range, hold the output
+    for (i = 0; i < 3; i++)
+    {
+        s16In[i] = _u8GyroHoldoff ? icm20948AvgGet(&_stGyroAvg[i]) : ps16In[i];
+    }
+    if (_u8GyroHoldoff)
+    {
+        // a held sample says nothing about the range: neither clipped nor quiet
+        _u8GyroHoldoff--;
+        _s16GyroPeak = AUTORANGE_QUIET_LSB;
+    }
+    else
+    {
+        _s16GyroPeak = icm20948PeakAbs(ps16In);
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        icm20948CalAvgValue(&_stGyroAvg[i].u8Index, _stGyroAvg[i].s16AvgBuffer, s16In[i], s32OutBuf + i);
+    }
+    *ps16X = s32OutBuf[0] - _stGyroOffset.s16X;
+    *ps16Y = s32OutBuf[1] - _stGyroOffset.s16Y;
+    *ps16Z = s32OutBuf[2] - _stGyroOffset.s16Z;
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948AccelRead(int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z)
+{
+    uint8_t u8Buf[2];
+    int16_t s16Buf[3] = {0};
+
+    icm20948BankSelect(REG_VAL_REG_BANK_0);
+    u8Buf[0] = busReadByte(REG_ADD_ACCEL_XOUT_L);
+    u8Buf[1] = busReadByte(REG_ADD_ACCEL_XOUT_H);
+    s16Buf[0] = (u8Buf[1] << 8) | u8Buf[0];
+
+    u8Buf[0] = busReadByte(REG_ADD_ACCEL_YOUT_L);
+    u8Buf[1] = busReadByte(REG_ADD_ACCEL_YOUT_H);
+    s16Buf[1] = (u8Buf[1] << 8) | u8Buf[0];
+
+    u8Buf[0] = busReadByte(REG_ADD_ACCEL_ZOUT_L);
+    u8Buf[1] = busReadByte(REG_ADD_ACCEL_ZOUT_H);
+    s16Buf[2] = (u8Buf[1] << 8) | u8Buf[0];
+
+    icm20948AccelAvg(s16Buf, ps16X, ps16Y, ps16Z);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948AccelAvg(const int16_t *ps16In, int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z)
+{
+    uint8_t i;
+    int32_t s32OutBuf[3] = {0};
+    int16_t s16In[3];
+
+    for (i = 0; i < 3; i++)
+    {
+        s16In[i] = _u8AccelHoldoff ? icm20948AvgGet(&_stAccelAvg[i]) : ps16In[i];
+    }
+    if (_u8AccelHoldoff)
+    {
+        // a held sample says nothing about the range: neither clipped nor quiet
+        _u8AccelHoldoff--;
+        _s16AccelPeak = AUTORANGE_QUIET_LSB;
+    }
+    else
+    {
+        _s16AccelPeak = icm20948PeakAbs(ps16In);
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        icm20948CalAvgValue(&_stAccelAvg[i].u8Index, _stAccelAvg[i].s16AvgBuffer, s16In[i], s32OutBuf + i);
+    }
+    *ps16X = s32OutBuf[0] - _stAccelOffset.s16X;
+    *ps16Y = s32OutBuf[1] - _stAccelOffset.s16Y;
+    *ps16Z = s32OutBuf[2] - _stAccelOffset.s16Z;
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948AccelGyroRead(IMU_ST_SENSOR_DATA *pstAccel, IMU_ST_SENSOR_DATA *pstGyro)
+{
+    ICM20948_ST_RAW_SAMPLE stSample;
+
+    if (_enAcqMode != IMU_EN_ACQ_MODE_SINGLE_BYTE)
+    {
+        icm20948BurstRead(&stSample);
+        icm20948AccelAvg(&stSample.stAccel.s16X, &pstAccel->s16X, &pstAccel->s16Y, &pstAccel->s16Z);
+        icm20948GyroAvg(&stSample.stGyro.s16X, &pstGyro->s16X, &pstGyro->s16Y, &pstGyro->s16Z);
+    }
+    else
+    {
+        icm20948AccelRead(&pstAccel->s16X, &pstAccel->s16Y, &pstAccel->s16Z);
+        icm20948GyroRead(&pstGyro->s16X, &pstGyro->s16Y, &pstGyro->s16Z);
+    }
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948BurstRead(ICM20948_ST_RAW_SAMPLE *pstSample)
+{
+    uint8_t u8Buf[REG_LEN_ACCEL_GYRO_TEMP];
+
+    // TEMP_OUT follows GYRO_ZOUT_L, two more bytes in the same transaction
+    icm20948BankSelect(REG_VAL_REG_BANK_0);
+    busReadBytes(REG_ADD_ACCEL_XOUT_H, u8Buf, REG_LEN_ACCEL_GYRO_TEMP);
+    icm20948SampleDecode(u8Buf, pstSample);
+    icm20948TempDecode(u8Buf + REG_LEN_ACCEL_GYRO);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948SampleDecode(const uint8_t *pu8Buf, ICM20948_ST_RAW_SAMPLE *pstSample)
+{
+    // registers are big-endian pairs in the same order as the struct members
+    pstSample->stAccel.s16X = (int16_t)((pu8Buf[0] << 8) | pu8Buf[1]);
+    pstSample->stAccel.s16Y = (int16_t)((pu8Buf[2] << 8) | pu8Buf[3]);
+    pstSample->stAccel.s16Z = (int16_t)((pu8Buf[4] << 8) | pu8Buf[5]);
+    pstSample->stGyro.s16X = (int16_t)((pu8Buf[6] << 8) | pu8Buf[7]);
+    pstSample->stGyro.s16Y = (int16_t)((pu8Buf[8] << 8) | pu8Buf[9]);
+    pstSample->stGyro.s16Z = (int16_t)((pu8Buf[10] << 8) | pu8Buf[11]);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948MagRead(int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z)
+{
+    uint8_t counter = 20;
+    uint8_t u8Data[MAG_DATA_LEN];
+    int16_t s16Buf[3] = {0};
+    while (counter > 0)
+    {
+        HAL_Delay(10);
+        icm20948ReadSecondary(I2C_ADD_ICM20948_AK09916 | I2C_ADD_ICM20948_AK09916_READ,
+                              REG_ADD_MAG_ST1, 1, u8Data);
+
+        if ((u8Data[0] & REG_VAL_BIT_MAG_DRDY) != 0)
+            break;
+
+        counter--;
+    }
+
+    if (counter != 0)
+    {
+        icm20948ReadSecondary(I2C_ADD_ICM20948_AK09916 | I2C_ADD_ICM20948_AK09916_READ,
+                              REG_ADD_MAG_DATA,
+                              MAG_DATA_LEN,
+                              u8Data);
+        s16Buf[0] = ((int16_t)u8Data[1] << 8) | u8Data[0];
+        s16Buf[1] = ((int16_t)u8Data[3] << 8) | u8Data[2];
+        s16Buf[2] = ((int16_t)u8Data[5] << 8) | u8Data[4];
+    }
+
+    icm20948MagAvg(s16Buf, ps16X, ps16Y, ps16Z);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948MagAvg(const int16_t *ps16In, int16_t *ps16X, int16_t *ps16Y, int16_t *ps16Z)
+{
+    uint8_t i;
+    int32_t s32OutBuf[3] = {0};
+
+    for (i = 0; i < 3; i++)
+    {
+        icm20948CalAvgValue(&_stMagnAvg[i].u8Index, _stMagnAvg[i].s16AvgBuffer, ps16In[i], s32OutBuf + i);
+    }
+
+    *ps16X = s32OutBuf[0];
+    *ps16Y = -s32OutBuf[1];
+    *ps16Z = -s32OutBuf[2];
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948MagAutoReadInit(void)
+{
+    /* user bank 3 register */
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_MST_CTRL, REG_VAL_I2C_MST_CLK_345KHZ);
+    // SLV1 still holds the CNTL2 write from init, it must not re-run every cycle
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV1_CTRL, 0x00);
+    // ST1..ST2 every sample: reading ST2 releases the AK09916 data lock
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV0_ADDR,
+                     I2C_ADD_ICM20948_AK09916 | I2C_ADD_ICM20948_AK09916_READ);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV0_REG, REG_ADD_MAG_ST1);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV0_CTRL, REG_VAL_BIT_SLV0_EN | REG_LEN_MAG_AUTO);
+
+    /* user bank 0 register */
+    icm20948RegModify(REG_VAL_REG_BANK_0, REG_ADD_USER_CTRL, 0, REG_VAL_BIT_I2C_MST_EN);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948MagAutoReadStop(void)
+{
+    icm20948RegModify(REG_VAL_REG_BANK_0, REG_ADD_USER_CTRL, REG_VAL_BIT_I2C_MST_EN, 0);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV0_CTRL, 0x00);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948BurstMagRead(IMU_ST_SENSOR_DATA *pstAccel, IMU_ST_SENSOR_DATA *pstGyro, int16_t *ps16Magn)
+{
+    uint8_t u8Buf[REG_LEN_ACCEL_GYRO_MAG];
+    ICM20948_ST_RAW_SAMPLE stSample;
+
+    // ACCEL_XOUT_H..TEMP_OUT_L..EXT_SENS_DATA_08 in one transaction, no delays
+    icm20948BankSelect(REG_VAL_REG_BANK_0);
+    busReadBytes(REG_ADD_ACCEL_XOUT_H, u8Buf, REG_LEN_ACCEL_GYRO_MAG);
+    icm20948SampleDecode(u8Buf, &stSample);
+    icm20948TempDecode(u8Buf + REG_LEN_ACCEL_GYRO);
+    icm20948AccelAvg(&stSample.stAccel.s16X, &pstAccel->s16X, &pstAccel->s16Y, &pstAccel->s16Z);
+    icm20948GyroAvg(&stSample.stGyro.s16X, &pstGyro->s16X, &pstGyro->s16Y, &pstGyro->s16Z);
+
+    // the magnetometer is slower than the ICM sample rate, hold the last measurement
+    icm20948MagDecode(u8Buf + (REG_ADD_EXT_SENS_DATA_00 - REG_ADD_ACCEL_XOUT_H), _s16MagnRaw);
+    icm20948MagAvg(_s16MagnRaw, &ps16Magn[0], &ps16Magn[1], &ps16Magn[2]);
+
+    return;
+}
+
+template <class Transport>
+bool Icm20948Driver<Transport>::icm20948MagDecode(const uint8_t *pu8Buf, int16_t *ps16Magn)
+{
+    // ST1, HXL..HZH (little-endian), TMPS, ST2
+    if (((pu8Buf[0] & REG_VAL_BIT_MAG_DRDY) == 0) || ((pu8Buf[8] & REG_VAL_BIT_MAG_HOFL) != 0))
+    {
+        return false;
+    }
+
+    ps16Magn[0] = (int16_t)((pu8Buf[2] << 8) | pu8Buf[1]);
+    ps16Magn[1] = (int16_t)((pu8Buf[4] << 8) | pu8Buf[3]);
+    ps16Magn[2] = (int16_t)((pu8Buf[6] << 8) | pu8Buf[5]);
+
+    return true;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948ReadSecondary(uint8_t u8I2CAddr, uint8_t u8RegAddr, uint8_t u8Len, uint8_t *pu8data)
+{
+    /* user bank 3 register */
+    // only SLV0 may run while the master is enabled
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV1_CTRL, 0x00);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV0_ADDR, u8I2CAddr);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV0_REG, u8RegAddr);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV0_CTRL, REG_VAL_BIT_SLV0_EN | u8Len);
+
+    /* user bank 0 register */
+    icm20948RegModify(REG_VAL_REG_BANK_0, REG_ADD_USER_CTRL, 0, REG_VAL_BIT_I2C_MST_EN);
+    HAL_Delay(5);
+    icm20948RegModify(REG_VAL_REG_BANK_0, REG_ADD_USER_CTRL, REG_VAL_BIT_I2C_MST_EN, 0);
+
+    // SLV0 stays configured but idle with the master off, the next access rewrites what differs
+    icm20948BankSelect(REG_VAL_REG_BANK_0);
+    busReadBytes(REG_ADD_EXT_SENS_DATA_00, pu8data, u8Len);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948WriteSecondary(uint8_t u8I2CAddr, uint8_t u8RegAddr, uint8_t u8data)
+{
+    /* user bank 3 register */
+    // only SLV1 may run while the master is enabled
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV0_CTRL, 0x00);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV1_ADDR, u8I2CAddr);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV1_REG, u8RegAddr);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV1_DO, u8data);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV1_CTRL, REG_VAL_BIT_SLV0_EN | 1);
+
+    /* user bank 0 register */
+    icm20948RegModify(REG_VAL_REG_BANK_0, REG_ADD_USER_CTRL, 0, REG_VAL_BIT_I2C_MST_EN);
+    HAL_Delay(5);
+    icm20948RegModify(REG_VAL_REG_BANK_0, REG_ADD_USER_CTRL, REG_VAL_BIT_I2C_MST_EN, 0);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948GyroOffset(void)
+{
+    uint8_t i;
+    int16_t s16Reg[3];
+    float fBias[3];
+    float fLsbPerDps = GYRO_LSB_PER_DPS[_enGyroFs];
+
+    icm20948GyroBiasGet(fBias);
+    if (_enBiasMode == IMU_EN_BIAS_MODE_REGISTER)
+    {
+        // the sensor adds XG_OFFS_USR * 4 / 2^GYRO_FS_SEL LSB to its output
+        for (i = 0; i < 3; i++)
+        {
+            s16Reg[i] = icm20948Sat16(-lroundf(fBias[i] * GYRO_OFFS_LSB_PER_DPS));
+            _fGyroBiasAppliedDps[i] = -s16Reg[i] / GYRO_OFFS_LSB_PER_DPS;
+        }
+        icm20948GyroOffsRegWrite(s16Reg);
+        _stGyroOffset = {0, 0, 0};
+    }
+    else
+    {
+        _stGyroOffset.s16X = icm20948Sat16(lroundf(fBias[0] * fLsbPerDps));
+        _stGyroOffset.s16Y = icm20948Sat16(lroundf(fBias[1] * fLsbPerDps));
+        _stGyroOffset.s16Z = icm20948Sat16(lroundf(fBias[2] * fLsbPerDps));
+        _fGyroBiasAppliedDps[0] = _stGyroOffset.s16X / fLsbPerDps;
+        _fGyroBiasAppliedDps[1] = _stGyroOffset.s16Y / fLsbPerDps;
+        _fGyroBiasAppliedDps[2] = _stGyroOffset.s16Z / fLsbPerDps;
+    }
+
+    return;
+}
+
+// zero until a bias was loaded or measured, then the temperature model once it has one
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948GyroBiasGet(float *pfBiasDps)
+{
+    if (_bTempComp && _bTempValid && _clGyroTemp.valid())
+    {
+        _clGyroTemp.biasGet(_fTempC, pfBiasDps);
+    }
+    else
+    {
+        memcpy(pfBiasDps, _stGyroCal.afBiasDps, sizeof(_stGyroCal.afBiasDps));
+    }
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948TempDecode(const uint8_t *pu8Buf)
+{
+    float fTempC = (int16_t)((pu8Buf[0] << 8) | pu8Buf[1]) / TEMP_LSB_PER_DEGC + TEMP_OFFSET_DEGC;
+
+    _fTempC = _bTempValid ? _fTempC + TEMP_FILTER_ALPHA * (fTempC - _fTempC) : fTempC;
+    _bTempValid = true;
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948AccelOffset(void)
+{
+    uint8_t i;
+    int16_t s16Reg[3];
+    float fLsbPerG = ACCEL_LSB_PER_G[_enAccelFs];
+
+    if (_enBiasMode == IMU_EN_BIAS_MODE_REGISTER)
+    {
+        // relative to the factory trim: the sensor adds (XA_OFFS - trim) << (3 - ACCEL_FS_SEL)
+        // LSB, bit 0 is reserved so the bias goes in as steps of two
+        icm20948AccelTrimRead();
+        for (i = 0; i < 3; i++)
+        {
+            s16Reg[i] = icm20948Sat16((_s16AccelTrim[i] & ~REG_VAL_BIT_ACCEL_OFFS_RSVD) -
+                                      2 * lroundf(_fAccelBiasG[i] * ACCEL_OFFS_LSB_PER_G * 0.5f));
+            s16Reg[i] = (s16Reg[i] & ~REG_VAL_BIT_ACCEL_OFFS_RSVD) | (_s16AccelTrim[i] & REG_VAL_BIT_ACCEL_OFFS_RSVD);
+        }
+        icm20948AccelOffsRegWrite(s16Reg);
+        _stAccelOffset = {0, 0, 0};
+    }
+    else
+    {
+        _stAccelOffset.s16X = icm20948Sat16(lroundf(_fAccelBiasG[0] * fLsbPerG));
+        _stAccelOffset.s16Y = icm20948Sat16(lroundf(_fAccelBiasG[1] * fLsbPerG));
+        _stAccelOffset.s16Z = icm20948Sat16(lroundf(_fAccelBiasG[2] * fLsbPerG));
+    }
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948GyroOffsRegWrite(const int16_t *ps16Reg)
+{
+    uint8_t i;
+
+    /* user bank 2 register */
+    for (i = 0; i < 3; i++)
+    {
+        icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_XG_OFFS_USRH + 2 * i, (uint16_t)ps16Reg[i] >> 8);
+        icm20948RegWrite(REG_VAL_REG_BANK_2, REG_ADD_XG_OFFS_USRH + 2 * i + 1, ps16Reg[i] & 0xFF);
+    }
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948AccelOffsRegWrite(const int16_t *ps16Reg)
+{
+    uint8_t i;
+    static const uint8_t su8Reg[3] = {REG_ADD_XA_OFFS_H, REG_ADD_YA_OFFS_H, REG_ADD_ZA_OFFS_H};
+
+    /* user bank 1 register */
+    for (i = 0; i < 3; i++)
+    {
+        icm20948RegWrite(REG_VAL_REG_BANK_1, su8Reg[i], (uint16_t)ps16Reg[i] >> 8);
+        icm20948RegWrite(REG_VAL_REG_BANK_1, su8Reg[i] + 1, ps16Reg[i] & 0xFF);
+    }
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948AccelTrimRead(void)
+{
+    uint8_t i;
+    static const uint8_t su8Reg[3] = {REG_ADD_XA_OFFS_H, REG_ADD_YA_OFFS_H, REG_ADD_ZA_OFFS_H};
+
+    // only valid before the driver writes the registers for the first time after a reset
+    if (_bAccelTrimValid)
+    {
+        return;
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        _s16AccelTrim[i] = (int16_t)((icm20948RegRead(REG_VAL_REG_BANK_1, su8Reg[i]) << 8) |
+                                     icm20948RegRead(REG_VAL_REG_BANK_1, su8Reg[i] + 1));
+    }
+    _bAccelTrimValid = true;
+
+    return;
+}
+
+template <class Transport>
+int16_t Icm20948Driver<Transport>::icm20948Sat16(int32_t s32Val)
+{
+    return (int16_t)(s32Val > INT16_MAX ? INT16_MAX : (s32Val < INT16_MIN ? INT16_MIN : s32Val));
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948GyroCalUpdate(const IMU_ST_SENSOR_DATA *pstAccel, const IMU_ST_SENSOR_DATA *pstGyro)
+{
+    float fGyro[3], fAccel[3];
+    float fGyroScale = 1.0f / GYRO_LSB_PER_DPS[_enGyroFs];
+    float fAccelScale = 1.0f / ACCEL_LSB_PER_G[_enAccelFs];
+
+    // the estimate is of what the sensor would report uncorrected, so put the offset in use back
+    fGyro[0] = pstGyro->s16X * fGyroScale + _fGyroBiasAppliedDps[0];
+    fGyro[1] = pstGyro->s16Y * fGyroScale + _fGyroBiasAppliedDps[1];
+    fGyro[2] = pstGyro->s16Z * fGyroScale + _fGyroBiasAppliedDps[2];
+    fAccel[0] = pstAccel->s16X * fAccelScale;
+    fAccel[1] = pstAccel->s16Y * fAccelScale;
+    fAccel[2] = pstAccel->s16Z * fAccelScale;
+
+    if (GyroCal_Update(&_stGyroCal, fGyro, fAccel, _fTempC))
+    {
+        if (_bTempValid)
+        {
+            _clGyroTemp.pointAdd(_stGyroCal.fTempC, _stGyroCal.afBiasDps);
+        }
+        icm20948GyroOffset();
+    }
+    else if (_bTempComp && _clGyroTemp.valid())
+    {
+        // constant time, and in register mode the cache drops writes of unchanged values
+        icm20948GyroOffset();
+    }
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948GyroFsWrite(IMU_EN_GYRO_FS enFs)
+{
+    uint8_t i;
+    int8_t s8Shift = (int8_t)_enGyroFs - (int8_t)enFs;
+
+    if (enFs == _enGyroFs)
+    {
+        return;
+    }
+
+    icm20948RegModify(REG_VAL_REG_BANK_2, REG_ADD_GYRO_CONFIG_1, REG_VAL_BIT_GYRO_FS_MASK, enFs << 1);
+
+    // keep the averaging window and the offset in the units of the new range
+    for (i = 0; i < 3; i++)
+    {
+        icm20948AvgRescale(&_stGyroAvg[i], s8Shift);
+    }
+
+    _enGyroFs = enFs;
+    icm20948GyroOffset();
+    _u8GyroHoldoff = 1;
+    _u16GyroQuiet = 0;
+    _u32RangeSwitches++;
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948AccelFsWrite(IMU_EN_ACCEL_FS enFs)
+{
+    uint8_t i;
+    int8_t s8Shift = (int8_t)_enAccelFs - (int8_t)enFs;
+
+    if (enFs == _enAccelFs)
+    {
+        return;
+    }
+
+    icm20948RegModify(REG_VAL_REG_BANK_2, REG_ADD_ACCEL_CONFIG, REG_VAL_BIT_ACCEL_FS_MASK, enFs << 1);
+
+    for (i = 0; i < 3; i++)
+    {
+        icm20948AvgRescale(&_stAccelAvg[i], s8Shift);
+    }
+
+    _enAccelFs = enFs;
+    icm20948AccelOffset();
+    _u8AccelHoldoff = 1;
+    _u16AccelQuiet = 0;
+    _u32RangeSwitches++;
+
+    return;
+}
+
+/*
+ * Runs once per imuDataGet() on the peaks of the raw sample. Widening is immediate
+ * so a clipped axis costs one sample; narrowing waits for a quiet second and only
+ * goes back down to the range set through imuGyroFsSet()/imuAccelFsSet().
+ * FIFO frames are not covered, they are scaled by whoever drains the FIFO.
+ */
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948AutoRange(void)
+{
+    if (!_bAutoRange)
+    {
+        return;
+    }
+
+    if (_s16GyroPeak >= AUTORANGE_SAT_LSB)
+    {
+        if (_enGyroFs < IMU_EN_GYRO_FS_2000DPS)
+        {
+            icm20948GyroFsWrite((IMU_EN_GYRO_FS)(_enGyroFs + 1));
+        }
+    }
+    else if ((_s16GyroPeak < AUTORANGE_QUIET_LSB) && (_enGyroFs > _enGyroFsBase))
+    {
+        if (++_u16GyroQuiet >= AUTORANGE_QUIET_SAMPLES)
+        {
+            icm20948GyroFsWrite((IMU_EN_GYRO_FS)(_enGyroFs - 1));
+        }
+    }
+    else
+    {
+        _u16GyroQuiet = 0;
+    }
+
+    if (_s16AccelPeak >= AUTORANGE_SAT_LSB)
+    {
+        if (_enAccelFs < IMU_EN_ACCEL_FS_16G)
+        {
+            icm20948AccelFsWrite((IMU_EN_ACCEL_FS)(_enAccelFs + 1));
+        }
+    }
+    else if ((_s16AccelPeak < AUTORANGE_QUIET_LSB) && (_enAccelFs > _enAccelFsBase))
+    {
+        if (++_u16AccelQuiet >= AUTORANGE_QUIET_SAMPLES)
+        {
+            icm20948AccelFsWrite((IMU_EN_ACCEL_FS)(_enAccelFs - 1));
+        }
+    }
+    else
+    {
+        _u16AccelQuiet = 0;
+    }
+
+    return;
+}
+
+template <class Transport>
+int16_t Icm20948Driver<Transport>::icm20948PeakAbs(const int16_t *ps16In)
+{
+    uint8_t i;
+    int32_t s32Peak = 0;
+
+    for (i = 0; i < 3; i++)
+    {
+        int32_t s32Abs = ps16In[i] < 0 ? -(int32_t)ps16In[i] : ps16In[i];
+        if (s32Abs > s32Peak)
+        {
+            s32Peak = s32Abs;
+        }
+    }
+
+    return (int16_t)(s32Peak > INT16_MAX ? INT16_MAX : s32Peak);
+}
+
+template <class Transport>
+int16_t Icm20948Driver<Transport>::icm20948AvgGet(const ICM20948_ST_AVG_DATA *pstAvg)
+{
+    uint8_t i;
+    int32_t s32Sum = 0;
+
+    for (i = 0; i < 8; i++)
+    {
+        s32Sum += pstAvg->s16AvgBuffer[i];
+    }
+
+    return (int16_t)(s32Sum >> 3);
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948AvgRescale(ICM20948_ST_AVG_DATA *pstAvg, int8_t s8Shift)
+{
+    uint8_t i;
+
+    for (i = 0; i < 8; i++)
+    {
+        pstAvg->s16AvgBuffer[i] = icm20948Rescale(pstAvg->s16AvgBuffer[i], s8Shift);
+    }
+
+    return;
+}
+
+// adjacent ranges differ by a factor of two: shift > 0 for a narrower range
+template <class Transport>
+int16_t Icm20948Driver<Transport>::icm20948Rescale(int16_t s16Val, int8_t s8Shift)
+{
+    int32_t s32Val = (s8Shift >= 0) ? (int32_t)s16Val * (1 << s8Shift) : (int32_t)s16Val >> -s8Shift;
+
+    if (s32Val > INT16_MAX)
+    {
+        s32Val = INT16_MAX;
+    }
+    else if (s32Val < INT16_MIN)
+    {
+        s32Val = INT16_MIN;
+    }
+
+    return (int16_t)s32Val;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948FifoReset(void)
+{
+    // assert and de-assert, FIFO_RST is never cached
+    icm20948BankSelect(REG_VAL_REG_BANK_0);
+    busWriteByte(REG_ADD_FIFO_RST, REG_VAL_FIFO_RESET);
+    busWriteByte(REG_ADD_FIFO_RST, 0x00);
+
+    return;
+}
+
+template <class Transport>
+uint16_t Icm20948Driver<Transport>::icm20948FifoCountGet(void)
+{
+    uint8_t u8Buf[2] = {0, 0}; // a failed read is an empty FIFO
+
+    icm20948BankSelect(REG_VAL_REG_BANK_0);
+    busReadBytes(REG_ADD_FIFO_COUNTH, u8Buf, 2);
+
+    return ((uint16_t)(u8Buf[0] & 0x1F) << 8) | u8Buf[1];
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948FifoParse(const uint8_t *pu8Buf, uint16_t u16Len)
+{
+    ICM20948_ST_RAW_SAMPLE stRaw;
+    ICM20948_ST_FIFO_SAMPLE *pstSample;
+    const uint8_t *pu8Magn;
+    int16_t s16Magn[3];
+    uint8_t u8Head;
+    uint16_t u16Off;
+    uint16_t u16Frames;
+
+    u16Frames = u16Len / _u8FifoFrameLen;
+    for (u16Off = 0; u16Off + _u8FifoFrameLen <= u16Len; u16Off += _u8FifoFrameLen)
+    {
+        _stFifoStats.u32Frames++;
+        u16Frames--;
+
+        u8Head = _u8FifoHead;
+        if (((u8Head + 1) & (FIFO_QUEUE_LEN - 1)) == _u8FifoTail)
+        {
+            _stFifoStats.u32Dropped++;
+            continue;
+        }
+
+        pstSample = &_stFifoQueue[u8Head];
+        icm20948SampleDecode(pu8Buf + u16Off, &stRaw);
+        pstSample->stAccel = stRaw.stAccel;
+        pstSample->stGyro = stRaw.stGyro;
+        pstSample->u8MagnValid = 0;
+        // the newest frame was written just before the count was read
+        pstSample->u32Stamp = _u32FifoRxStamp - Timestamp_UsToTicks(u16Frames * _u32FifoSampleUs);
+
+        if (_u8FifoFrameLen > REG_LEN_ACCEL_GYRO)
+        {
+            // axes aligned with accel/gyro as in icm20948MagRead
+            pu8Magn = pu8Buf + u16Off + REG_LEN_ACCEL_GYRO;
+            if (icm20948MagDecode(pu8Magn, s16Magn))
+            {
+                pstSample->stMagn.s16X = s16Magn[0];
+                pstSample->stMagn.s16Y = -s16Magn[1];
+                pstSample->stMagn.s16Z = -s16Magn[2];
+                pstSample->u8MagnValid = 1;
+            }
+        }
+
+        _u8FifoHead = (u8Head + 1) & (FIFO_QUEUE_LEN - 1);
+    }
+
+    return;
+}
+
+template <class Transport>
+bool Icm20948Driver<Transport>::icm20948DmpMemWrite(uint16_t u16Addr, const uint8_t *pu8Data, uint16_t u16Len, bool bVerify)
+{
+    uint16_t u16Chunk;
+    uint8_t u8Buf[DMP_MEM_CHUNK];
+
+    icm20948BankSelect(REG_VAL_REG_BANK_0);
+    while (u16Len > 0)
+    {
+        // a burst wraps inside its memory bank, so it stops at the bank boundary
+        u16Chunk = DMP_MEM_BANK_SIZE - (u16Addr & 0xFF);
+        if (u16Chunk > DMP_MEM_CHUNK)
+        {
+            u16Chunk = DMP_MEM_CHUNK;
+        }
+        if (u16Chunk > u16Len)
+        {
+            u16Chunk = u16Len;
+        }
+
+        busWriteByte(REG_ADD_MEM_BANK_SEL, u16Addr >> 8);
+        busWriteByte(REG_ADD_MEM_START_ADDR, u16Addr & 0xFF);
+        busWriteBytes(REG_ADD_MEM_R_W, pu8Data, u16Chunk);
+
+        if (bVerify)
+        {
+            busWriteByte(REG_ADD_MEM_START_ADDR, u16Addr & 0xFF);
+            busReadBytes(REG_ADD_MEM_R_W, u8Buf, u16Chunk);
+            if (memcmp(u8Buf, pu8Data, u16Chunk) != 0)
+            {
+                return false;
+            }
+        }
+
+        u16Addr += u16Chunk;
+        pu8Data += u16Chunk;
+        u16Len -= u16Chunk;
+    }
+
+    return true;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948DmpMemWrite16(uint16_t u16Addr, uint16_t u16Value)
+{
+    uint8_t u8Buf[2] = {(uint8_t)(u16Value >> 8), (uint8_t)u16Value};
+
+    icm20948DmpMemWrite(u16Addr, u8Buf, sizeof(u8Buf), false);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948DmpMemWrite32(uint16_t u16Addr, uint32_t u32Value)
+{
+    uint8_t u8Buf[4] = {(uint8_t)(u32Value >> 24), (uint8_t)(u32Value >> 16), (uint8_t)(u32Value >> 8), (uint8_t)u32Value};
+
+    icm20948DmpMemWrite(u16Addr, u8Buf, sizeof(u8Buf), false);
+
+    return;
+}
+
+// the settings of the eMD driver for a game (6-axis) or geomagnetic (9-axis) rotation vector
+// at every DMP sample
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948DmpConfig(bool b9Axis)
+{
+    uint8_t i;
+    uint16_t u16Header = b9Axis ? DMP_HDR_QUAT9 : DMP_HDR_QUAT6;
+    uint16_t u16Motion = DMP_MOTION_ACCEL_CAL | DMP_MOTION_GYRO_CAL;
+    uint16_t u16Ready = DMP_DATA_RDY_GYRO | DMP_DATA_RDY_ACCEL;
+    int32_t s32Cpass;
+
+    // sensor axes in and out, the board mapping is applied to the quaternion
+    for (i = 0; i < 9; i++)
+    {
+        icm20948DmpMemWrite32(DMP_MEM_B2S_MTX + 4 * i, (i % 4 == 0) ? DMP_Q30_ONE : 0);
+    }
+
+    icm20948DmpMemWrite32(DMP_MEM_GYRO_SF, Dmp_GyroSf(icm20948RegRead(REG_VAL_REG_BANK_2, REG_ADD_GYRO_SMPLRT_DIV),
+                                                      icm20948RegRead(REG_VAL_REG_BANK_1, REG_ADD_TIMEBASE_CORRECTION_PLL)));
+    icm20948DmpMemWrite32(DMP_MEM_GYRO_FULLSCALE, DMP_GYRO_FULLSCALE_2000DPS);
+    icm20948DmpMemWrite32(DMP_MEM_ACC_SCALE, DMP_ACC_SCALE_4G);
+    icm20948DmpMemWrite32(DMP_MEM_ACC_SCALE2, DMP_ACC_SCALE2_4G);
+
+    if (b9Axis)
+    {
+        // AK09916 y and z point against the accel/gyro axes, as in icm20948FifoParse
+        for (i = 0; i < 9; i++)
+        {
+            s32Cpass = (i == 0) ? DMP_CPASS_SCALE : -DMP_CPASS_SCALE;
+            icm20948DmpMemWrite32(DMP_MEM_CPASS_MTX + 4 * i, (i % 4 == 0) ? (uint32_t)s32Cpass : 0);
+        }
+        icm20948DmpMagInit();
+        u16Motion |= DMP_MOTION_COMPASS_CAL | DMP_MOTION_9AXIS;
+        u16Ready |= DMP_DATA_RDY_SECONDARY;
+    }
+
+    icm20948DmpMemWrite16(DMP_MEM_DATA_OUT_CTL1, u16Header);
+    icm20948DmpMemWrite16(DMP_MEM_DATA_OUT_CTL2, 0);
+    icm20948DmpMemWrite16(DMP_MEM_DATA_INTR_CTL, u16Header);
+    icm20948DmpMemWrite16(DMP_MEM_MOTION_EVENT_CTL, u16Motion);
+    icm20948DmpMemWrite16(DMP_MEM_DATA_RDY_STATUS, u16Ready);
+    icm20948DmpMemWrite16(b9Axis ? DMP_MEM_ODR_QUAT9 : DMP_MEM_ODR_QUAT6, 0);
+    icm20948DmpMemWrite16(b9Axis ? DMP_MEM_ODR_CNTR_QUAT9 : DMP_MEM_ODR_CNTR_QUAT6, 0);
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948DmpMagInit(void)
+{
+    /* user bank 3 register */
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_MST_ODR_CONFIG, REG_VAL_I2C_MST_ODR_DMP);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_MST_CTRL, REG_VAL_I2C_MST_CLK_345KHZ);
+    // the DMP expects RSV2..ST2 with the bytes of each axis swapped to big-endian
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV0_ADDR,
+                     I2C_ADD_ICM20948_AK09916 | I2C_ADD_ICM20948_AK09916_READ);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV0_REG, REG_ADD_MAG_RSV2);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV0_CTRL,
+                     REG_VAL_BIT_SLV0_EN | REG_VAL_BIT_SLV_BYTE_SW | REG_VAL_BIT_SLV_GRP | REG_LEN_MAG_DMP);
+    // and a single measurement triggered every cycle through SLV1
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV1_ADDR,
+                     I2C_ADD_ICM20948_AK09916 | I2C_ADD_ICM20948_AK09916_WRITE);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV1_REG, REG_ADD_MAG_CNTL2);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV1_DO, REG_VAL_MAG_MODE_SM);
+    icm20948RegWrite(REG_VAL_REG_BANK_3, REG_ADD_I2C_SLV1_CTRL, REG_VAL_BIT_SLV0_EN | 1);
+
+    return;
+}
+
+// the DMP reports the sensor frame; the board axes of imuDataGet() are the sensor axes
+// turned by +90 deg about z, i.e. q_board = q_sensor * (cos 45, 0, 0, -sin 45)
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948DmpQuatSet(const int32_t *ps32Q30)
+{
+    float fQ[4];
+    const float fHalfSqrt2 = 0.70710678f;
+
+    Dmp_QuatFromQ30(ps32Q30, fQ);
+    _fQ[0] = (fQ[0] + fQ[3]) * fHalfSqrt2;
+    _fQ[1] = (fQ[1] - fQ[2]) * fHalfSqrt2;
+    _fQ[2] = (fQ[1] + fQ[2]) * fHalfSqrt2;
+    _fQ[3] = (fQ[3] - fQ[0]) * fHalfSqrt2;
+    _bQFloatSet = true;
+
+    return;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948StreamStore(ACQ_SCHED_EN_STREAM enStream, int32_t s32X, int32_t s32Y, int32_t s32Z, uint32_t u32Stamp)
+{
+    IMU_ST_STREAM_SAMPLE *pstSample = &_stStream[enStream];
+
+    pstSample->as32Val[0] = s32X;
+    pstSample->as32Val[1] = s32Y;
+    pstSample->as32Val[2] = s32Z;
+    pstSample->u32Stamp = u32Stamp;
+    pstSample->u32Seq++;
+    _u8StreamNew |= ACQ_SCHED_BIT(enStream);
+
+    return;
+}
+
+// time since the previous sample of the stream the fusion took, 0 for the first one
+template <class Transport>
+uint32_t Icm20948Driver<Transport>::icm20948StreamDtUs(ACQ_SCHED_EN_STREAM enStream, uint32_t u32Stamp)
+{
+    uint32_t u32DtUs = 0;
+
+    if (_u8StreamFusedValid & ACQ_SCHED_BIT(enStream))
+    {
+        u32DtUs = Timestamp_DeltaUs(_u32StreamFused[enStream], u32Stamp);
+    }
+    _u32StreamFused[enStream] = u32Stamp;
+    _u8StreamFusedValid |= ACQ_SCHED_BIT(enStream);
+
+    return u32DtUs;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::icm20948CalAvgValue(uint8_t *pIndex, int16_t *pAvgBuffer, int16_t InVal, int32_t *pOutVal)
+{
+    uint8_t i;
+
+    *(pAvgBuffer + ((*pIndex)++)) = InVal;
+    *pIndex &= 0x07;
+
+    *pOutVal = 0;
+    for (i = 0; i < 8; i++)
+    {
+        *pOutVal += *(pAvgBuffer + i);
+    }
+    *pOutVal >>= 3;
+}
+
+// the attitude accel and magnetometer give: up from the accel, north from the horizontal part
+// of the field, or the board's x axis without one; a zero accel leaves the attitude as it is
+template <class Transport>
+void Icm20948Driver<Transport>::imuAHRSinit(const float *pfAccel, const float *pfMagn)
+{
+    Vector3f clUp(pfAccel), clNorth(pfMagn);
+    Dcmf clR;
+
+    if (clUp.norm_squared() <= 0.0f)
+    {
+        return;
+    }
+    clUp.normalize();
+
+    clNorth -= clUp * clNorth.dot(clUp);
+    if (clNorth.norm_squared() <= 1e-6f * Vector3f(pfMagn).norm_squared())
+    {
+        clNorth = (std::fabs(clUp(0)) < 0.9f) ? Vector3f(1.0f, 0.0f, 0.0f) : Vector3f(0.0f, 1.0f, 0.0f);
+        clNorth -= clUp * clNorth.dot(clUp);
+    }
+    clNorth.normalize();
+
+    // the earth axes in the board frame are the rows of the board to earth rotation
+    clR.setRow(0, clNorth);
+    clR.setRow(1, clUp.cross(clNorth));
+    clR.setRow(2, clUp);
+
+    const Quatf clQ(clR);
+    _fQ[0] = clQ(0);
+    _fQ[1] = clQ(1);
+    _fQ[2] = clQ(2);
+    _fQ[3] = clQ(3);
+    _bQFloatSet = true;
+
+    return;
+}
+
+// one step of the Mahony filter, each correction optional: pfAccel and pfMagn are NULL without
+// a new sample, and fAccelDt / fMagnDt the time the new one stands for
+template <class Transport>
+void Icm20948Driver<Transport>::imuAHRSstep(const float *pfGyro, const float *pfAccel, float fAccelDt, const float *pfMagn, float fMagnDt, float fDt)
+{
+    float &q0 = _fQ[0], &q1 = _fQ[1], &q2 = _fQ[2], &q3 = _fQ[3];
+    float afErr[3], afRate[3];
+    float gx, gy, gz, norm;
+    float halfT = 0.5f * fDt;
+
+    imuAHRSerror(pfAccel, fAccelDt / fDt, pfMagn, fMagnDt / fDt, afErr);
+    imuAHRSfeedback(afErr, fDt, afRate);
+
+    gx = pfGyro[0] + afRate[0];
+    gy = pfGyro[1] + afRate[1];
+    gz = pfGyro[2] + afRate[2];
+
+    // all four from the attitude before the step
+    const float p0 = q0, p1 = q1, p2 = q2, p3 = q3;
+    q0 = p0 + (-p1 * gx - p2 * gy - p3 * gz) * halfT;
+    q1 = p1 + (p0 * gx + p2 * gz - p3 * gy) * halfT;
+    q2 = p2 + (p0 * gy - p1 * gz + p3 * gx) * halfT;
+    q3 = p3 + (p0 * gz + p1 * gy - p2 * gx) * halfT;
+
+    norm = invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    q0 = q0 * norm;
+    q1 = q1 * norm;
+    q2 = q2 * norm;
+    q3 = q3 * norm;
+    _bQFloatSet = true;
+}
+
+// the slow stage of the two-rate fusion: the gyro rotation of the interval, then the
+// accel / magnetometer correction at its end, held over the fDt the interval spans
+template <class Transport>
+void Icm20948Driver<Transport>::imuAHRSdelta(const float *pfDeltaQ, const float *pfAccel, const float *pfMagn, float fDt)
+{
+    float &q0 = _fQ[0], &q1 = _fQ[1], &q2 = _fQ[2], &q3 = _fQ[3];
+    const float d0 = pfDeltaQ[0], d1 = pfDeltaQ[1], d2 = pfDeltaQ[2], d3 = pfDeltaQ[3];
+    float p0, p1, p2, p3;
+    float afErr[3], afRate[3];
+    float gx, gy, gz, norm;
+    float halfT = 0.5f * fDt;
+
+    p0 = q0 * d0 - q1 * d1 - q2 * d2 - q3 * d3;
+    p1 = q0 * d1 + q1 * d0 + q2 * d3 - q3 * d2;
+    p2 = q0 * d2 - q1 * d3 + q2 * d0 + q3 * d1;
+    p3 = q0 * d3 + q1 * d2 - q2 * d1 + q3 * d0;
+    norm = invSqrt(p0 * p0 + p1 * p1 + p2 * p2 + p3 * p3);
+    q0 = p0 * norm;
+    q1 = p1 * norm;
+    q2 = p2 * norm;
+    q3 = p3 * norm;
+
+    imuAHRSerror(pfAccel, 1.0f, pfMagn, 1.0f, afErr);
+    imuAHRSfeedback(afErr, fDt, afRate);
+
+    gx = afRate[0];
+    gy = afRate[1];
+    gz = afRate[2];
+
+    // all four from the attitude before the correction
+    p0 = q0;
+    p1 = q1;
+    p2 = q2;
+    p3 = q3;
+    q0 = p0 + (-p1 * gx - p2 * gy - p3 * gz) * halfT;
+    q1 = p1 + (p0 * gx + p2 * gz - p3 * gy) * halfT;
+    q2 = p2 + (p0 * gy - p1 * gz + p3 * gx) * halfT;
+    q3 = p3 + (p0 * gz + p1 * gy - p2 * gx) * halfT;
+
+    norm = invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    q0 = q0 * norm;
+    q1 = q1 * norm;
+    q2 = q2 * norm;
+    q3 = q3 * norm;
+    _bQFloatSet = true;
+}
+
+// sum of the cross products between the measured and the estimated directions of gravity
+// and flux, each weighted; a NULL or zero vector adds nothing
+template <class Transport>
+void Icm20948Driver<Transport>::imuAHRSerror(const float *pfAccel, float fAccelWeight, const float *pfMagn, float fMagnWeight, float *pfErr)
+{
+    const float &q0 = _fQ[0], &q1 = _fQ[1], &q2 = _fQ[2], &q3 = _fQ[3];
+    float ax, ay, az, mx, my, mz, norm;
+    float hx, hy, hz, bx, bz;
+    float vx, vy, vz, wx, wy, wz;
+
+    float q0q0 = q0 * q0;
+    float q0q1 = q0 * q1;
+    float q0q2 = q0 * q2;
+    float q0q3 = q0 * q3;
+    float q1q1 = q1 * q1;
+    float q1q2 = q1 * q2;
+    float q1q3 = q1 * q3;
+    float q2q2 = q2 * q2;
+    float q2q3 = q2 * q3;
+    float q3q3 = q3 * q3;
+
+    pfErr[0] = 0.0f;
+    pfErr[1] = 0.0f;
+    pfErr[2] = 0.0f;
+
+    norm = (pfAccel != NULL) ? pfAccel[0] * pfAccel[0] + pfAccel[1] * pfAccel[1] + pfAccel[2] * pfAccel[2] : 0.0f;
+    if (norm > 0.0f)
+    {
+        norm = invSqrt(norm);
+        ax = pfAccel[0] * norm;
+        ay = pfAccel[1] * norm;
+        az = pfAccel[2] * norm;
+
+        // estimated direction of gravity
+        vx = 2 * (q1q3 - q0q2);
+        vy = 2 * (q0q1 + q2q3);
+        vz = q0q0 - q1q1 - q2q2 + q3q3;
+
+        pfErr[0] += (ay * vz - az * vy) * fAccelWeight;
+        pfErr[1] += (az * vx - ax * vz) * fAccelWeight;
+        pfErr[2] += (ax * vy - ay * vx) * fAccelWeight;
+    }
+
+    norm = (pfMagn != NULL) ? pfMagn[0] * pfMagn[0] + pfMagn[1] * pfMagn[1] + pfMagn[2] * pfMagn[2] : 0.0f;
+    if (norm > 0.0f)
+    {
+        norm = invSqrt(norm);
+        mx = pfMagn[0] * norm;
+        my = pfMagn[1] * norm;
+        mz = pfMagn[2] * norm;
+
+        // reference direction of flux, and its estimated direction
+        hx = 2 * mx * (0.5f - q2q2 - q3q3) + 2 * my * (q1q2 - q0q3) + 2 * mz * (q1q3 + q0q2);
+        hy = 2 * mx * (q1q2 + q0q3) + 2 * my * (0.5f - q1q1 - q3q3) + 2 * mz * (q2q3 - q0q1);
+        hz = 2 * mx * (q1q3 - q0q2) + 2 * my * (q2q3 + q0q1) + 2 * mz * (0.5f - q1q1 - q2q2);
+        bx = sqrtf((hx * hx) + (hy * hy));
+        bz = hz;
+        wx = 2 * bx * (0.5f - q2q2 - q3q3) + 2 * bz * (q1q3 - q0q2);
+        wy = 2 * bx * (q1q2 - q0q3) + 2 * bz * (q0q1 + q2q3);
+        wz = 2 * bx * (q0q2 + q1q3) + 2 * bz * (0.5f - q1q1 - q2q2);
+
+        pfErr[0] += (my * wz - mz * wy) * fMagnWeight;
+        pfErr[1] += (mz * wx - mx * wz) * fMagnWeight;
+        pfErr[2] += (mx * wy - my * wx) * fMagnWeight;
+    }
+}
+
+// the correction rate of an error over fDt: proportional plus the integral, rad/s
+template <class Transport>
+void Icm20948Driver<Transport>::imuAHRSfeedback(const float *pfErr, float fDt, float *pfRate)
+{
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        _fErrInt[i] += pfErr[i] * _fKi * fDt;
+        pfRate[i] = _fKp * pfErr[i] + _fErrInt[i];
+    }
+
+    return;
+}
+
+/*
+ * The fast stage: one gyro sample into the coning integrator, a new accel / magnetometer
+ * kept for the correction. The interval closes on the gyro sample nearest to the period,
+ * then the slow stage runs; returns true when it did.
+ */
+template <class Transport>
+bool Icm20948Driver<Transport>::icm20948TwoRateStep(const float *pfGyro, float fDt, const float *pfAccel, const float *pfMagn)
+{
+    float afDeltaQ[4];
+
+    if (pfAccel != NULL)
+    {
+        memcpy(_fCorrAccel, pfAccel, sizeof(_fCorrAccel));
+        _bCorrAccel = true;
+    }
+    if (pfMagn != NULL)
+    {
+        memcpy(_fCorrMagn, pfMagn, sizeof(_fCorrMagn));
+        _bCorrMagn = true;
+    }
+
+    _clConing.put(pfGyro, fDt);
+    if ((_clConing.dtGet() + 0.5f * fDt) * 1e6f < _u32CorrUs)
+    {
+        return false;
+    }
+
+    fDt = _clConing.get(afDeltaQ);
+    imuAHRSdelta(afDeltaQ, _bCorrAccel ? _fCorrAccel : NULL, _bCorrMagn ? _fCorrMagn : NULL, fDt);
+    _bCorrAccel = false;
+    _bCorrMagn = false;
+
+    return true;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::imuAnglesFromQuat(IMU_ST_ANGLES_DATA *pstAngles)
+{
+    const float &q0 = _fQ[0], &q1 = _fQ[1], &q2 = _fQ[2], &q3 = _fQ[3];
+
+    pstAngles->fPitch = asin(-2 * q1 * q3 + 2 * q0 * q2) * 57.3;                                // pitch
+    pstAngles->fRoll = atan2(2 * q2 * q3 + 2 * q0 * q1, -2 * q1 * q1 - 2 * q2 * q2 + 1) * 57.3; // roll
+    pstAngles->fYaw = atan2(-2 * q1 * q2 - 2 * q0 * q3, 2 * q2 * q2 + 2 * q3 * q3 - 1) * 57.3;  // yaw
+
+    return;
+}
+
+template <class Transport>
+float Icm20948Driver<Transport>::invSqrt(float x)
+{
+    float halfx = 0.5f * x;
+    float y = x;
+
+    int32_t i = *(int32_t *)&y;       // get bits for floating value
+    i = 0x5f3759df - (i >> 1);        // gives initial guss you
+    y = *(float *)&i;                 // convert bits back to float
+    y = y * (1.5f - (halfx * y * y)); // newtop step, repeating increases accuracy
+
+    return y;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::bmp280Init(void)
+{
+    bmp280ConfigWrite();
+    bmp280ReadCalibration();
+}
+
+// CONFIG writes may be ignored in normal mode, so park the sensor in sleep first
+template <class Transport>
+void Icm20948Driver<Transport>::bmp280ConfigWrite(void)
+{
+    const IMU_ST_BARO_CONFIG *pstCfg = &_stBaroConfig;
+    uint8_t u8CtrlMeas = (pstCfg->enTempOsrs << 5) | (pstCfg->enPressOsrs << 2);
+
+    bmp280WriteByte(BMP280_REGISTER_CONTROL, u8CtrlMeas | IMU_EN_BARO_MODE_SLEEP);
+    bmp280WriteByte(BMP280_REGISTER_CONFIG, (pstCfg->enStandby << 5) | (pstCfg->enFilter << 2));
+    bmp280WriteByte(BMP280_REGISTER_CONTROL, u8CtrlMeas | pstCfg->enMode);
+
+    // the first result is not there before one full conversion
+    _u32BaroDueTick = HAL_GetTick() + (bmp280MeasTimeUs(pstCfg) + 999) / 1000;
+}
+
+// maximum measurement time from the datasheet: 1.25 + 2.3 * osrs_t + 2.3 * osrs_p + 0.575 ms
+template <class Transport>
+uint32_t Icm20948Driver<Transport>::bmp280MeasTimeUs(const IMU_ST_BARO_CONFIG *pstConfig)
+{
+    uint32_t u32Us = 1250;
+
+    if (pstConfig->enTempOsrs != IMU_EN_BARO_OSRS_SKIP)
+    {
+        u32Us += 2300 << (pstConfig->enTempOsrs - 1);
+    }
+    if (pstConfig->enPressOsrs != IMU_EN_BARO_OSRS_SKIP)
+    {
+        u32Us += (2300 << (pstConfig->enPressOsrs - 1)) + 575;
+    }
+
+    return u32Us;
+}
+
+template <class Transport>
+bool Icm20948Driver<Transport>::bmp280Check(void)
+{
+    bool bRet = false;
+    if (BMP280_VAL_CHIPID == bmp280ReadByte(BMP280_REGISTER_CHIPID))
+    {
+        bRet = true;
+    }
+
+    return bRet;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::bmp280ReadCalibration(void)
+{
+    uint8_t u8Buf[BMP280_LEN_CALIBRATION];
+
+    /* dig_T1..dig_P9, little endian, in one transfer */
+    bmp280ReadBytes(BMP280_REGISTER_DIG_T1, u8Buf, BMP280_LEN_CALIBRATION);
+
+    dig_T1 = (uint16_t)(u8Buf[1] << 8 | u8Buf[0]);
+    dig_T2 = (int16_t)(u8Buf[3] << 8 | u8Buf[2]);
+    dig_T3 = (int16_t)(u8Buf[5] << 8 | u8Buf[4]);
+    dig_P1 = (uint16_t)(u8Buf[7] << 8 | u8Buf[6]);
+    dig_P2 = (int16_t)(u8Buf[9] << 8 | u8Buf[8]);
+    dig_P3 = (int16_t)(u8Buf[11] << 8 | u8Buf[10]);
+    dig_P4 = (int16_t)(u8Buf[13] << 8 | u8Buf[12]);
+    dig_P5 = (int16_t)(u8Buf[15] << 8 | u8Buf[14]);
+    dig_P6 = (int16_t)(u8Buf[17] << 8 | u8Buf[16]);
+    dig_P7 = (int16_t)(u8Buf[19] << 8 | u8Buf[18]);
+    dig_P8 = (int16_t)(u8Buf[21] << 8 | u8Buf[20]);
+    dig_P9 = (int16_t)(u8Buf[23] << 8 | u8Buf[22]);
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::bmp280TandPGet(float *temperature, float *pressure)
+{
+    uint8_t u8Buf[BMP280_LEN_DATA];
+
+    // press and temp in one burst, so both come from the same conversion
+    bmp280ReadBytes(BMP280_PRESS_MSB_REG, u8Buf, BMP280_LEN_DATA);
+    bmp280DataDecode(u8Buf, temperature, pressure);
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::bmp280DataDecode(const uint8_t *pu8Buf, float *temperature, float *pressure)
+{
+    int32_t adc_P, adc_T;
+
+    adc_P = ((int32_t)pu8Buf[0] << 12) | ((int32_t)pu8Buf[1] << 4) | (pu8Buf[2] >> 4);
+    adc_T = ((int32_t)pu8Buf[3] << 12) | ((int32_t)pu8Buf[4] << 4) | (pu8Buf[5] >> 4);
+
+    // temperature first, it sets t_fine for the pressure compensation
+    *temperature = bmp280CompensateTemperature(adc_T);
+    *pressure = bmp280CompensatePressure(adc_P);
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::bmp280CalAvgValue(uint8_t *pIndex, int32_t *pAvgBuffer, int32_t InVal, int32_t *pOutVal)
+{
+    uint8_t i;
+
+    *(pAvgBuffer + ((*pIndex)++)) = InVal;
+    *pIndex &= 0x07;
+
+    *pOutVal = 0;
+    for (i = 0; i < 8; i++)
+    {
+        *pOutVal += *(pAvgBuffer + i);
+    }
+    *pOutVal >>= 3;
+}
+
+template <class Transport>
+void Icm20948Driver<Transport>::bmp280CalculateAbsoluteAltitude(int32_t *pAltitude, int32_t PressureVal)
+{
+    *pAltitude = 4433000 * (1 - powf((PressureVal / (float)_s32Pressure0), 0.1903f));
+}
+
+// backend chosen at compile time by BMP280_COMPENSATION, see bmp280_comp.h
+template <class Transport>
+float Icm20948Driver<Transport>::bmp280CompensateTemperature(int32_t adc_T)
+{
+    return Bmp280Comp_Temperature(&_stBmp280, adc_T);
+}
+
+template <class Transport>
+float Icm20948Driver<Transport>::bmp280CompensatePressure(int32_t adc_P)
+{
+    return Bmp280Comp_Pressure(&_stBmp280, adc_P);
+}
+
+template class Icm20948Driver<I2cBlockingTransport>;
+template class Icm20948Driver<I2cDmaTransport>;
+#ifdef HAL_SPI_MODULE_ENABLED
+template class Icm20948Driver<SpiDmaTransport>;
+#endif
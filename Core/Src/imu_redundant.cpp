@@ -0,0 +1,464 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "imu_redundant.h"
+#include "timestamp.h"
+
+static ImuRedundant *spclAttached = nullptr;
+
+extern "C" uint8_t ImuRedundant_RxCpltCallback(I2C_HandleTypeDef *phi2c)
+{
+    return ((spclAttached != nullptr) && spclAttached->rxCplt(phi2c)) ? 1 : 0;
+}
+
+extern "C" uint8_t ImuRedundant_ErrorCallback(I2C_HandleTypeDef *phi2c)
+{
+    return ((spclAttached != nullptr) && spclAttached->rxError(phi2c)) ? 1 : 0;
+}
+
+ImuRedundant::ImuRedundant(ICM20948 *const *ppclImu, uint8_t u8Count, uint32_t u32SampleUs, uint32_t u32WaitUs)
+{
+    uint8_t i;
+
+    _u8Count = (u8Count < IMU_MAX) ? u8Count : IMU_MAX;
+    _u32AlignUs = u32SampleUs / 2;
+    _u32WaitUs = u32WaitUs;
+    _bOutValid = false;
+    memset(&_stOut, 0, sizeof(_stOut));
+
+    for (i = 0; i < IMU_MAX; i++)
+    {
+        _pclImu[i] = (i < _u8Count) ? ppclImu[i] : nullptr;
+        _bPending[i] = false;
+        memset(&_stPrev[i], 0, sizeof(_stPrev[i]));
+        _u8Same[i] = 0;
+        memset(&_stHealth[i], 0, sizeof(_stHealth[i]));
+        _stHealth[i].u8Score = SCORE_MAX;
+    }
+}
+
+// public
+void ImuRedundant::callbackAttach(void)
+{
+    spclAttached = this;
+
+    return;
+}
+
+void ImuRedundant::poll(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < _u8Count; i++)
+    {
+        _pclImu[i]->imuFifoPoll();
+    }
+
+    return;
+}
+
+bool ImuRedundant::rxCplt(I2C_HandleTypeDef *phi2c)
+{
+    uint8_t i;
+
+    for (i = 0; i < _u8Count; i++)
+    {
+        if ((_pclImu[i]->imuBusGet() == phi2c) && _pclImu[i]->imuFifoBusy())
+        {
+            _pclImu[i]->imuFifoRxCplt();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ImuRedundant::rxError(I2C_HandleTypeDef *phi2c)
+{
+    uint8_t i;
+
+    for (i = 0; i < _u8Count; i++)
+    {
+        if ((_pclImu[i]->imuBusGet() == phi2c) && _pclImu[i]->imuFifoBusy())
+        {
+            _pclImu[i]->imuFifoRxError();
+            _stHealth[i].u32BusErrors++;
+            scoreAdd(i, -PENALTY_FAULT);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ImuRedundant::read(IMU_ST_VOTED_SAMPLE *pstSample)
+{
+    uint8_t i, j, k, n, u8Newest, u8Pick;
+    bool bDropped, bAgree;
+    bool bOk[IMU_MAX], bVote[IMU_MAX];
+    float fAxis[IMU_MAX][6];
+    float fVal[IMU_MAX], fTmp, fDist, fBest;
+    IMU_ST_VOTED_SAMPLE stOut;
+
+    // match the oldest samples: one more than half a sample period older than the newest
+    // of them has no counterpart on the other sensors, the sensor's next one is tried
+    do
+    {
+        pendingFill();
+        u8Newest = IMU_MAX;
+        for (i = 0; i < _u8Count; i++)
+        {
+            if (_bPending[i] && ((u8Newest == IMU_MAX) ||
+                                 (Timestamp_DiffUs(_stPending[i].u32Stamp, _stPending[u8Newest].u32Stamp) > 0)))
+            {
+                u8Newest = i;
+            }
+        }
+        if (u8Newest == IMU_MAX)
+        {
+            return false;
+        }
+
+        bDropped = false;
+        for (i = 0; i < _u8Count; i++)
+        {
+            if (_bPending[i] &&
+                (Timestamp_DiffUs(_stPending[u8Newest].u32Stamp, _stPending[i].u32Stamp) > (int32_t)_u32AlignUs))
+            {
+                _bPending[i] = false;
+                _stHealth[i].u32Misaligned++;
+                bDropped = true;
+            }
+        }
+    } while (bDropped);
+
+    // a voting sensor with nothing yet is waited for while its drain is in flight or until
+    // the sample is older than the wait, then the vote is held without it
+    for (i = 0; i < _u8Count; i++)
+    {
+        if (_bPending[i] || _stHealth[i].bExcluded)
+        {
+            continue;
+        }
+        if (_pclImu[i]->imuFifoBusy() ||
+            (Timestamp_DiffUs(Timestamp_Get(), _stPending[u8Newest].u32Stamp) <= (int32_t)_u32WaitUs))
+        {
+            return false;
+        }
+    }
+    for (i = 0; i < _u8Count; i++)
+    {
+        if (!_bPending[i] && !_stHealth[i].bExcluded)
+        {
+            _stHealth[i].u32Missing++;
+            scoreAdd(i, -PENALTY_FAULT);
+        }
+    }
+
+    n = 0;
+    for (i = 0; i < _u8Count; i++)
+    {
+        bOk[i] = _bPending[i] && plausible(i);
+        if (bOk[i])
+        {
+            convert(i, &fAxis[i][0], &fAxis[i][3]);
+        }
+        else if (_bPending[i])
+        {
+            scoreAdd(i, -PENALTY_FAULT);
+        }
+        bVote[i] = bOk[i] && !_stHealth[i].bExcluded;
+        n += bVote[i] ? 1 : 0;
+    }
+    // the voting sensors all failed their checks, whatever is plausible is better than nothing
+    if (n == 0)
+    {
+        for (i = 0; i < _u8Count; i++)
+        {
+            bVote[i] = bOk[i];
+            n += bVote[i] ? 1 : 0;
+        }
+    }
+
+    memset(&stOut, 0, sizeof(stOut));
+    stOut.u32Stamp = _stPending[u8Newest].u32Stamp;
+    for (i = 0; i < _u8Count; i++)
+    {
+        _bPending[i] = false;
+        if (bVote[i])
+        {
+            stOut.u8Voters |= (uint8_t)(1u << i);
+        }
+    }
+    if (n == 0)
+    {
+        return false;
+    }
+
+    // per-axis median, the mean of the middle two for an even count
+    for (k = 0; k < 6; k++)
+    {
+        j = 0;
+        for (i = 0; i < _u8Count; i++)
+        {
+            if (bVote[i])
+            {
+                fTmp = fAxis[i][k];
+                for (u8Pick = j; (u8Pick > 0) && (fVal[u8Pick - 1] > fTmp); u8Pick--)
+                {
+                    fVal[u8Pick] = fVal[u8Pick - 1];
+                }
+                fVal[u8Pick] = fTmp;
+                j++;
+            }
+        }
+        fTmp = (n & 1) ? fVal[n / 2] : 0.5f * (fVal[n / 2 - 1] + fVal[n / 2]);
+        if (k < 3)
+        {
+            stOut.afGyroDps[k] = fTmp;
+        }
+        else
+        {
+            stOut.afAccelG[k - 3] = fTmp;
+        }
+    }
+
+    // two that disagree have no majority: the one continuing the previous output wins,
+    // the healthier one without a previous output, the mean on a tie
+    if (n == 2)
+    {
+        bAgree = true;
+        i = IMU_MAX;
+        j = IMU_MAX;
+        for (k = 0; k < _u8Count; k++)
+        {
+            if (bVote[k] && (i == IMU_MAX))
+            {
+                i = k;
+            }
+            else if (bVote[k])
+            {
+                j = k;
+            }
+        }
+        for (k = 0; k < 6; k++)
+        {
+            if (fabsf(fAxis[i][k] - fAxis[j][k]) > ((k < 3) ? GYRO_TOL_DPS : ACCEL_TOL_G))
+            {
+                bAgree = false;
+            }
+        }
+
+        u8Pick = IMU_MAX;
+        if (!bAgree && _bOutValid)
+        {
+            fBest = distance(fAxis[i], &_stOut);
+            fDist = distance(fAxis[j], &_stOut);
+            if (fBest != fDist)
+            {
+                u8Pick = (fBest < fDist) ? i : j;
+            }
+        }
+        else if (!bAgree && (_stHealth[i].u8Score != _stHealth[j].u8Score))
+        {
+            u8Pick = (_stHealth[i].u8Score > _stHealth[j].u8Score) ? i : j;
+        }
+
+        if (u8Pick != IMU_MAX)
+        {
+            memcpy(stOut.afGyroDps, &fAxis[u8Pick][0], sizeof(stOut.afGyroDps));
+            memcpy(stOut.afAccelG, &fAxis[u8Pick][3], sizeof(stOut.afAccelG));
+        }
+    }
+
+    // every plausible sensor is scored against the vote, excluded ones earn their way back
+    for (i = 0; i < _u8Count; i++)
+    {
+        if (!bOk[i])
+        {
+            continue;
+        }
+
+        if (agrees(fAxis[i], &stOut))
+        {
+            scoreAdd(i, 1);
+        }
+        else
+        {
+            _stHealth[i].u32Outvoted++;
+            scoreAdd(i, -PENALTY_OUTVOTED);
+        }
+    }
+
+    for (i = 0; i < _u8Count; i++)
+    {
+        if (!_stHealth[i].bExcluded && (_stHealth[i].u8Score < SCORE_EXCLUDE) && (votersCount() > 1))
+        {
+            _stHealth[i].bExcluded = true;
+        }
+        else if (_stHealth[i].bExcluded && (_stHealth[i].u8Score >= SCORE_READMIT))
+        {
+            _stHealth[i].bExcluded = false;
+        }
+    }
+
+    _stOut = stOut;
+    _bOutValid = true;
+    *pstSample = stOut;
+
+    return true;
+}
+
+uint8_t ImuRedundant::countGet(void) const
+{
+    return _u8Count;
+}
+
+const IMU_ST_HEALTH *ImuRedundant::healthGet(uint8_t u8Index) const
+{
+    return (u8Index < _u8Count) ? &_stHealth[u8Index] : nullptr;
+}
+
+// private
+void ImuRedundant::pendingFill(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < _u8Count; i++)
+    {
+        if (!_bPending[i])
+        {
+            _bPending[i] = _pclImu[i]->imuFifoRead(&_stPending[i]);
+        }
+    }
+
+    return;
+}
+
+bool ImuRedundant::plausible(uint8_t i)
+{
+    const ICM20948_ST_FIFO_SAMPLE *pstSample = &_stPending[i];
+    const IMU_ST_SENSOR_DATA *pstPrev[2] = {&_stPrev[i].stAccel, &_stPrev[i].stGyro};
+    const IMU_ST_SENSOR_DATA *pstCur[2] = {&pstSample->stAccel, &pstSample->stGyro};
+    bool bSame = true;
+    uint8_t j;
+
+    _stHealth[i].u32Samples++;
+
+    for (j = 0; j < 2; j++)
+    {
+        if ((pstPrev[j]->s16X != pstCur[j]->s16X) || (pstPrev[j]->s16Y != pstCur[j]->s16Y) ||
+            (pstPrev[j]->s16Z != pstCur[j]->s16Z))
+        {
+            bSame = false;
+        }
+    }
+    _stPrev[i] = *pstSample;
+    _u8Same[i] = bSame ? ((_u8Same[i] < STUCK_SAMPLES) ? _u8Same[i] + 1 : STUCK_SAMPLES) : 0;
+    if (_u8Same[i] >= STUCK_SAMPLES - 1)
+    {
+        _stHealth[i].u32Stuck++;
+        return false;
+    }
+
+    for (j = 0; j < 2; j++)
+    {
+        if ((abs(pstCur[j]->s16X) >= SATURATED_LSB) || (abs(pstCur[j]->s16Y) >= SATURATED_LSB) ||
+            (abs(pstCur[j]->s16Z) >= SATURATED_LSB))
+        {
+            _stHealth[i].u32Saturated++;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// full-scale range of the sensor, minus the calibrated gyro bias when the driver removes it
+void ImuRedundant::convert(uint8_t i, float *pfGyroDps, float *pfAccelG) const
+{
+    const ICM20948 *pclImu = _pclImu[i];
+    const ICM20948_ST_FIFO_SAMPLE *pstSample = &_stPending[i];
+    const GYRO_CAL_ST_STATE *pstCal = pclImu->imuGyroCalGet();
+    const float fGyroLsb = ICM20948::GYRO_LSB_PER_DPS[pclImu->imuGyroFsGet()];
+    const float fAccelLsb = ICM20948::ACCEL_LSB_PER_G[pclImu->imuAccelFsGet()];
+    uint8_t k;
+
+    pfGyroDps[0] = pstSample->stGyro.s16X / fGyroLsb;
+    pfGyroDps[1] = pstSample->stGyro.s16Y / fGyroLsb;
+    pfGyroDps[2] = pstSample->stGyro.s16Z / fGyroLsb;
+    pfAccelG[0] = pstSample->stAccel.s16X / fAccelLsb;
+    pfAccelG[1] = pstSample->stAccel.s16Y / fAccelLsb;
+    pfAccelG[2] = pstSample->stAccel.s16Z / fAccelLsb;
+
+    if ((pclImu->imuBiasModeGet() == IMU_EN_BIAS_MODE_SOFTWARE) && pstCal->u8Valid)
+    {
+        for (k = 0; k < 3; k++)
+        {
+            pfGyroDps[k] -= pstCal->afBiasDps[k];
+        }
+    }
+
+    return;
+}
+
+// pfAxis: gyro in dps then accel in g
+bool ImuRedundant::agrees(const float *pfAxis, const IMU_ST_VOTED_SAMPLE *pstOut) const
+{
+    uint8_t k;
+
+    for (k = 0; k < 3; k++)
+    {
+        if ((fabsf(pfAxis[k] - pstOut->afGyroDps[k]) > GYRO_TOL_DPS) ||
+            (fabsf(pfAxis[k + 3] - pstOut->afAccelG[k]) > ACCEL_TOL_G))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// in units of the agreement window, summed over the axes
+float ImuRedundant::distance(const float *pfAxis, const IMU_ST_VOTED_SAMPLE *pstOut) const
+{
+    float fDist = 0.0f;
+    uint8_t k;
+
+    for (k = 0; k < 3; k++)
+    {
+        fDist += fabsf(pfAxis[k] - pstOut->afGyroDps[k]) / GYRO_TOL_DPS +
+                 fabsf(pfAxis[k + 3] - pstOut->afAccelG[k]) / ACCEL_TOL_G;
+    }
+
+    return fDist;
+}
+
+void ImuRedundant::scoreAdd(uint8_t i, int16_t s16Delta)
+{
+    int16_t s16Score = (int16_t)_stHealth[i].u8Score + s16Delta;
+
+    if (s16Score < 0)
+    {
+        s16Score = 0;
+    }
+    else if (s16Score > SCORE_MAX)
+    {
+        s16Score = SCORE_MAX;
+    }
+    _stHealth[i].u8Score = (uint8_t)s16Score;
+
+    return;
+}
+
+uint8_t ImuRedundant::votersCount(void) const
+{
+    uint8_t i, n = 0;
+
+    for (i = 0; i < _u8Count; i++)
+    {
+        n += _stHealth[i].bExcluded ? 0 : 1;
+    }
+
+    return n;
+}
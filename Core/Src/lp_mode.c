@@ -0,0 +1,89 @@
+#include "main.h"
+#include "lp_mode.h"
+
+void SystemClock_Config(void);
+
+static volatile uint8_t lpTimerFired = 0;
+
+// LPTIM1 keeps counting in STOP2 and wakes the core through EXTI line 32
+void LpMode_Init(void)
+{
+	RCC->CSR |= RCC_CSR_LSION;
+	while ((RCC->CSR & RCC_CSR_LSIRDY) == 0)
+	{
+	}
+
+	MODIFY_REG(RCC->CCIPR, RCC_CCIPR_LPTIM1SEL, RCC_CCIPR_LPTIM1SEL_0);
+	RCC->APB1ENR1 |= RCC_APB1ENR1_LPTIM1EN;
+
+	// CFGR and IER can only be written while the timer is disabled
+	LPTIM1->CR = 0;
+	LPTIM1->CFGR = LP_MODE_LPTIM_PRESC << LPTIM_CFGR_PRESC_Pos;
+	LPTIM1->IER = LPTIM_IER_ARRMIE;
+	EXTI->IMR2 |= EXTI_IMR2_IM32;
+
+	HAL_NVIC_SetPriority(LPTIM1_IRQn, 2, 0);
+	HAL_NVIC_EnableIRQ(LPTIM1_IRQn);
+}
+
+void LPTIM1_IRQHandler(void)
+{
+	if (LPTIM1->ISR & LPTIM_ISR_ARRM)
+	{
+		LPTIM1->ICR = LPTIM_ICR_ARRMCF;
+		lpTimerFired = 1;
+	}
+}
+
+// the counter runs from the LSI, asynchronous to the bus: a value is valid once read twice
+static uint32_t LpMode_Count(void)
+{
+	uint32_t u32Cnt;
+
+	do
+	{
+		u32Cnt = LPTIM1->CNT;
+	} while (u32Cnt != LPTIM1->CNT);
+
+	return u32Cnt;
+}
+
+// stops until the timer runs out or another interrupt (IMU_INT) arrives and restores the
+// PLL clock; *pu32SleptUs is the time the core was stopped, the DWT does not see it
+LP_SCHED_EN_WAKE LpMode_Stop(uint32_t u32StopUs, uint32_t *pu32SleptUs)
+{
+	uint32_t u32Ticks = u32StopUs / LP_MODE_TICK_US;
+	uint32_t u32Slept;
+
+	if (u32Ticks == 0)
+	{
+		u32Ticks = 1;
+	}
+	if (u32Ticks > 0xFFFF)
+	{
+		u32Ticks = 0xFFFF;
+	}
+
+	lpTimerFired = 0;
+	LPTIM1->CR = LPTIM_CR_ENABLE;
+	LPTIM1->ARR = u32Ticks;
+	while ((LPTIM1->ISR & LPTIM_ISR_ARROK) == 0)
+	{
+	}
+	LPTIM1->ICR = LPTIM_ICR_ARROKCF;
+	LPTIM1->CR = LPTIM_CR_ENABLE | LPTIM_CR_SNGSTRT;
+
+	// the SysTick would wake the core every millisecond
+	HAL_SuspendTick();
+	HAL_PWREx_EnterSTOP2Mode(PWR_STOPENTRY_WFI);
+
+	// the core wakes on the MSI
+	SystemClock_Config();
+	HAL_ResumeTick();
+
+	u32Slept = lpTimerFired ? u32Ticks : LpMode_Count();
+	LPTIM1->CR = 0;
+	*pu32SleptUs = u32Slept * LP_MODE_TICK_US;
+
+	return lpTimerFired ? LP_SCHED_WAKE_TIMER : LP_SCHED_WAKE_EVENT;
+}
@@ -0,0 +1,108 @@
+#include <string.h>
+#include "lp_sched.h"
+
+void LpSched_Init(LP_SCHED_ST_STATE *pstSched, const LP_SCHED_ST_CONFIG *pstCfg)
+{
+	memset(pstSched, 0, sizeof(*pstSched));
+	pstSched->stCfg = *pstCfg;
+}
+
+// the period, cut short so the batch stays at the watermark and the FIFO does not fill while
+// the MCU restarts its clocks and drains: the longest wake so far plus one frame is kept free
+uint32_t LpSched_StopUs(const LP_SCHED_ST_STATE *pstSched)
+{
+	const LP_SCHED_ST_CONFIG *pstCfg = &pstSched->stCfg;
+	uint64_t u64StopUs = (uint64_t)pstCfg->u32PeriodMs * 1000u;
+	uint64_t u64FullUs, u64MarginUs;
+
+	if (pstCfg->u32SampleUs == 0)
+	{
+		return (uint32_t)u64StopUs;
+	}
+
+	if (pstCfg->u16WatermarkFrames != 0)
+	{
+		u64FullUs = (uint64_t)pstCfg->u16WatermarkFrames * pstCfg->u32SampleUs;
+		if (u64FullUs < u64StopUs)
+		{
+			u64StopUs = u64FullUs;
+		}
+	}
+
+	u64FullUs = (uint64_t)pstCfg->u16FifoFrames * pstCfg->u32SampleUs;
+	u64MarginUs = (uint64_t)pstSched->u32AwakeMaxUs + pstCfg->u32SampleUs;
+	u64FullUs = (u64FullUs > u64MarginUs) ? u64FullUs - u64MarginUs : 0;
+	if (u64FullUs < u64StopUs)
+	{
+		u64StopUs = u64FullUs;
+	}
+
+	return (uint32_t)u64StopUs;
+}
+
+// u32SleptUs: time spent stopped since the last WakeEnd, from the wake-up timer
+void LpSched_WakeBegin(LP_SCHED_ST_STATE *pstSched, uint32_t u32SleptUs, LP_SCHED_EN_WAKE enReason)
+{
+	pstSched->u8Awake = 1;
+	pstSched->u64SleptUs += u32SleptUs;
+	if (enReason < LP_SCHED_WAKE_NUM)
+	{
+		pstSched->au32Wakeups[enReason]++;
+	}
+}
+
+void LpSched_WakeEnd(LP_SCHED_ST_STATE *pstSched, uint32_t u32AwakeUs, uint16_t u16Samples)
+{
+	if (!pstSched->u8Awake)
+	{
+		return;
+	}
+
+	pstSched->u8Awake = 0;
+	pstSched->u64AwakeUs += u32AwakeUs;
+	if (u32AwakeUs > pstSched->u32AwakeMaxUs)
+	{
+		pstSched->u32AwakeMaxUs = u32AwakeUs;
+	}
+
+	if (u16Samples != 0)
+	{
+		pstSched->u32Batches++;
+		pstSched->u32Samples += u16Samples;
+	}
+
+	// a full FIFO stopped taking samples (snapshot mode), the batch has a gap in front of it
+	if (u16Samples >= pstSched->stCfg.u16FifoFrames)
+	{
+		pstSched->u32Overflows++;
+	}
+}
+
+void LpSched_MetricsGet(const LP_SCHED_ST_STATE *pstSched, LP_SCHED_ST_METRICS *pstMetrics)
+{
+	uint32_t u32Wakeups = 0;
+	uint64_t u64TotalUs = pstSched->u64SleptUs + pstSched->u64AwakeUs;
+	uint8_t i;
+
+	for (i = 0; i < LP_SCHED_WAKE_NUM; i++)
+	{
+		u32Wakeups += pstSched->au32Wakeups[i];
+	}
+
+	memset(pstMetrics, 0, sizeof(*pstMetrics));
+	if (u64TotalUs != 0)
+	{
+		pstMetrics->fWakeupsPerSec = (float)u32Wakeups * 1e6f / (float)u64TotalUs;
+		pstMetrics->fDutyPct = 100.0f * (float)pstSched->u64AwakeUs / (float)u64TotalUs;
+	}
+
+	if (pstSched->u32Batches != 0)
+	{
+		pstMetrics->fAwakeUsPerBatch = (float)pstSched->u64AwakeUs / (float)pstSched->u32Batches;
+	}
+
+	if (u32Wakeups != 0)
+	{
+		pstMetrics->fSamplesPerWakeup = (float)pstSched->u32Samples / (float)u32Wakeups;
+	}
+}
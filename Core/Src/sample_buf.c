@@ -0,0 +1,47 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "sample_buf.h"
+
+void SampleBuf_Init(SAMPLE_ST_PINGPONG *pstBuf)
+{
+	memset(pstBuf, 0, sizeof(*pstBuf));
+}
+
+// the frame the next DMA transfer may fill, never the one a reader can see
+uint8_t *SampleBuf_WriteBuf(SAMPLE_ST_PINGPONG *pstBuf)
+{
+	return pstBuf->astFrame[pstBuf->u8Front ^ 1].au8Data;
+}
+
+// single producer: call from the completion interrupt once the back frame is filled
+void SampleBuf_Publish(SAMPLE_ST_PINGPONG *pstBuf, uint32_t u32Seq, uint32_t u32Stamp)
+{
+	SAMPLE_ST_FRAME *pstBack = &pstBuf->astFrame[pstBuf->u8Front ^ 1];
+
+	pstBack->u32Seq = u32Seq;
+	pstBack->u32Stamp = u32Stamp;
+
+	pstBuf->u32Lock++;
+	atomic_thread_fence(memory_order_release);
+	pstBuf->u8Front ^= 1;
+	atomic_thread_fence(memory_order_release);
+	pstBuf->u32Lock++;
+}
+
+// copies the newest frame; returns its sequence number (0: nothing published yet)
+uint32_t SampleBuf_Read(const SAMPLE_ST_PINGPONG *pstBuf, SAMPLE_ST_FRAME *pstFrame)
+{
+	uint32_t u32Lock;
+
+	// the old front becomes the DMA target only after a publish, which moves the lock,
+	// so an unchanged even lock means the copy was not overwritten
+	do
+	{
+		u32Lock = pstBuf->u32Lock;
+		atomic_thread_fence(memory_order_acquire);
+		memcpy(pstFrame, (const void *)&pstBuf->astFrame[pstBuf->u8Front], sizeof(*pstFrame));
+		atomic_thread_fence(memory_order_acquire);
+	} while ((u32Lock & 1U) || (u32Lock != pstBuf->u32Lock));
+
+	return pstFrame->u32Seq;
+}
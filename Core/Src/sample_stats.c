@@ -0,0 +1,108 @@
+#include <math.h>
+#include "sample_stats.h"
+
+void SampleStats_Reset(SAMPLE_ST_STATS *pstStats)
+{
+	pstStats->u32Samples = 0;
+	pstStats->u32Dropped = 0;
+	pstStats->u32Duplicates = 0;
+	pstStats->u32LastSeq = 0;
+	pstStats->u32LatencyUs = 0;
+	pstStats->u32LatencyMinUs = UINT32_MAX;
+	pstStats->u32LatencyMaxUs = 0;
+	pstStats->u64LatencySumUs = 0;
+}
+
+void SampleStats_Update(SAMPLE_ST_STATS *pstStats, uint32_t u32Seq, uint32_t u32LatencyUs)
+{
+	// sequence numbers start at 1, so the first sample after reset is never a gap
+	if (pstStats->u32Samples != 0 && u32Seq == pstStats->u32LastSeq)
+	{
+		pstStats->u32Duplicates++;
+		return;
+	}
+
+	if (pstStats->u32Samples != 0)
+	{
+		pstStats->u32Dropped += u32Seq - pstStats->u32LastSeq - 1;
+	}
+
+	pstStats->u32LastSeq = u32Seq;
+	pstStats->u32Samples++;
+	pstStats->u32LatencyUs = u32LatencyUs;
+	pstStats->u64LatencySumUs += u32LatencyUs;
+
+	if (u32LatencyUs < pstStats->u32LatencyMinUs)
+	{
+		pstStats->u32LatencyMinUs = u32LatencyUs;
+	}
+
+	if (u32LatencyUs > pstStats->u32LatencyMaxUs)
+	{
+		pstStats->u32LatencyMaxUs = u32LatencyUs;
+	}
+}
+
+uint32_t SampleStats_LatencyAvgUs(const SAMPLE_ST_STATS *pstStats)
+{
+	if (pstStats->u32Samples == 0)
+	{
+		return 0;
+	}
+
+	return (uint32_t)(pstStats->u64LatencySumUs / pstStats->u32Samples);
+}
+
+void SampleStats_DtReset(SAMPLE_ST_DT_STATS *pstStats)
+{
+	pstStats->u32Count = 0;
+	pstStats->u32DtUs = 0;
+	pstStats->u32DtMinUs = UINT32_MAX;
+	pstStats->u32DtMaxUs = 0;
+	pstStats->u64DtSumUs = 0;
+	pstStats->u64DtSqSumUs = 0;
+}
+
+void SampleStats_DtUpdate(SAMPLE_ST_DT_STATS *pstStats, uint32_t u32DtUs)
+{
+	pstStats->u32Count++;
+	pstStats->u32DtUs = u32DtUs;
+	pstStats->u64DtSumUs += u32DtUs;
+	pstStats->u64DtSqSumUs += (uint64_t)u32DtUs * u32DtUs;
+
+	if (u32DtUs < pstStats->u32DtMinUs)
+	{
+		pstStats->u32DtMinUs = u32DtUs;
+	}
+
+	if (u32DtUs > pstStats->u32DtMaxUs)
+	{
+		pstStats->u32DtMaxUs = u32DtUs;
+	}
+}
+
+uint32_t SampleStats_DtAvgUs(const SAMPLE_ST_DT_STATS *pstStats)
+{
+	if (pstStats->u32Count == 0)
+	{
+		return 0;
+	}
+
+	return (uint32_t)(pstStats->u64DtSumUs / pstStats->u32Count);
+}
+
+// population standard deviation; evaluated on demand, not per sample
+float SampleStats_DtStdUs(const SAMPLE_ST_DT_STATS *pstStats)
+{
+	double mean, var;
+
+	if (pstStats->u32Count == 0)
+	{
+		return 0.0f;
+	}
+
+	mean = (double)pstStats->u64DtSumUs / pstStats->u32Count;
+	var = (double)pstStats->u64DtSqSumUs / pstStats->u32Count - mean * mean;
+
+	return (var > 0.0) ? (float)sqrt(var) : 0.0f;
+}
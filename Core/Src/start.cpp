@@ -2,6 +2,13 @@
 #include "main.h"
 #include "usart.h"
 #include "icm20948.h"
+#include "i2c.h"
+#include "i2c_bus.h"
+#include "sample_stats.h"
+#include "timestamp.h"
+#include "lp_sched.h"
+#include "lp_mode.h"
+#include <string.h>
 #include <string>
 using namespace std;
 
@@ -9,6 +16,19 @@ extern uint8_t time1000ms, time5ms;
 
 // for stm32cube monitor debug
 float debug[20] = {0};
+#if (I2C_TRANSMIT_MODE != 5)
+SAMPLE_ST_STATS imuStats;
+// spacing of the capture stamps: the dt a fusion step on these samples integrates over
+SAMPLE_ST_DT_STATS imuDtStats;
+static uint32_t imuLastStamp = 0;
+#else
+// wakeups per second, awake time per batch and samples per wakeup in lpMetrics; the FIFO
+// frames carry neither a capture stamp nor a sequence number, so there are no latency,
+// drop or dt statistics in this mode
+LP_SCHED_ST_STATE lpSched;
+LP_SCHED_ST_METRICS lpMetrics;
+static uint8_t lpBatch[ICM20948_FIFO_SIZE];
+#endif
 
 extern uint8_t imuDataBuffer[12];
 
@@ -26,12 +46,60 @@ extern int16_t Magn_Z_RAW;
 
 extern float Ax, Ay, Az, Gx, Gy, Gz;
 
+static void sample_debug(void)
+{
+	debug[0] = Magn_X_RAW;
+	debug[1] = Magn_Y_RAW;
+	debug[2] = Magn_Z_RAW;
+
+	debug[3] = Gyro_X_RAW;
+	debug[4] = Gyro_Y_RAW;
+	debug[5] = Gyro_Z_RAW;
+
+	// debug[6] = Accel_X_RAW;
+	// debug[7] = Accel_Y_RAW;
+	// debug[8] = Accel_Z_RAW;
+
+	// debug[9] = Gx;
+	// debug[10] = Gy;
+	// debug[11] = Gz;
+
+	// debug[12] = Ax;
+	// debug[13] = Ay;
+	// debug[14] = Az;
+
+	// debug[15] = Gx;
+	// debug[16] = Gy;
+	// debug[17] = Gz;
+}
+
 void start_up()
 {
+	Timestamp_Init();
+#if (I2C_TRANSMIT_MODE != 5)
+	SampleStats_Reset(&imuStats);
+	SampleStats_DtReset(&imuDtStats);
+#endif
+	const I2C_BUS_ST_PINS stI2c3Pins = {GPIOC, GPIO_PIN_0, GPIOC, GPIO_PIN_1};
+	const I2C_TIMING_ST_BUS stI2c3Lines = {I2C_BUS_I2C3_RISE_NS, I2C_BUS_I2C3_FALL_NS};
+	I2cBus_Init(&i2c3Bus, &hi2c3, &stI2c3Pins, &stI2c3Lines, I2C_BUS_I2C3_SPEED);
 	ICM20948_Init();
+#if (I2C_TRANSMIT_MODE == 5)
+	const LP_SCHED_ST_CONFIG stLpCfg = {
+		.u32PeriodMs = ICM20948_LP_PERIOD_MS,
+		.u32SampleUs = 1000000u * (1 + ICM20948_LP_SMPLRT_DIV) / 1125u,
+		.u16FifoFrames = ICM20948_FIFO_SIZE / ICM20948_FIFO_FRAME_LEN,
+		.u16WatermarkFrames = ICM20948_LP_WATERMARK,
+	};
+	LpSched_Init(&lpSched, &stLpCfg);
+	LpMode_Init();
+#endif
 
 	while (1)
 	{
+		// a timed-out transfer left the bus to the recovery, clock it along
+		I2cBus_RecoverPoll(&i2c3Bus);
+
 		if (time1000ms)
 		{
 			string str = "Powered By QizhiHe, Wechat: 1210106584\r\n";
@@ -41,39 +109,64 @@ void start_up()
 			time1000ms = 0;
 		}
 
-		if (time5ms)
+#if (I2C_TRANSMIT_MODE == 3) || (I2C_TRANSMIT_MODE == 4)
+		// fuse every sample as soon as its data-ready burst has landed
+		uint32_t u32Stamp;
+		uint32_t u32Seq = ICM20948_Sample_Get(&u32Stamp);
+		if (u32Seq != 0 && u32Seq != imuStats.u32LastSeq)
 		{
 			ICM20948_Read_Gyro();
 			ICM20948_Read_Accel();
-			// ICM20948_Read_Magn_Polling();
-
-			{	
-				debug[0] = Magn_X_RAW;
-				debug[1] = Magn_Y_RAW;
-				debug[2] = Magn_Z_RAW;
-
-				debug[3] = Gyro_X_RAW;
-				debug[4] = Gyro_Y_RAW;
-				debug[5] = Gyro_Z_RAW;
-
-				// debug[6] = Accel_X_RAW;
-				// debug[7] = Accel_Y_RAW;
-				// debug[8] = Accel_Z_RAW;
-
-				// debug[9] = Gx;
-				// debug[10] = Gy;
-				// debug[11] = Gz;
+			if (imuStats.u32Samples != 0)
+			{
+				SampleStats_DtUpdate(&imuDtStats, Timestamp_DeltaUs(imuLastStamp, u32Stamp));
+			}
+			imuLastStamp = u32Stamp;
+			SampleStats_Update(&imuStats, u32Seq, Timestamp_ElapsedUs(u32Stamp));
 
-				// debug[12] = Ax;
-				// debug[13] = Ay;
-				// debug[14] = Az;
+			sample_debug();
+		}
+#elif (I2C_TRANSMIT_MODE == 5)
+		// stop until the next batch is due, then fuse every sample of it in order
+		uint32_t u32SleptUs;
+		LP_SCHED_EN_WAKE enWake = LpMode_Stop(LpSched_StopUs(&lpSched), &u32SleptUs);
+		uint32_t u32Awake = Timestamp_Get();
+		LpSched_WakeBegin(&lpSched, u32SleptUs, enWake);
+
+		uint16_t u16Frames = ICM20948_Fifo_Drain(lpBatch, sizeof(lpBatch));
+		for (uint16_t i = 0; i < u16Frames; i++)
+		{
+			memcpy(imuDataBuffer, &lpBatch[i * ICM20948_FIFO_FRAME_LEN], ICM20948_FIFO_FRAME_LEN);
+			ICM20948_Read_Gyro();
+			ICM20948_Read_Accel();
+		}
+		sample_debug();
 
-				// debug[15] = Gx;
-				// debug[16] = Gy;
-				// debug[17] = Gz;
+		LpSched_WakeEnd(&lpSched, Timestamp_ElapsedUs(u32Awake), u16Frames);
+		LpSched_MetricsGet(&lpSched, &lpMetrics);
+#else
+		if (time5ms)
+		{
+			// one consistent snapshot for both halves
+			uint32_t u32Stamp;
+			uint32_t u32Seq = ICM20948_Sample_Get(&u32Stamp);
+			if (u32Seq != 0 && u32Seq != imuStats.u32LastSeq)
+			{
+				if (imuStats.u32Samples != 0)
+				{
+					SampleStats_DtUpdate(&imuDtStats, Timestamp_DeltaUs(imuLastStamp, u32Stamp));
+				}
+				imuLastStamp = u32Stamp;
+				SampleStats_Update(&imuStats, u32Seq, Timestamp_ElapsedUs(u32Stamp));
 			}
+			ICM20948_Read_Gyro();
+			ICM20948_Read_Accel();
+			// ICM20948_Read_Magn_Polling();
+
+			sample_debug();
 
 			time5ms = 0;
 		}
+#endif
 	}
 }
@@ -0,0 +1,37 @@
+#include "main.h"
+#include "timestamp.h"
+
+void Timestamp_Init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t Timestamp_Get(void)
+{
+	return DWT->CYCCNT;
+}
+
+uint32_t Timestamp_ElapsedUs(uint32_t u32Since)
+{
+	// unsigned subtraction stays correct across one wrap
+	return (DWT->CYCCNT - u32Since) / (SystemCoreClock / 1000000U);
+}
+
+// interval between two stamps, e.g. the capture times of consecutive samples
+uint32_t Timestamp_DeltaUs(uint32_t u32From, uint32_t u32To)
+{
+	return (u32To - u32From) / (SystemCoreClock / 1000000U);
+}
+
+// u32A - u32B, negative when u32A is the earlier stamp; the two must be less than half a wrap apart
+int32_t Timestamp_DiffUs(uint32_t u32A, uint32_t u32B)
+{
+	return (int32_t)(u32A - u32B) / (int32_t)(SystemCoreClock / 1000000U);
+}
+
+uint32_t Timestamp_UsToTicks(uint32_t u32Us)
+{
+	return u32Us * (SystemCoreClock / 1000000U);
+}
@@ -6,6 +6,10 @@
 namespace matrix
 {
 
+/**
+ * Dense update for any R, inverts S = C P C^T + R. For a diagonal R kalman_correct_sequential
+ * gives the same result without the inverse.
+ */
 template<typename Type, size_t M, size_t N>
 int kalman_correct(
 	const Matrix<Type, M, M> &P,
@@ -25,4 +29,139 @@ int kalman_correct(
 	return 0;
 }
 
+/**
+ * One scalar measurement z = c x + v, var(v) = R, with residual r formed before any
+ * correction in dx. P and dx are updated in place, nothing is inverted.
+ *
+ * beta is the normalised innovation squared, chi-square with one degree of freedom; above
+ * gate the measurement is rejected and nothing changes, gate <= 0 accepts everything.
+ * joseph selects (I - k c) P (I - k c)^T + k R k^T, which stays symmetric and positive
+ * where the short form P - k c P can lose both to round-off, at about twice the cost.
+ *
+ * @return false if rejected by the gate or if the innovation variance is not positive
+ */
+template<typename Type, size_t M>
+bool kalman_correct_scalar(
+	Matrix<Type, M, M> &P,
+	const Matrix<Type, 1, M> &c,
+	Type R,
+	Type r,
+	Matrix<Type, M, 1> &dx,
+	Type &beta,
+	Type gate = Type(0),
+	bool joseph = false
+)
+{
+	Matrix<Type, M, 1> h;	// P c^T
+	Type S = R;
+	Type innov = r;
+
+	for (size_t i = 0; i < M; i++) {
+		h(i, 0) = Type(0);
+
+		for (size_t j = 0; j < M; j++) {
+			h(i, 0) += P(i, j) * c(0, j);
+		}
+	}
+
+	for (size_t i = 0; i < M; i++) {
+		S += c(0, i) * h(i, 0);
+		innov -= c(0, i) * dx(i, 0);
+	}
+
+	if (!(S > Type(0))) {
+		beta = Type(0);
+		return false;
+	}
+
+	beta = innov * innov / S;
+
+	if ((gate > Type(0)) && (beta > gate)) {
+		return false;
+	}
+
+	const Matrix<Type, M, 1> k = h / S;
+	dx += k * innov;
+
+	if (joseph) {
+		// T = (I - k c) P, then P = T (I - k c)^T + k R k^T with g = T c^T
+		Matrix<Type, M, 1> g;
+
+		for (size_t i = 0; i < M; i++) {
+			for (size_t j = 0; j < M; j++) {
+				P(i, j) -= k(i, 0) * h(j, 0);
+			}
+		}
+
+		for (size_t i = 0; i < M; i++) {
+			g(i, 0) = Type(0);
+
+			for (size_t j = 0; j < M; j++) {
+				g(i, 0) += P(i, j) * c(0, j);
+			}
+		}
+
+		// symmetric in exact arithmetic, the upper triangle is taken
+		for (size_t i = 0; i < M; i++) {
+			for (size_t j = i; j < M; j++) {
+				P(i, j) += k(j, 0) * (R * k(i, 0) - g(i, 0));
+				P(j, i) = P(i, j);
+			}
+		}
+
+	} else {
+		// k h^T is symmetric as k is h / S, only the upper triangle is computed
+		for (size_t i = 0; i < M; i++) {
+			for (size_t j = i; j < M; j++) {
+				P(i, j) -= k(i, 0) * h(j, 0);
+				P(j, i) = P(i, j);
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+ * kalman_correct for a diagonal R, given as the vector of variances: the rows of C go in
+ * one after the other through kalman_correct_scalar. Same dx, dP and, with nothing gated,
+ * the same beta as the dense update, without the inverse of S. A non-diagonal R has to go
+ * through kalman_correct, or be decorrelated first.
+ *
+ * @return the number of rows rejected by the gate
+ */
+template<typename Type, size_t M, size_t N>
+int kalman_correct_sequential(
+	const Matrix<Type, M, M> &P,
+	const Matrix<Type, N, M> &C,
+	const Matrix<Type, N, 1> &R,
+	const Matrix<Type, N, 1> &r,
+	Matrix<Type, M, 1> &dx,
+	Matrix<Type, M, M> &dP,
+	Type &beta,
+	Type gate = Type(0),
+	bool joseph = false
+)
+{
+	Matrix<Type, M, M> Pn = P;
+	int rejected = 0;
+
+	dx.setZero();
+	beta = Type(0);
+
+	for (size_t n = 0; n < N; n++) {
+		Type b;
+
+		if (kalman_correct_scalar<Type, M>(Pn, C.row(n), R(n, 0), r(n, 0), dx, b, gate, joseph)) {
+			beta += b;
+
+		} else {
+			rejected++;
+		}
+	}
+
+	dP = Pn - P;
+	return rejected;
+}
+
 } // namespace matrix
@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+#include "acq_sched.h"
+#include "i2c_timing.h"
+
+namespace
+{
+
+constexpr uint8_t GYRO = ACQ_SCHED_BIT(ACQ_SCHED_STREAM_GYRO);
+constexpr uint8_t ACCEL = ACQ_SCHED_BIT(ACQ_SCHED_STREAM_ACCEL);
+constexpr uint8_t MAGN = ACQ_SCHED_BIT(ACQ_SCHED_STREAM_MAGN);
+constexpr uint8_t BARO = ACQ_SCHED_BIT(ACQ_SCHED_STREAM_BARO);
+
+TEST(AcqSchedTest, EveryStreamDueAtStart)
+{
+	ACQ_SCHED_ST_STATE sched;
+	const ACQ_SCHED_ST_PLAN plan = {{909, 4444, 0, 38000}};
+
+	AcqSched_Init(&sched, &plan, 1000);
+	EXPECT_EQ(AcqSched_Due(&sched, 1000), GYRO | ACCEL | BARO);
+	EXPECT_EQ(AcqSched_Due(&sched, 1000), 0);
+}
+
+TEST(AcqSchedTest, EachStreamAtItsPeriod)
+{
+	ACQ_SCHED_ST_STATE sched;
+	const ACQ_SCHED_ST_PLAN plan = {{100, 250, 0, 0}};
+
+	AcqSched_Init(&sched, &plan, 1000);
+	AcqSched_Due(&sched, 1000);
+	EXPECT_EQ(AcqSched_Due(&sched, 1099), 0);
+	EXPECT_EQ(AcqSched_Due(&sched, 1100), GYRO);
+	EXPECT_EQ(AcqSched_Due(&sched, 1200), GYRO);
+	EXPECT_EQ(AcqSched_Due(&sched, 1250), ACCEL);
+	EXPECT_EQ(AcqSched_Due(&sched, 1300), GYRO);
+	EXPECT_EQ(sched.au32Reads[ACQ_SCHED_STREAM_GYRO], 4u);
+	EXPECT_EQ(sched.au32Reads[ACQ_SCHED_STREAM_ACCEL], 2u);
+	EXPECT_EQ(sched.au32Reads[ACQ_SCHED_STREAM_MAGN], 0u);
+}
+
+TEST(AcqSchedTest, LatePollReadsOnceAndCountsMissed)
+{
+	ACQ_SCHED_ST_STATE sched;
+	const ACQ_SCHED_ST_PLAN plan = {{100, 0, 0, 0}};
+
+	AcqSched_Init(&sched, &plan, 1000);
+	AcqSched_Due(&sched, 1000);
+
+	// 1100 and 1200 slept through, 1300 read late; the grid stays
+	EXPECT_EQ(AcqSched_Due(&sched, 1350), GYRO);
+	EXPECT_EQ(sched.au32Missed[ACQ_SCHED_STREAM_GYRO], 2u);
+	EXPECT_EQ(AcqSched_Due(&sched, 1399), 0);
+	EXPECT_EQ(AcqSched_Due(&sched, 1400), GYRO);
+	EXPECT_EQ(sched.au32Reads[ACQ_SCHED_STREAM_GYRO], 3u);
+}
+
+TEST(AcqSchedTest, WaitToTheNextStream)
+{
+	ACQ_SCHED_ST_STATE sched;
+	const ACQ_SCHED_ST_PLAN plan = {{100, 250, 0, 0}};
+	const ACQ_SCHED_ST_PLAN off = {{0, 0, 0, 0}};
+
+	AcqSched_Init(&sched, &plan, 1000);
+	EXPECT_EQ(AcqSched_WaitGet(&sched, 1000), 0u);
+	AcqSched_Due(&sched, 1000);
+	EXPECT_EQ(AcqSched_WaitGet(&sched, 1030), 70u);
+	AcqSched_Due(&sched, 1100);
+	EXPECT_EQ(AcqSched_WaitGet(&sched, 1190), 10u);
+	EXPECT_EQ(AcqSched_WaitGet(&sched, 1300), 0u);
+
+	AcqSched_Init(&sched, &off, 1000);
+	EXPECT_EQ(AcqSched_WaitGet(&sched, 1000), UINT32_MAX);
+	EXPECT_EQ(AcqSched_Due(&sched, 5000), 0);
+}
+
+TEST(AcqSchedTest, ClockWraps)
+{
+	ACQ_SCHED_ST_STATE sched;
+	const ACQ_SCHED_ST_PLAN plan = {{0x200, 0, 0, 0}};
+
+	AcqSched_Init(&sched, &plan, 0xFFFFFF00u);
+	EXPECT_EQ(AcqSched_Due(&sched, 0xFFFFFF00u), GYRO);
+	EXPECT_EQ(AcqSched_Due(&sched, 0x000000FFu), 0);
+	EXPECT_EQ(AcqSched_WaitGet(&sched, 0x000000FFu), 1u);
+	EXPECT_EQ(AcqSched_Due(&sched, 0x00000100u), GYRO);
+	EXPECT_EQ(sched.au32Missed[ACQ_SCHED_STREAM_GYRO], 0u);
+}
+
+TEST(AcqSchedTest, BusCostOfAPoll)
+{
+	// accel and gyro together are one burst, cheaper than two reads
+	EXPECT_EQ(AcqSched_BusUs(GYRO | ACCEL, 400000), I2cTiming_XferUs(400000, 12, 1));
+	EXPECT_LT(AcqSched_BusUs(GYRO | ACCEL, 400000), AcqSched_BusUs(GYRO, 400000) + AcqSched_BusUs(ACCEL, 400000));
+	EXPECT_EQ(AcqSched_BusUs(GYRO, 400000), I2cTiming_XferUs(400000, 6, 1));
+	EXPECT_EQ(AcqSched_BusUs(MAGN, 400000), I2cTiming_XferUs(400000, 9, 1));
+	EXPECT_EQ(AcqSched_BusUs(BARO, 400000), I2cTiming_XferUs(400000, 1, 1) + I2cTiming_XferUs(400000, 6, 1));
+	EXPECT_EQ(AcqSched_BusUs(ACQ_SCHED_ALL, 400000),
+		  AcqSched_BusUs(GYRO | ACCEL, 400000) + AcqSched_BusUs(MAGN, 400000) + AcqSched_BusUs(BARO, 400000));
+	EXPECT_EQ(AcqSched_BusUs(0, 400000), 0u);
+	EXPECT_LT(AcqSched_BusUs(ACQ_SCHED_ALL, 1000000), AcqSched_BusUs(ACQ_SCHED_ALL, 400000));
+}
+
+// one second of the main loop polling every LOOP_US on a simulated clock; a read beyond what
+// the sensor produced in the time is stale, the same sample again
+class AcqSimTest : public ::testing::Test
+{
+protected:
+	static constexpr uint32_t LOOP_US = 100;
+	static constexpr uint32_t SIM_US = 1000000;
+	// gyro, accel at SMPLRT_DIV 0, AK09916 at 100 Hz, BMP280 x16/x16 at 0.5 ms standby
+	static constexpr uint32_t SENSOR_HZ[ACQ_SCHED_STREAM_NUM] = {1100, 1125, 100, 13};
+
+	struct Result {
+		uint32_t reads[ACQ_SCHED_STREAM_NUM];
+		uint32_t stale[ACQ_SCHED_STREAM_NUM];
+		float busPct;
+	};
+
+	Result run(const ACQ_SCHED_ST_PLAN &plan, uint32_t sclHz)
+	{
+		ACQ_SCHED_ST_STATE sched;
+		uint64_t busUs = 0;
+		Result r{};
+
+		AcqSched_Init(&sched, &plan, 0);
+		for (uint32_t now = 0; now < SIM_US; now += LOOP_US) {
+			busUs += AcqSched_BusUs(AcqSched_Due(&sched, now), sclHz);
+		}
+
+		for (int s = 0; s < ACQ_SCHED_STREAM_NUM; s++) {
+			r.reads[s] = sched.au32Reads[s];
+			r.stale[s] = r.reads[s] > SENSOR_HZ[s] ? r.reads[s] - SENSOR_HZ[s] : 0;
+		}
+		r.busPct = 100.f * busUs / SIM_US;
+
+		return r;
+	}
+
+	// every stream read with the gyro, the loop of imuDataGet at full rate
+	const ACQ_SCHED_ST_PLAN lockstep{{909, 909, 909, 909}};
+	// imuDataGet at the 225 Hz of the init dividers
+	const ACQ_SCHED_ST_PLAN current{{4444, 4444, 4444, 4444}};
+	// imuStreamInit: accel with every fifth gyro read, baro polled twice per 76 ms conversion
+	const ACQ_SCHED_ST_PLAN multiRate{{909, 5 * 909, 10000, 38000}};
+};
+
+TEST_F(AcqSimTest, BusUtilisationPerPlan)
+{
+	for (uint32_t scl : {400000u, 1000000u}) {
+		const Result l = run(lockstep, scl);
+		const Result c = run(current, scl);
+		const Result m = run(multiRate, scl);
+
+		// the gyro at its full rate for less bus time than the lockstep plan
+		EXPECT_EQ(m.reads[ACQ_SCHED_STREAM_GYRO], l.reads[ACQ_SCHED_STREAM_GYRO]);
+		EXPECT_LT(m.busPct, l.busPct * 0.5f);
+		EXPECT_GT(m.reads[ACQ_SCHED_STREAM_GYRO], 4 * c.reads[ACQ_SCHED_STREAM_GYRO]);
+
+		// slow sensors are not read faster than they produce
+		EXPECT_EQ(m.stale[ACQ_SCHED_STREAM_MAGN], 0u);
+		EXPECT_GT(l.stale[ACQ_SCHED_STREAM_MAGN], 900u);
+		EXPECT_GT(c.stale[ACQ_SCHED_STREAM_MAGN], 100u);
+	}
+
+	// lockstep at fast mode fills the bus
+	EXPECT_GT(run(lockstep, 400000).busPct, 90.f);
+}
+
+TEST_F(AcqSimTest, MultiRateReadsAtThePlannedRates)
+{
+	const Result m = run(multiRate, 400000);
+
+	EXPECT_NEAR(m.reads[ACQ_SCHED_STREAM_GYRO], 1100, 2);
+	EXPECT_NEAR(m.reads[ACQ_SCHED_STREAM_ACCEL], 220, 2);
+	EXPECT_NEAR(m.reads[ACQ_SCHED_STREAM_MAGN], 100, 1);
+	EXPECT_NEAR(m.reads[ACQ_SCHED_STREAM_BARO], 26, 1);
+}
+
+} // namespace
@@ -0,0 +1,306 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include "AhrsTrajectory.hpp"
+#include "ahrs_eskf.h"
+#include "inc/filter.hpp"
+
+using namespace matrix;
+
+namespace
+{
+
+constexpr double DT = 1.0 / 500.0;
+// the noise of sim::Trajectory
+constexpr double GYRO_SIGMA = sim::SensorNoise().gyro; // per sample, rad/s
+constexpr double ACCEL_SIGMA = sim::SensorNoise().accel;
+constexpr double MAGN_SIGMA = sim::SensorNoise().mag;
+constexpr double RAD2DEG = 180.0 / M_PI;
+
+// the noise the simulation has, for the consistency check
+struct SimNoise {
+	constexpr static double GYRO = 2.2360679774997897e-4; // GYRO_SIGMA * sqrt(DT)
+	constexpr static double GYRO_BIAS = 1e-6;
+	constexpr static double ACCEL = ACCEL_SIGMA;
+	constexpr static double MAGN = MAGN_SIGMA;
+	constexpr static double INIT_ATT = 0.1;
+	constexpr static double INIT_BIAS = 0.02;
+};
+
+using Eskf = AhrsEskf<double, SimNoise>;
+
+/*
+ * The textbook filter the sparse one has to agree with: F P F^T + Q on the full 6x6 and
+ * the accel as one 3-vector update through kalman_correct, which inverts S.
+ */
+class DenseEskf
+{
+public:
+	DenseEskf()
+	{
+		_P.setZero();
+		for (size_t i = 0; i < 3; i++) {
+			_P(i, i) = SimNoise::INIT_ATT * SimNoise::INIT_ATT;
+			_P(3 + i, 3 + i) = SimNoise::INIT_BIAS * SimNoise::INIT_BIAS;
+		}
+	}
+
+	void reset(const Quatd &q) { _q = q; }
+
+	void update(const Vector3d &gyro, const Vector3d *accel, const Vector3d *mag, double dt)
+	{
+		const Vector3d angle((gyro - _bias) * dt);
+
+		_q = _q * Quatd::expq(angle * 0.5);
+		_q.normalize();
+
+		SquareMatrix<double, 6> F;
+		SquareMatrix<double, 6> Q;
+		F.setIdentity();
+		Q.setZero();
+		F.slice<3, 3>(0, 0) = SquareMatrix3d(F.slice<3, 3>(0, 0)) - angle.hat();
+		for (size_t i = 0; i < 3; i++) {
+			F(i, 3 + i) = -dt;
+			Q(i, i) = SimNoise::GYRO * SimNoise::GYRO * dt;
+			Q(3 + i, 3 + i) = SimNoise::GYRO_BIAS * SimNoise::GYRO_BIAS * dt;
+		}
+		_P = F * _P * F.T() + Q;
+
+		if (accel != nullptr) {
+			const Dcmd R(_q);
+			const Vector3d v(R(2, 0), R(2, 1), R(2, 2));
+			Matrix<double, 3, 6> C;
+			C.setZero();
+			C.slice<3, 3>(0, 0) = v.hat();
+			correct<3>(C, Vector3d(Vector3d(accel->unit()) - v), SimNoise::ACCEL * SimNoise::ACCEL);
+		}
+
+		if (mag != nullptr) {
+			const Dcmd R(_q);
+			const Vector3d h(R * Vector3d(mag->unit()));
+			const double horiz = Vector2d(h(0), h(1)).norm();
+			Matrix<double, 1, 6> C;
+			C.setZero();
+			C.slice<1, 3>(0, 0) = Vector3d(R(2, 0), R(2, 1), R(2, 2)).transpose();
+			Vector<double, 1> r;
+			r(0) = -std::atan2(h(1), h(0));
+			correct<1>(C, r, SimNoise::MAGN * SimNoise::MAGN / (horiz * horiz));
+		}
+	}
+
+	const Quatd &attitude() const { return _q; }
+	const SquareMatrix<double, 6> &covariance() const { return _P; }
+
+private:
+	// whitened, C / sigma and r / sigma against R = I: inv() refuses a determinant below
+	// FLT_EPSILON, which S of the raw units is
+	template <size_t N>
+	void correct(const Matrix<double, N, 6> &C, const Matrix<double, N, 1> &r, double var)
+	{
+		const double sigma = std::sqrt(var);
+		SquareMatrix<double, N> R;
+		Vector<double, 6> dx;
+		SquareMatrix<double, 6> dP;
+		double beta;
+
+		R.setIdentity();
+		kalman_correct<double, 6, N>(_P, Matrix<double, N, 6>(C / sigma), R, Matrix<double, N, 1>(r / sigma), dx, dP, beta);
+		_P += dP;
+		_q = _q * Quatd::expq(Vector3d(dx(0), dx(1), dx(2)) * 0.5);
+		_q.normalize();
+		_bias += Vector3d(dx(3), dx(4), dx(5));
+	}
+
+	Quatd _q;
+	Vector3d _bias;
+	SquareMatrix<double, 6> _P;
+};
+
+// rotation error in the body frame of the estimate, q_true = q * exp(dtheta / 2)
+Vector3d attError(const Quatd &truth, const Quatd &est)
+{
+	Quatd d = est.inversed() * truth;
+
+	if (d(0) < 0) {
+		d = -d;
+	}
+	return Vector3d(d(1), d(2), d(3)) * 2.0;
+}
+
+TEST(AhrsEskfTest, SparseMatchesDense)
+{
+	sim::Trajectory traj(DT, Vector3d(0.01, -0.02, 0.015), 1);
+	Eskf sparse;
+	DenseEskf dense;
+
+	sparse.reset(traj.attitude());
+	dense.reset(traj.attitude());
+	for (int i = 0; i < 5000; i++) {
+		const sim::Sample s = traj.next();
+
+		// the mag at a tenth of the rate, so both paths get used on their own
+		sparse.update(s.gyro, &s.accel, (i % 10) == 0 ? &s.mag : nullptr, DT);
+		dense.update(s.gyro, &s.accel, (i % 10) == 0 ? &s.mag : nullptr, DT);
+	}
+
+	EXPECT_LT(attError(dense.attitude(), sparse.attitude()).norm(), 1e-9);
+	for (size_t i = 0; i < 6; i++) {
+		for (size_t j = 0; j < 6; j++) {
+			EXPECT_NEAR(sparse.covariance()(i, j), dense.covariance()(i, j), 1e-12) << i << "," << j;
+		}
+	}
+}
+
+TEST(AhrsEskfTest, TracksAndLearnsTheGyroBias)
+{
+	const Vector3d bias(0.01, -0.02, 0.015);
+	sim::Trajectory traj(DT, bias, 2);
+	AhrsEskf<float> filter;
+	double max = 0.0;
+
+	filter.reset(Quatf(AxisAnglef(0.3f, -0.2f, 0.5f)));
+	while (traj.time() < 60.0) {
+		const sim::Sample s = traj.next();
+		const Vector3f g(s.gyro(0), s.gyro(1), s.gyro(2));
+		const Vector3f a(s.accel(0), s.accel(1), s.accel(2));
+		const Vector3f m(s.mag(0), s.mag(1), s.mag(2));
+
+		filter.update(g, &a, &m, float(DT));
+		if (traj.time() > 10.0) {
+			const Quatf &q = filter.attitude();
+			max = std::max(max, attError(s.q, Quatd(q(0), q(1), q(2), q(3))).norm() * RAD2DEG);
+		}
+	}
+
+	EXPECT_LT(max, 2.0);
+	for (int i = 0; i < 3; i++) {
+		EXPECT_NEAR(filter.biasGet()(i), bias(i), 0.002) << i;
+		// the bias is observable on all axes while the board turns
+		EXPECT_LT(std::sqrt(filter.covariance()(3 + i, 3 + i)), 0.002) << i;
+	}
+}
+
+TEST(AhrsEskfTest, CovarianceGrowsWithoutMeasurements)
+{
+	Eskf filter;
+	const double before = filter.covariance()(0, 0);
+
+	for (int i = 0; i < 500; i++) {
+		filter.update(Vector3d(0.1, 0.2, 0.3), nullptr, nullptr, DT);
+	}
+
+	EXPECT_GT(filter.covariance()(0, 0), before);
+	// the unknown bias integrates into the attitude, the two become correlated
+	EXPECT_LT(filter.covariance()(0, 3), 0.0);
+	EXPECT_EQ(filter.covariance()(3, 0), filter.covariance()(0, 3));
+}
+
+TEST(AhrsEskfTest, MagCorrectsHeadingOnly)
+{
+	Eskf filter;
+	const Vector3d level(0.0, 0.0, 1.0);
+	const Vector3d north(sim::Trajectory::field());
+
+	// 20 degrees of heading off, level
+	filter.reset(Quatd(AxisAngled(0.0, 0.0, 0.35)));
+	for (int i = 0; i < 2000; i++) {
+		filter.update(Vector3d(), &level, &north, DT);
+	}
+
+	EXPECT_LT(attError(Quatd(), filter.attitude()).norm() * RAD2DEG, 0.5);
+
+	// rolled, with the accel missing: the mag alone turns the heading and leaves the tilt
+	const Vector3d rolled(Dcmd(Eulerd(0.1, 0.0, 0.0)).transpose() * north);
+	filter.reset(Quatd(Eulerd(0.1, 0.0, 0.35)));
+	for (int i = 0; i < 2000; i++) {
+		filter.update(Vector3d(), nullptr, &rolled, DT);
+	}
+	const Eulerd e(filter.attitude());
+	EXPECT_NEAR(e.phi(), 0.1, 1e-3);
+	EXPECT_NEAR(e.psi(), 0.0, 0.01);
+}
+
+/*
+ * Normalised estimation error squared, e^T P^-1 e over the 6 states. With the model matching
+ * the simulation it is chi-square with 6 degrees of freedom: mean 6, 95 % below 12.59.
+ */
+TEST(AhrsEskfTest, NeesIsConsistent)
+{
+	constexpr int RUNS = 5;
+	const Vector3d bias(0.01, -0.02, 0.015);
+	double sum = 0.0;
+	int n = 0, inside = 0;
+
+	for (int run = 0; run < RUNS; run++) {
+		sim::Trajectory traj(DT, bias, 100 + run);
+		Eskf filter;
+
+		filter.reset(traj.attitude());
+		while (traj.time() < 30.0) {
+			const sim::Sample s = traj.next();
+
+			filter.update(s.gyro, &s.accel, &s.mag, DT);
+			if (traj.time() > 1.0) {
+				Vector<double, 6> e;
+				e.slice<3, 1>(0, 0) = attError(s.q, filter.attitude());
+				e.slice<3, 1>(3, 0) = bias - filter.biasGet();
+
+				// scaled to unit variances first, for the same reason as in DenseEskf
+				SquareMatrix<double, 6> P = filter.covariance();
+				for (size_t i = 0; i < 6; i++) {
+					const double d = std::sqrt(filter.covariance()(i, i));
+					e(i) /= d;
+					for (size_t j = 0; j < 6; j++) {
+						P(i, j) /= d * std::sqrt(filter.covariance()(j, j));
+					}
+				}
+
+				const double nees = (e.transpose() * inv(P) * e)(0, 0);
+				sum += nees;
+				inside += nees < 12.59 ? 1 : 0;
+				n++;
+			}
+		}
+	}
+
+	const double mean = sum / n;
+	EXPECT_GT(mean, 3.0);
+	EXPECT_LT(mean, 9.0);
+	EXPECT_GT(double(inside) / n, 0.85);
+}
+
+template <class Filter>
+double bench(int n)
+{
+	sim::Trajectory traj(DT, Vector3d(0.01, -0.02, 0.015), 3);
+	sim::Sample s[100];
+	Filter filter;
+
+	for (sim::Sample &x : s) {
+		x = traj.next();
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < n; i++) {
+		const sim::Sample &x = s[i % 100];
+		filter.update(x.gyro, &x.accel, &x.mag, DT);
+	}
+
+	const auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	volatile double sink = filter.attitude()(0);
+	(void)sink;
+	return ns / n;
+}
+
+TEST(AhrsEskfTest, Benchmark)
+{
+	constexpr int N = 50000;
+	const double sparse = bench<Eskf>(N);
+	const double dense = bench<DenseEskf>(N);
+
+	printf("eskf sparse %7.1f ns per update, dense %7.1f ns, %.1fx\n", sparse, dense, dense / sparse);
+}
+
+} // namespace
@@ -0,0 +1,172 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include "AhrsTrajectory.hpp"
+#include "ahrs_filter.h"
+
+using namespace matrix;
+
+namespace
+{
+
+constexpr double DT = 1.0 / 500.0;
+constexpr double SIM_S = 60.0;
+constexpr double SETTLE_S = 10.0;
+
+struct Result {
+	double rmsDeg;
+	double maxDeg;
+};
+
+template <class Filter, typename Type>
+Result run(Filter &filter, bool withAccel, bool withMag, const Vector3d &bias = Vector3d(0.01, -0.02, 0.015))
+{
+	sim::Trajectory traj(DT, bias, 1234);
+	const Quatd q0 = traj.attitude();
+	double sum = 0.0, max = 0.0;
+	int n = 0;
+
+	// from the true attitude, the convergence is tested on its own
+	filter.reset(Quaternion<Type>(Type(q0(0)), Type(q0(1)), Type(q0(2)), Type(q0(3))));
+
+	while (traj.time() < SIM_S) {
+		const sim::Sample s = traj.next();
+		const Vector3<Type> g(Type(s.gyro(0)), Type(s.gyro(1)), Type(s.gyro(2)));
+		const Vector3<Type> a(Type(s.accel(0)), Type(s.accel(1)), Type(s.accel(2)));
+		const Vector3<Type> m(Type(s.mag(0)), Type(s.mag(1)), Type(s.mag(2)));
+
+		filter.update(g, withAccel ? &a : nullptr, withMag ? &m : nullptr, Type(DT));
+
+		if (traj.time() > SETTLE_S) {
+			const double e = sim::errorDeg(s.q, filter.attitude());
+			sum += e * e;
+			max = std::max(max, e);
+			n++;
+		}
+	}
+
+	return {std::sqrt(sum / n), max};
+}
+
+TEST(AhrsFilterTest, MahonyTracksTheTrajectory)
+{
+	Ahrs<AhrsAlgo::MAHONY> filter;
+	const Result r = run<decltype(filter), float>(filter, true, true);
+
+	EXPECT_LT(r.rmsDeg, 2.0);
+	EXPECT_LT(r.maxDeg, 4.0);
+}
+
+TEST(AhrsFilterTest, MadgwickTracksTheTrajectory)
+{
+	Ahrs<AhrsAlgo::MADGWICK> filter;
+	const Result r = run<decltype(filter), float>(filter, true, true);
+
+	EXPECT_LT(r.rmsDeg, 2.0);
+	EXPECT_LT(r.maxDeg, 4.0);
+}
+
+TEST(AhrsFilterTest, MahonyIntegralLearnsTheGyroBias)
+{
+	const Vector3d bias(0.01, -0.02, 0.015);
+	MahonyAhrs<double> filter;
+
+	run<decltype(filter), double>(filter, true, true, bias);
+
+	// the integral keeps its value from one update to the next
+	for (int i = 0; i < 3; i++) {
+		EXPECT_NEAR(filter.biasGet()(i), bias(i), 0.003) << i;
+	}
+}
+
+TEST(AhrsFilterTest, CorrectionsBoundTheDrift)
+{
+	MahonyAhrs<float> gyroOnly, accelOnly, full;
+
+	const Result g = run<decltype(gyroOnly), float>(gyroOnly, false, false);
+	const Result a = run<decltype(accelOnly), float>(accelOnly, true, false);
+	const Result f = run<decltype(full), float>(full, true, true);
+
+	// the bias integrates into the attitude without a reference, the accel alone leaves yaw
+	EXPECT_GT(g.rmsDeg, 10.0);
+	EXPECT_LT(f.rmsDeg, a.rmsDeg);
+	EXPECT_LT(f.rmsDeg, g.rmsDeg / 10);
+}
+
+TEST(AhrsFilterTest, StartsAtTheGivenAttitude)
+{
+	const Quatf q0(Eulerf(0.1f, -0.2f, 1.0f));
+	Ahrs<AhrsAlgo::MADGWICK> madgwick;
+	Ahrs<AhrsAlgo::MAHONY> mahony;
+
+	madgwick.reset(q0);
+	mahony.reset(q0);
+
+	// no rate and no reference: nothing moves
+	madgwick.update(Vector3f(), nullptr, nullptr, 0.01f);
+	mahony.update(Vector3f(), nullptr, nullptr, 0.01f);
+	for (int i = 0; i < 4; i++) {
+		EXPECT_NEAR(madgwick.attitude()(i), q0(i), 1e-6f);
+		EXPECT_NEAR(mahony.attitude()(i), q0(i), 1e-6f);
+	}
+}
+
+// gains are part of the type
+struct StiffGains {
+	constexpr static double KP = 5.0;
+	constexpr static double KI = 0.0;
+	constexpr static double BETA = 0.5;
+};
+
+TEST(AhrsFilterTest, GainsAreATemplateArgument)
+{
+	Ahrs<AhrsAlgo::MAHONY, float, StiffGains> stiff;
+	Ahrs<AhrsAlgo::MAHONY, float> soft;
+	const Vector3f level(0.f, 0.f, 1.f);
+
+	static_assert(!std::is_same<decltype(stiff), decltype(soft)>::value, "gains select the type");
+
+	// from a 30 degree tilt toward level, the stiffer filter gets there first
+	stiff.reset(Quatf(AxisAnglef(0.52f, 0.f, 0.f)));
+	soft.reset(Quatf(AxisAnglef(0.52f, 0.f, 0.f)));
+	for (int i = 0; i < 50; i++) {
+		stiff.update(Vector3f(), &level, nullptr, 0.002f);
+		soft.update(Vector3f(), &level, nullptr, 0.002f);
+	}
+	EXPECT_LT(sim::errorDeg(Quatd(), stiff.attitude()), sim::errorDeg(Quatd(), soft.attitude()));
+}
+
+template <class Filter, typename Type>
+void bench(const char *name)
+{
+	constexpr int N = 200000;
+	const Vector3<Type> g(Type(0.1), Type(-0.2), Type(0.3));
+	const Vector3<Type> a(Type(0.05), Type(-0.02), Type(0.99));
+	const Vector3<Type> m(Type(0.4), Type(0.1), Type(-0.9));
+	Filter filter;
+	Filter accuracy;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < N; i++) {
+		filter.update(g, &a, &m, Type(0.002));
+	}
+
+	const auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	const Result r = run<Filter, Type>(accuracy, true, true);
+	volatile Type sink = filter.attitude()(0);
+	(void)sink;
+
+	std::printf("ahrs %-16s %6.1f ns per update, %5.2f deg rms, %5.2f deg max\n", name, ns / N, r.rmsDeg, r.maxDeg);
+}
+
+TEST(AhrsFilterTest, Benchmark)
+{
+	bench<Ahrs<AhrsAlgo::MAHONY, float>, float>("mahony float");
+	bench<Ahrs<AhrsAlgo::MADGWICK, float>, float>("madgwick float");
+	bench<Ahrs<AhrsAlgo::MAHONY, double>, double>("mahony double");
+	bench<Ahrs<AhrsAlgo::MADGWICK, double>, double>("madgwick double");
+}
+
+} // namespace
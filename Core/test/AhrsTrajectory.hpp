@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cmath>
+#include <random>
+#include "embedMath.h"
+
+namespace sim
+{
+
+// one sample of the synthetic trajectory: truth and what the sensors report
+struct Sample {
+	matrix::Quatd q;
+	matrix::Vector3d gyro;  // rad/s
+	matrix::Vector3d accel; // g
+	matrix::Vector3d mag;   // unit earth field
+};
+
+// white noise on each sensor, one sigma in the units of Sample
+struct SensorNoise {
+	double gyro{0.005};
+	double accel{0.01};
+	double mag{0.01};
+};
+
+/*
+ * A board tumbling on all three axes, integrated finely from the body rate, that the
+ * attitude filter tests run on. The gyro reports the mean rate over the sample period, as
+ * its own filter does, plus a constant bias; accel and mag are the earth vectors in the
+ * body frame, the field unit length, north and down.
+ */
+class Trajectory
+{
+public:
+	static constexpr int SUBSTEPS = 10;
+
+	Trajectory(double dt, const matrix::Vector3d &bias, unsigned seed, const SensorNoise &noise = SensorNoise())
+		: _dt(dt), _bias(bias), _noise(noise), _rng(seed)
+	{
+		_q = matrix::Quatd(matrix::AxisAngled(0.3, -0.2, 0.5));
+	}
+
+	Sample next()
+	{
+		Sample s;
+		const double h = _dt / SUBSTEPS;
+		matrix::Vector3d mean;
+
+		for (int i = 0; i < SUBSTEPS; i++) {
+			const matrix::Vector3d w = rate(_t + 0.5 * h);
+			_q = _q * matrix::Quatd::expq(w * (0.5 * h));
+			_q.normalize();
+			mean += w / SUBSTEPS;
+			_t += h;
+		}
+
+		const matrix::Dcmd R(_q);
+		s.q = _q;
+		s.gyro = mean + _bias + noise(_noise.gyro);
+		s.accel = matrix::Vector3d(R.transpose() * matrix::Vector3d(0.0, 0.0, 1.0)) + noise(_noise.accel);
+		s.mag = matrix::Vector3d(R.transpose() * field()) + noise(_noise.mag);
+		return s;
+	}
+
+	double time() const { return _t; }
+	const matrix::Quatd &attitude() const { return _q; }
+
+	static matrix::Vector3d field() { return matrix::Vector3d(0.4, 0.0, -0.9).unit(); }
+
+private:
+	static matrix::Vector3d rate(double t)
+	{
+		return matrix::Vector3d(0.8 * std::sin(0.7 * t), 0.6 * std::cos(0.4 * t), 0.5 + 0.3 * std::sin(0.2 * t));
+	}
+
+	matrix::Vector3d noise(double sigma)
+	{
+		std::normal_distribution<double> n(0.0, sigma);
+		return matrix::Vector3d(n(_rng), n(_rng), n(_rng));
+	}
+
+	double _dt;
+	matrix::Vector3d _bias;
+	SensorNoise _noise;
+	std::mt19937 _rng;
+	matrix::Quatd _q;
+	double _t{0.0};
+};
+
+// rotation angle between truth and estimate, degrees; from the vector part, acos of w has
+// no resolution left at the hundredths of a degree some tests compare
+template <typename Type>
+double errorDeg(const matrix::Quatd &truth, const matrix::Quaternion<Type> &est)
+{
+	const matrix::Quatd e = truth.inversed() * matrix::Quatd(est(0), est(1), est(2), est(3));
+
+	return 2.0 * std::atan2(matrix::Vector3d(e(1), e(2), e(3)).norm(), std::fabs(e(0))) * 180.0 / M_PI;
+}
+
+} // namespace sim
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include "bmp280_comp.h"
+
+namespace
+{
+
+// Bosch BMP280 datasheet trimming example
+constexpr BMP280_HandleTypeDef DATASHEET_CAL = {27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000, 0};
+constexpr int32_t ADC_MAX = 1 << 20;
+
+struct Backend {
+	const char *name;
+	float (*temperature)(BMP280_HandleTypeDef *, int32_t);
+	float (*pressure)(const BMP280_HandleTypeDef *, int32_t);
+};
+
+const Backend INT64 = {"int64", Bmp280Comp_Temperature64, Bmp280Comp_Pressure64};
+const Backend INT32 = {"int32", Bmp280Comp_Temperature32, Bmp280Comp_Pressure32};
+const Backend FLOAT = {"float", Bmp280Comp_TemperatureF, Bmp280Comp_PressureF};
+
+float pressure(const Backend &b, int32_t adcT, int32_t adcP)
+{
+	BMP280_HandleTypeDef cal = DATASHEET_CAL;
+	b.temperature(&cal, adcT);
+	return b.pressure(&cal, adcP);
+}
+
+// adc_T giving -40, 0, 25 and 85 degC with the datasheet trimming
+constexpr int32_t ADC_T_SWEEP[] = {313696, 400000, 519888, 600000, 712487};
+
+TEST(Bmp280CompTest, DatasheetVectors)
+{
+	for (const Backend &b : {INT64, INT32, FLOAT}) {
+		BMP280_HandleTypeDef cal = DATASHEET_CAL;
+		EXPECT_NEAR(b.temperature(&cal, 519888), 2508.f, 0.5f) << b.name;
+		EXPECT_EQ(cal.T_fine, 128422) << b.name;
+		// the 32-bit path lands on 100656 Pa, its error is a few Pa across the range
+		EXPECT_NEAR(b.pressure(&cal, 415148), 100653.27f, 5.f) << b.name;
+	}
+}
+
+TEST(Bmp280CompTest, TemperatureFullRange)
+{
+	for (int32_t adcT = 0; adcT < ADC_MAX; adcT++) {
+		BMP280_HandleTypeDef ref = DATASHEET_CAL;
+		BMP280_HandleTypeDef cal = DATASHEET_CAL;
+		const float t = Bmp280Comp_Temperature64(&ref, adcT);
+
+		// same arithmetic without the int64 casts, nothing overflows
+		ASSERT_EQ(Bmp280Comp_Temperature32(&cal, adcT), t) << adcT;
+		ASSERT_EQ(cal.T_fine, ref.T_fine) << adcT;
+
+		if (t >= -4000.f && t <= 8500.f) {
+			ASSERT_NEAR(Bmp280Comp_TemperatureF(&cal, adcT), t, 1.f) << adcT;
+		}
+	}
+}
+
+TEST(Bmp280CompTest, PressureFullRange)
+{
+	for (int32_t adcT : ADC_T_SWEEP) {
+		float max32 = 0.f, maxF = 0.f;
+
+		for (int32_t adcP = 0; adcP < ADC_MAX; adcP++) {
+			const float ref = pressure(INT64, adcT, adcP);
+			const float err32 = std::fabs(pressure(INT32, adcT, adcP) - ref);
+			const float errF = std::fabs(pressure(FLOAT, adcT, adcP) - ref);
+
+			// below ~1 kPa the datasheet 32-bit path wraps; the sensor range starts at 30 kPa
+			if (ref < 2000.f) {
+				continue;
+			}
+
+			ASSERT_LE(err32, 8.f) << adcT << " " << adcP;
+			ASSERT_LE(errF, 1.f) << adcT << " " << adcP;
+
+			// operating range 300..1100 hPa
+			if (ref >= 30000.f && ref <= 110000.f) {
+				max32 = std::fmax(max32, err32);
+				maxF = std::fmax(maxF, errF);
+			}
+		}
+
+		EXPECT_LE(max32, 5.f) << adcT;
+		EXPECT_LE(maxF, 0.5f) << adcT;
+	}
+}
+
+TEST(Bmp280CompTest, Benchmark)
+{
+	constexpr int N = 2000000;
+
+	for (const Backend &b : {INT64, INT32, FLOAT}) {
+		BMP280_HandleTypeDef cal = DATASHEET_CAL;
+		volatile float sink = 0.f;
+
+		const auto start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < N; i++) {
+			sink = sink + b.temperature(&cal, 500000 + (i & 0xFFFF));
+			sink = sink + b.pressure(&cal, 400000 + (i & 0x3FFFF));
+		}
+
+		const auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		std::printf("bmp280 %-5s  %6.1f ns per temperature + pressure\n", b.name, ns / N);
+	}
+}
+
+} // namespace
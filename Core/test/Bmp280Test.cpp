@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+#include "FakeI2cBus.hpp"
+#include "imu.h"
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+constexpr uint16_t BMP_ADDR = ICM20948::BMP280_ADDR;
+
+// Bosch BMP280 datasheet, section 8.2 / appendix: calibration and ADC example
+constexpr uint16_t DIG_T1 = 27504;
+constexpr int16_t DIG_T2 = 26435;
+constexpr int16_t DIG_T3 = -1000;
+constexpr uint16_t DIG_P1 = 36477;
+constexpr int16_t DIG_P2 = -10685;
+constexpr int16_t DIG_P3 = 3024;
+constexpr int16_t DIG_P4 = 2855;
+constexpr int16_t DIG_P5 = 140;
+constexpr int16_t DIG_P6 = -7;
+constexpr int16_t DIG_P7 = 15500;
+constexpr int16_t DIG_P8 = -14600;
+constexpr int16_t DIG_P9 = 6000;
+constexpr int32_t ADC_T = 519888;
+constexpr int32_t ADC_P = 415148;
+
+// BMP280 register file with the datasheet trimming and a STATUS.measuring flag
+class FakeBmp280 : public fake::RegisterDevice
+{
+public:
+	FakeBmp280()
+	{
+		const uint16_t dig[12] = {DIG_T1, (uint16_t)DIG_T2, (uint16_t)DIG_T3, DIG_P1, (uint16_t)DIG_P2,
+					  (uint16_t)DIG_P3, (uint16_t)DIG_P4, (uint16_t)DIG_P5, (uint16_t)DIG_P6,
+					  (uint16_t)DIG_P7, (uint16_t)DIG_P8, (uint16_t)DIG_P9
+					 };
+
+		for (int i = 0; i < 12; i++) {
+			regs[0x88 + 2 * i] = dig[i] & 0xFF;
+			regs[0x89 + 2 * i] = dig[i] >> 8;
+		}
+
+		regs[0xD0] = 0x58;
+		setAdc(ADC_T, ADC_P);
+	}
+
+	void setAdc(int32_t adcT, int32_t adcP)
+	{
+		regs[0xF7] = adcP >> 12;
+		regs[0xF8] = adcP >> 4;
+		regs[0xF9] = (adcP & 0x0F) << 4;
+		regs[0xFA] = adcT >> 12;
+		regs[0xFB] = adcT >> 4;
+		regs[0xFC] = (adcT & 0x0F) << 4;
+	}
+
+	void setMeasuring(bool busy) { regs[0xF3] = busy ? 0x08 : 0x00; }
+};
+
+class Bmp280Test : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		bus.reset();
+		bus.attach(ICM_ADDR, &icm);
+		bus.attach(BMP_ADDR, &bmp);
+		imu.imuInit(&motion, &pressure);
+		bus.clearLog();
+		bus.delayCalls = 0;
+	}
+
+	size_t bmpTransactions() const
+	{
+		size_t n = 0;
+
+		for (const auto &t : bus.log()) {
+			n += t.devAddr == BMP_ADDR;
+		}
+
+		return n;
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+	FakeBmp280 bmp;
+	ICM20948 imu;
+	IMU_EN_SENSOR_TYPE motion;
+	IMU_EN_SENSOR_TYPE pressure;
+};
+
+TEST_F(Bmp280Test, InitReadsCalibrationInOneTransfer)
+{
+	bus.reset();
+	bus.attach(ICM_ADDR, &icm);
+	bus.attach(BMP_ADDR, &bmp);
+	ICM20948 fresh;
+	fresh.imuInit(&motion, &pressure);
+
+	EXPECT_EQ(pressure, IMU_EN_SENSOR_TYPE_BMP280);
+
+	size_t calReads = 0;
+
+	for (const auto &t : bus.log()) {
+		if (t.devAddr == BMP_ADDR && t.read && t.regAddr >= 0x88 && t.regAddr <= 0x9F) {
+			calReads++;
+			EXPECT_EQ(t.regAddr, 0x88);
+			EXPECT_EQ(t.len, 24);
+		}
+	}
+
+	EXPECT_EQ(calReads, 1u);
+
+	// default configuration is the one bmp280Init always used (0xFF / 0x14), all
+	// oversampling and filter codes above x16 alias to x16
+	EXPECT_EQ(bmp.regs[0xF4], (5 << 5) | (5 << 2) | 3);
+	EXPECT_EQ(bmp.regs[0xF5], 4 << 2);
+}
+
+TEST_F(Bmp280Test, DatasheetVectors)
+{
+	bus.tick += imu.pressSensorPeriodMs();
+	ASSERT_TRUE(imu.pressSensorPoll());
+
+	int32_t t, p;
+	imu.pressSensorLatestGet(&t, &p);
+	EXPECT_EQ(t, 2508);    // 25.08 degC
+	EXPECT_NEAR(p, 100653, 5); // 100653.27 Pa, the 32-bit backend is off by a few Pa
+
+	// one STATUS read and one 6-byte burst
+	ASSERT_EQ(bmpTransactions(), 2u);
+	EXPECT_EQ(bus.log()[1].regAddr, 0xF7);
+	EXPECT_EQ(bus.log()[1].len, 6);
+}
+
+TEST_F(Bmp280Test, AveragedPathUsesBurst)
+{
+	int32_t t, p, alt;
+
+	for (int i = 0; i < 8; i++) {
+		imu.pressSensorDataGet(&t, &p, &alt);
+	}
+
+	EXPECT_EQ(t, 2508);
+	EXPECT_NEAR(p, 100653, 5);
+	EXPECT_EQ(bmpTransactions(), 8u);
+	EXPECT_EQ(bus.readsInRange(BMP_ADDR, 0xF7, 0xFC), 8u);
+}
+
+TEST_F(Bmp280Test, PollNeverBlocks)
+{
+	// result not due yet: no bus traffic at all
+	EXPECT_FALSE(imu.pressSensorPoll());
+	EXPECT_EQ(bmpTransactions(), 0u);
+
+	// due, but the sensor is still converting: only the STATUS read
+	bus.tick += imu.pressSensorPeriodMs();
+	bmp.setMeasuring(true);
+	EXPECT_FALSE(imu.pressSensorPoll());
+	EXPECT_EQ(bmpTransactions(), 1u);
+	EXPECT_EQ(bus.log().back().regAddr, 0xF3);
+
+	bmp.setMeasuring(false);
+	EXPECT_TRUE(imu.pressSensorPoll());
+	EXPECT_FALSE(imu.pressSensorPoll());
+	EXPECT_EQ(bus.delayCalls, 0u);
+}
+
+TEST_F(Bmp280Test, RuntimeConfig)
+{
+	IMU_ST_BARO_CONFIG cfg{};
+	cfg.enTempOsrs = IMU_EN_BARO_OSRS_X1;
+	cfg.enPressOsrs = IMU_EN_BARO_OSRS_X4;
+	cfg.enMode = IMU_EN_BARO_MODE_NORMAL;
+	cfg.enStandby = IMU_EN_BARO_STANDBY_62_5MS;
+	cfg.enFilter = IMU_EN_BARO_FILTER_4;
+	imu.pressSensorConfigSet(&cfg);
+
+	EXPECT_EQ(bmp.regs[0xF4], (1 << 5) | (3 << 2) | 3);
+	EXPECT_EQ(bmp.regs[0xF5], (1 << 5) | (2 << 2));
+
+	// sleep, CONFIG, CTRL_MEAS: CONFIG is only written while the sensor sleeps
+	ASSERT_EQ(bus.transactions(), 3u);
+	EXPECT_EQ(bus.log()[0].regAddr, 0xF4);
+	EXPECT_EQ(bus.log()[1].regAddr, 0xF5);
+
+	// t_meas 1.25 + 2.3 + 9.2 + 0.575 ms plus 62.5 ms standby
+	EXPECT_EQ(imu.pressSensorPeriodMs(), 76u);
+
+	// forced mode: each result restarts a conversion
+	cfg.enMode = IMU_EN_BARO_MODE_FORCED;
+	imu.pressSensorConfigSet(&cfg);
+	EXPECT_EQ(imu.pressSensorPeriodMs(), 14u);
+
+	bus.clearLog();
+	bus.tick += 14;
+	ASSERT_TRUE(imu.pressSensorPoll());
+	ASSERT_EQ(bus.transactions(), 3u);
+	EXPECT_FALSE(bus.log()[2].read);
+	EXPECT_EQ(bmp.regs[0xF4], (1 << 5) | (3 << 2) | 1);
+}
+
+} // namespace
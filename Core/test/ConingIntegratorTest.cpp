@@ -0,0 +1,220 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include "AhrsTrajectory.hpp"
+#include "ahrs_filter.h"
+#include "coning_integrator.h"
+
+using namespace matrix;
+
+namespace
+{
+
+constexpr double GYRO_HZ = 1125.0;
+constexpr double DT = 1.0 / GYRO_HZ;
+
+Vector3f toFloat(const Vector3d &v)
+{
+	return Vector3f(float(v(0)), float(v(1)), float(v(2)));
+}
+
+/*
+ * Coning: the body rate (a W cos Wt, a W sin Wt, 0) turns in the x-y plane, the board
+ * wobbles around z and drifts about it, which a sum of the sample rotations does not see.
+ * The truth is integrated finely, every gyro sample is the exact mean rate over its period.
+ */
+class Coning
+{
+public:
+	static constexpr int SUBSTEPS = 50;
+
+	Coning(double amplitude, double hz) : _a(amplitude), _w(2.0 * M_PI * hz)
+	{
+	}
+
+	Vector3f next()
+	{
+		const double h = DT / SUBSTEPS;
+		const double t0 = _t;
+
+		for (int i = 0; i < SUBSTEPS; i++) {
+			_q = _q * Quatd::expq(rate(_t + 0.5 * h) * (0.5 * h));
+			_q.normalize();
+			_t += h;
+		}
+
+		// the integral of the rate over the sample, divided by its length
+		const Vector3d mean(_a * (std::sin(_w * _t) - std::sin(_w * t0)), _a * (std::cos(_w * t0) - std::cos(_w * _t)), 0.0);
+		return toFloat(mean / DT);
+	}
+
+	const Quatd &attitude() const { return _q; }
+
+	// gravity and a field north and down, in the body frame
+	Vector3f accel() const { return toFloat(Dcmd(_q).transpose() * Vector3d(0.0, 0.0, 1.0)); }
+	Vector3f mag() const { return toFloat(Dcmd(_q).transpose() * Vector3d(0.4, 0.0, -0.9)); }
+
+private:
+	Vector3d rate(double t) const
+	{
+		return Vector3d(_a * _w * std::cos(_w * t), _a * _w * std::sin(_w * t), 0.0);
+	}
+
+	double _a;
+	double _w;
+	double _t{0.0};
+	Quatd _q;
+};
+
+TEST(ConingIntegratorTest, FixedAxisIsTheSum)
+{
+	ConingIntegrator integ;
+	const float gyro[3] = {0.3f, -0.2f, 0.1f};
+	float angle[3], dq[4];
+
+	for (int i = 0; i < 10; i++) {
+		integ.put(gyro, 0.001f);
+	}
+
+	EXPECT_EQ(integ.samplesGet(), 10u);
+	EXPECT_NEAR(integ.dtGet(), 0.01f, 1e-7f);
+	integ.deltaAngleGet(angle);
+	for (int i = 0; i < 3; i++) {
+		EXPECT_NEAR(angle[i], gyro[i] * 0.01f, 1e-8f) << i;
+	}
+
+	// the delta quaternion is the rotation of that angle, and the next interval starts empty
+	EXPECT_NEAR(integ.get(dq), 0.01f, 1e-7f);
+	const Quatf expected(AxisAnglef(angle[0], angle[1], angle[2]));
+	for (int i = 0; i < 4; i++) {
+		EXPECT_NEAR(dq[i], expected(i), 1e-7f) << i;
+	}
+	EXPECT_EQ(integ.samplesGet(), 0u);
+	EXPECT_EQ(integ.dtGet(), 0.f);
+}
+
+TEST(ConingIntegratorTest, ConingTermRecoversTheDrift)
+{
+	constexpr int SAMPLES = 10;
+	Coning motion(0.05, 20.0);
+	ConingIntegrator integ;
+	Vector3f sum;
+	float dq[4];
+
+	const Quatd start = motion.attitude();
+	for (int i = 0; i < SAMPLES; i++) {
+		const Vector3f g = motion.next();
+		float gyro[3];
+
+		g.copyTo(gyro);
+		integ.put(gyro, float(DT));
+		sum += g * float(DT);
+	}
+	integ.get(dq);
+
+	const Quatd truth = start.inversed() * motion.attitude();
+	const double plain = sim::errorDeg(truth, Quatf::expq(sum * 0.5f));
+	const double coning = sim::errorDeg(truth, Quatf(dq[0], dq[1], dq[2], dq[3]));
+
+	EXPECT_LT(coning, plain / 10);
+}
+
+/*
+ * Three loops on the same coning motion for 10 s, references exact:
+ *   single-rate, every sample: the filter step per gyro sample
+ *   single-rate, decimated:    the step at the slow rate on the gyro sample it reads
+ *   two-rate:                  every sample into the integrator, the step at the slow rate
+ */
+struct LoopResult {
+	double nsPerSecond;
+	double rmsDeg;
+	double maxDeg;
+};
+
+template <class Step>
+LoopResult runLoop(int decimation, Step step)
+{
+	constexpr int SECONDS = 10;
+	Coning motion(0.05, 20.0);
+	MahonyAhrs<float> filter;
+	std::chrono::steady_clock::duration cpu{};
+	double sum = 0.0, max = 0.0;
+	int n = 0;
+
+	for (int i = 1; i <= SECONDS * int(GYRO_HZ); i++) {
+		const Vector3f g = motion.next();
+		const bool slow = (i % decimation) == 0;
+		const Vector3f a = motion.accel();
+		const Vector3f m = motion.mag();
+
+		const auto start = std::chrono::steady_clock::now();
+		step(filter, g, slow ? &a : nullptr, slow ? &m : nullptr);
+		cpu += std::chrono::steady_clock::now() - start;
+
+		if (slow) {
+			const double e = sim::errorDeg(motion.attitude(), filter.attitude());
+			sum += e * e;
+			max = std::max(max, e);
+			n++;
+		}
+	}
+
+	return {std::chrono::duration<double, std::nano>(cpu).count() / SECONDS, std::sqrt(sum / n), max};
+}
+
+struct Loops {
+	LoopResult full;
+	LoopResult decimated;
+	LoopResult twoRate;
+};
+
+Loops runLoops()
+{
+	constexpr int DECIMATION = 10; // 112.5 Hz fusion
+	ConingIntegrator integ;
+	Loops r;
+
+	r.full = runLoop(DECIMATION, [](MahonyAhrs<float> &f, const Vector3f &g, const Vector3f *a, const Vector3f *m) {
+		f.update(g, a, m, float(DT));
+	});
+	r.decimated = runLoop(DECIMATION, [](MahonyAhrs<float> &f, const Vector3f &g, const Vector3f *a, const Vector3f *m) {
+		if (a != nullptr) {
+			f.update(g, a, m, float(DT * DECIMATION));
+		}
+	});
+	r.twoRate = runLoop(DECIMATION, [&integ](MahonyAhrs<float> &f, const Vector3f &g, const Vector3f *a, const Vector3f *m) {
+		float gyro[3], dq[4];
+
+		g.copyTo(gyro);
+		integ.put(gyro, float(DT));
+		if (a != nullptr) {
+			const float dt = integ.get(dq);
+			f.updateDelta(Quatf(dq[0], dq[1], dq[2], dq[3]), a, m, dt);
+		}
+	});
+	return r;
+}
+
+// the accuracy of the full-rate loop, far better than reading less
+TEST(ConingIntegratorTest, TwoRateKeepsTheFullRateAccuracy)
+{
+	const Loops r = runLoops();
+
+	EXPECT_LT(r.twoRate.rmsDeg, 2 * r.full.rmsDeg + 0.05);
+	EXPECT_LT(r.twoRate.rmsDeg * 10, r.decimated.rmsDeg);
+}
+
+TEST(ConingIntegratorTest, Benchmark)
+{
+	const Loops r = runLoops();
+
+	printf("coning single-rate 1125 Hz  %8.0f us cpu/s  %6.3f deg rms  %6.3f deg max\n", r.full.nsPerSecond / 1000, r.full.rmsDeg,
+	       r.full.maxDeg);
+	printf("coning single-rate  112 Hz  %8.0f us cpu/s  %6.3f deg rms  %6.3f deg max\n", r.decimated.nsPerSecond / 1000,
+	       r.decimated.rmsDeg, r.decimated.maxDeg);
+	printf("coning two-rate 1125/112 Hz %8.0f us cpu/s  %6.3f deg rms  %6.3f deg max\n", r.twoRate.nsPerSecond / 1000,
+	       r.twoRate.rmsDeg, r.twoRate.maxDeg);
+}
+
+} // namespace
@@ -0,0 +1,396 @@
+#include <gtest/gtest.h>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include "FakeI2cBus.hpp"
+#include "gyro_cal.h"
+#include "imu.h"
+
+namespace
+{
+
+constexpr uint32_t PAGE_SIZE = 2048;
+constexpr uint32_t SLOTS = PAGE_SIZE / sizeof(GYRO_CAL_ST_RECORD);
+constexpr float BIAS[3] = {0.8f, -1.2f, 0.3f};
+
+// one erasable flash page: erased bytes read 0xFF and can only be programmed once
+struct FakeFlash {
+	std::array<uint8_t, PAGE_SIZE> mem;
+	uint32_t erases{0};
+	uint32_t programs{0};
+
+	FakeFlash() { mem.fill(0xFF); }
+};
+
+FakeFlash flash;
+
+uint8_t flashRead(uint32_t off, void *buf, uint32_t len)
+{
+	if (off + len > PAGE_SIZE) {
+		return 0;
+	}
+
+	std::memcpy(buf, flash.mem.data() + off, len);
+	return 1;
+}
+
+uint8_t flashProgram(uint32_t off, const void *buf, uint32_t len)
+{
+	if (off + len > PAGE_SIZE || (off | len) & 7) {
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < len; i++) {
+		if (flash.mem[off + i] != 0xFF) {
+			return 0;
+		}
+	}
+
+	std::memcpy(flash.mem.data() + off, buf, len);
+	flash.programs++;
+	return 1;
+}
+
+uint8_t flashErase()
+{
+	flash.mem.fill(0xFF);
+	flash.erases++;
+	return 1;
+}
+
+const GYRO_CAL_ST_NV FAKE_NV = {PAGE_SIZE, flashRead, flashProgram, flashErase};
+
+class GyroCalTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		flash = FakeFlash();
+		GyroCal_Init(&cal, &FAKE_NV);
+	}
+
+	// board at rest: sensor noise around the bias, gravity on z
+	uint32_t still(int n, const float *bias = BIAS)
+	{
+		uint32_t accepted = 0;
+
+		for (int i = 0; i < n; i++) {
+			const float g[3] = {bias[0] + gyroNoise(rng), bias[1] + gyroNoise(rng), bias[2] + gyroNoise(rng)};
+			const float a[3] = {accelNoise(rng), accelNoise(rng), 1.f + accelNoise(rng)};
+			accepted += GyroCal_Update(&cal, g, a, 25.f);
+		}
+
+		return accepted;
+	}
+
+	// handled: rotating back and forth, the specific force swings with the tilt
+	void moving(int n)
+	{
+		for (int i = 0; i < n; i++, phase += 2.f * (float)M_PI / 225.f) {
+			const float g[3] = {BIAS[0] + 30.f * std::sin(phase), BIAS[1], BIAS[2] + 10.f * std::cos(phase)};
+			const float a[3] = {0.3f * std::sin(phase), 0.f, std::cos(0.3f * std::sin(phase))};
+			GyroCal_Update(&cal, g, a, 25.f);
+		}
+	}
+
+	GYRO_CAL_ST_STATE cal;
+	std::mt19937 rng{12345};
+	std::normal_distribution<float> gyroNoise{0.f, 0.05f};
+	std::normal_distribution<float> accelNoise{0.f, 0.002f};
+	float phase{0.f};
+};
+
+TEST_F(GyroCalTest, WelfordMatchesTwoPass)
+{
+	GYRO_CAL_ST_WELFORD w;
+	std::vector<float> v[3];
+	std::normal_distribution<float> d{5.f, 0.3f};
+
+	GyroCal_WelfordReset(&w);
+
+	for (int i = 0; i < 1000; i++) {
+		const float in[3] = {d(rng), -d(rng), 100.f + d(rng)};
+		GyroCal_WelfordUpdate(&w, in);
+
+		for (int k = 0; k < 3; k++) {
+			v[k].push_back(in[k]);
+		}
+	}
+
+	for (int k = 0; k < 3; k++) {
+		double mean = 0., var = 0.;
+
+		for (float x : v[k]) {
+			mean += x;
+		}
+
+		mean /= v[k].size();
+
+		for (float x : v[k]) {
+			var += (x - mean) * (x - mean);
+		}
+
+		var /= v[k].size() - 1;
+
+		EXPECT_NEAR(w.afMean[k], mean, 1e-4) << k;
+		EXPECT_NEAR(GyroCal_WelfordVar(&w, k), var, 1e-3 * var) << k;
+	}
+}
+
+TEST_F(GyroCalTest, EmptyStorageStartsWithoutBias)
+{
+	EXPECT_FALSE(cal.u8Valid);
+	EXPECT_EQ(cal.afBiasDps[0], 0.f);
+	EXPECT_FALSE(GyroCal_Save(&cal));
+	EXPECT_EQ(flash.programs, 0u);
+}
+
+TEST_F(GyroCalTest, StationaryWindowIsAccepted)
+{
+	EXPECT_EQ(still(GYRO_CAL_WINDOW - 1), 0u);
+	EXPECT_FALSE(cal.u8Valid);
+	EXPECT_EQ(still(1), 1u);
+
+	ASSERT_TRUE(cal.u8Valid);
+
+	for (int k = 0; k < 3; k++) {
+		EXPECT_NEAR(cal.afBiasDps[k], BIAS[k], 0.01f) << k;
+	}
+
+	EXPECT_TRUE(cal.u8SavePending);
+	EXPECT_EQ(cal.u32Accepted, 1u);
+}
+
+TEST_F(GyroCalTest, MovingProfile)
+{
+	// moving, still, moving again: only the still stretch may set the bias
+	moving(3 * GYRO_CAL_WINDOW);
+	EXPECT_FALSE(cal.u8Valid);
+	EXPECT_GE(cal.u32Rejected, 3u);
+
+	// the first window straddles the end of the motion and is thrown away
+	still(3 * GYRO_CAL_WINDOW);
+	EXPECT_GE(cal.u32Accepted, 2u);
+	ASSERT_TRUE(cal.u8Valid);
+
+	const uint32_t accepted = cal.u32Accepted;
+	moving(3 * GYRO_CAL_WINDOW);
+	EXPECT_EQ(cal.u32Accepted, accepted);
+
+	for (int k = 0; k < 3; k++) {
+		EXPECT_NEAR(cal.afBiasDps[k], BIAS[k], 0.01f) << k;
+	}
+}
+
+TEST_F(GyroCalTest, SteadyTurnIsNotABias)
+{
+	// a slow constant turn has no variance, only its size gives it away
+	const float turn[3] = {0.f, 0.f, 20.f};
+	still(GYRO_CAL_WINDOW, turn);
+
+	EXPECT_FALSE(cal.u8Valid);
+	EXPECT_EQ(cal.u32Rejected, 1u);
+}
+
+TEST_F(GyroCalTest, VibrationIsNotStill)
+{
+	// gyro quiet, but the accelerometer sees a 0.05 g shake
+	for (int i = 0; i < GYRO_CAL_WINDOW; i++) {
+		const float g[3] = {BIAS[0], BIAS[1], BIAS[2]};
+		const float a[3] = {0.f, 0.f, 1.f + 0.05f * std::sin(i * 0.9f)};
+		GyroCal_Update(&cal, g, a, 25.f);
+	}
+
+	EXPECT_FALSE(cal.u8Valid);
+	EXPECT_EQ(cal.u32Rejected, 1u);
+}
+
+TEST_F(GyroCalTest, PersistsAcrossBoots)
+{
+	still(GYRO_CAL_WINDOW);
+	ASSERT_TRUE(GyroCal_Save(&cal));
+	EXPECT_EQ(flash.programs, 1u);
+	EXPECT_FALSE(GyroCal_Save(&cal));
+
+	// the same bias again is not worth a flash write
+	still(GYRO_CAL_WINDOW);
+	EXPECT_EQ(cal.u32Accepted, 2u);
+	EXPECT_FALSE(cal.u8SavePending);
+
+	GYRO_CAL_ST_STATE boot;
+	GyroCal_Init(&boot, &FAKE_NV);
+	ASSERT_TRUE(boot.u8Valid);
+	EXPECT_EQ(boot.u16Seq, 1u);
+
+	for (int k = 0; k < 3; k++) {
+		EXPECT_EQ(boot.afBiasDps[k], cal.afSavedDps[k]) << k;
+	}
+}
+
+TEST_F(GyroCalTest, CorruptRecordIsSkipped)
+{
+	const float first[3] = {0.5f, 0.5f, 0.5f};
+	const float second[3] = {-0.5f, -0.5f, -0.5f};
+
+	still(GYRO_CAL_WINDOW, first);
+	ASSERT_TRUE(GyroCal_Save(&cal));
+	still(GYRO_CAL_WINDOW, second);
+	ASSERT_TRUE(GyroCal_Save(&cal));
+
+	// a bit flip in the newest record: fall back to the one before
+	flash.mem[sizeof(GYRO_CAL_ST_RECORD) + offsetof(GYRO_CAL_ST_RECORD, afBiasDps) + 1] ^= 0x10;
+
+	GyroCal_Init(&cal, &FAKE_NV);
+	ASSERT_TRUE(cal.u8Valid);
+	EXPECT_NEAR(cal.afBiasDps[0], 0.5f, 0.01f);
+
+	// the damaged slot is not reused
+	still(GYRO_CAL_WINDOW, second);
+	ASSERT_TRUE(GyroCal_Save(&cal));
+	EXPECT_EQ(cal.u32Slot, 3u);
+
+	// nothing valid at all
+	flash.mem.fill(0x00);
+	GyroCal_Init(&cal, &FAKE_NV);
+	EXPECT_FALSE(cal.u8Valid);
+}
+
+TEST_F(GyroCalTest, FullPageIsErased)
+{
+	for (uint32_t i = 0; i <= SLOTS; i++) {
+		const float bias[3] = {0.1f * (i % 50), 0.f, 0.f};
+		still(GYRO_CAL_WINDOW, bias);
+		ASSERT_TRUE(GyroCal_Save(&cal)) << i;
+	}
+
+	// SLOTS records fit before the first erase
+	EXPECT_EQ(flash.erases, 1u);
+
+	GYRO_CAL_ST_STATE boot;
+	GyroCal_Init(&boot, &FAKE_NV);
+	ASSERT_TRUE(boot.u8Valid);
+	EXPECT_NEAR(boot.afBiasDps[0], 0.1f * (SLOTS % 50), 0.01f);
+	EXPECT_EQ(boot.u32Slot, 1u);
+}
+
+TEST_F(GyroCalTest, Crc32)
+{
+	EXPECT_EQ(GyroCal_Crc32("123456789", 9), 0xCBF43926u);
+}
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+
+class ImuGyroCalTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		flash = FakeFlash();
+		bus.reset();
+		bus.attach(ICM_ADDR, &icm);
+		icm.setAccel(0, 0, 16384);
+	}
+
+	// bias in LSB at the default 1000 dps range
+	void setGyroBias() { icm.setGyro(33, -66, 16); }
+
+	IMU_ST_SENSOR_DATA sample()
+	{
+		IMU_ST_ANGLES_DATA angles;
+		IMU_ST_SENSOR_DATA gyro, accel, magn;
+		imu.imuDataGet(&angles, &gyro, &accel, &magn);
+		return gyro;
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+	ICM20948 imu;
+	IMU_EN_SENSOR_TYPE motion{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_EN_SENSOR_TYPE pressure{IMU_EN_SENSOR_TYPE_NULL};
+};
+
+TEST_F(ImuGyroCalTest, InitDoesNotBlock)
+{
+	setGyroBias();
+	imu.imuInit(&motion, &pressure);
+
+	// reset and settle only, the 32 x 30 ms averaging is gone
+	EXPECT_LT(bus.tick, 200u);
+	EXPECT_FALSE(imu.imuGyroCalGet()->u8Valid);
+}
+
+TEST_F(ImuGyroCalTest, LearnsBiasAndStartsWithItNextBoot)
+{
+	setGyroBias();
+	imu.imuGyroCalNvSet(&FAKE_NV);
+	imu.imuInit(&motion, &pressure);
+
+	IMU_ST_SENSOR_DATA gyro{};
+
+	// the first window holds the averaging filter filling up and is rejected
+	for (int i = 0; i < GYRO_CAL_WINDOW; i++) {
+		gyro = sample();
+	}
+
+	EXPECT_FALSE(imu.imuGyroCalGet()->u8Valid);
+	EXPECT_EQ(gyro.s16Y, 33);
+
+	for (int i = 0; i < GYRO_CAL_WINDOW; i++) {
+		gyro = sample();
+	}
+
+	ASSERT_TRUE(imu.imuGyroCalGet()->u8Valid);
+
+	// the window completes on the last sample, the next one is corrected
+	gyro = sample();
+	EXPECT_EQ(gyro.s16X, 0);
+	EXPECT_EQ(gyro.s16Y, 0);
+	EXPECT_EQ(gyro.s16Z, 0);
+	ASSERT_TRUE(imu.imuGyroCalSave());
+
+	// next power-up: corrected from the first sample
+	ICM20948 next;
+	next.imuGyroCalNvSet(&FAKE_NV);
+	next.imuInit(&motion, &pressure);
+
+	IMU_ST_ANGLES_DATA angles;
+	IMU_ST_SENSOR_DATA accel, magn;
+
+	for (int i = 0; i < 8; i++) {
+		next.imuDataGet(&angles, &gyro, &accel, &magn);
+	}
+
+	EXPECT_EQ(gyro.s16X, 0);
+	EXPECT_EQ(gyro.s16Y, 0);
+	EXPECT_EQ(gyro.s16Z, 0);
+}
+
+TEST_F(ImuGyroCalTest, OffsetFollowsRange)
+{
+	setGyroBias();
+	imu.imuGyroCalNvSet(&FAKE_NV);
+	imu.imuInit(&motion, &pressure);
+
+	for (int i = 0; i < 2 * GYRO_CAL_WINDOW; i++) {
+		sample();
+	}
+
+	ASSERT_TRUE(imu.imuGyroCalGet()->u8Valid);
+
+	// same physical bias at 2000 dps is half the LSB
+	imu.imuGyroFsSet(IMU_EN_GYRO_FS_2000DPS);
+	icm.setGyro(16, -33, 8);
+
+	IMU_ST_SENSOR_DATA gyro{};
+
+	for (int i = 0; i < 16; i++) {
+		gyro = sample();
+	}
+
+	EXPECT_NEAR(gyro.s16X, 0, 1);
+	EXPECT_NEAR(gyro.s16Y, 0, 1);
+	EXPECT_NEAR(gyro.s16Z, 0, 1);
+}
+
+} // namespace
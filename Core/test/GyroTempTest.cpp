@@ -0,0 +1,230 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include "FakeI2cBus.hpp"
+#include "gyro_temp.h"
+#include "imu.h"
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+
+// synthetic zero-rate offset over die temperature, per axis
+void trueBias(float t, float *b)
+{
+	const float d = t - 25.f;
+
+	b[0] = 0.5f + 0.06f * d + 0.002f * d * d;
+	b[1] = -0.8f - 0.04f * d + 0.001f * d * d;
+	b[2] = 0.2f + 0.03f * d;
+}
+
+TEST(GyroTempModelTest, EmptyIsInvalid)
+{
+	GyroTempModel model;
+
+	EXPECT_FALSE(model.valid());
+	EXPECT_EQ(model.pointsGet(), 0);
+}
+
+TEST(GyroTempModelTest, SinglePointIsConstant)
+{
+	GyroTempModel model;
+	const float bias[3] = {0.8f, -1.2f, 0.3f};
+	float out[3];
+
+	model.pointAdd(30.f, bias);
+	EXPECT_TRUE(model.valid());
+	EXPECT_EQ(model.orderGet(), 0);
+
+	for (float t : {-40.f, 0.f, 30.f, 100.f}) {
+		model.biasGet(t, out);
+		for (int k = 0; k < 3; k++) {
+			EXPECT_NEAR(out[k], bias[k], 0.001f) << t << " " << k;
+		}
+	}
+}
+
+TEST(GyroTempModelTest, OrderFollowsSpan)
+{
+	GyroTempModel model;
+	float b[3];
+
+	// close points merge, no slope from a 0.3 degC spread
+	for (float t : {30.f, 30.3f, 30.1f}) {
+		trueBias(t, b);
+		model.pointAdd(t, b);
+	}
+	EXPECT_EQ(model.pointsGet(), 1);
+	EXPECT_EQ(model.orderGet(), 0);
+
+	for (float t : {32.f, 34.f}) {
+		trueBias(t, b);
+		model.pointAdd(t, b);
+	}
+	EXPECT_EQ(model.orderGet(), 1);
+
+	for (float t : {37.f, 40.f, 43.f}) {
+		trueBias(t, b);
+		model.pointAdd(t, b);
+	}
+	EXPECT_EQ(model.pointsGet(), 6);
+	EXPECT_EQ(model.orderGet(), 2);
+}
+
+TEST(GyroTempModelTest, RecoversQuadraticAndHoldsEnds)
+{
+	GyroTempModel model;
+	float b[3], out[3];
+
+	for (float t = 10.f; t <= 60.f; t += 2.f) {
+		trueBias(t, b);
+		model.pointAdd(t, b);
+	}
+	EXPECT_EQ(model.pointsGet(), GyroTempModel::POINTS);
+	EXPECT_EQ(model.orderGet(), 2);
+
+	// between nodes the table is linear: curvature * step^2 / 4 = 0.0125 dps
+	for (float t = 10.f; t <= 60.f; t += 0.7f) {
+		trueBias(t, b);
+		model.biasGet(t, out);
+		for (int k = 0; k < 3; k++) {
+			EXPECT_NEAR(out[k], b[k], 0.015f) << t << " " << k;
+		}
+	}
+
+	// below the lowest point nothing is extrapolated
+	float lo[3];
+	model.biasGet(-15.f, out);
+	model.biasGet(-40.f, lo);
+	for (int k = 0; k < 3; k++) {
+		EXPECT_FLOAT_EQ(lo[k], out[k]) << k;
+	}
+}
+
+TEST(GyroTempModelTest, FullBufferKeepsCoverage)
+{
+	GyroTempModel model;
+	float b[3], out[3];
+
+	// a long soak at 40 degC must not push out the cold points
+	for (float t = 20.f; t <= 40.f; t += 1.f) {
+		trueBias(t, b);
+		model.pointAdd(t, b);
+	}
+	for (int i = 0; i < 200; i++) {
+		const float t = 40.f + 0.1f * (i % 5);
+		trueBias(t, b);
+		model.pointAdd(t, b);
+	}
+
+	EXPECT_LE(model.pointsGet(), GyroTempModel::POINTS);
+	trueBias(20.f, b);
+	model.biasGet(20.f, out);
+	for (int k = 0; k < 3; k++) {
+		EXPECT_NEAR(out[k], b[k], 0.01f) << k;
+	}
+}
+
+class ImuGyroTempTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		bus.reset();
+		bus.attach(ICM_ADDR, &icm);
+		icm.setAccel(0, 0, 16384);
+		setTemp(25.f);
+		imu.imuInit(&motion, &pressure);
+	}
+
+	// the board at rest at die temperature t, default 1000 dps range
+	void setTemp(float t)
+	{
+		float b[3];
+
+		trueBias(t, b);
+		icm.setTemp((int16_t)std::lround((t - ICM20948::TEMP_OFFSET_DEGC) * ICM20948::TEMP_LSB_PER_DEGC));
+		icm.setGyro((int16_t)std::lround(b[0] * 32.8f), (int16_t)std::lround(b[1] * 32.8f),
+			    (int16_t)std::lround(b[2] * 32.8f));
+	}
+
+	// linear ramp over n samples, returns the largest gyro output in dps; vibration keeps the
+	// calibration from seeing a still window
+	float ramp(float from, float to, int n, bool vibrate)
+	{
+		IMU_ST_ANGLES_DATA angles;
+		IMU_ST_SENSOR_DATA gyro, accel, magn;
+		float worst = 0.f;
+
+		for (int i = 0; i < n; i++) {
+			setTemp(from + (to - from) * i / n);
+			if (vibrate) {
+				icm.setAccel(0, 0, (i / 16) & 1 ? 16384 + 2000 : 16384 - 2000);
+			}
+			imu.imuDataGet(&angles, &gyro, &accel, &magn);
+
+			// skip the averaging ramp at the start
+			if (i >= 16) {
+				worst = std::max({worst, std::fabs(gyro.s16X / 32.8f), std::fabs(gyro.s16Y / 32.8f),
+						  std::fabs(gyro.s16Z / 32.8f)});
+			}
+		}
+
+		icm.setAccel(0, 0, 16384);
+		return worst;
+	}
+
+	// warm-up from 25 to 45 degC over 40 still windows
+	void learn()
+	{
+		ramp(25.f, 45.f, 40 * GYRO_CAL_WINDOW, false);
+
+		EXPECT_GE(imu.imuGyroCalGet()->u32Accepted, 30u);
+		EXPECT_EQ(imu.imuTempModelGet()->orderGet(), 2);
+		EXPECT_NEAR(imu.imuTempGet(), 45.f, 0.2f);
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+	ICM20948 imu;
+	IMU_EN_SENSOR_TYPE motion{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_EN_SENSOR_TYPE pressure{IMU_EN_SENSOR_TYPE_NULL};
+};
+
+TEST_F(ImuGyroTempTest, TempInBurst)
+{
+	setTemp(31.5f);
+	ramp(31.5f, 31.5f, 4, false);
+
+	EXPECT_NEAR(imu.imuTempGet(), 31.5f, 0.01f);
+}
+
+TEST_F(ImuGyroTempTest, ThermalRampResidual)
+{
+	learn();
+
+	// cooling down while in motion: only the model can follow the bias; the first windows
+	// of the warm-up hold the averaging ramp, so stay inside the span the points cover
+	EXPECT_LT(ramp(45.f, 30.f, 30 * GYRO_CAL_WINDOW, true), 0.1f);
+}
+
+TEST_F(ImuGyroTempTest, ConstantBiasDoesNotFollow)
+{
+	learn();
+	imu.imuTempCompEnable(false);
+
+	// the bias of the last still window at 45 degC is 1.6 dps off at 30 degC
+	EXPECT_GT(ramp(45.f, 30.f, 30 * GYRO_CAL_WINDOW, true), 1.f);
+}
+
+TEST_F(ImuGyroTempTest, RegisterModeFollowsModel)
+{
+	learn();
+	imu.imuBiasModeSet(IMU_EN_BIAS_MODE_REGISTER);
+
+	EXPECT_LT(ramp(45.f, 30.f, 30 * GYRO_CAL_WINDOW, true), 0.1f);
+}
+
+} // namespace
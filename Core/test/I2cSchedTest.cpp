@@ -0,0 +1,224 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "FakeI2cBus.hpp"
+#include "i2c.h"
+#include "i2c_sched.h"
+
+// on the target icm20948.c owns these callbacks and forwards to the scheduler
+extern "C" void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	I2CSched_RxCpltCallback(hi2c);
+}
+
+extern "C" void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	I2CSched_ErrorCallback(hi2c);
+}
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = 0xD0;
+constexpr uint16_t BMP_ADDR = 0xEE;
+
+struct Completion {
+	uint16_t devAddr;
+	uint8_t regAddr;
+	HAL_StatusTypeDef status;
+	uint32_t us;
+};
+
+std::vector<Completion> completions;
+
+void record(const I2C_SCHED_ST_XFER *pstXfer, HAL_StatusTypeDef enStatus)
+{
+	completions.push_back({pstXfer->u16DevAddr, pstXfer->u8RegAddr, enStatus, fake::I2cBus::instance().us});
+}
+
+class I2cSchedTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		bus.reset();
+		bus.deferDma = true;
+		bus.attach(ICM_ADDR, &icm);
+		bus.attach(BMP_ADDR, &bmp);
+		completions.clear();
+		I2CSched_Init(&sched, &hi2c3);
+	}
+
+	HAL_StatusTypeDef submit(uint16_t dev, uint8_t reg, uint8_t *buf, uint16_t len,
+				 I2C_SCHED_EN_PRIO prio, I2C_SCHED_EN_DIR dir = I2C_SCHED_DIR_READ)
+	{
+		I2C_SCHED_ST_XFER x{};
+		x.u16DevAddr = dev;
+		x.u8RegAddr = reg;
+		x.u8Dir = dir;
+		x.u16Len = len;
+		x.pu8Buf = buf;
+		x.u8Prio = prio;
+		x.pfnCallback = record;
+		return I2CSched_Submit(&sched, &x);
+	}
+
+	// play the DMA/I2C interrupts until the queue is empty
+	void drain()
+	{
+		while (bus.dmaPending()) {
+			bus.completeDma();
+		}
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::RegisterDevice icm;
+	fake::RegisterDevice bmp;
+	I2C_SCHED_ST_BUS sched;
+	uint8_t imuBuf[12] {};
+	uint8_t baroBuf[6] {};
+};
+
+TEST_F(I2cSchedTest, StartsWhenIdle)
+{
+	EXPECT_EQ(submit(ICM_ADDR, 0x2D, imuBuf, 12, I2C_SCHED_PRIO_HIGH), HAL_OK);
+
+	ASSERT_TRUE(bus.dmaPending());
+	EXPECT_EQ(bus.dmaActive().devAddr, ICM_ADDR);
+	EXPECT_EQ(bus.dmaActive().len, 12);
+	EXPECT_EQ(I2CSched_Pending(&sched), 0);
+}
+
+TEST_F(I2cSchedTest, ChainsFromCompletion)
+{
+	for (int i = 0; i < 12; i++) {
+		icm.regs[0x2D + i] = (uint8_t)(i + 1);
+		bmp.regs[0xF7 + i % 6] = (uint8_t)(0xA0 + i % 6);
+	}
+
+	submit(ICM_ADDR, 0x2D, imuBuf, 12, I2C_SCHED_PRIO_HIGH);
+	submit(BMP_ADDR, 0xF7, baroBuf, 6, I2C_SCHED_PRIO_LOW);
+	EXPECT_EQ(I2CSched_Pending(&sched), 1);
+
+	// one completion starts the next transfer without any thread-context help
+	bus.completeDma();
+	ASSERT_TRUE(bus.dmaPending());
+	EXPECT_EQ(bus.dmaActive().devAddr, BMP_ADDR);
+	bus.completeDma();
+	EXPECT_FALSE(bus.dmaPending());
+
+	ASSERT_EQ(completions.size(), 2u);
+	EXPECT_EQ(completions[0].devAddr, ICM_ADDR);
+	EXPECT_EQ(completions[1].devAddr, BMP_ADDR);
+	EXPECT_EQ(completions[1].us, bus.wireUs(12, true) + bus.wireUs(6, true));
+	EXPECT_EQ(imuBuf[11], 12);
+	EXPECT_EQ(baroBuf[5], 0xA5);
+}
+
+TEST_F(I2cSchedTest, HigherPriorityOvertakesQueue)
+{
+	uint8_t cfg = 0x57;
+
+	submit(BMP_ADDR, 0xF7, baroBuf, 6, I2C_SCHED_PRIO_LOW);
+	submit(BMP_ADDR, 0xF4, &cfg, 1, I2C_SCHED_PRIO_LOW, I2C_SCHED_DIR_WRITE);
+	submit(BMP_ADDR, 0xFA, baroBuf, 3, I2C_SCHED_PRIO_NORMAL);
+	submit(ICM_ADDR, 0x2D, imuBuf, 12, I2C_SCHED_PRIO_HIGH);
+	drain();
+
+	ASSERT_EQ(completions.size(), 4u);
+	EXPECT_EQ(completions[0].regAddr, 0xF7); // already on the bus
+	EXPECT_EQ(completions[1].regAddr, 0x2D);
+	EXPECT_EQ(completions[2].regAddr, 0xFA);
+	EXPECT_EQ(completions[3].regAddr, 0xF4);
+	EXPECT_EQ(bmp.regs[0xF4], 0x57);
+}
+
+TEST_F(I2cSchedTest, FullQueueRejects)
+{
+	// one on the bus plus QUEUE_LEN - 1 in the ring
+	for (int i = 0; i < I2C_SCHED_QUEUE_LEN; i++) {
+		EXPECT_EQ(submit(ICM_ADDR, 0x2D, imuBuf, 12, I2C_SCHED_PRIO_HIGH), HAL_OK);
+	}
+
+	EXPECT_EQ(submit(ICM_ADDR, 0x2D, imuBuf, 12, I2C_SCHED_PRIO_HIGH), HAL_BUSY);
+	EXPECT_EQ(sched.u32Rejected, 1u);
+
+	// other priorities have their own ring
+	EXPECT_EQ(submit(BMP_ADDR, 0xF7, baroBuf, 6, I2C_SCHED_PRIO_LOW), HAL_OK);
+
+	drain();
+	EXPECT_EQ(completions.size(), (size_t)I2C_SCHED_QUEUE_LEN + 1);
+}
+
+TEST_F(I2cSchedTest, RejectsBadDescriptor)
+{
+	EXPECT_EQ(submit(ICM_ADDR, 0x2D, nullptr, 12, I2C_SCHED_PRIO_HIGH), HAL_ERROR);
+	EXPECT_EQ(submit(ICM_ADDR, 0x2D, imuBuf, 0, I2C_SCHED_PRIO_HIGH), HAL_ERROR);
+	EXPECT_EQ(submit(ICM_ADDR, 0x2D, imuBuf, 12, I2C_SCHED_PRIO_NUM), HAL_ERROR);
+	EXPECT_FALSE(bus.dmaPending());
+}
+
+TEST_F(I2cSchedTest, ErrorDoesNotStallQueue)
+{
+	submit(0x42, 0x00, baroBuf, 1, I2C_SCHED_PRIO_HIGH); // nothing answers
+	submit(ICM_ADDR, 0x2D, imuBuf, 12, I2C_SCHED_PRIO_HIGH);
+	drain();
+
+	ASSERT_EQ(completions.size(), 2u);
+	EXPECT_EQ(completions[0].status, HAL_ERROR);
+	EXPECT_EQ(completions[1].status, HAL_OK);
+	EXPECT_EQ(I2CSched_DevStatsGet(&sched, 0x42)->u32Errors, 1u);
+	EXPECT_EQ(I2CSched_DevStatsGet(&sched, ICM_ADDR)->u32Xfers, 1u);
+}
+
+TEST_F(I2cSchedTest, BusTakenOutsideScheduler)
+{
+	uint8_t raw[2];
+
+	// a blocking-era driver still owns the peripheral
+	ASSERT_EQ(HAL_I2C_Mem_Read_DMA(&hi2c3, ICM_ADDR, 0x00, I2C_MEMADD_SIZE_8BIT, raw, 2), HAL_OK);
+	submit(ICM_ADDR, 0x2D, imuBuf, 12, I2C_SCHED_PRIO_HIGH);
+
+	ASSERT_EQ(completions.size(), 1u);
+	EXPECT_EQ(completions[0].status, HAL_BUSY);
+
+	// the foreign completion is not mistaken for a scheduled one
+	bus.completeDma();
+	EXPECT_EQ(completions.size(), 1u);
+}
+
+TEST_F(I2cSchedTest, ImuAndBaroShareBus)
+{
+	const uint32_t imuWire = bus.wireUs(12, true);
+	const uint32_t baroWire = bus.wireUs(6, true);
+
+	// 1 kHz IMU bursts, 50 Hz barometer reads queued just ahead of an IMU edge
+	for (uint32_t ms = 0; ms < 1000; ms++) {
+		bus.us = ms * 1000;
+
+		if (ms % 20 == 0) {
+			ASSERT_EQ(submit(BMP_ADDR, 0xF7, baroBuf, 6, I2C_SCHED_PRIO_LOW), HAL_OK);
+		}
+
+		ASSERT_EQ(submit(ICM_ADDR, 0x2D, imuBuf, 12, I2C_SCHED_PRIO_HIGH), HAL_OK);
+		drain();
+	}
+
+	const I2C_SCHED_ST_DEV_STATS *imu = I2CSched_DevStatsGet(&sched, ICM_ADDR);
+	const I2C_SCHED_ST_DEV_STATS *baro = I2CSched_DevStatsGet(&sched, BMP_ADDR);
+	ASSERT_NE(imu, nullptr);
+	ASSERT_NE(baro, nullptr);
+
+	EXPECT_EQ(imu->u32Xfers, 1000u);
+	EXPECT_EQ(imu->u32Bytes, 12000u);
+	EXPECT_EQ(imu->u32BusUs, 1000 * imuWire);
+	EXPECT_EQ(baro->u32Xfers, 50u);
+	EXPECT_EQ(baro->u32Bytes, 300u);
+	EXPECT_EQ(baro->u32Errors, 0u);
+
+	// the IMU only ever waits behind one barometer read
+	EXPECT_EQ(imu->u32LatencyMaxUs, baroWire + imuWire);
+	EXPECT_EQ(I2CSched_LatencyAvgUs(imu), imuWire + 50 * baroWire / 1000);
+	EXPECT_EQ(baro->u32LatencyMaxUs, baroWire);
+}
+
+} // namespace
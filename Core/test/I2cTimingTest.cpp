@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include "i2c_timing.h"
+
+namespace
+{
+
+struct Example {
+	uint32_t clkHz;
+	I2C_TIMING_EN_SPEED speed;
+	uint32_t timingr;
+};
+
+// RM0394, examples of timings settings for fI2CCLK = 8, 16 and 48 MHz
+const Example rmExamples[] = {
+	{8000000, I2C_TIMING_SPEED_100K, I2C_TIMING(0x1, 0x4, 0x2, 0x0F, 0x13)},
+	{8000000, I2C_TIMING_SPEED_400K, I2C_TIMING(0x0, 0x3, 0x1, 0x03, 0x09)},
+	{16000000, I2C_TIMING_SPEED_100K, I2C_TIMING(0x3, 0x4, 0x2, 0x0F, 0x13)},
+	{16000000, I2C_TIMING_SPEED_400K, I2C_TIMING(0x1, 0x3, 0x2, 0x03, 0x09)},
+	{16000000, I2C_TIMING_SPEED_1M, I2C_TIMING(0x0, 0x2, 0x0, 0x02, 0x04)},
+	{48000000, I2C_TIMING_SPEED_100K, I2C_TIMING(0xB, 0x4, 0x2, 0x0F, 0x13)},
+	{48000000, I2C_TIMING_SPEED_400K, I2C_TIMING(0x5, 0x3, 0x3, 0x03, 0x09)},
+	{48000000, I2C_TIMING_SPEED_1M, I2C_TIMING(0x5, 0x1, 0x0, 0x01, 0x03)},
+};
+
+// 2.2 kOhm pull-ups on a short board trace, fit for all three modes
+const I2C_TIMING_ST_BUS board = {100, 20};
+// CubeMX leaves rise and fall time at 0
+const I2C_TIMING_ST_BUS cubeMx = {0, 0};
+
+TEST(I2cTimingTest, ReferenceManualExamplesMeetTheSpec)
+{
+	for (const Example &e : rmExamples) {
+		SCOPED_TRACE(e.clkHz);
+		SCOPED_TRACE(e.speed);
+		EXPECT_EQ(I2cTiming_Check(e.clkHz, e.speed, &board, e.timingr), 0);
+	}
+}
+
+TEST(I2cTimingTest, ComputedMeetsTheSpecAtTheNominalRate)
+{
+	for (const Example &e : rmExamples) {
+		SCOPED_TRACE(e.clkHz);
+		SCOPED_TRACE(e.speed);
+		uint32_t timingr = 0;
+		ASSERT_TRUE(I2cTiming_Compute(e.clkHz, e.speed, &board, &timingr));
+		EXPECT_EQ(I2cTiming_Check(e.clkHz, e.speed, &board, timingr), 0);
+
+		const uint32_t hz = I2cTiming_SclHz(e.clkHz, &board, timingr);
+		const uint32_t nominal = I2cTiming_SpeedHz(e.speed);
+		EXPECT_LE(hz, nominal);
+		// the prescaler step is 5 % of the period at 8 MHz, fast mode
+		EXPECT_GE(hz, nominal * 95 / 100);
+	}
+}
+
+TEST(I2cTimingTest, CubeMxI2c3Setting)
+{
+	// MX_I2C3_Init, PCLK1 at 80 MHz
+	const uint32_t cubeTimingr = 0x00702991;
+	uint32_t timingr = 0;
+
+	EXPECT_EQ(I2cTiming_Check(80000000, I2C_TIMING_SPEED_400K, &cubeMx, cubeTimingr), 0);
+	EXPECT_EQ(I2cTiming_SclHz(80000000, &cubeMx, cubeTimingr), 400000u);
+
+	ASSERT_TRUE(I2cTiming_Compute(80000000, I2C_TIMING_SPEED_400K, &cubeMx, &timingr));
+	EXPECT_EQ(I2cTiming_Check(80000000, I2C_TIMING_SPEED_400K, &cubeMx, timingr), 0);
+	EXPECT_NEAR(I2cTiming_SclHz(80000000, &cubeMx, timingr), 400000, 400);
+
+	// the real bus has a rise time: SCLDEL 7 is 100 ns, the data setup alone
+	EXPECT_EQ(I2cTiming_Check(80000000, I2C_TIMING_SPEED_400K, &board, cubeTimingr), I2C_TIMING_ERR_SETUP);
+}
+
+TEST(I2cTimingTest, AllProfilesAtTheCoreClock)
+{
+	for (int s = 0; s < I2C_TIMING_SPEED_NUM; s++) {
+		SCOPED_TRACE(s);
+		const I2C_TIMING_EN_SPEED speed = (I2C_TIMING_EN_SPEED)s;
+		uint32_t timingr = 0;
+
+		ASSERT_TRUE(I2cTiming_Compute(80000000, speed, &board, &timingr));
+		EXPECT_EQ(I2cTiming_Check(80000000, speed, &board, timingr), 0);
+		EXPECT_LE(I2cTiming_SclHz(80000000, &board, timingr), I2cTiming_SpeedHz(speed));
+		EXPECT_GE(I2cTiming_SclHz(80000000, &board, timingr), I2cTiming_SpeedHz(speed) * 99 / 100);
+	}
+}
+
+TEST(I2cTimingTest, FlagsViolatedLimits)
+{
+	const I2C_TIMING_ST_BUS slow = {300, 20};
+	const I2C_TIMING_ST_BUS slowFall = {100, 300};
+
+	// SCLL one step short of tLOW at 16 MHz, Fm+
+	EXPECT_EQ(I2cTiming_Check(16000000, I2C_TIMING_SPEED_1M, &board, I2C_TIMING(0x0, 0x2, 0x0, 0x02, 0x03)),
+		  I2C_TIMING_ERR_LOW);
+	EXPECT_EQ(I2cTiming_Check(16000000, I2C_TIMING_SPEED_400K, &board, I2C_TIMING(0x1, 0x3, 0x2, 0x00, 0x09)),
+		  I2C_TIMING_ERR_HIGH);
+	EXPECT_EQ(I2cTiming_Check(48000000, I2C_TIMING_SPEED_100K, &board, I2C_TIMING(0xB, 0x0, 0x2, 0x0F, 0x13)),
+		  I2C_TIMING_ERR_SETUP);
+	EXPECT_EQ(I2cTiming_Check(48000000, I2C_TIMING_SPEED_1M, &board, I2C_TIMING(0x5, 0x1, 0x3, 0x01, 0x03)),
+		  I2C_TIMING_ERR_VALID);
+	EXPECT_EQ(I2cTiming_Check(48000000, I2C_TIMING_SPEED_100K, &slowFall, I2C_TIMING(0xB, 0x4, 0x0, 0x0F, 0x13)),
+		  I2C_TIMING_ERR_HOLD);
+	EXPECT_TRUE(I2cTiming_Check(16000000, I2C_TIMING_SPEED_1M, &slow, I2C_TIMING(0x0, 0x2, 0x0, 0x02, 0x04)) &
+		    I2C_TIMING_ERR_BUS);
+}
+
+TEST(I2cTimingTest, NoSettingForASlowBus)
+{
+	const I2C_TIMING_ST_BUS slow = {300, 20};
+	uint32_t timingr = 0xDEADBEEF;
+
+	// 300 ns is fine for fast mode, but not for Fm+
+	EXPECT_TRUE(I2cTiming_Compute(80000000, I2C_TIMING_SPEED_400K, &slow, &timingr));
+	timingr = 0xDEADBEEF;
+	EXPECT_FALSE(I2cTiming_Compute(80000000, I2C_TIMING_SPEED_1M, &slow, &timingr));
+	EXPECT_EQ(timingr, 0xDEADBEEFu);
+	EXPECT_FALSE(I2cTiming_Compute(0, I2C_TIMING_SPEED_400K, &board, &timingr));
+	EXPECT_FALSE(I2cTiming_Compute(80000000, I2C_TIMING_SPEED_NUM, &board, &timingr));
+}
+
+TEST(I2cTimingTest, TimeoutFollowsTheTransfer)
+{
+	// 12-byte burst read: 15 bytes on the wire at 9 bits
+	EXPECT_EQ(I2cTiming_XferUs(400000, 12, 1), 338u);
+	EXPECT_EQ(I2cTiming_XferUs(1000000, 12, 1), 135u);
+	EXPECT_EQ(I2cTiming_XferUs(100000, 1, 0), 270u);
+	EXPECT_EQ(I2cTiming_TimeoutUs(400000, 12, 1), 2 * 338u + I2C_TIMING_SLACK_US);
+
+	// grows with the length and the inverse of the rate
+	EXPECT_LT(I2cTiming_TimeoutUs(400000, 12, 1), I2cTiming_TimeoutUs(400000, 120, 1));
+	EXPECT_LT(I2cTiming_TimeoutUs(1000000, 120, 1), I2cTiming_TimeoutUs(400000, 120, 1));
+	EXPECT_LT(I2cTiming_TimeoutUs(400000, 120, 1), I2cTiming_TimeoutUs(100000, 120, 1));
+
+	// a full 512-byte FIFO drain at 100 kHz still ends far below the 100 ms HAL timeouts
+	EXPECT_LT(I2cTiming_TimeoutUs(100000, 512, 1), 100000u);
+	EXPECT_EQ(I2cTiming_XferUs(0, 12, 1), 0u);
+}
+
+} // namespace
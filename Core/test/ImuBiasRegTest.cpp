@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "FakeI2cBus.hpp"
+#include "imu.h"
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+
+// factory accel trim, bit 0 set on x to check the reserved bit survives
+constexpr int16_t TRIM[3] = {0x1235, -0x0642, 0x0A10};
+// physical gyro bias in 1000 dps LSB (about 1, -2 and 0.5 dps) and accel bias in g
+constexpr int16_t GYRO_BIAS_LSB[3] = {33, -66, 16};
+constexpr float ACCEL_BIAS_G[3] = {0.05f, -0.02f, 0.1f};
+
+class ImuBiasRegTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		bus.reset();
+		icm.setAccelTrim(TRIM[0], TRIM[1], TRIM[2]);
+		bus.attach(ICM_ADDR, &icm);
+		imu.imuInit(&motion, &pressure);
+		still();
+
+		// learn the gyro bias in software mode: the first window holds the filter ramp
+		for (int i = 0; i < 2 * GYRO_CAL_WINDOW; i++) {
+			sample();
+		}
+
+		EXPECT_TRUE(imu.imuGyroCalGet()->u8Valid);
+		imu.imuAccelBiasSet(ACCEL_BIAS_G);
+	}
+
+	int deviceAccelFs() { return (icm.reg(2, ICM20948::REG_ADD_ACCEL_CONFIG) >> 1) & 0x03; }
+	int deviceGyroFs() { return (icm.reg(2, ICM20948::REG_ADD_GYRO_CONFIG_1) >> 1) & 0x03; }
+
+	int16_t reg16(uint8_t bank, uint8_t addr) { return (int16_t)((icm.reg(bank, addr) << 8) | icm.reg(bank, addr + 1)); }
+	int16_t gyroOffs(int axis) { return reg16(2, ICM20948::REG_ADD_XG_OFFS_USRH + 2 * axis); }
+	int16_t accelOffs(int axis) { return reg16(1, ICM20948::REG_ADD_XA_OFFS_H + 3 * axis); }
+
+	// board at rest on z: the sensor sees bias plus gravity, in the range in its registers
+	void still()
+	{
+		const float accelLsb = ICM20948::ACCEL_LSB_PER_G[deviceAccelFs()];
+		const float gyroScale = ICM20948::GYRO_LSB_PER_DPS[deviceGyroFs()] / ICM20948::GYRO_OFFS_LSB_PER_DPS;
+
+		icm.setAccel((int16_t)std::lround(ACCEL_BIAS_G[0] * accelLsb), (int16_t)std::lround(ACCEL_BIAS_G[1] * accelLsb),
+			     (int16_t)std::lround((1.f + ACCEL_BIAS_G[2]) * accelLsb));
+		icm.setGyro((int16_t)std::lround(GYRO_BIAS_LSB[0] * gyroScale), (int16_t)std::lround(GYRO_BIAS_LSB[1] * gyroScale),
+			    (int16_t)std::lround(GYRO_BIAS_LSB[2] * gyroScale));
+	}
+
+	// n samples with the board still, returns the last output in sensor axes
+	void sample(int n = 1)
+	{
+		IMU_ST_ANGLES_DATA angles;
+		IMU_ST_SENSOR_DATA magn;
+
+		for (int i = 0; i < n; i++) {
+			imu.imuDataGet(&angles, &gyro, &accel, &magn);
+		}
+
+		// undo the board axis mapping of imuDataGet()
+		gyroOut[0] = gyro.s16Y;
+		gyroOut[1] = -gyro.s16X;
+		gyroOut[2] = gyro.s16Z;
+		accelOut[0] = accel.s16Y;
+		accelOut[1] = -accel.s16X;
+		accelOut[2] = accel.s16Z;
+	}
+
+	void expectCorrected(int tolGyro, int tolAccel)
+	{
+		const float accelLsb = ICM20948::ACCEL_LSB_PER_G[imu.imuAccelFsGet()];
+
+		for (int k = 0; k < 3; k++) {
+			EXPECT_NEAR(gyroOut[k], 0, tolGyro) << k;
+		}
+
+		EXPECT_NEAR(accelOut[0], 0, tolAccel);
+		EXPECT_NEAR(accelOut[1], 0, tolAccel);
+		EXPECT_NEAR(accelOut[2], accelLsb, tolAccel);
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+	ICM20948 imu;
+	IMU_EN_SENSOR_TYPE motion{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_EN_SENSOR_TYPE pressure{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_ST_SENSOR_DATA gyro{}, accel{};
+	int gyroOut[3]{}, accelOut[3]{};
+};
+
+TEST_F(ImuBiasRegTest, SoftwareModeLeavesRegistersAlone)
+{
+	sample(8);
+	expectCorrected(1, 2);
+
+	for (int k = 0; k < 3; k++) {
+		EXPECT_EQ(gyroOffs(k), 0) << k;
+		EXPECT_EQ(accelOffs(k), TRIM[k]) << k;
+	}
+}
+
+TEST_F(ImuBiasRegTest, RegisterScaling)
+{
+	imu.imuBiasModeSet(IMU_EN_BIAS_MODE_REGISTER);
+	EXPECT_EQ(imu.imuBiasModeGet(), IMU_EN_BIAS_MODE_REGISTER);
+
+	for (int k = 0; k < 3; k++) {
+		// the register is added to the output, so it holds minus the bias in 1000 dps LSB
+		EXPECT_NEAR(gyroOffs(k), -GYRO_BIAS_LSB[k], 1) << k;
+
+		// accel: minus the bias in 16 g LSB relative to the trim, reserved bit untouched
+		EXPECT_NEAR(accelOffs(k) - TRIM[k], -ACCEL_BIAS_G[k] * ICM20948::ACCEL_OFFS_LSB_PER_G, 2) << k;
+		EXPECT_EQ(accelOffs(k) & 1, TRIM[k] & 1) << k;
+	}
+
+	// the sensor now outputs corrected data, the driver passes it through
+	sample(8);
+	expectCorrected(1, 8);
+}
+
+TEST_F(ImuBiasRegTest, RegisterOffsetsHoldAcrossRanges)
+{
+	imu.imuBiasModeSet(IMU_EN_BIAS_MODE_REGISTER);
+	const int16_t gyroReg = gyroOffs(0);
+	const int16_t accelReg = accelOffs(2);
+
+	for (int fs = IMU_EN_ACCEL_FS_2G; fs < IMU_EN_ACCEL_FS_MAX; fs++) {
+		imu.imuAccelFsSet((IMU_EN_ACCEL_FS)fs);
+		imu.imuGyroFsSet((IMU_EN_GYRO_FS)fs);
+		still();
+		// the sample held across the switch takes one slot of the averaging window
+		sample(9);
+
+		// one offset step is 8 >> ACCEL_FS_SEL output LSB
+		SCOPED_TRACE(fs);
+		expectCorrected(4, 8 >> fs);
+		EXPECT_EQ(gyroOffs(0), gyroReg) << fs;
+		EXPECT_EQ(accelOffs(2), accelReg) << fs;
+	}
+}
+
+TEST_F(ImuBiasRegTest, CalibrationKeepsRunningInRegisterMode)
+{
+	imu.imuBiasModeSet(IMU_EN_BIAS_MODE_REGISTER);
+	const float bias = imu.imuGyroCalGet()->afBiasDps[1];
+
+	// the sensor output is already corrected, the estimate must still see the full bias
+	sample(2 * GYRO_CAL_WINDOW);
+	EXPECT_GE(imu.imuGyroCalGet()->u32Accepted, 2u);
+	EXPECT_NEAR(imu.imuGyroCalGet()->afBiasDps[1], bias, 0.05f);
+	EXPECT_NEAR(gyroOffs(1), -GYRO_BIAS_LSB[1], 1);
+}
+
+TEST_F(ImuBiasRegTest, BackToSoftwareRestoresTrim)
+{
+	imu.imuBiasModeSet(IMU_EN_BIAS_MODE_REGISTER);
+	sample(8);
+	imu.imuBiasModeSet(IMU_EN_BIAS_MODE_SOFTWARE);
+
+	for (int k = 0; k < 3; k++) {
+		EXPECT_EQ(gyroOffs(k), 0) << k;
+		EXPECT_EQ(accelOffs(k), TRIM[k]) << k;
+	}
+
+	sample(8);
+	expectCorrected(1, 2);
+}
+
+} // namespace
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include "FakeI2cBus.hpp"
+#include "imu.h"
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+
+class ImuBurstReadTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		bus.reset();
+		bus.attach(ICM_ADDR, &icm);
+		imu.imuInit(&motion, &pressure);
+	}
+
+	// run enough samples to fill the 8-tap moving average
+	void settle(IMU_ST_SENSOR_DATA *gyro, IMU_ST_SENSOR_DATA *accel)
+	{
+		IMU_ST_ANGLES_DATA angles;
+		IMU_ST_SENSOR_DATA magn;
+
+		for (int i = 0; i < 8; i++) {
+			imu.imuDataGet(&angles, gyro, accel, &magn);
+		}
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+	ICM20948 imu;
+	IMU_EN_SENSOR_TYPE motion{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_EN_SENSOR_TYPE pressure{IMU_EN_SENSOR_TYPE_NULL};
+};
+
+TEST_F(ImuBurstReadTest, DefaultsToBurst)
+{
+	EXPECT_EQ(motion, IMU_EN_SENSOR_TYPE_ICM20948);
+	EXPECT_EQ(imu.imuAcqModeGet(), IMU_EN_ACQ_MODE_BURST);
+}
+
+TEST_F(ImuBurstReadTest, OneTransactionPerSample)
+{
+	IMU_ST_ANGLES_DATA angles;
+	IMU_ST_SENSOR_DATA gyro, accel, magn;
+
+	imu.imuAcqModeSet(IMU_EN_ACQ_MODE_SINGLE_BYTE);
+	bus.clearLog();
+	imu.imuDataGet(&angles, &gyro, &accel, &magn);
+	const size_t single = bus.readsInRange(ICM_ADDR, ICM20948::REG_ADD_ACCEL_XOUT_H, ICM20948::REG_ADD_GYRO_ZOUT_L);
+
+	imu.imuAcqModeSet(IMU_EN_ACQ_MODE_BURST);
+	bus.clearLog();
+	imu.imuDataGet(&angles, &gyro, &accel, &magn);
+	const size_t burst = bus.readsInRange(ICM_ADDR, ICM20948::REG_ADD_ACCEL_XOUT_H, ICM20948::REG_ADD_GYRO_ZOUT_L);
+
+	EXPECT_EQ(single, 12u);
+	EXPECT_EQ(burst, 1u);
+
+	const fake::Transaction &t = bus.log().front();
+	EXPECT_TRUE(t.read);
+	EXPECT_EQ(t.regAddr, ICM20948::REG_ADD_ACCEL_XOUT_H);
+	EXPECT_EQ(t.len, ICM20948::REG_LEN_ACCEL_GYRO_TEMP);
+}
+
+TEST_F(ImuBurstReadTest, DecodesBigEndianPairs)
+{
+	IMU_ST_SENSOR_DATA gyro, accel;
+
+	icm.setAccel(1000, -2000, 16384);
+	icm.setGyro(-300, 400, -32768);
+	settle(&gyro, &accel);
+
+	// board axes: X = -sensor Y, Y = sensor X
+	EXPECT_EQ(accel.s16X, 2000);
+	EXPECT_EQ(accel.s16Y, 1000);
+	EXPECT_EQ(accel.s16Z, 16384);
+	EXPECT_EQ(gyro.s16X, -400);
+	EXPECT_EQ(gyro.s16Y, -300);
+	EXPECT_EQ(gyro.s16Z, -32768);
+}
+
+TEST_F(ImuBurstReadTest, MatchesSingleByteMode)
+{
+	IMU_ST_SENSOR_DATA gyroBurst, accelBurst, gyroSingle, accelSingle;
+
+	icm.setAccel(-123, 4567, -8910);
+	icm.setGyro(11, -12, 13);
+
+	settle(&gyroBurst, &accelBurst);
+	imu.imuAcqModeSet(IMU_EN_ACQ_MODE_SINGLE_BYTE);
+	settle(&gyroSingle, &accelSingle);
+
+	EXPECT_EQ(accelBurst.s16X, accelSingle.s16X);
+	EXPECT_EQ(accelBurst.s16Y, accelSingle.s16Y);
+	EXPECT_EQ(accelBurst.s16Z, accelSingle.s16Z);
+	EXPECT_EQ(gyroBurst.s16X, gyroSingle.s16X);
+	EXPECT_EQ(gyroBurst.s16Y, gyroSingle.s16Y);
+	EXPECT_EQ(gyroBurst.s16Z, gyroSingle.s16Z);
+}
+
+// the attitude starts from the first accel sample instead of level: 30 degrees of pitch
+TEST_F(ImuBurstReadTest, FirstSampleSetsTheAttitude)
+{
+	IMU_ST_ANGLES_DATA angles;
+	IMU_ST_SENSOR_DATA gyro, accel, magn;
+
+	icm.setAccel(0, 8192, 14189);
+	icm.setGyro(0, 0, 0);
+	imu.imuDataGet(&angles, &gyro, &accel, &magn);
+
+	EXPECT_NEAR(angles.fPitch, 30.0f, 0.1f);
+	EXPECT_NEAR(angles.fRoll, 0.0f, 0.1f);
+}
+
+} // namespace
@@ -0,0 +1,304 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "FakeI2cBus.hpp"
+#include "dmp.h"
+#include "imu.h"
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+
+void putBe16(std::vector<uint8_t> &v, uint16_t x)
+{
+	v.push_back((uint8_t)(x >> 8));
+	v.push_back((uint8_t)x);
+}
+
+void putBe32(std::vector<uint8_t> &v, int32_t x)
+{
+	putBe16(v, (uint16_t)((uint32_t)x >> 16));
+	putBe16(v, (uint16_t)x);
+}
+
+int32_t q30(double x) { return (int32_t)std::lround(x * (1 << 30)); }
+
+// QUAT6 packet of a rotation by deg about the unit axis (x, y, z) of the sensor frame
+std::vector<uint8_t> quat6Packet(double deg, double x, double y, double z, uint16_t footer = 0x1234)
+{
+	const double s = std::sin(deg * M_PI / 360.0);
+	std::vector<uint8_t> p;
+
+	putBe16(p, DMP_HDR_QUAT6);
+	putBe32(p, q30(x * s));
+	putBe32(p, q30(y * s));
+	putBe32(p, q30(z * s));
+	putBe16(p, footer);
+	return p;
+}
+
+TEST(DmpParseTest, Quat6)
+{
+	const auto p = quat6Packet(90.0, 1.0, 0.0, 0.0);
+	DMP_ST_PACKET pkt;
+
+	ASSERT_EQ(p.size(), ICM20948::DMP_PACKET_LEN_QUAT6);
+	EXPECT_EQ(Dmp_PacketLen(p.data(), p.size()), p.size());
+	EXPECT_EQ(Dmp_PacketParse(p.data(), p.size(), &pkt), p.size());
+	EXPECT_EQ(pkt.u16Header, DMP_HDR_QUAT6);
+	EXPECT_EQ(pkt.as32Quat6[0], q30(std::sqrt(0.5)));
+	EXPECT_EQ(pkt.as32Quat6[1], 0);
+	EXPECT_EQ(pkt.u16Footer, 0x1234);
+
+	float q[4];
+	Dmp_QuatFromQ30(pkt.as32Quat6, q);
+	EXPECT_NEAR(q[0], std::sqrt(0.5), 1e-6);
+	EXPECT_NEAR(q[1], std::sqrt(0.5), 1e-6);
+}
+
+TEST(DmpParseTest, IncompleteWaitsForMore)
+{
+	const auto p = quat6Packet(10.0, 0.0, 0.0, 1.0);
+	DMP_ST_PACKET pkt;
+
+	EXPECT_EQ(Dmp_PacketLen(p.data(), 1), 0);
+	for (size_t n = 0; n < p.size(); n++) {
+		EXPECT_EQ(Dmp_PacketParse(p.data(), n, &pkt), 0) << n;
+	}
+}
+
+TEST(DmpParseTest, AllFieldsInOrder)
+{
+	std::vector<uint8_t> p;
+	DMP_ST_PACKET pkt;
+
+	putBe16(p, DMP_HDR_ACCEL | DMP_HDR_GYRO | DMP_HDR_CPASS | DMP_HDR_ALS | DMP_HDR_QUAT9 | DMP_HDR_PQUAT6 |
+			   DMP_HDR_STEP_DETECTOR | DMP_HDR_HEADER2);
+	putBe16(p, DMP_HDR2_ACCEL_ACCURACY | DMP_HDR2_GYRO_ACCURACY | DMP_HDR2_CPASS_ACCURACY | DMP_HDR2_ACT_RECOG |
+			   DMP_HDR2_BATCH_MODE);
+	for (int16_t v : {1, -2, 3}) putBe16(p, (uint16_t)v);          // accel
+	for (int16_t v : {4, 5, -6, 7, 8, 9}) putBe16(p, (uint16_t)v); // gyro, bias
+	for (int16_t v : {-10, 11, 12}) putBe16(p, (uint16_t)v);       // compass
+	p.insert(p.end(), 8, 0xAA);                                    // ALS
+	putBe32(p, q30(0.1));
+	putBe32(p, q30(-0.2));
+	putBe32(p, q30(0.3));
+	putBe16(p, 0x0042);                                            // heading accuracy
+	p.insert(p.end(), 6, 0xBB);                                    // PQUAT6
+	p.insert(p.end(), 4, 0xCC);                                    // step detector
+	putBe16(p, 3);
+	putBe16(p, 2);
+	putBe16(p, 1);
+	p.insert(p.end(), 6, 0xDD);                                    // activity
+	putBe16(p, 0xBEEF);
+
+	ASSERT_EQ(Dmp_PacketParse(p.data(), p.size(), &pkt), p.size());
+	EXPECT_EQ(pkt.as16Accel[1], -2);
+	EXPECT_EQ(pkt.as16Gyro[2], -6);
+	EXPECT_EQ(pkt.as16GyroBias[0], 7);
+	EXPECT_EQ(pkt.as16Cpass[0], -10);
+	EXPECT_EQ(pkt.as32Quat9[1], q30(-0.2));
+	EXPECT_EQ(pkt.s16Quat9Accuracy, 0x42);
+	EXPECT_EQ(pkt.au16Accuracy[0], 3);
+	EXPECT_EQ(pkt.au16Accuracy[2], 1);
+	EXPECT_EQ(pkt.u16Footer, 0xBEEF);
+}
+
+TEST(DmpParseTest, UnknownHeader2IsInvalid)
+{
+	std::vector<uint8_t> p;
+	DMP_ST_PACKET pkt;
+
+	putBe16(p, DMP_HDR_QUAT6 | DMP_HDR_HEADER2);
+	putBe16(p, 0x8000);
+	p.insert(p.end(), 14, 0);
+
+	EXPECT_EQ(Dmp_PacketParse(p.data(), p.size(), &pkt), DMP_PACKET_INVALID);
+}
+
+TEST(DmpParseTest, GyroSf)
+{
+	// 225 Hz, untrimmed oscillator
+	EXPECT_EQ(Dmp_GyroSf(4, 0x00), 166580712u);
+	// a faster oscillator means a shorter period, so a smaller scale; the sign is bit 7
+	EXPECT_LT(Dmp_GyroSf(4, 0x03), Dmp_GyroSf(4, 0x00));
+	EXPECT_GT(Dmp_GyroSf(4, 0x83), Dmp_GyroSf(4, 0x00));
+	EXPECT_EQ(Dmp_GyroSf(255, 0x00), 0x7FFFFFFFu);
+}
+
+class ImuDmpTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		bus.reset();
+		bus.attach(ICM_ADDR, &icm);
+		imu.imuInit(&motion, &pressure);
+
+		// stands in for the eMD image, which cannot be shipped
+		image.resize(5000);
+		for (size_t i = 0; i < image.size(); i++) {
+			image[i] = (uint8_t)(i * 7 + 3);
+		}
+	}
+
+	uint16_t mem16(uint16_t addr) { return (uint16_t)((icm.dmpMem(addr) << 8) | icm.dmpMem(addr + 1)); }
+	uint32_t mem32(uint16_t addr) { return ((uint32_t)mem16(addr) << 16) | mem16(addr + 2); }
+
+	void push(const std::vector<uint8_t> &p) { icm.fifoWrite(p.data(), p.size()); }
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+	ICM20948 imu;
+	IMU_EN_SENSOR_TYPE motion{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_EN_SENSOR_TYPE pressure{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_ST_ANGLES_DATA angles{};
+	std::vector<uint8_t> image;
+};
+
+TEST_F(ImuDmpTest, UploadAndConfig)
+{
+	ASSERT_TRUE(imu.imuDmpInit(image.data(), (uint16_t)image.size(), false));
+	EXPECT_TRUE(imu.imuDmpEnabled());
+
+	// the configuration goes to the data area, the code from the start address is untouched
+	for (size_t i = DMP_START_ADDR - DMP_LOAD_START; i < image.size(); i++) {
+		ASSERT_EQ(icm.dmpMem(DMP_LOAD_START + i), image[i]) << i;
+	}
+	EXPECT_EQ(icm.reg(2, ICM20948::REG_ADD_PRGM_START_ADDRH), DMP_START_ADDR >> 8);
+	EXPECT_EQ(icm.reg(2, ICM20948::REG_ADD_PRGM_START_ADDRH + 1), DMP_START_ADDR & 0xFF);
+
+	EXPECT_EQ(mem16(DMP_MEM_DATA_OUT_CTL1), DMP_HDR_QUAT6);
+	EXPECT_EQ(mem16(DMP_MEM_DATA_RDY_STATUS), DMP_DATA_RDY_GYRO | DMP_DATA_RDY_ACCEL);
+	EXPECT_EQ(mem32(DMP_MEM_GYRO_SF), Dmp_GyroSf(4, 0));
+	EXPECT_EQ(mem32(DMP_MEM_B2S_MTX + 16), (uint32_t)DMP_Q30_ONE);
+
+	const uint8_t ctrl = icm.reg(0, ICM20948::REG_ADD_USER_CTRL);
+	EXPECT_TRUE(ctrl & ICM20948::REG_VAL_BIT_DMP_EN);
+	EXPECT_TRUE(ctrl & ICM20948::REG_VAL_BIT_FIFO_EN);
+	EXPECT_EQ(icm.reg(0, ICM20948::REG_ADD_FIFO_EN_2), 0);
+	EXPECT_EQ(imu.imuGyroFsGet(), IMU_EN_GYRO_FS_2000DPS);
+	EXPECT_EQ(imu.imuAccelFsGet(), IMU_EN_ACCEL_FS_4G);
+}
+
+TEST_F(ImuDmpTest, NineAxisConfig)
+{
+	ASSERT_TRUE(imu.imuDmpInit(image.data(), (uint16_t)image.size(), true));
+
+	EXPECT_EQ(mem16(DMP_MEM_DATA_OUT_CTL1), DMP_HDR_QUAT9);
+	EXPECT_TRUE(mem16(DMP_MEM_MOTION_EVENT_CTL) & DMP_MOTION_9AXIS);
+	EXPECT_EQ(mem32(DMP_MEM_CPASS_MTX), (uint32_t)DMP_CPASS_SCALE);
+	EXPECT_EQ(mem32(DMP_MEM_CPASS_MTX + 32), (uint32_t)-DMP_CPASS_SCALE);
+	EXPECT_EQ(icm.reg(3, ICM20948::REG_ADD_I2C_SLV0_REG), ICM20948::REG_ADD_MAG_RSV2);
+	EXPECT_TRUE(icm.reg(0, ICM20948::REG_ADD_USER_CTRL) & ICM20948::REG_VAL_BIT_I2C_MST_EN);
+}
+
+TEST_F(ImuDmpTest, UploadVerifyFails)
+{
+	icm.dmpStuckAddr = DMP_LOAD_START + 1000;
+
+	EXPECT_FALSE(imu.imuDmpInit(image.data(), (uint16_t)image.size(), false));
+	EXPECT_FALSE(imu.imuDmpEnabled());
+	EXPECT_FALSE(imu.imuDmpDataGet(&angles));
+}
+
+TEST_F(ImuDmpTest, UploadStaysInsideMemoryBanks)
+{
+	bus.clearLog();
+	ASSERT_TRUE(imu.imuDmpInit(image.data(), (uint16_t)image.size(), false));
+
+	for (const auto &t : bus.log()) {
+		if (t.regAddr == ICM20948::REG_ADD_MEM_R_W) {
+			EXPECT_LE(t.len, DMP_MEM_CHUNK);
+		}
+	}
+}
+
+TEST_F(ImuDmpTest, QuaternionToBoardAngles)
+{
+	ASSERT_TRUE(imu.imuDmpInit(image.data(), (uint16_t)image.size(), false));
+	EXPECT_FALSE(imu.imuDmpDataGet(&angles));
+
+	// sensor x is board y (see imuDataGet), a turn about it is pitch
+	push(quat6Packet(30.0, 1.0, 0.0, 0.0));
+	ASSERT_TRUE(imu.imuDmpDataGet(&angles));
+	EXPECT_NEAR(angles.fPitch, 30.0f, 0.1f);
+	EXPECT_NEAR(angles.fRoll, 0.0f, 0.1f);
+
+	// sensor y is board -x
+	push(quat6Packet(20.0, 0.0, 1.0, 0.0));
+	ASSERT_TRUE(imu.imuDmpDataGet(&angles));
+	EXPECT_NEAR(angles.fRoll, -20.0f, 0.1f);
+	EXPECT_NEAR(angles.fPitch, 0.0f, 0.1f);
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Frames, 2u);
+}
+
+TEST_F(ImuDmpTest, PacketSplitAcrossReads)
+{
+	ASSERT_TRUE(imu.imuDmpInit(image.data(), (uint16_t)image.size(), false));
+
+	auto p = quat6Packet(10.0, 1.0, 0.0, 0.0);
+	const auto q = quat6Packet(25.0, 1.0, 0.0, 0.0);
+	p.insert(p.end(), q.begin(), q.end());
+
+	// one and a half packets: the first is used, the rest waits
+	icm.fifoWrite(p.data(), 24);
+	ASSERT_TRUE(imu.imuDmpDataGet(&angles));
+	EXPECT_NEAR(angles.fPitch, 10.0f, 0.1f);
+
+	icm.fifoWrite(p.data() + 24, p.size() - 24);
+	ASSERT_TRUE(imu.imuDmpDataGet(&angles));
+	EXPECT_NEAR(angles.fPitch, 25.0f, 0.1f);
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Bytes, p.size());
+}
+
+TEST_F(ImuDmpTest, LostAlignmentResetsFifo)
+{
+	ASSERT_TRUE(imu.imuDmpInit(image.data(), (uint16_t)image.size(), false));
+
+	std::vector<uint8_t> junk;
+	putBe16(junk, DMP_HDR_HEADER2);
+	putBe16(junk, 0x0001);
+	push(junk);
+	EXPECT_FALSE(imu.imuDmpDataGet(&angles));
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Overflows, 1u);
+	EXPECT_EQ(icm.fifoCount(), 0u);
+
+	push(quat6Packet(15.0, 1.0, 0.0, 0.0));
+	ASSERT_TRUE(imu.imuDmpDataGet(&angles));
+	EXPECT_NEAR(angles.fPitch, 15.0f, 0.1f);
+}
+
+// 31 packets and most of the 32nd: nothing was lost, all of it is read
+TEST_F(ImuDmpTest, NearlyFullIsNotAnOverflow)
+{
+	ASSERT_TRUE(imu.imuDmpInit(image.data(), (uint16_t)image.size(), false));
+
+	std::vector<uint8_t> p;
+	for (int i = 0; i < 32; i++) {
+		const auto q = quat6Packet(1.0 + i, 1.0, 0.0, 0.0);
+		p.insert(p.end(), q.begin(), q.end());
+	}
+	icm.fifoWrite(p.data(), 506);
+	ASSERT_TRUE(imu.imuDmpDataGet(&angles));
+	EXPECT_NEAR(angles.fPitch, 31.0f, 0.1f);
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Overflows, 0u);
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Frames, 31u);
+
+	icm.fifoWrite(p.data() + 506, p.size() - 506);
+	ASSERT_TRUE(imu.imuDmpDataGet(&angles));
+	EXPECT_NEAR(angles.fPitch, 32.0f, 0.1f);
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Frames, 32u);
+}
+
+TEST_F(ImuDmpTest, FifoInitLeavesDmpMode)
+{
+	ASSERT_TRUE(imu.imuDmpInit(image.data(), (uint16_t)image.size(), false));
+	imu.imuFifoInit(false, 1);
+
+	EXPECT_FALSE(imu.imuDmpEnabled());
+	EXPECT_FALSE(icm.reg(0, ICM20948::REG_ADD_USER_CTRL) & ICM20948::REG_VAL_BIT_DMP_EN);
+}
+
+} // namespace
@@ -0,0 +1,334 @@
+#include <cmath>
+#include <gtest/gtest.h>
+#include "FakeI2cBus.hpp"
+#include "imu.h"
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+
+class ImuFifoTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		bus.reset();
+		bus.attach(ICM_ADDR, &icm);
+		imu.imuInit(&motion, &pressure);
+	}
+
+	// one sensor sample: registers updated, frame pushed to the FIFO
+	void sample(int16_t v)
+	{
+		icm.setAccel(v, (int16_t)(v + 1), (int16_t)(v + 2));
+		icm.setGyro((int16_t)(-v), (int16_t)(-v - 1), (int16_t)(-v - 2));
+		icm.fifoPush();
+	}
+
+	bool drain()
+	{
+		if (!imu.imuFifoPoll()) {
+			return false;
+		}
+
+		imu.imuFifoRxCplt();
+		return true;
+	}
+
+	void expectSample(int16_t v)
+	{
+		ICM20948_ST_FIFO_SAMPLE s;
+		ASSERT_TRUE(imu.imuFifoRead(&s));
+		EXPECT_EQ(s.stAccel.s16X, v);
+		EXPECT_EQ(s.stAccel.s16Y, v + 1);
+		EXPECT_EQ(s.stAccel.s16Z, v + 2);
+		EXPECT_EQ(s.stGyro.s16X, -v);
+		EXPECT_EQ(s.stGyro.s16Y, -v - 1);
+		EXPECT_EQ(s.stGyro.s16Z, -v - 2);
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+	ICM20948 imu;
+	IMU_EN_SENSOR_TYPE motion{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_EN_SENSOR_TYPE pressure{IMU_EN_SENSOR_TYPE_NULL};
+};
+
+TEST_F(ImuFifoTest, Configuration)
+{
+	imu.imuFifoInit(false, 4);
+
+	EXPECT_EQ(imu.imuFifoFrameLen(), 12);
+	EXPECT_EQ(icm.reg(0, ICM20948::REG_ADD_FIFO_EN_2), 0x1E);
+	EXPECT_EQ(icm.reg(0, ICM20948::REG_ADD_FIFO_EN_1), 0x00);
+	EXPECT_EQ(icm.reg(0, ICM20948::REG_ADD_FIFO_MODE), ICM20948::REG_VAL_FIFO_MODE_SNAPSHOT);
+	EXPECT_TRUE(icm.reg(0, ICM20948::REG_ADD_USER_CTRL) & ICM20948::REG_VAL_BIT_FIFO_EN);
+	EXPECT_EQ(icm.reg(2, ICM20948::REG_ADD_GYRO_SMPLRT_DIV), 0x00);
+	EXPECT_EQ(icm.reg(2, ICM20948::REG_ADD_ACCEL_SMPLRT_DIV_2), 0x00);
+	EXPECT_EQ(icm.bank(), 0);
+}
+
+TEST_F(ImuFifoTest, WatermarkDrain)
+{
+	imu.imuFifoInit(false, 4);
+
+	for (int16_t i = 0; i < 3; i++) {
+		sample((int16_t)(100 * i));
+	}
+
+	EXPECT_FALSE(drain());
+
+	sample(300);
+	bus.clearLog();
+	EXPECT_TRUE(drain());
+
+	// FIFO_COUNT read plus one DMA transfer of all four frames
+	ASSERT_EQ(bus.transactions(), 2u);
+	EXPECT_EQ(bus.log()[0].regAddr, ICM20948::REG_ADD_FIFO_COUNTH);
+	EXPECT_TRUE(bus.log()[1].dma);
+	EXPECT_EQ(bus.log()[1].regAddr, ICM20948::REG_ADD_FIFO_R_W);
+	EXPECT_EQ(bus.log()[1].len, 48);
+
+	for (int16_t i = 0; i < 4; i++) {
+		expectSample((int16_t)(100 * i));
+	}
+
+	ICM20948_ST_FIFO_SAMPLE s;
+	EXPECT_FALSE(imu.imuFifoRead(&s));
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Frames, 4u);
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Bytes, 48u);
+	EXPECT_EQ(icm.fifoCount(), 0u);
+}
+
+TEST_F(ImuFifoTest, PartialFrameStaysInFifo)
+{
+	imu.imuFifoInit(false, 1);
+
+	sample(7);
+	icm.setAccel(8, 9, 10);
+	icm.setGyro(-8, -9, -10);
+	const std::vector<uint8_t> next = icm.fifoFrame();
+	icm.fifoWrite(next.data(), 5);
+
+	EXPECT_TRUE(drain());
+	EXPECT_EQ(icm.fifoCount(), 5u);
+	expectSample(7);
+
+	icm.fifoWrite(next.data() + 5, next.size() - 5);
+	EXPECT_TRUE(drain());
+	expectSample(8);
+	EXPECT_EQ(icm.fifoCount(), 0u);
+}
+
+TEST_F(ImuFifoTest, OverflowRecovery)
+{
+	imu.imuFifoInit(false, 1);
+
+	// 50 frames do not fit, the snapshot FIFO fills and cuts the last frame short
+	for (int16_t i = 0; i < 50; i++) {
+		sample(i);
+	}
+
+	EXPECT_EQ(icm.fifoCount(), fake::FakeIcm20948::FIFO_SIZE);
+	EXPECT_TRUE(icm.fifoOverflowed());
+
+	EXPECT_FALSE(drain());
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Overflows, 1u);
+	EXPECT_EQ(icm.fifoCount(), 0u);
+
+	ICM20948_ST_FIFO_SAMPLE s;
+	EXPECT_FALSE(imu.imuFifoRead(&s));
+
+	// stream is frame aligned again after the reset
+	sample(1000);
+	sample(1001);
+	EXPECT_TRUE(drain());
+	expectSample(1000);
+	expectSample(1001);
+}
+
+TEST_F(ImuFifoTest, MagnetometerFrames)
+{
+	imu.imuFifoInit(true, 1);
+
+	EXPECT_EQ(imu.imuFifoFrameLen(), 21);
+	EXPECT_EQ(icm.reg(0, ICM20948::REG_ADD_FIFO_EN_1), ICM20948::REG_VAL_BIT_SLV_0_FIFO_EN);
+	EXPECT_TRUE(icm.reg(0, ICM20948::REG_ADD_USER_CTRL) & ICM20948::REG_VAL_BIT_I2C_MST_EN);
+
+	icm.setMag(120, -340, 560);
+	icm.runI2cMaster();
+	sample(5);
+	EXPECT_TRUE(drain());
+
+	ICM20948_ST_FIFO_SAMPLE s;
+	ASSERT_TRUE(imu.imuFifoRead(&s));
+	EXPECT_EQ(s.stAccel.s16X, 5);
+	EXPECT_EQ(s.stGyro.s16Z, -7);
+	EXPECT_TRUE(s.u8MagnValid);
+	EXPECT_EQ(s.stMagn.s16X, 120);
+	EXPECT_EQ(s.stMagn.s16Y, 340);
+	EXPECT_EQ(s.stMagn.s16Z, -560);
+}
+
+TEST_F(ImuFifoTest, NearlyFullIsNotAnOverflow)
+{
+	imu.imuFifoInit(false, 1);
+
+	// 42 frames are 504 bytes, one more would not fit but nothing is lost yet
+	for (int16_t i = 0; i < 42; i++) {
+		sample(i);
+	}
+	EXPECT_EQ(icm.fifoCount(), 42u * 12u);
+	EXPECT_FALSE(icm.fifoOverflowed());
+
+	EXPECT_TRUE(drain());
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Overflows, 0u);
+	EXPECT_EQ(icm.fifoCount(), 0u);
+	for (int16_t i = 0; i < 42; i++) {
+		expectSample(i);
+	}
+}
+
+TEST_F(ImuFifoTest, FullQueueCountsDrops)
+{
+	imu.imuFifoInit(false, 1);
+
+	for (int16_t i = 0; i < ICM20948::FIFO_QUEUE_LEN + 10; i++) {
+		sample(i);
+
+		if (icm.fifoCount() >= 30 * 12) {
+			EXPECT_TRUE(drain());
+		}
+	}
+
+	EXPECT_TRUE(drain());
+
+	// one slot is kept free to tell full from empty
+	const uint32_t kept = ICM20948::FIFO_QUEUE_LEN - 1;
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Frames, ICM20948::FIFO_QUEUE_LEN + 10u);
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Dropped, 11u);
+
+	for (uint32_t i = 0; i < kept; i++) {
+		expectSample((int16_t)i);
+	}
+}
+
+TEST_F(ImuFifoTest, LosslessAtFullRateWithLowBusOverhead)
+{
+	imu.imuFifoInit(false, 10);
+	bus.clearLog();
+
+	// 1 s at 1.1 kHz, main loop polling every 5 ms
+	int16_t next = 0;
+
+	for (int t = 0; t < 1100; t++) {
+		sample((int16_t)t);
+
+		if (t % 5 == 4) {
+			drain();
+		}
+
+		ICM20948_ST_FIFO_SAMPLE s;
+
+		while (imu.imuFifoRead(&s)) {
+			ASSERT_EQ(s.stAccel.s16X, next);
+			next++;
+		}
+	}
+
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Overflows, 0u);
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Dropped, 0u);
+	EXPECT_GE(next, 1100 - 10);
+
+	// a register burst per sample would be 1100 transactions, here every poll
+	// costs a FIFO_COUNT read and every second poll one DMA drain
+	EXPECT_LT(bus.transactions(), 1100u / 3);
+}
+
+// the FIFO frames through the two-rate fusion: one correction per 10 ms of frames, the same
+// attitude as stepping the filter with every frame
+TEST_F(ImuFifoTest, TwoRateFusionCorrectsPerPeriod)
+{
+	IMU_ST_ANGLES_DATA perFrame, twoRate;
+	int corrections = 0;
+
+	// 1.125 kHz frames, 11 of them span a 10 ms correction period
+	imu.imuFifoInit(false, 11);
+	imu.imuCorrPeriodSet(10000);
+	EXPECT_EQ(imu.imuCorrPeriodGet(), 10000u);
+	icm.setAccel(0, 0, 16384);
+	icm.setGyro(0, 0, 328);
+
+	for (int n = 0; n < 10; n++) {
+		for (int i = 0; i < 11; i++) {
+			icm.fifoPush();
+		}
+		ASSERT_TRUE(drain());
+		corrections += imu.imuFifoUpdate(&twoRate) ? 1 : 0;
+	}
+	EXPECT_EQ(corrections, 10);
+	EXPECT_FALSE(imu.imuFifoUpdate(&twoRate));
+
+	// the reference: a fresh driver stepping the filter with every frame
+	ICM20948 ref;
+	ref.imuInit(&motion, &pressure);
+	ref.imuFifoInit(false, 11);
+	ref.imuCorrPeriodSet(0);
+	for (int n = 0; n < 10; n++) {
+		for (int i = 0; i < 11; i++) {
+			icm.fifoPush();
+		}
+		ASSERT_TRUE(ref.imuFifoPoll());
+		ref.imuFifoRxCplt();
+		EXPECT_TRUE(ref.imuFifoUpdate(&perFrame));
+	}
+
+	EXPECT_GT(std::fabs(perFrame.fYaw), 5.0f);
+	EXPECT_NEAR(twoRate.fYaw, perFrame.fYaw, 0.05f);
+	EXPECT_NEAR(twoRate.fPitch, perFrame.fPitch, 0.05f);
+	EXPECT_NEAR(twoRate.fRoll, perFrame.fRoll, 0.05f);
+}
+
+// a board held at 30 degrees of pitch, the attitude starting level: without gains it stays
+// where the gyro keeps it, with them the correction at the end of every period pulls it
+// onto the accel
+TEST_F(ImuFifoTest, TwoRateFusionFollowsTiltedAccel)
+{
+	IMU_ST_ANGLES_DATA angles{};
+	float kp, ki;
+
+	imu.imuAHRSgainsGet(&kp, &ki);
+	EXPECT_GT(kp, 0.0f);
+	EXPECT_GT(ki, 0.0f);
+
+	imu.imuFifoInit(false, 11);
+	imu.imuCorrPeriodSet(10000);
+	icm.setAccel(0, 8192, 14189);
+	icm.setGyro(0, 0, 0);
+
+	auto run = [&](int periods) {
+		for (int n = 0; n < periods; n++) {
+			for (int i = 0; i < 11; i++) {
+				icm.fifoPush();
+			}
+			ASSERT_TRUE(drain());
+			ASSERT_TRUE(imu.imuFifoUpdate(&angles));
+		}
+	};
+
+	imu.imuAHRSgainsSet(0.0f, 0.0f);
+	run(50);
+	EXPECT_NEAR(angles.fPitch, 0.0f, 0.01f);
+
+	// half a second is part of the way, five settle on the tilt
+	imu.imuAHRSgainsSet(kp, ki);
+	run(50);
+	EXPECT_GT(angles.fPitch, 5.0f);
+	EXPECT_LT(angles.fPitch, 25.0f);
+	run(450);
+	EXPECT_NEAR(angles.fPitch, 30.0f, 3.0f);
+	EXPECT_NEAR(angles.fRoll, 0.0f, 0.1f);
+}
+
+} // namespace
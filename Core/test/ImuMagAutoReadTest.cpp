@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include "FakeI2cBus.hpp"
+#include "imu.h"
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+
+class ImuMagAutoReadTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		bus.reset();
+		bus.attach(ICM_ADDR, &icm);
+		imu.imuInit(&motion, &pressure);
+		imu.imuAcqModeSet(IMU_EN_ACQ_MODE_BURST_MAGN);
+		bus.clearLog();
+		bus.delayCalls = 0;
+	}
+
+	// one ODR tick: the ICM runs its I2C master and latches ST1..ST2
+	void tick()
+	{
+		icm.runI2cMaster();
+		imu.imuDataGet(&angles, &gyro, &accel, &magn);
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+	ICM20948 imu;
+	IMU_EN_SENSOR_TYPE motion{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_EN_SENSOR_TYPE pressure{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_ST_ANGLES_DATA angles;
+	IMU_ST_SENSOR_DATA gyro, accel, magn;
+};
+
+TEST_F(ImuMagAutoReadTest, ProgramsSlv0Once)
+{
+	EXPECT_EQ(icm.reg(3, ICM20948::REG_ADD_I2C_SLV0_ADDR),
+		  ICM20948::I2C_ADD_ICM20948_AK09916 | ICM20948::I2C_ADD_ICM20948_AK09916_READ);
+	EXPECT_EQ(icm.reg(3, ICM20948::REG_ADD_I2C_SLV0_REG), ICM20948::REG_ADD_MAG_ST1);
+	EXPECT_EQ(icm.reg(3, ICM20948::REG_ADD_I2C_SLV0_CTRL),
+		  ICM20948::REG_VAL_BIT_SLV0_EN | ICM20948::REG_LEN_MAG_AUTO);
+	EXPECT_EQ(icm.reg(3, ICM20948::REG_ADD_I2C_SLV1_CTRL), 0);
+	EXPECT_TRUE(icm.reg(0, ICM20948::REG_ADD_USER_CTRL) & ICM20948::REG_VAL_BIT_I2C_MST_EN);
+	EXPECT_EQ(icm.bank(), 0);
+}
+
+TEST_F(ImuMagAutoReadTest, NoDelayPerSample)
+{
+	icm.setAccel(100, 200, 300);
+	icm.setGyro(0, 0, 0);
+
+	for (int i = 0; i < 100; i++) {
+		icm.setMag(120, -340, 560);
+		tick();
+	}
+
+	EXPECT_EQ(bus.delayCalls, 0u);
+	EXPECT_EQ(bus.transactions(), 100u);
+	EXPECT_EQ(bus.readsInRange(ICM_ADDR, ICM20948::REG_ADD_ACCEL_XOUT_H, ICM20948::REG_ADD_ACCEL_XOUT_H), 100u);
+
+	// axes remapped as in the legacy secondary read
+	EXPECT_EQ(magn.s16X, -340);
+	EXPECT_EQ(magn.s16Y, 120);
+	EXPECT_EQ(magn.s16Z, -560);
+}
+
+TEST_F(ImuMagAutoReadTest, LegacyPathDelays)
+{
+	imu.imuAcqModeSet(IMU_EN_ACQ_MODE_BURST);
+	EXPECT_FALSE(icm.reg(0, ICM20948::REG_ADD_USER_CTRL) & ICM20948::REG_VAL_BIT_I2C_MST_EN);
+	bus.delayCalls = 0;
+
+	icm.setMag(120, -340, 560);
+	imu.imuDataGet(&angles, &gyro, &accel, &magn);
+
+	EXPECT_GT(bus.delayCalls, 0u);
+}
+
+TEST_F(ImuMagAutoReadTest, HoldsLastMeasurementBetweenMagSamples)
+{
+	for (int i = 0; i < 8; i++) {
+		icm.setMag(80, 0, 0);
+		tick();
+	}
+
+	// the magnetometer runs at 100 Hz, most ICM samples carry no new data
+	for (int i = 0; i < 8; i++) {
+		tick();
+	}
+
+	EXPECT_EQ(magn.s16Y, 80);
+	EXPECT_EQ(bus.delayCalls, 0u);
+}
+
+TEST_F(ImuMagAutoReadTest, DropsOverflowedMeasurement)
+{
+	for (int i = 0; i < 8; i++) {
+		icm.setMag(80, 0, 0);
+		tick();
+	}
+
+	for (int i = 0; i < 8; i++) {
+		icm.setMag(-4000, 0, 0);
+		icm.magReg(ICM20948::REG_ADD_MAG_ST2) = ICM20948::REG_VAL_BIT_MAG_HOFL;
+		tick();
+	}
+
+	EXPECT_EQ(magn.s16Y, 80);
+}
+
+} // namespace
@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include "FakeI2cBus.hpp"
+#include "imu.h"
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+
+static_assert(ICM20948::ACCEL_LSB_PER_G[IMU_EN_ACCEL_FS_2G] == 16384.0f, "2 g sensitivity");
+static_assert(ICM20948::GYRO_LSB_PER_DPS[IMU_EN_GYRO_FS_1000DPS] == 32.8f, "1000 dps sensitivity");
+
+class ImuRangeTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		bus.reset();
+		bus.attach(ICM_ADDR, &icm);
+		imu.imuInit(&motion, &pressure);
+	}
+
+	// what the sensor outputs for a physical signal with the range currently in its registers
+	static int16_t clip(float v)
+	{
+		return (int16_t)std::max(-32768.f, std::min(32767.f, std::round(v)));
+	}
+
+	int deviceAccelFs() { return (icm.reg(2, ICM20948::REG_ADD_ACCEL_CONFIG) >> 1) & 0x03; }
+	int deviceGyroFs() { return (icm.reg(2, ICM20948::REG_ADD_GYRO_CONFIG_1) >> 1) & 0x03; }
+
+	// one imuDataGet() for accel z in g and gyro z in dps, returns both in physical units
+	void sample(float accelG, float gyroDps, float *outG, float *outDps)
+	{
+		IMU_ST_ANGLES_DATA angles;
+		IMU_ST_SENSOR_DATA gyro, accel, magn;
+
+		icm.setAccel(0, 0, clip(accelG * ICM20948::ACCEL_LSB_PER_G[deviceAccelFs()]));
+		icm.setGyro(0, 0, clip(gyroDps * ICM20948::GYRO_LSB_PER_DPS[deviceGyroFs()]));
+
+		// the output is in the range in use when the sample was taken
+		const IMU_EN_ACCEL_FS accelFs = imu.imuAccelFsGet();
+		const IMU_EN_GYRO_FS gyroFs = imu.imuGyroFsGet();
+		imu.imuDataGet(&angles, &gyro, &accel, &magn);
+
+		*outG = accel.s16Z / ICM20948::ACCEL_LSB_PER_G[accelFs];
+		*outDps = gyro.s16Z / ICM20948::GYRO_LSB_PER_DPS[gyroFs];
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+	ICM20948 imu;
+	IMU_EN_SENSOR_TYPE motion{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_EN_SENSOR_TYPE pressure{IMU_EN_SENSOR_TYPE_NULL};
+};
+
+TEST_F(ImuRangeTest, InitUsesSelectedRange)
+{
+	EXPECT_EQ(imu.imuGyroFsGet(), IMU_EN_GYRO_FS_1000DPS);
+	EXPECT_EQ(imu.imuAccelFsGet(), IMU_EN_ACCEL_FS_2G);
+	EXPECT_EQ(deviceGyroFs(), IMU_EN_GYRO_FS_1000DPS);
+	EXPECT_EQ(deviceAccelFs(), IMU_EN_ACCEL_FS_2G);
+}
+
+TEST_F(ImuRangeTest, ManualSelection)
+{
+	const uint8_t gyroCfg = icm.reg(2, ICM20948::REG_ADD_GYRO_CONFIG_1);
+
+	imu.imuGyroFsSet(IMU_EN_GYRO_FS_2000DPS);
+	imu.imuAccelFsSet(IMU_EN_ACCEL_FS_16G);
+
+	EXPECT_EQ(deviceGyroFs(), IMU_EN_GYRO_FS_2000DPS);
+	EXPECT_EQ(deviceAccelFs(), IMU_EN_ACCEL_FS_16G);
+	// DLPF bits are left alone
+	EXPECT_EQ(icm.reg(2, ICM20948::REG_ADD_GYRO_CONFIG_1) & ~ICM20948::REG_VAL_BIT_GYRO_FS_MASK,
+		  gyroCfg & ~ICM20948::REG_VAL_BIT_GYRO_FS_MASK);
+
+	// conversion follows the range, the physical value does not change
+	float g = 0.f, dps = 0.f;
+
+	for (int i = 0; i < 16; i++) {
+		sample(1.5f, 300.f, &g, &dps);
+	}
+
+	EXPECT_NEAR(g, 1.5f, 1e-3f);
+	EXPECT_NEAR(dps, 300.f, 0.1f);
+	EXPECT_EQ(imu.imuRangeSwitchesGet(), 2u);
+}
+
+TEST_F(ImuRangeTest, ClipsWithoutAutoRange)
+{
+	float g = 0.f, dps = 0.f;
+
+	for (int i = 0; i < 50; i++) {
+		sample(5.f, 0.f, &g, &dps);
+	}
+
+	EXPECT_EQ(imu.imuAccelFsGet(), IMU_EN_ACCEL_FS_2G);
+	EXPECT_LT(g, 2.f);
+}
+
+TEST_F(ImuRangeTest, AccelAutoRange)
+{
+	float g = 0.f, dps = 0.f, prev;
+
+	imu.imuAutoRangeEnable(true);
+
+	for (int i = 0; i < 16; i++) {
+		sample(1.f, 0.f, &g, &dps);
+	}
+
+	EXPECT_EQ(imu.imuAccelFsGet(), IMU_EN_ACCEL_FS_2G);
+	EXPECT_NEAR(g, 1.f, 1e-3f);
+
+	// 5 g shock: 2 g and 4 g both clip, settles at 8 g; the averaged output only ever
+	// rises, a window left in the old units would show up as a drop at the switch
+	prev = g;
+
+	for (int i = 0; i < 40; i++) {
+		sample(5.f, 0.f, &g, &dps);
+		ASSERT_GE(g, prev - 1e-3f) << i;
+		ASSERT_LE(g, 5.f + 1e-3f) << i;
+		prev = g;
+	}
+
+	EXPECT_EQ(imu.imuAccelFsGet(), IMU_EN_ACCEL_FS_8G);
+	EXPECT_EQ(deviceAccelFs(), IMU_EN_ACCEL_FS_8G);
+	EXPECT_NEAR(g, 5.f, 1e-3f);
+	EXPECT_EQ(imu.imuRangeSwitchesGet(), 2u);
+
+	// back to rest: 1 g is quiet at 8 g and 4 g, so after two quiet periods it is back at 2 g
+	for (int i = 0; i < 16; i++) {
+		sample(1.f, 0.f, &g, &dps);
+	}
+
+	for (int i = 0; i < 3 * ICM20948::AUTORANGE_QUIET_SAMPLES; i++) {
+		sample(1.f, 0.f, &g, &dps);
+		ASSERT_NEAR(g, 1.f, 1e-3f) << i;
+	}
+
+	EXPECT_EQ(imu.imuAccelFsGet(), IMU_EN_ACCEL_FS_2G);
+	EXPECT_EQ(imu.imuRangeSwitchesGet(), 4u);
+}
+
+TEST_F(ImuRangeTest, GyroAutoRangeKeepsOffset)
+{
+	float g = 0.f, dps = 0.f, prev;
+
+	imu.imuAutoRangeEnable(true);
+
+	for (int i = 0; i < 16; i++) {
+		sample(1.f, 100.f, &g, &dps);
+	}
+
+	EXPECT_NEAR(dps, 100.f, 0.1f);
+
+	// 1500 dps spin clips the 1000 dps range
+	prev = dps;
+
+	for (int i = 0; i < 20; i++) {
+		sample(1.f, 1500.f, &g, &dps);
+		ASSERT_GE(dps, prev - 0.1f) << i;
+		prev = dps;
+	}
+
+	EXPECT_EQ(imu.imuGyroFsGet(), IMU_EN_GYRO_FS_2000DPS);
+	EXPECT_NEAR(dps, 1500.f, 1.f);
+
+	for (int i = 0; i < 2 * ICM20948::AUTORANGE_QUIET_SAMPLES; i++) {
+		sample(1.f, 100.f, &g, &dps);
+	}
+
+	EXPECT_EQ(imu.imuGyroFsGet(), IMU_EN_GYRO_FS_1000DPS);
+	EXPECT_NEAR(dps, 100.f, 0.1f);
+}
+
+TEST_F(ImuRangeTest, NeverBelowSelectedRange)
+{
+	float g = 0.f, dps = 0.f;
+
+	imu.imuAccelFsSet(IMU_EN_ACCEL_FS_4G);
+	imu.imuAutoRangeEnable(true);
+
+	for (int i = 0; i < 20; i++) {
+		sample(6.f, 0.f, &g, &dps);
+	}
+
+	EXPECT_EQ(imu.imuAccelFsGet(), IMU_EN_ACCEL_FS_8G);
+
+	for (int i = 0; i < 4 * ICM20948::AUTORANGE_QUIET_SAMPLES; i++) {
+		sample(0.2f, 0.f, &g, &dps);
+	}
+
+	EXPECT_EQ(imu.imuAccelFsGet(), IMU_EN_ACCEL_FS_4G);
+	EXPECT_NEAR(g, 0.2f, 1e-3f);
+}
+
+} // namespace
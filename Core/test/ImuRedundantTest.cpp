@@ -0,0 +1,359 @@
+#include <functional>
+#include <gtest/gtest.h>
+#include "FakeI2cBus.hpp"
+#include "imu.h"
+#include "imu_redundant.h"
+
+// on the target icm20948.c owns these callbacks and forwards to the attached front end
+extern "C" void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	ImuRedundant_RxCpltCallback(hi2c);
+}
+
+extern "C" void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	ImuRedundant_ErrorCallback(hi2c);
+}
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+constexpr uint32_t SAMPLE_US = 1000000u / 1125u;
+constexpr uint32_t WAIT_US = 8 * SAMPLE_US;
+// LSB at the ranges set up below, 250 dps and 2 g
+constexpr float GYRO_LSB = 131.0f;
+constexpr float ACCEL_LSB = 16384.0f;
+
+// the same part on I2C3 and I2C2, both at the default address
+class ImuRedundantTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		front.callbackAttach();
+		bus.reset();
+		bus.attach(ICM_ADDR, &icmA, &hi2c3);
+		bus.attach(ICM_ADDR, &icmB, &hi2c2);
+		imuA.imuInit(&motion, &pressure);
+		imuB.imuInit(&motion, &pressure);
+		imuA.imuFifoInit(false, 1);
+		imuB.imuFifoInit(false, 1);
+		for (ICM20948 *imu : imus) {
+			imu->imuGyroFsSet(IMU_EN_GYRO_FS_250DPS);
+			imu->imuAccelFsSet(IMU_EN_ACCEL_FS_2G);
+		}
+		bus.deferDma = true;
+	}
+
+	// a slow rotation with some noise, so no axis repeats
+	void motionAt(uint32_t k, int16_t *gyro, int16_t *accel)
+	{
+		for (int i = 0; i < 3; i++) {
+			gyro[i] = (int16_t)(100 * i + 7 * (int)(k % 13) - 40);
+			accel[i] = (int16_t)((i == 2 ? 16384 : 0) + 11 * (int)(k % 7) - 30 + i);
+		}
+	}
+
+	// one output interval: both sensors sample, B through the fault injected by fault()
+	void sample()
+	{
+		int16_t gyro[3], accel[3];
+
+		motionAt(k, gyro, accel);
+		icmA.setGyro(gyro[0], gyro[1], gyro[2]);
+		icmA.setAccel(accel[0], accel[1], accel[2]);
+		icmA.fifoPush();
+		if (fault) {
+			fault(k, gyro, accel);
+		}
+		icmB.setGyro(gyro[0], gyro[1], gyro[2]);
+		icmB.setAccel(accel[0], accel[1], accel[2]);
+		icmB.fifoPush();
+		bus.us += SAMPLE_US;
+		k++;
+	}
+
+	// n sensor samples, one concurrent drain, then everything the front end puts out
+	std::vector<IMU_ST_VOTED_SAMPLE> cycle(int n)
+	{
+		std::vector<IMU_ST_VOTED_SAMPLE> out;
+		IMU_ST_VOTED_SAMPLE s;
+
+		for (int i = 0; i < n; i++) {
+			sample();
+		}
+		front.poll();
+		bus.completeDma(&hi2c3);
+		bus.completeDma(&hi2c2);
+		while (front.read(&s)) {
+			out.push_back(s);
+		}
+		return out;
+	}
+
+	// the output is sensor A's motion for capture k
+	void expectFollowsA(const IMU_ST_VOTED_SAMPLE &s, uint32_t at)
+	{
+		int16_t gyro[3], accel[3];
+
+		motionAt(at, gyro, accel);
+		for (int i = 0; i < 3; i++) {
+			EXPECT_NEAR(s.afGyroDps[i], gyro[i] / GYRO_LSB, 1e-4f);
+			EXPECT_NEAR(s.afAccelG[i], accel[i] / ACCEL_LSB, 1e-5f);
+		}
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icmA;
+	fake::FakeIcm20948 icmB;
+	ICM20948 imuA{I2cDmaTransport(&hi2c3, ICM_ADDR)};
+	ICM20948 imuB{I2cDmaTransport(&hi2c2, ICM_ADDR)};
+	ICM20948 *const imus[2] = {&imuA, &imuB};
+	ImuRedundant front{imus, 2, SAMPLE_US, WAIT_US};
+	IMU_EN_SENSOR_TYPE motion{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_EN_SENSOR_TYPE pressure{IMU_EN_SENSOR_TYPE_NULL};
+	std::function<void(uint32_t, int16_t *, int16_t *)> fault;
+	uint32_t k{0};
+};
+
+TEST_F(ImuRedundantTest, InstancesOwnTheirBus)
+{
+	EXPECT_EQ(imuA.imuBusGet(), &hi2c3);
+	EXPECT_EQ(imuB.imuBusGet(), &hi2c2);
+	EXPECT_EQ(imuB.imuTransportGet().addrGet(), ICM_ADDR);
+
+	bus.clearLog();
+	imuB.imuFifoPoll();
+	for (const auto &t : bus.log()) {
+		EXPECT_EQ(t.hi2c, &hi2c2);
+	}
+}
+
+// the HAL starts no DMA transfer on a bus without a linked channel
+TEST_F(ImuRedundantTest, DrainNeedsTheDmaChannel)
+{
+	DMA_HandleTypeDef *const rx = hi2c2.hdmarx;
+
+	hi2c2.hdmarx = nullptr;
+	cycle(4);
+	hi2c2.hdmarx = rx;
+
+	EXPECT_EQ(imuB.imuFifoStatsGet()->u32Drains, 0u);
+	EXPECT_EQ(imuA.imuFifoStatsGet()->u32Drains, 1u);
+	EXPECT_FALSE(imuB.imuFifoBusy());
+}
+
+TEST_F(ImuRedundantTest, DrainsRunConcurrently)
+{
+	for (int i = 0; i < 4; i++) {
+		sample();
+	}
+	front.poll();
+
+	EXPECT_TRUE(bus.dmaPending(&hi2c3));
+	EXPECT_TRUE(bus.dmaPending(&hi2c2));
+	EXPECT_TRUE(imuA.imuFifoBusy());
+	EXPECT_TRUE(imuB.imuFifoBusy());
+
+	// with one drain done the other sensor is waited for
+	IMU_ST_VOTED_SAMPLE s;
+	bus.completeDma(&hi2c3);
+	EXPECT_FALSE(front.read(&s));
+	bus.completeDma(&hi2c2);
+	EXPECT_TRUE(front.read(&s));
+	EXPECT_EQ(s.u8Voters, 0x03);
+}
+
+TEST_F(ImuRedundantTest, AgreeingSensorsAveraged)
+{
+	fault = [](uint32_t, int16_t *gyro, int16_t *accel) {
+		gyro[0] += 2 * 131;
+		accel[1] += 164;
+	};
+
+	const auto out = cycle(10);
+	ASSERT_EQ(out.size(), 10u);
+
+	int16_t gyro[3], accel[3];
+	motionAt(3, gyro, accel);
+	EXPECT_NEAR(out[3].afGyroDps[0], gyro[0] / GYRO_LSB + 1.0f, 1e-4f);
+	EXPECT_NEAR(out[3].afAccelG[1], (accel[1] + 82) / ACCEL_LSB, 1e-5f);
+	EXPECT_EQ(front.healthGet(0)->u8Score, ImuRedundant::SCORE_MAX);
+	EXPECT_EQ(front.healthGet(1)->u8Score, ImuRedundant::SCORE_MAX);
+	EXPECT_EQ(front.healthGet(1)->u32Samples, 10u);
+}
+
+TEST_F(ImuRedundantTest, StuckSensorExcluded)
+{
+	cycle(4);
+	fault = [](uint32_t, int16_t *gyro, int16_t *accel) {
+		for (int i = 0; i < 3; i++) {
+			gyro[i] = 500;
+			accel[i] = 1000;
+		}
+	};
+
+	uint32_t first = k;
+	for (int c = 0; c < 10; c++) {
+		const auto out = cycle(8);
+		ASSERT_EQ(out.size(), 8u);
+		for (size_t i = 0; i < out.size(); i++) {
+			expectFollowsA(out[i], first + i);
+		}
+		first = k;
+	}
+
+	const IMU_ST_HEALTH *h = front.healthGet(1);
+	EXPECT_GT(h->u32Stuck, 0u);
+	EXPECT_LT(h->u8Score, ImuRedundant::SCORE_EXCLUDE);
+	EXPECT_TRUE(h->bExcluded);
+	EXPECT_FALSE(front.healthGet(0)->bExcluded);
+	EXPECT_EQ(front.healthGet(0)->u8Score, ImuRedundant::SCORE_MAX);
+
+	// back to normal, it votes again once the score has recovered
+	fault = nullptr;
+	for (int c = 0; c < 12; c++) {
+		cycle(8);
+	}
+	EXPECT_FALSE(h->bExcluded);
+	EXPECT_GE(h->u8Score, ImuRedundant::SCORE_READMIT);
+}
+
+TEST_F(ImuRedundantTest, BiasedSensorOutvoted)
+{
+	cycle(4);
+	// a 20 dps step on one axis
+	fault = [](uint32_t, int16_t *gyro, int16_t *) {
+		gyro[1] += 20 * 131;
+	};
+
+	uint32_t first = k;
+	for (int c = 0; c < 4; c++) {
+		const auto out = cycle(8);
+		ASSERT_EQ(out.size(), 8u);
+		for (size_t i = 0; i < out.size(); i++) {
+			expectFollowsA(out[i], first + i);
+		}
+		first = k;
+	}
+
+	// outvoted from the first sample, excluded after the score fell below the threshold
+	const IMU_ST_HEALTH *h = front.healthGet(1);
+	EXPECT_EQ(h->u32Outvoted, 32u);
+	EXPECT_LT(h->u8Score, ImuRedundant::SCORE_EXCLUDE);
+	EXPECT_TRUE(h->bExcluded);
+
+	const auto out = cycle(8);
+	EXPECT_EQ(out[0].u8Voters, 0x01);
+}
+
+TEST_F(ImuRedundantTest, SpikeRejected)
+{
+	cycle(4);
+	fault = [](uint32_t at, int16_t *gyro, int16_t *) {
+		if (at == 6) {
+			gyro[2] = 32767;
+		}
+	};
+
+	const auto out = cycle(8);
+	ASSERT_EQ(out.size(), 8u);
+	expectFollowsA(out[2], 6);
+	EXPECT_EQ(out[2].u8Voters, 0x01);
+	EXPECT_EQ(out[3].u8Voters, 0x03);
+	EXPECT_EQ(front.healthGet(1)->u32Saturated, 1u);
+	EXPECT_FALSE(front.healthGet(1)->bExcluded);
+}
+
+TEST_F(ImuRedundantTest, DetachedSensorMissing)
+{
+	cycle(4);
+	bus.detach(ICM_ADDR, &hi2c2);
+
+	std::vector<IMU_ST_VOTED_SAMPLE> out;
+	for (int c = 0; c < 10; c++) {
+		const auto part = cycle(8);
+		out.insert(out.end(), part.begin(), part.end());
+	}
+
+	// the samples younger than the wait come out with the next drain
+	EXPECT_GE(out.size(), 72u);
+	for (size_t i = 0; i < out.size(); i++) {
+		expectFollowsA(out[i], 4 + i);
+		EXPECT_EQ(out[i].u8Voters, 0x01);
+	}
+
+	const IMU_ST_HEALTH *h = front.healthGet(1);
+	EXPECT_GT(h->u32Missing, 0u);
+	EXPECT_TRUE(h->bExcluded);
+	EXPECT_FALSE(front.healthGet(0)->bExcluded);
+}
+
+TEST_F(ImuRedundantTest, BusErrorPenalised)
+{
+	IMU_ST_VOTED_SAMPLE s;
+
+	for (int i = 0; i < 4; i++) {
+		sample();
+	}
+	front.poll();
+	bus.completeDma(&hi2c3);
+	bus.completeDma(&hi2c2, HAL_ERROR);
+
+	EXPECT_EQ(imuB.imuFifoStatsGet()->u32Errors, 1u);
+	EXPECT_FALSE(imuB.imuFifoBusy());
+	EXPECT_EQ(front.healthGet(1)->u32BusErrors, 1u);
+	EXPECT_EQ(front.healthGet(1)->u8Score, ImuRedundant::SCORE_MAX - ImuRedundant::PENALTY_FAULT);
+
+	// B's frames are lost, A's are put out on their own once the wait is over
+	bus.us += WAIT_US;
+	int n = 0;
+	while (front.read(&s)) {
+		EXPECT_EQ(s.u8Voters, 0x01);
+		n++;
+	}
+	EXPECT_EQ(n, 4);
+}
+
+TEST_F(ImuRedundantTest, MagnetometerAveragedPerInstance)
+{
+	IMU_ST_ANGLES_DATA angles;
+	IMU_ST_SENSOR_DATA gyro, accel, magnA, magnB;
+
+	bus.deferDma = false;
+	for (ICM20948 *imu : imus) {
+		imu->imuAcqModeSet(IMU_EN_ACQ_MODE_BURST_MAGN);
+	}
+	for (int i = 0; i < 8; i++) {
+		icmA.setMag(80, 0, 0);
+		icmB.setMag(-200, 0, 0);
+		icmA.runI2cMaster();
+		icmB.runI2cMaster();
+		imuA.imuDataGet(&angles, &gyro, &accel, &magnA);
+		imuB.imuDataGet(&angles, &gyro, &accel, &magnB);
+	}
+
+	EXPECT_EQ(magnA.s16Y, 80);
+	EXPECT_EQ(magnB.s16Y, -200);
+}
+
+TEST_F(ImuRedundantTest, SamplesTimeAligned)
+{
+	// B started one sample earlier
+	icmB.setGyro(1, 2, 3);
+	icmB.fifoPush();
+	bus.us += SAMPLE_US;
+
+	const auto out = cycle(8);
+	ASSERT_EQ(out.size(), 8u);
+	EXPECT_EQ(front.healthGet(1)->u32Misaligned, 1u);
+	EXPECT_EQ(front.healthGet(0)->u32Misaligned, 0u);
+	for (size_t i = 0; i < out.size(); i++) {
+		expectFollowsA(out[i], i);
+		EXPECT_EQ(out[i].u8Voters, 0x03);
+	}
+	EXPECT_EQ(front.healthGet(1)->u8Score, ImuRedundant::SCORE_MAX);
+}
+
+} // namespace
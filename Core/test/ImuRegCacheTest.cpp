@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include "FakeI2cBus.hpp"
+#include "imu.h"
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+
+struct Cost {
+	size_t init;
+	size_t sample;
+	size_t bankWrites;
+};
+
+class ImuRegCacheTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		bus.reset();
+		bus.attach(ICM_ADDR, &icm);
+	}
+
+	size_t bankWrites() const
+	{
+		const auto &log = bus.log();
+		return std::count_if(log.begin(), log.end(), [](const fake::Transaction & t) {
+			return !t.read && t.devAddr == ICM_ADDR && t.regAddr == fake::FakeIcm20948::REG_BANK_SEL;
+		});
+	}
+
+	// bring-up plus one legacy sample whose magnetometer read goes through SLV0
+	Cost run(ICM20948 &imu, bool cached)
+	{
+		IMU_EN_SENSOR_TYPE motion, pressure;
+		IMU_ST_ANGLES_DATA angles;
+		IMU_ST_SENSOR_DATA gyro, accel, magn;
+		Cost c{};
+
+		imu.imuRegCacheEnable(cached);
+		imu.imuInit(&motion, &pressure);
+		c.init = bus.transactions();
+		EXPECT_EQ(motion, IMU_EN_SENSOR_TYPE_ICM20948);
+
+		// first sample after init still pays for switching SLV1 off
+		icm.setMag(10, 20, 30);
+		imu.imuDataGet(&angles, &gyro, &accel, &magn);
+
+		bus.clearLog();
+		icm.setMag(10, 20, 30);
+		imu.imuDataGet(&angles, &gyro, &accel, &magn);
+		c.sample = bus.transactions();
+		c.bankWrites = bankWrites();
+		return c;
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+};
+
+TEST_F(ImuRegCacheTest, FewerTransactions)
+{
+	// driver before the cache on the same sequence: each secondary access switched banks
+	// four times and read back USER_CTRL and I2C_SLV0_CTRL
+	constexpr size_t BASELINE_INIT = 70;
+	constexpr size_t BASELINE_SAMPLE = 32;
+
+	ICM20948 uncachedImu;
+	const Cost off = run(uncachedImu, false);
+
+	SetUp();
+	ICM20948 cachedImu;
+	const Cost on = run(cachedImu, true);
+
+	// init: the gyro offset comes from the background calibration, no reads at boot
+	EXPECT_EQ(on.init, 28u);
+	EXPECT_LT(on.init, BASELINE_INIT);
+
+	// burst + two SLV0 round trips (ST1, then HXL..ST2) of 7 transactions each
+	EXPECT_EQ(on.sample, 15u);
+	EXPECT_LT(on.sample, BASELINE_SAMPLE / 2);
+	EXPECT_EQ(on.bankWrites, 4u);
+
+	// with the cache off every access selects its bank and every modify reads first
+	EXPECT_GT(off.init, on.init);
+	EXPECT_GT(off.sample, on.sample);
+	EXPECT_GT(off.bankWrites, on.bankWrites);
+}
+
+TEST_F(ImuRegCacheTest, SameRegisterState)
+{
+	uint8_t regs[2][4][128];
+
+	for (int pass = 0; pass < 2; pass++) {
+		SetUp();
+		icm = fake::FakeIcm20948();
+		ICM20948 imu;
+		run(imu, pass == 1);
+
+		for (uint8_t bank = 0; bank < 4; bank++) {
+			for (uint8_t addr = 0; addr < 0x7F; addr++) {
+				regs[pass][bank][addr] = icm.reg(bank, addr);
+			}
+		}
+	}
+
+	for (uint8_t bank = 0; bank < 4; bank++) {
+		for (uint8_t addr = 0; addr < 0x7F; addr++) {
+			EXPECT_EQ(regs[0][bank][addr], regs[1][bank][addr]) << "bank " << int(bank) << " reg " << int(addr);
+		}
+	}
+}
+
+TEST_F(ImuRegCacheTest, BurstSkipsBankSelect)
+{
+	IMU_EN_SENSOR_TYPE motion, pressure;
+	IMU_ST_ANGLES_DATA angles;
+	IMU_ST_SENSOR_DATA gyro, accel, magn;
+	ICM20948 imu;
+
+	imu.imuInit(&motion, &pressure);
+	imu.imuAcqModeSet(IMU_EN_ACQ_MODE_BURST_MAGN);
+	imu.imuDataGet(&angles, &gyro, &accel, &magn);
+
+	bus.clearLog();
+
+	for (int i = 0; i < 10; i++) {
+		imu.imuDataGet(&angles, &gyro, &accel, &magn);
+	}
+
+	EXPECT_EQ(bus.transactions(), 10u);
+	EXPECT_EQ(bankWrites(), 0u);
+}
+
+TEST_F(ImuRegCacheTest, ReenableForgetsShadow)
+{
+	IMU_EN_SENSOR_TYPE motion, pressure;
+	ICM20948 imu;
+
+	imu.imuInit(&motion, &pressure);
+	imu.imuAcqModeSet(IMU_EN_ACQ_MODE_BURST_MAGN);
+	imu.imuAcqModeSet(IMU_EN_ACQ_MODE_BURST);
+
+	// someone else reprogrammed the device behind the driver's back
+	icm.reg(0, ICM20948::REG_ADD_USER_CTRL) = ICM20948::REG_VAL_BIT_I2C_MST_EN;
+	icm.reg(3, ICM20948::REG_ADD_I2C_SLV0_CTRL) = 0x00;
+	imu.imuRegCacheEnable(true);
+
+	bus.clearLog();
+	imu.imuAcqModeSet(IMU_EN_ACQ_MODE_BURST_MAGN);
+
+	EXPECT_EQ(bus.readsInRange(ICM_ADDR, ICM20948::REG_ADD_USER_CTRL, ICM20948::REG_ADD_USER_CTRL), 1u);
+	EXPECT_EQ(icm.reg(3, ICM20948::REG_ADD_I2C_SLV0_CTRL),
+		  ICM20948::REG_VAL_BIT_SLV0_EN | ICM20948::REG_LEN_MAG_AUTO);
+	EXPECT_TRUE(icm.reg(0, ICM20948::REG_ADD_USER_CTRL) & ICM20948::REG_VAL_BIT_I2C_MST_EN);
+}
+
+} // namespace
@@ -0,0 +1,209 @@
+#include <cmath>
+#include <gtest/gtest.h>
+#include "FakeI2cBus.hpp"
+#include "imu.h"
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+constexpr uint32_t GYRO_US = 909;    // 1.1 kHz
+constexpr uint32_t ACCEL_US = 5 * GYRO_US; // 220 Hz, read with every fifth gyro sample
+constexpr uint32_t MAGN_US = 10000;  // 100 Hz
+constexpr uint32_t LOOP_US = 100;
+
+class ImuStreamTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		bus.reset();
+		bus.attach(ICM_ADDR, &icm);
+		imu.imuInit(&motion, &pressure);
+		bus.us = 0;
+	}
+
+	void init(uint32_t magnUs = MAGN_US)
+	{
+		const ACQ_SCHED_ST_PLAN plan = {{GYRO_US, ACCEL_US, magnUs, 0}};
+
+		imu.imuStreamInit(&plan);
+		bus.clearLog();
+	}
+
+	// the sensor side on the bus clock: the I2C master at the gyro rate, a new
+	// magnetometer measurement every MAGN_US with a value of its own, half way
+	// between two magnetometer polls
+	void run(uint32_t us)
+	{
+		const uint32_t end = bus.us + us;
+
+		while (bus.us < end) {
+			if (bus.us >= nextMagn) {
+				magnSet++;
+				icm.setMag(magnSet, -magnSet, 2 * magnSet);
+				nextMagn += MAGN_US;
+			}
+			if (bus.us >= nextMaster) {
+				icm.runI2cMaster();
+				nextMaster += GYRO_US;
+			}
+			imu.imuStreamPoll();
+			step();
+			bus.us += LOOP_US;
+		}
+	}
+
+	virtual void step()
+	{
+		IMU_ST_STREAM_SAMPLE s;
+
+		for (int i = 0; i < ACQ_SCHED_STREAM_NUM; i++) {
+			if (imu.imuStreamRead((ACQ_SCHED_EN_STREAM)i, &s)) {
+				taken[i]++;
+				last[i] = s;
+			}
+		}
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+	ICM20948 imu;
+	IMU_EN_SENSOR_TYPE motion{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_EN_SENSOR_TYPE pressure{IMU_EN_SENSOR_TYPE_NULL};
+	uint32_t nextMagn{MAGN_US / 2};
+	uint32_t nextMaster{0};
+	int16_t magnSet{0};
+	uint32_t taken[ACQ_SCHED_STREAM_NUM]{};
+	IMU_ST_STREAM_SAMPLE last[ACQ_SCHED_STREAM_NUM]{};
+};
+
+TEST_F(ImuStreamTest, SensorRatesFollowThePlan)
+{
+	init();
+
+	EXPECT_EQ(icm.reg(2, ICM20948::REG_ADD_GYRO_SMPLRT_DIV), 0);
+	EXPECT_EQ(icm.reg(2, ICM20948::REG_ADD_ACCEL_SMPLRT_DIV_2), 4);
+	EXPECT_EQ(icm.magReg(ICM20948::REG_ADD_MAG_CNTL2), ICM20948::REG_VAL_MAG_MODE_100HZ);
+	EXPECT_EQ(icm.reg(3, ICM20948::REG_ADD_I2C_SLV0_CTRL), ICM20948::REG_VAL_BIT_SLV0_EN | ICM20948::REG_LEN_MAG_AUTO);
+	EXPECT_EQ(imu.imuAcqModeGet(), IMU_EN_ACQ_MODE_BURST_MAGN);
+	EXPECT_EQ(imu.imuStreamSchedGet()->stPlan.au32Period[ACQ_SCHED_STREAM_BARO], 0u);
+
+	// the slowest AK09916 mode that still keeps up with the period
+	init(25000);
+	EXPECT_EQ(icm.magReg(ICM20948::REG_ADD_MAG_CNTL2), ICM20948::REG_VAL_MAG_MODE_50HZ);
+	init(50000);
+	EXPECT_EQ(icm.magReg(ICM20948::REG_ADD_MAG_CNTL2), ICM20948::REG_VAL_MAG_MODE_20HZ);
+	init(200000);
+	EXPECT_EQ(icm.magReg(ICM20948::REG_ADD_MAG_CNTL2), ICM20948::REG_VAL_MAG_MODE_10HZ);
+}
+
+TEST_F(ImuStreamTest, EachStreamAtItsRate)
+{
+	icm.setAccel(100, 200, 16384);
+	icm.setGyro(-3, 5, 7);
+	init();
+	run(1000000);
+
+	EXPECT_NEAR(taken[ACQ_SCHED_STREAM_GYRO], 1100, 2);
+	EXPECT_NEAR(taken[ACQ_SCHED_STREAM_ACCEL], 220, 2);
+	EXPECT_EQ(taken[ACQ_SCHED_STREAM_BARO], 0u);
+	EXPECT_EQ(last[ACQ_SCHED_STREAM_GYRO].as32Val[0], -3);
+	EXPECT_EQ(last[ACQ_SCHED_STREAM_GYRO].as32Val[2], 7);
+	EXPECT_EQ(last[ACQ_SCHED_STREAM_ACCEL].as32Val[2], 16384);
+	EXPECT_EQ(last[ACQ_SCHED_STREAM_GYRO].u32Seq, taken[ACQ_SCHED_STREAM_GYRO]);
+
+	// every measurement once: the registers of the init, then all but the last one,
+	// which is not due before the second is over
+	EXPECT_EQ(taken[ACQ_SCHED_STREAM_MAGN], 100u);
+	EXPECT_EQ(magnSet, 100);
+	EXPECT_EQ(last[ACQ_SCHED_STREAM_MAGN].as32Val[0], magnSet - 1);
+	EXPECT_EQ(last[ACQ_SCHED_STREAM_MAGN].as32Val[1], -(magnSet - 1));
+	EXPECT_EQ(imu.imuStreamSchedGet()->au32Missed[ACQ_SCHED_STREAM_GYRO], 0u);
+}
+
+TEST_F(ImuStreamTest, NothingIsTakenTwice)
+{
+	IMU_ST_STREAM_SAMPLE s;
+
+	init();
+	run(LOOP_US);
+
+	EXPECT_FALSE(imu.imuStreamRead(ACQ_SCHED_STREAM_GYRO, &s));
+	EXPECT_FALSE(imu.imuStreamRead(ACQ_SCHED_STREAM_MAGN, &s));
+	EXPECT_FALSE(imu.imuStreamRead(ACQ_SCHED_STREAM_NUM, &s));
+
+	// EXT_SENS_DATA holds the measurement with DRDY cleared, it is not new again
+	icm.runI2cMaster();
+	bus.us = MAGN_US;
+	imu.imuStreamPoll();
+	EXPECT_TRUE(imu.imuStreamRead(ACQ_SCHED_STREAM_GYRO, &s));
+	EXPECT_FALSE(imu.imuStreamRead(ACQ_SCHED_STREAM_MAGN, &s));
+}
+
+TEST_F(ImuStreamTest, OneBurstWhenAccelAndGyroAreDue)
+{
+	uint32_t bursts = 0, gyroOnly = 0, magn = 0;
+
+	init();
+	run(100000);
+
+	for (const fake::Transaction &t : bus.log()) {
+		if (t.devAddr != ICM_ADDR || !t.read) {
+			continue;
+		}
+		if (t.regAddr == ICM20948::REG_ADD_ACCEL_XOUT_H && t.len == ICM20948::REG_LEN_ACCEL_GYRO) {
+			bursts++;
+		} else if (t.regAddr == ICM20948::REG_ADD_GYRO_XOUT_H && t.len == ACQ_SCHED_LEN_GYRO) {
+			gyroOnly++;
+		} else if (t.regAddr == ICM20948::REG_ADD_EXT_SENS_DATA_00 && t.len == ICM20948::REG_LEN_MAG_AUTO) {
+			magn++;
+		}
+	}
+
+	const ACQ_SCHED_ST_STATE *sched = imu.imuStreamSchedGet();
+	EXPECT_EQ(bursts, sched->au32Reads[ACQ_SCHED_STREAM_ACCEL]);
+	EXPECT_EQ(bursts + gyroOnly, sched->au32Reads[ACQ_SCHED_STREAM_GYRO]);
+	EXPECT_EQ(magn, sched->au32Reads[ACQ_SCHED_STREAM_MAGN]);
+	EXPECT_EQ(magn, 10u);
+	EXPECT_EQ(bursts, 22u);
+}
+
+class ImuStreamFusionTest : public ImuStreamTest
+{
+protected:
+	void step() override
+	{
+		if (imu.imuStreamUpdate(&angles)) {
+			steps++;
+		}
+	}
+
+	IMU_ST_ANGLES_DATA angles{};
+	uint32_t steps{0};
+};
+
+TEST_F(ImuStreamFusionTest, StepsOnNewGyroOnly)
+{
+	// 10 dps about z at the 1000 dps range of init, level and still otherwise
+	icm.setAccel(0, 0, 16384);
+	icm.setGyro(0, 0, 328);
+	init();
+	// the magnetometer of the fake does not turn with the gyro, only the integration is checked
+	imu.imuAHRSgainsSet(0.0f, 0.0f);
+	run(1000000);
+
+	// the first sample only sets the stamp
+	EXPECT_NEAR(steps, 1099, 2);
+	EXPECT_NEAR(imu.imuDtGet(), GYRO_US * 1e-6f, 1e-4f);
+	// yaw of the identity quaternion is 180 degrees
+	EXPECT_NEAR(std::fabs(std::remainder(angles.fYaw - 180.f, 360.f)), 10.f, 0.2f);
+	EXPECT_NEAR(angles.fPitch, 0.f, 0.1f);
+	EXPECT_NEAR(angles.fRoll, 0.f, 0.1f);
+
+	IMU_ST_ANGLES_DATA before = angles;
+	EXPECT_FALSE(imu.imuStreamUpdate(&angles));
+	EXPECT_EQ(angles.fYaw, before.fYaw);
+}
+
+} // namespace
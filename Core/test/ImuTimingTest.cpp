@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include "FakeI2cBus.hpp"
+#include "imu.h"
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+constexpr float RATE_DPS = 90.f;
+
+// wrap an angle difference to [-180, 180)
+float wrap(float deg)
+{
+	return deg - 360.f * std::floor((deg + 180.f) / 360.f);
+}
+
+class ImuTimingTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		bus.reset();
+		bus.attach(ICM_ADDR, &icm);
+		// level and at rest while the gyro offset is measured
+		icm.setAccel(0, 0, 16384);
+		imu.imuInit(&motion, &pressure);
+	}
+
+	// constant yaw rate, samples taken at the given interval; returns the yaw error in
+	// degrees against the rotation that really happened between the first and last sample
+	float replay(int samples, uint32_t (*intervalUs)(int))
+	{
+		IMU_ST_ANGLES_DATA angles;
+		IMU_ST_SENSOR_DATA gyro, accel, magn;
+
+		icm.setGyro(0, 0, (int16_t)std::lround(RATE_DPS * ICM20948::GYRO_LSB_PER_DPS[IMU_EN_GYRO_FS_1000DPS]));
+
+		// fill the 8-tap average at the nominal rate first
+		for (int i = 0; i < 16; i++) {
+			bus.us += 5000;
+			imu.imuDataGet(&angles, &gyro, &accel, &magn);
+		}
+
+		const float yaw0 = angles.fYaw;
+		const uint32_t t0 = bus.us;
+
+		for (int i = 0; i < samples; i++) {
+			bus.us += intervalUs(i);
+			imu.imuDataGet(&angles, &gyro, &accel, &magn);
+		}
+
+		const float turned = RATE_DPS * (bus.us - t0) * 1e-6f;
+		return wrap(angles.fYaw - yaw0 - turned);
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+	ICM20948 imu;
+	IMU_EN_SENSOR_TYPE motion{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_EN_SENSOR_TYPE pressure{IMU_EN_SENSOR_TYPE_NULL};
+};
+
+TEST_F(ImuTimingTest, NominalRate)
+{
+	const float err = replay(300, [](int) -> uint32_t { return 5000; });
+
+	EXPECT_LT(std::fabs(err), 0.5f);
+	EXPECT_NEAR(imu.imuDtGet(), 0.005f, 1e-6f);
+	EXPECT_EQ(imu.imuDtStatsGet()->u32DtMinUs, 5000u);
+	EXPECT_EQ(imu.imuDtStatsGet()->u32DtMaxUs, 5000u);
+}
+
+TEST_F(ImuTimingTest, JitteredTimestamps)
+{
+	// main loop anywhere between 2 and 12 ms late, 1000 samples
+	static std::mt19937 rng(11);
+	const float err = replay(1000, [](int) -> uint32_t {
+		return std::uniform_int_distribution<uint32_t>(2000, 12000)(rng);
+	});
+
+	// ~7 s and ~630 deg of rotation, integrated with the measured dt
+	EXPECT_LT(std::fabs(err), 1.f);
+
+	const SAMPLE_ST_DT_STATS *dt = imu.imuDtStatsGet();
+	EXPECT_GE(dt->u32DtMinUs, 2000u);
+	EXPECT_LE(dt->u32DtMaxUs, 12000u);
+	// uniform over 10 ms: 2.9 ms standard deviation
+	EXPECT_NEAR(SampleStats_DtStdUs(dt), 2887.f, 250.f);
+}
+
+TEST_F(ImuTimingTest, StallIsClamped)
+{
+	IMU_ST_ANGLES_DATA angles;
+	IMU_ST_SENSOR_DATA gyro, accel, magn;
+
+	bus.us += 5000;
+	imu.imuDataGet(&angles, &gyro, &accel, &magn);
+	bus.us += 2000000;
+	imu.imuDataGet(&angles, &gyro, &accel, &magn);
+
+	EXPECT_NEAR(imu.imuDtGet(), ICM20948::FUSION_DT_MAX_US * 1e-6f, 1e-6f);
+	EXPECT_EQ(imu.imuDtStatsGet()->u32DtMaxUs, 2000000u);
+}
+
+} // namespace
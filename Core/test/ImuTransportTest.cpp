@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include "FakeI2cBus.hpp"
+#include "imu.h"
+#include "imu_transport_mock.h"
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+constexpr int FRAMES = 16;
+
+typedef MockTransport<I2cTransport::Wire, false> MockI2cBlocking;
+typedef MockTransport<I2cTransport::Wire, true> MockI2cDma;
+typedef MockTransport<Icm20948SpiWire, true> MockSpiDma;
+
+// the same driver code on every transport
+template <class Transport>
+class ImuTransportTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		bus.reset();
+		imu.imuInit(&motion, &pressure);
+		imu.imuFifoInit(false, 1);
+	}
+
+	void push(int16_t v)
+	{
+		icm.setAccel(v, (int16_t)(v + 1), (int16_t)(v + 2));
+		icm.setGyro((int16_t)(-v), (int16_t)(-v - 1), (int16_t)(-v - 2));
+		icm.fifoPush();
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+	Icm20948Driver<Transport> imu{Transport(&icm)};
+	IMU_EN_SENSOR_TYPE motion{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_EN_SENSOR_TYPE pressure{IMU_EN_SENSOR_TYPE_NULL};
+};
+
+typedef ::testing::Types<MockI2cBlocking, MockI2cDma, MockSpiDma> Transports;
+TYPED_TEST_SUITE(ImuTransportTest, Transports);
+
+TYPED_TEST(ImuTransportTest, FifoSamples)
+{
+	ICM20948_ST_FIFO_SAMPLE s;
+
+	EXPECT_EQ(this->motion, IMU_EN_SENSOR_TYPE_ICM20948);
+	// nothing went through the HAL
+	EXPECT_EQ(this->bus.transactions(), 0u);
+
+	for (int16_t i = 0; i < FRAMES; i++) {
+		this->push((int16_t)(100 * i));
+	}
+	ASSERT_TRUE(this->imu.imuFifoPoll());
+	EXPECT_FALSE(this->imu.imuFifoBusy());
+
+	for (int16_t i = 0; i < FRAMES; i++) {
+		ASSERT_TRUE(this->imu.imuFifoRead(&s));
+		EXPECT_EQ(s.stAccel.s16X, 100 * i);
+		EXPECT_EQ(s.stGyro.s16Z, -100 * i - 2);
+	}
+	EXPECT_FALSE(this->imu.imuFifoRead(&s));
+}
+
+// count read, bank select and the drain, spread over the frames of one drain
+template <class Transport>
+double busUsPerSample(bool blocked)
+{
+	fake::FakeIcm20948 icm;
+	Icm20948Driver<Transport> imu{Transport(&icm)};
+	IMU_EN_SENSOR_TYPE motion, pressure;
+
+	fake::I2cBus::instance().reset();
+	imu.imuInit(&motion, &pressure);
+	imu.imuFifoInit(false, 1);
+	for (int i = 0; i < FRAMES; i++) {
+		icm.fifoPush();
+	}
+
+	Transport &bus = imu.imuTransportGet();
+	bus.statsReset();
+	imu.imuFifoPoll();
+	return (blocked ? bus.blockedNs : bus.busNs) / 1000.0 / FRAMES;
+}
+
+TEST(ImuTransportCostTest, BusTimePerSample)
+{
+	const double i2c = busUsPerSample<MockI2cBlocking>(false);
+	const double i2cBlocked = busUsPerSample<MockI2cBlocking>(true);
+	const double i2cDmaBlocked = busUsPerSample<MockI2cDma>(true);
+	const double spi = busUsPerSample<MockSpiDma>(false);
+	const double spiBlocked = busUsPerSample<MockSpiDma>(true);
+
+	// 12 bytes a frame at 9 bits and 400 kHz, plus the count read and bank select
+	EXPECT_GT(i2c, 12 * 9 / 0.4);
+	EXPECT_LT(i2c, 1.5 * 12 * 9 / 0.4);
+	EXPECT_EQ(i2cBlocked, i2c);
+	// DMA moves the same bytes, the CPU just does not wait for them
+	EXPECT_EQ(busUsPerSample<MockI2cDma>(false), i2c);
+	EXPECT_LT(i2cDmaBlocked, i2cBlocked / 4);
+	// 5 MHz at 8 bits a byte against 400 kHz at 9
+	EXPECT_LT(spi * 10, i2c);
+	EXPECT_LT(spiBlocked, spi);
+}
+
+// the blocking I2C transport through the HAL: the drain is done when imuFifoPoll returns
+TEST(ImuTransportHalTest, BlockingDrain)
+{
+	fake::I2cBus &bus = fake::I2cBus::instance();
+	fake::FakeIcm20948 icm;
+	Icm20948Driver<I2cBlockingTransport> imu{I2cBlockingTransport(&hi2c3, ICM_ADDR)};
+	IMU_EN_SENSOR_TYPE motion, pressure;
+	ICM20948_ST_FIFO_SAMPLE s;
+
+	bus.reset();
+	bus.attach(ICM_ADDR, &icm);
+	bus.deferDma = true;
+	imu.imuInit(&motion, &pressure);
+	imu.imuFifoInit(false, 1);
+
+	icm.setAccel(1, 2, 3);
+	icm.fifoPush();
+	bus.clearLog();
+	ASSERT_TRUE(imu.imuFifoPoll());
+
+	EXPECT_FALSE(bus.dmaPending());
+	for (const auto &t : bus.log()) {
+		EXPECT_FALSE(t.dma);
+	}
+	ASSERT_TRUE(imu.imuFifoRead(&s));
+	EXPECT_EQ(s.stAccel.s16Z, 3);
+	EXPECT_EQ(imu.imuFifoStatsGet()->u32Bytes, ICM20948::REG_LEN_ACCEL_GYRO);
+}
+
+} // namespace
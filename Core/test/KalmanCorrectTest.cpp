@@ -0,0 +1,269 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <gtest/gtest.h>
+#include "embedMath.h"
+#include "inc/filter.hpp"
+
+using namespace matrix;
+
+namespace
+{
+
+constexpr size_t M = 9;
+
+// a random covariance, well conditioned so the dense inverse does not fail its thresholds
+template <typename Type>
+SquareMatrix<Type, M> covariance(std::mt19937 &rng)
+{
+	std::uniform_real_distribution<double> u(-1.0, 1.0);
+	Matrix<Type, M, M> A;
+
+	for (size_t i = 0; i < M; i++) {
+		for (size_t j = 0; j < M; j++) {
+			A(i, j) = Type(u(rng));
+		}
+	}
+
+	SquareMatrix<Type, M> P = A * A.T();
+	for (size_t i = 0; i < M; i++) {
+		P(i, i) += Type(0.5);
+	}
+	return P;
+}
+
+template <typename Type, size_t N>
+struct Problem {
+	SquareMatrix<Type, M> P;
+	Matrix<Type, N, M> C;
+	Vector<Type, N> R;
+	Vector<Type, N> r;
+
+	explicit Problem(unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<double> u(-1.0, 1.0);
+
+		P = covariance<Type>(rng);
+		for (size_t i = 0; i < N; i++) {
+			for (size_t j = 0; j < M; j++) {
+				C(i, j) = Type(u(rng));
+			}
+			R(i) = Type(0.1 + 0.2 * (u(rng) + 1.0));
+			r(i) = Type(u(rng));
+		}
+	}
+
+	SquareMatrix<Type, N> Rdiag() const
+	{
+		return diag(R);
+	}
+};
+
+template <size_t N>
+void expectSameAsDense(unsigned seed, bool joseph)
+{
+	const Problem<double, N> p(seed);
+	Vector<double, M> dx, dxRef;
+	SquareMatrix<double, M> dP, dPRef;
+	double beta, betaRef;
+
+	kalman_correct<double, M, N>(p.P, p.C, p.Rdiag(), p.r, dxRef, dPRef, betaRef);
+	EXPECT_EQ((kalman_correct_sequential<double, M, N>(p.P, p.C, p.R, p.r, dx, dP, beta, 0.0, joseph)), 0);
+
+	for (size_t i = 0; i < M; i++) {
+		EXPECT_NEAR(dx(i), dxRef(i), 1e-10) << i;
+		for (size_t j = 0; j < M; j++) {
+			EXPECT_NEAR(dP(i, j), dPRef(i, j), 1e-10) << i << "," << j;
+		}
+	}
+	// the innovations of the sequence are independent, their squares add up to r^T S^-1 r
+	EXPECT_NEAR(beta, betaRef, 1e-9);
+}
+
+TEST(KalmanCorrectTest, SequentialMatchesDense)
+{
+	for (unsigned seed = 1; seed <= 5; seed++) {
+		expectSameAsDense<1>(seed, false);
+		expectSameAsDense<3>(seed, false);
+		expectSameAsDense<6>(seed, false);
+		expectSameAsDense<9>(seed, false);
+	}
+}
+
+TEST(KalmanCorrectTest, JosephMatchesDense)
+{
+	for (unsigned seed = 1; seed <= 5; seed++) {
+		expectSameAsDense<3>(seed, true);
+		expectSameAsDense<9>(seed, true);
+	}
+}
+
+TEST(KalmanCorrectTest, ScalarUpdatesInPlace)
+{
+	Problem<double, 1> p(7);
+	const SquareMatrix<double, M> P0 = p.P;
+	Vector<double, M> dx;
+	double beta;
+
+	ASSERT_TRUE((kalman_correct_scalar<double, M>(p.P, p.C, p.R(0), p.r(0), dx, beta)));
+
+	// the variance seen through c shrinks, P stays symmetric
+	const double before = (p.C * P0 * p.C.T())(0, 0);
+	const double after = (p.C * p.P * p.C.T())(0, 0);
+	EXPECT_LT(after, before);
+	EXPECT_NEAR(after, before * p.R(0) / (before + p.R(0)), 1e-12);
+	for (size_t i = 0; i < M; i++) {
+		for (size_t j = 0; j < M; j++) {
+			EXPECT_EQ(p.P(i, j), p.P(j, i));
+		}
+	}
+}
+
+TEST(KalmanCorrectTest, GateRejectsTheOutlierOnly)
+{
+	Problem<double, 3> p(3);
+	Problem<double, 3> clean(3);
+	Vector<double, M> dx, dxClean;
+	SquareMatrix<double, M> dP, dPClean;
+	double beta, betaClean;
+
+	// the middle row 100 sigma off; with it dropped the result is the update of the other two
+	const Matrix<double, 1, M> c1(p.C.row(1));
+	const double sigma = std::sqrt((c1 * p.P * c1.T())(0, 0) + p.R(1));
+	p.r(1) = 100.0 * sigma;
+	clean.R(1) = 1e30;
+
+	EXPECT_EQ((kalman_correct_sequential<double, M, 3>(p.P, p.C, p.R, p.r, dx, dP, beta, 9.0)), 1);
+	kalman_correct_sequential<double, M, 3>(clean.P, clean.C, clean.R, clean.r, dxClean, dPClean, betaClean);
+
+	for (size_t i = 0; i < M; i++) {
+		EXPECT_NEAR(dx(i), dxClean(i), 1e-9) << i;
+		EXPECT_NEAR(dP(i, i), dPClean(i, i), 1e-9) << i;
+	}
+	EXPECT_LT(beta, 9.0 * 2);
+
+	// without the gate it goes in
+	EXPECT_EQ((kalman_correct_sequential<double, M, 3>(p.P, p.C, p.R, p.r, dx, dP, beta)), 0);
+	EXPECT_GT(beta, 9.0);
+}
+
+TEST(KalmanCorrectTest, NoVarianceNoUpdate)
+{
+	SquareMatrix<double, M> P;
+	Matrix<double, 1, M> c;
+	Vector<double, M> dx;
+	double beta;
+
+	P.setZero();
+	c(0, 0) = 1.0;
+	EXPECT_FALSE((kalman_correct_scalar<double, M>(P, c, 0.0, 1.0, dx, beta)));
+	EXPECT_EQ(dx.norm(), 0.0);
+}
+
+/*
+ * float, a large prior against precise measurements, the variances falling by seven orders:
+ * the short form cancels into negative variances, the Joseph form stays positive and closer
+ * to the same sequence in double
+ */
+struct FloatRun {
+	int negative;
+	double maxRelErr;
+};
+
+FloatRun floatRun(bool joseph)
+{
+	constexpr float R = 1e-4f;
+	std::mt19937 rng(11);
+	SquareMatrix<double, M> Pd = covariance<double>(rng) * 1000.0;
+	SquareMatrix<float, M> P;
+	Matrix<float, 1, M> c;
+	Matrix<double, 1, M> cd;
+	Vector<float, M> dx;
+	Vector<double, M> dxd;
+	float beta;
+	double betad;
+	FloatRun run{0, 0.0};
+
+	for (size_t i = 0; i < M; i++) {
+		for (size_t j = 0; j < M; j++) {
+			P(i, j) = float(Pd(i, j));
+		}
+	}
+
+	for (int n = 0; n < 400; n++) {
+		c.setZero();
+		c(0, n % M) = 1.f;
+		c(0, (n + 1) % M) = 0.5f;
+		cd.setZero();
+		cd(0, n % M) = 1.0;
+		cd(0, (n + 1) % M) = 0.5;
+		kalman_correct_scalar<float, M>(P, c, R, 0.f, dx, beta, 0.f, joseph);
+		kalman_correct_scalar<double, M>(Pd, cd, double(R), 0.0, dxd, betad, 0.0, true);
+
+		for (size_t i = 0; i < M; i++) {
+			run.negative += P(i, i) > 0.f ? 0 : 1;
+			run.maxRelErr = std::max(run.maxRelErr, std::fabs(P(i, i) - Pd(i, i)) / Pd(i, i));
+		}
+	}
+	return run;
+}
+
+TEST(KalmanCorrectTest, JosephHoldsUpInFloat)
+{
+	const FloatRun shortForm = floatRun(false);
+	const FloatRun joseph = floatRun(true);
+
+	EXPECT_GT(shortForm.negative, 0);
+	EXPECT_EQ(joseph.negative, 0);
+	EXPECT_LT(joseph.maxRelErr, shortForm.maxRelErr);
+	EXPECT_LT(joseph.maxRelErr, 1.0);
+}
+
+template <size_t N>
+void bench()
+{
+	constexpr int ITER = 5000;
+	const Problem<float, N> p(1);
+	const SquareMatrix<float, N> R = p.Rdiag();
+	Vector<float, M> dx;
+	SquareMatrix<float, M> dP;
+	float beta;
+	float sink = 0.f;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < ITER; i++) {
+		kalman_correct<float, M, N>(p.P, p.C, R, p.r, dx, dP, beta);
+		sink += dx(0);
+	}
+	const double dense = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < ITER; i++) {
+		kalman_correct_sequential<float, M, N>(p.P, p.C, p.R, p.r, dx, dP, beta);
+		sink += dx(0);
+	}
+	const double seq = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < ITER; i++) {
+		kalman_correct_sequential<float, M, N>(p.P, p.C, p.R, p.r, dx, dP, beta, 0.f, true);
+		sink += dx(0);
+	}
+	const double joseph = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+	volatile float out = sink;
+	(void)out;
+	printf("kalman M %zu N %zu  dense %8.1f ns  sequential %8.1f ns  joseph %8.1f ns\n", M, N, dense / ITER, seq / ITER,
+	       joseph / ITER);
+}
+
+TEST(KalmanCorrectTest, Benchmark)
+{
+	bench<3>();
+	bench<6>();
+	bench<9>();
+}
+
+} // namespace
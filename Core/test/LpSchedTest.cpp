@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+#include "FakeI2cBus.hpp"
+#include "imu.h"
+#include "lp_sched.h"
+
+namespace
+{
+
+constexpr uint16_t ICM_ADDR = ICM20948::I2C_ADD_ICM20948;
+
+// 1125 / (1 + 10) Hz
+constexpr uint8_t SMPLRT_DIV = 10;
+constexpr uint32_t SAMPLE_US = 1000000u * (1 + SMPLRT_DIV) / 1125u;
+// the driver takes a FIFO with no room for another frame as overflowed
+constexpr uint16_t FIFO_FRAMES = ICM20948::FIFO_SIZE / ICM20948::REG_LEN_ACCEL_GYRO - 1;
+
+LP_SCHED_ST_CONFIG config(uint32_t periodMs, uint16_t watermark)
+{
+	return {periodMs, SAMPLE_US, FIFO_FRAMES, watermark};
+}
+
+TEST(LpSchedTest, StopFollowsPeriod)
+{
+	LP_SCHED_ST_STATE sched;
+	const auto cfg = config(250, 32);
+
+	LpSched_Init(&sched, &cfg);
+	EXPECT_EQ(LpSched_StopUs(&sched), 250000u);
+}
+
+TEST(LpSchedTest, StopShortenedToWatermark)
+{
+	LP_SCHED_ST_STATE sched;
+	const auto cfg = config(1000, 20);
+
+	LpSched_Init(&sched, &cfg);
+	EXPECT_EQ(LpSched_StopUs(&sched), 20 * SAMPLE_US);
+}
+
+TEST(LpSchedTest, StopKeepsFifoHeadroom)
+{
+	LP_SCHED_ST_STATE sched;
+	const auto cfg = config(2000, 0);
+
+	LpSched_Init(&sched, &cfg);
+	EXPECT_EQ(LpSched_StopUs(&sched), (FIFO_FRAMES - 1) * SAMPLE_US);
+
+	// a slow wake eats into the time the FIFO can cover
+	LpSched_WakeBegin(&sched, 0, LP_SCHED_WAKE_TIMER);
+	LpSched_WakeEnd(&sched, 30000, 10);
+	EXPECT_EQ(LpSched_StopUs(&sched), (FIFO_FRAMES - 1) * SAMPLE_US - 30000);
+}
+
+TEST(LpSchedTest, Metrics)
+{
+	LP_SCHED_ST_STATE sched;
+	LP_SCHED_ST_METRICS metrics;
+	const auto cfg = config(100, 0);
+
+	LpSched_Init(&sched, &cfg);
+	LpSched_MetricsGet(&sched, &metrics);
+	EXPECT_EQ(metrics.fWakeupsPerSec, 0.f);
+
+	// 4 wakeups in 1 s, one of them by the sensor and one with nothing to drain
+	LpSched_WakeBegin(&sched, 240000, LP_SCHED_WAKE_TIMER);
+	LpSched_WakeEnd(&sched, 2000, 20);
+	LpSched_WakeBegin(&sched, 240000, LP_SCHED_WAKE_EVENT);
+	LpSched_WakeEnd(&sched, 4000, 30);
+	LpSched_WakeBegin(&sched, 250000, LP_SCHED_WAKE_TIMER);
+	LpSched_WakeEnd(&sched, 0, 0);
+	LpSched_WakeBegin(&sched, 258000, LP_SCHED_WAKE_TIMER);
+	LpSched_WakeEnd(&sched, 6000, 50);
+
+	LpSched_MetricsGet(&sched, &metrics);
+	EXPECT_FLOAT_EQ(metrics.fWakeupsPerSec, 4.f);
+	EXPECT_FLOAT_EQ(metrics.fSamplesPerWakeup, 25.f);
+	EXPECT_FLOAT_EQ(metrics.fAwakeUsPerBatch, 4000.f);
+	EXPECT_FLOAT_EQ(metrics.fDutyPct, 1.2f);
+	EXPECT_EQ(sched.au32Wakeups[LP_SCHED_WAKE_EVENT], 1u);
+	EXPECT_EQ(sched.u32Batches, 3u);
+	EXPECT_EQ(sched.u32AwakeMaxUs, 6000u);
+
+	// a second WakeEnd without a wake is ignored
+	LpSched_WakeEnd(&sched, 6000, 50);
+	EXPECT_EQ(sched.u32Samples, 100u);
+}
+
+TEST(LpSchedTest, FullBatchCountsAsOverflow)
+{
+	LP_SCHED_ST_STATE sched;
+	const auto cfg = config(100, 0);
+
+	LpSched_Init(&sched, &cfg);
+	LpSched_WakeBegin(&sched, 1000000, LP_SCHED_WAKE_TIMER);
+	LpSched_WakeEnd(&sched, 1000, FIFO_FRAMES);
+	EXPECT_EQ(sched.u32Overflows, 1u);
+}
+
+// the board duty-cycled on a simulated clock: the sensor pushes a frame every SAMPLE_US,
+// the MCU stops for what the scheduler says, then drains and fuses the batch
+class LpSimTest : public ::testing::Test
+{
+protected:
+	// clock restore, FIFO count read, 400 kHz bus at ~25 us per byte, fusion per sample
+	static constexpr uint32_t WAKE_US = 300;
+	static constexpr uint32_t BYTE_US = 25;
+	static constexpr uint32_t FUSE_US = 50;
+
+	void SetUp() override
+	{
+		bus.reset();
+		bus.attach(ICM_ADDR, &icm);
+		imu.imuInit(&motion, &pressure);
+		imu.imuFifoInit(false, 1);
+		imu.imuLowPowerSet(true, SMPLRT_DIV);
+	}
+
+	void advance(uint64_t us)
+	{
+		const uint64_t end = now + us;
+
+		while (next <= end) {
+			icm.fifoPush();
+			produced++;
+			next += SAMPLE_US;
+		}
+		now = end;
+	}
+
+	uint16_t drain()
+	{
+		ICM20948_ST_FIFO_SAMPLE s;
+		uint16_t n = 0;
+
+		if (imu.imuFifoPoll()) {
+			imu.imuFifoRxCplt();
+		}
+		while (imu.imuFifoRead(&s)) {
+			n++;
+		}
+		return n;
+	}
+
+	void run(const LP_SCHED_ST_CONFIG &cfg, double seconds)
+	{
+		LpSched_Init(&sched, &cfg);
+		while (now < seconds * 1e6) {
+			const uint32_t stop = LpSched_StopUs(&sched);
+
+			advance(stop);
+			LpSched_WakeBegin(&sched, stop, LP_SCHED_WAKE_TIMER);
+
+			const uint16_t n = drain();
+			const uint32_t awake = WAKE_US + n * (ICM20948::REG_LEN_ACCEL_GYRO * BYTE_US + FUSE_US);
+			advance(awake);
+			LpSched_WakeEnd(&sched, awake, n);
+			consumed += n;
+		}
+		LpSched_MetricsGet(&sched, &metrics);
+	}
+
+	void expectNoLoss()
+	{
+		EXPECT_EQ(imu.imuFifoStatsGet()->u32Overflows, 0u);
+		EXPECT_EQ(sched.u32Overflows, 0u);
+		EXPECT_FALSE(icm.fifoOverflowed());
+		// whatever is not consumed yet is still in the FIFO
+		EXPECT_EQ(consumed + icm.fifoCount() / ICM20948::REG_LEN_ACCEL_GYRO, produced);
+	}
+
+	fake::I2cBus &bus{fake::I2cBus::instance()};
+	fake::FakeIcm20948 icm;
+	ICM20948 imu;
+	IMU_EN_SENSOR_TYPE motion{IMU_EN_SENSOR_TYPE_NULL};
+	IMU_EN_SENSOR_TYPE pressure{IMU_EN_SENSOR_TYPE_NULL};
+	LP_SCHED_ST_STATE sched{};
+	LP_SCHED_ST_METRICS metrics{};
+	uint64_t now{0};
+	uint64_t next{SAMPLE_US};
+	uint32_t produced{0};
+	uint32_t consumed{0};
+};
+
+TEST_F(LpSimTest, SensorDutyCycled)
+{
+	EXPECT_EQ(icm.reg(0, ICM20948::REG_ADD_LP_CONFIG), ICM20948::REG_VAL_BIT_ACCEL_CYCLE | ICM20948::REG_VAL_BIT_GYRO_CYCLE);
+	EXPECT_TRUE(icm.reg(0, ICM20948::REG_ADD_PWR_MGMT_1) & ICM20948::REG_VAL_BIT_LP_EN);
+	EXPECT_EQ(icm.reg(2, ICM20948::REG_ADD_GYRO_SMPLRT_DIV), SMPLRT_DIV);
+	EXPECT_EQ(icm.reg(2, ICM20948::REG_ADD_ACCEL_SMPLRT_DIV_2), SMPLRT_DIV);
+
+	imu.imuLowPowerSet(false, SMPLRT_DIV);
+	EXPECT_EQ(icm.reg(0, ICM20948::REG_ADD_LP_CONFIG), 0);
+	EXPECT_FALSE(icm.reg(0, ICM20948::REG_ADD_PWR_MGMT_1) & ICM20948::REG_VAL_BIT_LP_EN);
+	EXPECT_EQ(icm.reg(2, ICM20948::REG_ADD_GYRO_SMPLRT_DIV), 0);
+}
+
+TEST_F(LpSimTest, MagnetometerReadsCycleToo)
+{
+	imu.imuFifoInit(true, 1);
+	imu.imuLowPowerSet(true, SMPLRT_DIV);
+
+	EXPECT_TRUE(icm.reg(0, ICM20948::REG_ADD_LP_CONFIG) & ICM20948::REG_VAL_BIT_I2C_MST_CYCLE);
+}
+
+TEST_F(LpSimTest, PeriodicBatches)
+{
+	run(config(250, 32), 10.0);
+
+	expectNoLoss();
+	// one wake per period plus the time spent draining
+	EXPECT_NEAR(metrics.fWakeupsPerSec, 1e6f / (250000.f + metrics.fAwakeUsPerBatch), 0.05f);
+	EXPECT_NEAR(metrics.fSamplesPerWakeup, (250000.f + metrics.fAwakeUsPerBatch) / SAMPLE_US, 0.5f);
+	EXPECT_LT(metrics.fDutyPct, 5.f);
+	EXPECT_EQ(sched.au32Wakeups[LP_SCHED_WAKE_TIMER], sched.u32Batches);
+}
+
+TEST_F(LpSimTest, WatermarkBeforePeriod)
+{
+	run(config(1000, 20), 10.0);
+
+	expectNoLoss();
+	EXPECT_NEAR(metrics.fSamplesPerWakeup, 20.f, 1.f);
+}
+
+TEST_F(LpSimTest, LongPeriodLimitedByFifo)
+{
+	// two seconds of samples do not fit, the stop is cut short
+	run(config(2000, 0), 20.0);
+
+	expectNoLoss();
+	EXPECT_GT(metrics.fWakeupsPerSec, 1e6f / (FIFO_FRAMES * SAMPLE_US));
+	EXPECT_LE(metrics.fSamplesPerWakeup, FIFO_FRAMES);
+}
+
+TEST_F(LpSimTest, BatchingWakesLessThanPerSample)
+{
+	run(config(250, 32), 5.0);
+	const float batched = metrics.fWakeupsPerSec;
+
+	// the data-ready interrupt mode wakes for every sample
+	EXPECT_LT(batched * 20.f, 1e6f / SAMPLE_US);
+}
+
+} // namespace
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "sample_stats.h"
+
+namespace
+{
+
+// ICM-20948 at 1.1 kHz / (1 + 4) and a 12-byte burst at 400 kHz
+constexpr double ODR_PERIOD_US = 1e6 / 220.0;
+constexpr double BURST_US = 330.0;
+constexpr double DURATION_US = 1e6;
+
+// sequence number (1-based) of the newest sample whose burst has landed at t
+uint32_t latestSeq(double t)
+{
+	if (t < BURST_US) {
+		return 0;
+	}
+
+	return (uint32_t)std::floor((t - BURST_US) / ODR_PERIOD_US) + 1;
+}
+
+double captureTime(uint32_t seq)
+{
+	return (seq - 1) * ODR_PERIOD_US;
+}
+
+// main loop woken by a timer, consumes whatever sample is current
+SAMPLE_ST_STATS pollAt(double periodUs)
+{
+	SAMPLE_ST_STATS stats;
+	SampleStats_Reset(&stats);
+
+	for (double t = periodUs; t < DURATION_US; t += periodUs) {
+		const uint32_t seq = latestSeq(t);
+
+		if (seq != 0) {
+			SampleStats_Update(&stats, seq, (uint32_t)(t - captureTime(seq)));
+		}
+	}
+
+	return stats;
+}
+
+TEST(SampleStatsTest, FirstSampleIsNotAGap)
+{
+	SAMPLE_ST_STATS stats;
+	SampleStats_Reset(&stats);
+
+	SampleStats_Update(&stats, 17, 100);
+	SampleStats_Update(&stats, 18, 300);
+	SampleStats_Update(&stats, 18, 900);
+	SampleStats_Update(&stats, 21, 200);
+
+	EXPECT_EQ(stats.u32Samples, 3u);
+	EXPECT_EQ(stats.u32Duplicates, 1u);
+	EXPECT_EQ(stats.u32Dropped, 2u);
+	EXPECT_EQ(stats.u32LatencyMinUs, 100u);
+	EXPECT_EQ(stats.u32LatencyMaxUs, 300u);
+	EXPECT_EQ(SampleStats_LatencyAvgUs(&stats), 200u);
+}
+
+TEST(SampleStatsTest, SequenceWrap)
+{
+	SAMPLE_ST_STATS stats;
+	SampleStats_Reset(&stats);
+
+	SampleStats_Update(&stats, UINT32_MAX, 0);
+	SampleStats_Update(&stats, 1, 0);
+
+	EXPECT_EQ(stats.u32Dropped, 1u);
+}
+
+TEST(SampleStatsTest, TimerPollingAliases)
+{
+	// TIM7 at 5 ms is slower than the 220 Hz ODR: samples are skipped
+	const SAMPLE_ST_STATS slow = pollAt(5000.0);
+	EXPECT_GT(slow.u32Dropped, 15u);
+	EXPECT_GT(slow.u32LatencyMaxUs, 4000u);
+
+	// a faster timer sees the same sample twice
+	const SAMPLE_ST_STATS fast = pollAt(4000.0);
+	EXPECT_GT(fast.u32Duplicates, 20u);
+}
+
+TEST(SampleStatsTest, DataReadyIsLosslessWithConstantLatency)
+{
+	SAMPLE_ST_STATS stats;
+	SampleStats_Reset(&stats);
+
+	// the EXTI starts the burst at capture time, a busy main loop (up to 100 us
+	// per iteration) picks the sample up right after the DMA completes
+	for (uint32_t seq = 1; captureTime(seq) < DURATION_US; seq++) {
+		const double loopJitter = (seq * 37) % 100;
+		SampleStats_Update(&stats, seq, (uint32_t)(BURST_US + loopJitter));
+	}
+
+	EXPECT_EQ(stats.u32Dropped, 0u);
+	EXPECT_EQ(stats.u32Duplicates, 0u);
+	EXPECT_GE(stats.u32Samples, 219u);
+	EXPECT_LT(stats.u32LatencyMaxUs, 500u);
+}
+
+TEST(SampleStatsTest, DtJitter)
+{
+	SAMPLE_ST_DT_STATS stats;
+	SampleStats_DtReset(&stats);
+
+	EXPECT_EQ(SampleStats_DtAvgUs(&stats), 0u);
+	EXPECT_EQ(SampleStats_DtStdUs(&stats), 0.0f);
+
+	// 5 ms +- 1 ms alternating: mean 5000, standard deviation 1000
+	for (int i = 0; i < 1000; i++) {
+		SampleStats_DtUpdate(&stats, (i & 1) ? 6000 : 4000);
+	}
+
+	EXPECT_EQ(stats.u32Count, 1000u);
+	EXPECT_EQ(stats.u32DtMinUs, 4000u);
+	EXPECT_EQ(stats.u32DtMaxUs, 6000u);
+	EXPECT_EQ(SampleStats_DtAvgUs(&stats), 5000u);
+	EXPECT_NEAR(SampleStats_DtStdUs(&stats), 1000.0f, 0.5f);
+}
+
+TEST(SampleStatsTest, DtConstantHasNoJitter)
+{
+	SAMPLE_ST_DT_STATS stats;
+	SampleStats_DtReset(&stats);
+
+	for (int i = 0; i < 100000; i++) {
+		SampleStats_DtUpdate(&stats, 4545);
+	}
+
+	EXPECT_EQ(SampleStats_DtStdUs(&stats), 0.0f);
+	EXPECT_EQ(stats.u32DtUs, 4545u);
+}
+
+} // namespace
@@ -0,0 +1,537 @@
+#include <algorithm>
+#include "FakeI2cBus.hpp"
+#include "i2c.h"
+#include "timestamp.h"
+
+// the channels i2c.c links on the target: DMA1 4/5 for I2C2, 2/3 for I2C3
+DMA_HandleTypeDef hdma_i2c2_rx = {5};
+DMA_HandleTypeDef hdma_i2c2_tx = {4};
+DMA_HandleTypeDef hdma_i2c3_rx = {3};
+DMA_HandleTypeDef hdma_i2c3_tx = {2};
+I2C_HandleTypeDef hi2c2 = {2, &hdma_i2c2_tx, &hdma_i2c2_rx};
+I2C_HandleTypeDef hi2c3 = {3, &hdma_i2c3_tx, &hdma_i2c3_rx};
+
+namespace fake
+{
+
+I2cBus &I2cBus::instance()
+{
+	static I2cBus bus;
+	return bus;
+}
+
+I2cDevice *I2cBus::device(I2C_HandleTypeDef *hi2c, uint16_t devAddr)
+{
+	auto it = _devices.find(key(hi2c, devAddr));
+
+	if (it == _devices.end() && hi2c != nullptr) {
+		it = _devices.find(key(nullptr, devAddr));
+	}
+
+	return it == _devices.end() ? nullptr : it->second;
+}
+
+size_t I2cBus::bytes() const
+{
+	size_t n = 0;
+
+	for (const auto &t : _log) {
+		n += t.len;
+	}
+
+	return n;
+}
+
+size_t I2cBus::readsInRange(uint16_t devAddr, uint8_t first, uint8_t last) const
+{
+	size_t n = 0;
+
+	for (const auto &t : _log) {
+		if (t.read && t.devAddr == devAddr && t.regAddr >= first && t.regAddr <= last) {
+			n++;
+		}
+	}
+
+	return n;
+}
+
+bool I2cBus::startDma(const Transaction &t, uint8_t *data)
+{
+	if (_dma.count(t.hi2c->Instance) != 0) {
+		return false;
+	}
+
+	record(t);
+	_dma[t.hi2c->Instance] = PendingDma{t, data};
+	return true;
+}
+
+void I2cBus::completeDma(HAL_StatusTypeDef status)
+{
+	if (_dma.empty()) {
+		return;
+	}
+
+	completeDma(_dma.begin()->second.t.hi2c, status);
+}
+
+void I2cBus::completeDma(I2C_HandleTypeDef *hi2c, HAL_StatusTypeDef status)
+{
+	auto it = _dma.find(hi2c->Instance);
+
+	if (it == _dma.end()) {
+		return;
+	}
+
+	const PendingDma dma = it->second;
+	const Transaction &t = dma.t;
+	I2cDevice *dev = device(t.hi2c, t.devAddr);
+	_dma.erase(it);
+	us += wireUs(t.len, t.read);
+
+	if (dev == nullptr) {
+		status = HAL_ERROR;
+	}
+
+	if (status != HAL_OK) {
+		HAL_I2C_ErrorCallback(t.hi2c);
+		return;
+	}
+
+	if (t.read) {
+		dev->read((uint8_t)t.regAddr, dma.data, t.len);
+		HAL_I2C_MemRxCpltCallback(t.hi2c);
+
+	} else {
+		dev->write((uint8_t)t.regAddr, dma.data, t.len);
+		HAL_I2C_MemTxCpltCallback(t.hi2c);
+	}
+}
+
+void I2cBus::reset()
+{
+	_devices.clear();
+	_log.clear();
+	_dma.clear();
+	tick = 0;
+	delayCalls = 0;
+	deferDma = false;
+	busHz = 400000;
+	us = 0;
+}
+
+FakeIcm20948::FakeIcm20948()
+{
+	_regs[0][0x00] = 0xEA;  // WHO_AM_I
+	_mag[0x00] = 0x48;      // WIA1
+	_mag[0x01] = 0x09;      // WIA2
+	_mag[0x10] = 0x01;      // ST1: DRDY
+}
+
+void FakeIcm20948::read(uint8_t reg, uint8_t *data, uint16_t len)
+{
+	// FIFO_R_W does not auto-increment, a burst keeps popping the FIFO
+	if (_bank == 0 && reg == 0x72) {
+		for (uint16_t i = 0; i < len; i++) {
+			if (_fifo.empty()) {
+				data[i] = 0xFF;
+
+			} else {
+				data[i] = _fifo.front();
+				_fifo.pop_front();
+			}
+		}
+
+		return;
+	}
+
+	// MEM_R_W does not auto-increment either, the memory address does
+	if (_bank == 0 && reg == 0x7D) {
+		for (uint16_t i = 0; i < len; i++) {
+			data[i] = dmpMem((uint16_t)((_regs[0][0x7E] << 8) | _regs[0][0x7C]++));
+		}
+
+		return;
+	}
+
+	for (uint16_t i = 0; i < len; i++) {
+		uint8_t r = (uint8_t)(reg + i);
+
+		if (r == REG_BANK_SEL) {
+			data[i] = (uint8_t)(_bank << 4);
+
+		} else if (_bank == 0 && r == 0x70) {
+			data[i] = (uint8_t)((_fifo.size() >> 8) & 0x1F);
+
+		} else if (_bank == 0 && r == 0x71) {
+			data[i] = (uint8_t)(_fifo.size() & 0xFF);
+
+		} else {
+			data[i] = _regs[_bank][r & 0x7F];
+		}
+	}
+}
+
+void FakeIcm20948::write(uint8_t reg, const uint8_t *data, uint16_t len)
+{
+	if (_bank == 0 && reg == 0x7D) {
+		for (uint16_t i = 0; i < len; i++) {
+			const uint16_t addr = (uint16_t)((_regs[0][0x7E] << 8) | _regs[0][0x7C]++);
+
+			if (addr != dmpStuckAddr) {
+				dmpMem(addr) = data[i];
+			}
+		}
+
+		return;
+	}
+
+	for (uint16_t i = 0; i < len; i++) {
+		uint8_t r = (uint8_t)(reg + i);
+
+		if (r == REG_BANK_SEL) {
+			_bank = (data[i] >> 4) & 0x03;
+			continue;
+		}
+
+		_regs[_bank][r & 0x7F] = data[i];
+
+		// FIFO_RST
+		if (_bank == 0 && r == 0x68 && (data[i] & 0x1F)) {
+			_fifo.clear();
+			_fifoOverflow = false;
+		}
+
+		// USER_CTRL: I2C_MST_EN kicks the auxiliary master
+		if (_bank == 0 && r == 0x03 && (data[i] & 0x20)) {
+			runI2cMaster();
+		}
+	}
+
+	// offsets (bank 1 XA_OFFS, bank 2 XG_OFFS_USR) and ranges (bank 2) change the output
+	if (_bank == 1 || _bank == 2) {
+		updateOutputs();
+	}
+}
+
+void FakeIcm20948::setAccel(int16_t x, int16_t y, int16_t z)
+{
+	_accelIn[0] = x;
+	_accelIn[1] = y;
+	_accelIn[2] = z;
+	updateOutputs();
+}
+
+void FakeIcm20948::setGyro(int16_t x, int16_t y, int16_t z)
+{
+	_gyroIn[0] = x;
+	_gyroIn[1] = y;
+	_gyroIn[2] = z;
+	updateOutputs();
+}
+
+void FakeIcm20948::setAccelTrim(int16_t x, int16_t y, int16_t z)
+{
+	const int16_t v[3] = {x, y, z};
+
+	for (int i = 0; i < 3; i++) {
+		_accelTrim[i] = v[i];
+		_regs[1][0x14 + 3 * i] = (uint8_t)((uint16_t)v[i] >> 8);
+		_regs[1][0x15 + 3 * i] = (uint8_t)(v[i] & 0xFF);
+	}
+
+	updateOutputs();
+}
+
+void FakeIcm20948::updateOutputs()
+{
+	const int gyroFs = (_regs[2][0x01] >> 1) & 0x03;
+	const int accelFs = (_regs[2][0x14] >> 1) & 0x03;
+
+	for (int i = 0; i < 3; i++) {
+		// XG_OFFS_USR is in 1000 dps LSB: * 4 / 2^GYRO_FS_SEL
+		const int32_t gyro = _gyroIn[i] + getBe16(2, 0x03 + 2 * i) * 4 / (1 << gyroFs);
+		// XA_OFFS is in 16 g LSB relative to the trim, bit 0 reserved
+		const int32_t accelOffs = (getBe16(1, 0x14 + 3 * i) & ~1) - (_accelTrim[i] & ~1);
+		const int32_t accel = _accelIn[i] + accelOffs * (8 >> accelFs);
+
+		putBe16(0x2D + 2 * i, (int16_t)std::max<int32_t>(INT16_MIN, std::min<int32_t>(INT16_MAX, accel)));
+		putBe16(0x33 + 2 * i, (int16_t)std::max<int32_t>(INT16_MIN, std::min<int32_t>(INT16_MAX, gyro)));
+	}
+}
+
+int16_t FakeIcm20948::getBe16(uint8_t bank, uint8_t addr) const
+{
+	return (int16_t)((_regs[bank][addr] << 8) | _regs[bank][addr + 1]);
+}
+
+void FakeIcm20948::setMag(int16_t x, int16_t y, int16_t z)
+{
+	const int16_t v[3] = {x, y, z};
+
+	for (int i = 0; i < 3; i++) {
+		_mag[0x11 + 2 * i] = (uint8_t)(v[i] & 0xFF);
+		_mag[0x12 + 2 * i] = (uint8_t)((uint16_t)v[i] >> 8);
+	}
+
+	_mag[0x10] |= 0x01;
+}
+
+void FakeIcm20948::runI2cMaster()
+{
+	uint8_t ext = 0x3B; // EXT_SENS_DATA_00
+
+	// SLV0 (0x03..0x06) and SLV1 (0x07..0x0A) in bank 3
+	for (uint8_t base = 0x03; base <= 0x07; base += 4) {
+		const uint8_t addr = _regs[3][base];
+		const uint8_t reg = _regs[3][base + 1];
+		const uint8_t ctrl = _regs[3][base + 2];
+		const uint8_t dout = _regs[3][base + 3];
+
+		if (!(ctrl & 0x80) || (addr & 0x7F) != 0x0C) {
+			continue;
+		}
+
+		if (addr & 0x80) {
+			for (uint8_t i = 0; i < (ctrl & 0x0F); i++) {
+				const uint8_t r = (uint8_t)(reg + i);
+				_regs[0][ext++] = _mag[r];
+
+				// reading ST2 releases the data lock
+				if (r == 0x18) {
+					_mag[0x10] &= (uint8_t)~0x01;
+				}
+			}
+
+		} else {
+			_mag[reg] = dout;
+		}
+	}
+}
+
+std::vector<uint8_t> FakeIcm20948::fifoFrame() const
+{
+	std::vector<uint8_t> f;
+	const uint8_t en1 = _regs[0][0x66];
+	const uint8_t en2 = _regs[0][0x67];
+
+	if (en2 & 0x10) {
+		f.insert(f.end(), &_regs[0][0x2D], &_regs[0][0x33]);
+	}
+
+	for (uint8_t axis = 0; axis < 3; axis++) {
+		if (en2 & (0x02 << axis)) {
+			f.insert(f.end(), &_regs[0][0x33 + 2 * axis], &_regs[0][0x35 + 2 * axis]);
+		}
+	}
+
+	if (en2 & 0x01) {
+		f.insert(f.end(), &_regs[0][0x39], &_regs[0][0x3B]);
+	}
+
+	if ((en1 & 0x01) && (_regs[3][0x05] & 0x80)) {
+		f.insert(f.end(), &_regs[0][0x3B], &_regs[0][0x3B + (_regs[3][0x05] & 0x0F)]);
+	}
+
+	return f;
+}
+
+void FakeIcm20948::fifoWrite(const uint8_t *data, size_t len)
+{
+	if (!(_regs[0][0x03] & 0x40)) {
+		return;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		if (_fifo.size() >= FIFO_SIZE) {
+			// snapshot mode drops new bytes, stream mode drops the oldest
+			_fifoOverflow = true;
+
+			if (_regs[0][0x69] & 0x1F) {
+				return;
+			}
+
+			_fifo.pop_front();
+		}
+
+		_fifo.push_back(data[i]);
+	}
+}
+
+void FakeIcm20948::putBe16(uint8_t addr, int16_t v)
+{
+	_regs[0][addr] = (uint8_t)((uint16_t)v >> 8);
+	_regs[0][addr + 1] = (uint8_t)(v & 0xFF);
+}
+
+} // namespace fake
+
+using fake::I2cBus;
+using fake::Transaction;
+
+extern "C" HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+		uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	(void)MemAddSize;
+	(void)Timeout;
+	I2cBus &bus = I2cBus::instance();
+	bus.record(Transaction{hi2c, DevAddress, MemAddress, Size, true, false});
+
+	fake::I2cDevice *dev = bus.device(hi2c, DevAddress);
+
+	if (dev == nullptr) {
+		return HAL_ERROR;
+	}
+
+	dev->read((uint8_t)MemAddress, pData, Size);
+	return HAL_OK;
+}
+
+// the transfer lands immediately, the test plays the role of the completion ISR
+extern "C" HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+		uint16_t MemAddSize, uint8_t *pData, uint16_t Size)
+{
+	(void)MemAddSize;
+	I2cBus &bus = I2cBus::instance();
+
+	if (hi2c->hdmarx == nullptr) {
+		return HAL_ERROR;
+	}
+	if (bus.deferDma) {
+		return bus.startDma(Transaction{hi2c, DevAddress, MemAddress, Size, true, true}, pData) ? HAL_OK : HAL_BUSY;
+	}
+
+	bus.record(Transaction{hi2c, DevAddress, MemAddress, Size, true, true});
+
+	fake::I2cDevice *dev = bus.device(hi2c, DevAddress);
+
+	if (dev == nullptr) {
+		return HAL_ERROR;
+	}
+
+	dev->read((uint8_t)MemAddress, pData, Size);
+	return HAL_OK;
+}
+
+extern "C" HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+		uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	(void)MemAddSize;
+	(void)Timeout;
+	I2cBus &bus = I2cBus::instance();
+	bus.record(Transaction{hi2c, DevAddress, MemAddress, Size, false, false});
+
+	fake::I2cDevice *dev = bus.device(hi2c, DevAddress);
+
+	if (dev == nullptr) {
+		return HAL_ERROR;
+	}
+
+	dev->write((uint8_t)MemAddress, pData, Size);
+	return HAL_OK;
+}
+
+extern "C" HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+		uint16_t MemAddSize, uint8_t *pData, uint16_t Size)
+{
+	(void)MemAddSize;
+	I2cBus &bus = I2cBus::instance();
+
+	if (hi2c->hdmatx == nullptr) {
+		return HAL_ERROR;
+	}
+	if (bus.deferDma) {
+		return bus.startDma(Transaction{hi2c, DevAddress, MemAddress, Size, false, true}, pData) ? HAL_OK : HAL_BUSY;
+	}
+
+	bus.record(Transaction{hi2c, DevAddress, MemAddress, Size, false, true});
+
+	fake::I2cDevice *dev = bus.device(hi2c, DevAddress);
+
+	if (dev == nullptr) {
+		return HAL_ERROR;
+	}
+
+	dev->write((uint8_t)MemAddress, pData, Size);
+	return HAL_OK;
+}
+
+extern "C" HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData,
+		uint16_t Size, uint32_t Timeout)
+{
+	(void)Timeout;
+
+	if (Size == 0) {
+		return HAL_ERROR;
+	}
+
+	I2cBus &bus = I2cBus::instance();
+	bus.record(Transaction{hi2c, DevAddress, pData[0], (uint16_t)(Size - 1), false, false});
+
+	fake::I2cDevice *dev = bus.device(hi2c, DevAddress);
+
+	if (dev == nullptr) {
+		return HAL_ERROR;
+	}
+
+	dev->write(pData[0], pData + 1, (uint16_t)(Size - 1));
+	return HAL_OK;
+}
+
+extern "C" void HAL_Delay(uint32_t Delay)
+{
+	I2cBus &bus = I2cBus::instance();
+	bus.delayCalls++;
+	bus.tick += Delay;
+}
+
+extern "C" uint32_t HAL_GetTick(void)
+{
+	return I2cBus::instance().tick;
+}
+
+extern "C" __attribute__((weak)) void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	(void)hi2c;
+}
+
+extern "C" __attribute__((weak)) void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	(void)hi2c;
+}
+
+extern "C" __attribute__((weak)) void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	(void)hi2c;
+}
+
+// Timestamp_* on the host run on the bus model's microsecond clock
+extern "C" void Timestamp_Init(void)
+{
+	I2cBus::instance().us = 0;
+}
+
+extern "C" uint32_t Timestamp_Get(void)
+{
+	return I2cBus::instance().us;
+}
+
+extern "C" uint32_t Timestamp_ElapsedUs(uint32_t u32Since)
+{
+	return I2cBus::instance().us - u32Since;
+}
+
+extern "C" uint32_t Timestamp_DeltaUs(uint32_t u32From, uint32_t u32To)
+{
+	return u32To - u32From;
+}
+
+extern "C" int32_t Timestamp_DiffUs(uint32_t u32A, uint32_t u32B)
+{
+	return (int32_t)(u32A - u32B);
+}
+
+extern "C" uint32_t Timestamp_UsToTicks(uint32_t u32Us)
+{
+	return u32Us;
+}
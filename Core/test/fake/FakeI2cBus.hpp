@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <vector>
+#include "main.h"
+
+namespace fake
+{
+
+struct Transaction {
+	I2C_HandleTypeDef *hi2c;
+	uint16_t devAddr;
+	uint16_t regAddr;
+	uint16_t len;
+	bool read;
+	bool dma;
+};
+
+class I2cDevice
+{
+public:
+	virtual ~I2cDevice() = default;
+	virtual void read(uint8_t reg, uint8_t *data, uint16_t len) = 0;
+	virtual void write(uint8_t reg, const uint8_t *data, uint16_t len) = 0;
+};
+
+/**
+ * Host model of the I2C peripheral behind the HAL_I2C_* calls. Devices are
+ * attached by their 8-bit HAL address; every transfer is logged so tests can
+ * count bus transactions and payload bytes.
+ */
+class I2cBus
+{
+public:
+	static I2cBus &instance();
+
+	// without a handle the device answers on every bus
+	void attach(uint16_t devAddr, I2cDevice *dev, I2C_HandleTypeDef *hi2c = nullptr) { _devices[key(hi2c, devAddr)] = dev; }
+	void detach(uint16_t devAddr, I2C_HandleTypeDef *hi2c = nullptr) { _devices.erase(key(hi2c, devAddr)); }
+	void detachAll() { _devices.clear(); }
+	I2cDevice *device(uint16_t devAddr) { return device(nullptr, devAddr); }
+	I2cDevice *device(I2C_HandleTypeDef *hi2c, uint16_t devAddr);
+
+	void clearLog() { _log.clear(); }
+	const std::vector<Transaction> &log() const { return _log; }
+	void record(const Transaction &t) { _log.push_back(t); }
+
+	size_t transactions() const { return _log.size(); }
+	size_t bytes() const;
+
+	// reads of device registers falling in [first, last]
+	size_t readsInRange(uint16_t devAddr, uint8_t first, uint8_t last) const;
+
+	// HAL_Delay bookkeeping
+	uint32_t tick{0};
+	uint32_t delayCalls{0};
+
+	// Deferred DMA: a *_DMA call occupies its bus until completeDma(), which
+	// moves the data, advances the microsecond clock behind Timestamp_Get() by
+	// the wire time at busHz and fires the HAL completion callback. A second
+	// DMA request on a bus with one in flight returns HAL_BUSY as on the
+	// target; transfers on different buses are in flight together. Without a
+	// handle the calls act on the first bus with a transfer pending.
+	bool deferDma{false};
+	uint32_t busHz{400000};
+	uint32_t us{0};
+
+	bool dmaPending() const { return !_dma.empty(); }
+	bool dmaPending(I2C_HandleTypeDef *hi2c) const { return _dma.count(hi2c->Instance) != 0; }
+	const Transaction &dmaActive() const { return _dma.begin()->second.t; }
+	bool startDma(const Transaction &t, uint8_t *data);
+	void completeDma(HAL_StatusTypeDef status = HAL_OK);
+	void completeDma(I2C_HandleTypeDef *hi2c, HAL_StatusTypeDef status = HAL_OK);
+
+	// START, address, register, (repeated START, address), payload; 9 bits per byte
+	uint32_t wireUs(uint16_t len, bool read) const { return (uint32_t)(((read ? 3u : 2u) + len) * 9u * 1000000u / busHz); }
+
+	void reset();
+
+private:
+	struct PendingDma {
+		Transaction t{};
+		uint8_t *data{nullptr};
+	};
+
+	static uint32_t key(I2C_HandleTypeDef *hi2c, uint16_t devAddr) { return ((hi2c ? hi2c->Instance : 0u) << 16) | devAddr; }
+
+	std::map<uint32_t, I2cDevice *> _devices;
+	std::vector<Transaction> _log;
+	std::map<uint32_t, PendingDma> _dma; // by bus instance
+};
+
+/**
+ * Plain 256-byte register file with auto-increment, enough for devices whose
+ * registers hold no side effects.
+ */
+class RegisterDevice : public I2cDevice
+{
+public:
+	void read(uint8_t reg, uint8_t *data, uint16_t len) override
+	{
+		for (uint16_t i = 0; i < len; i++) {
+			data[i] = regs[(uint8_t)(reg + i)];
+		}
+	}
+
+	void write(uint8_t reg, const uint8_t *data, uint16_t len) override
+	{
+		for (uint16_t i = 0; i < len; i++) {
+			regs[(uint8_t)(reg + i)] = data[i];
+		}
+	}
+
+	uint8_t regs[256] {};
+};
+
+/**
+ * Register model of the ICM-20948 with its AK09916 behind the auxiliary
+ * I2C master. Bank selection and SLV0/SLV1 transactions are simulated.
+ */
+class FakeIcm20948 : public I2cDevice
+{
+public:
+	static constexpr uint8_t REG_BANK_SEL = 0x7F;
+
+	FakeIcm20948();
+
+	void read(uint8_t reg, uint8_t *data, uint16_t len) override;
+	void write(uint8_t reg, const uint8_t *data, uint16_t len) override;
+
+	uint8_t &reg(uint8_t bank, uint8_t addr) { return _regs[bank & 0x03][addr & 0x7F]; }
+	uint8_t &magReg(uint8_t addr) { return _mag[addr]; }
+	uint8_t bank() const { return _bank; }
+
+	void setAccel(int16_t x, int16_t y, int16_t z);
+	void setGyro(int16_t x, int16_t y, int16_t z);
+	void setMag(int16_t x, int16_t y, int16_t z);
+	// factory accel offsets, as a reset loads them into XA/YA/ZA_OFFS
+	void setAccelTrim(int16_t x, int16_t y, int16_t z);
+	// raw TEMP_OUT: degC = raw / 333.87 + 21
+	void setTemp(int16_t raw) { putBe16(0x39, raw); }
+
+	// one pass of the auxiliary I2C master over SLV0/SLV1
+	void runI2cMaster();
+
+	// FIFO model: 512 bytes, frame content follows FIFO_EN_1/FIFO_EN_2
+	static constexpr size_t FIFO_SIZE = 512;
+	std::vector<uint8_t> fifoFrame() const;
+	void fifoWrite(const uint8_t *data, size_t len);
+	void fifoPush() { const auto f = fifoFrame(); fifoWrite(f.data(), f.size()); }
+	size_t fifoCount() const { return _fifo.size(); }
+	bool fifoOverflowed() const { return _fifoOverflow; }
+
+	// DMP memory behind MEM_BANK_SEL/MEM_START_ADDR/MEM_R_W; the address wraps inside a bank
+	static constexpr size_t DMP_MEM_SIZE = 0x8000;
+	uint8_t &dmpMem(uint16_t addr) { return _dmpMem[addr % DMP_MEM_SIZE]; }
+	// a cell that ignores writes, to fail the upload verification
+	int dmpStuckAddr{-1};
+
+private:
+	void putBe16(uint8_t addr, int16_t v);
+	int16_t getBe16(uint8_t bank, uint8_t addr) const;
+	// data registers: the set values plus what the user offset registers add
+	void updateOutputs();
+
+	int16_t _accelIn[3] {};
+	int16_t _gyroIn[3] {};
+	int16_t _accelTrim[3] {};
+
+	std::deque<uint8_t> _fifo;
+	bool _fifoOverflow{false};
+
+	uint8_t _regs[4][128] {};
+	std::vector<uint8_t> _dmpMem = std::vector<uint8_t>(DMP_MEM_SIZE);
+	uint8_t _mag[256] {};
+	uint8_t _bank{0};
+};
+
+} // namespace fake
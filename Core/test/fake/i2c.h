@@ -0,0 +1,15 @@
+#pragma once
+
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    extern I2C_HandleTypeDef hi2c2;
+    extern I2C_HandleTypeDef hi2c3;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,7 @@
+// the driver with its template definitions, instantiated on the mock transports as well
+#include "imu_transport_mock.h"
+#include "../../Src/imu.cpp"
+
+template class Icm20948Driver<MockTransport<I2cTransport::Wire, false>>;
+template class Icm20948Driver<MockTransport<I2cTransport::Wire, true>>;
+template class Icm20948Driver<MockTransport<Icm20948SpiWire, true>>;
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include "FakeI2cBus.hpp"
+#include "imu_transport.h"
+
+/**
+ * Register-level transport for the ICM20948 driver on the host: transfers go
+ * straight to a simulated device, and the time each would take on the wire
+ * of the transport it stands in for is added up. Async transfers count as
+ * bus time only, the CPU is free while they run.
+ */
+template <class Wire, bool ASYNC_XFER>
+class MockTransport
+{
+public:
+	typedef fake::I2cDevice Handle;
+	constexpr static bool ASYNC = false;
+	constexpr static uint8_t USER_CTRL_BITS = 0x00;
+
+	explicit MockTransport(fake::I2cDevice *dev = nullptr, fake::I2cDevice *aux = nullptr) : _dev(dev), _aux(aux) {}
+
+	fake::I2cDevice *busGet() const { return _dev; }
+
+	bool read(uint8_t reg, uint8_t *buf, uint16_t len) { return xfer(_dev, reg, buf, len, true, false); }
+	bool write(uint8_t reg, const uint8_t *buf, uint16_t len) { return xfer(_dev, reg, (uint8_t *)buf, len, false, false); }
+	bool writeByte(uint8_t reg, uint8_t value) { return write(reg, &value, 1); }
+	bool readStart(uint8_t reg, uint8_t *buf, uint16_t len) { return xfer(_dev, reg, buf, len, true, ASYNC_XFER); }
+	void readDone() {}
+
+	bool auxRead(uint8_t dev, uint8_t reg, uint8_t *buf, uint16_t len)
+	{
+		(void)dev;
+		return xfer(_aux, reg, buf, len, true, false);
+	}
+
+	bool auxWrite(uint8_t dev, uint8_t reg, uint8_t value)
+	{
+		(void)dev;
+		return xfer(_aux, reg, &value, 1, false, false);
+	}
+
+	void statsReset()
+	{
+		busNs = 0;
+		blockedNs = 0;
+		transfers = 0;
+	}
+
+	uint64_t busNs{0};
+	uint64_t blockedNs{0};
+	uint32_t transfers{0};
+
+private:
+	bool xfer(fake::I2cDevice *dev, uint8_t reg, uint8_t *buf, uint16_t len, bool read, bool async)
+	{
+		const uint32_t ns = Wire::xferNs(len, read);
+
+		if (dev == nullptr) {
+			return false;
+		}
+
+		if (read) {
+			dev->read(reg, buf, len);
+		} else {
+			dev->write(reg, buf, len);
+		}
+		busNs += ns;
+		blockedNs += async ? 0 : ns;
+		transfers++;
+		return true;
+	}
+
+	fake::I2cDevice *_dev;
+	fake::I2cDevice *_aux;
+};
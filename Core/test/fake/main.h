@@ -0,0 +1,67 @@
+#pragma once
+
+/*
+ * Host-side stand-in for the CubeMX main.h. Declares only the HAL subset the
+ * drivers in Core/Src use, so they can be compiled and exercised on the host
+ * against the simulated devices in FakeI2cBus.
+ */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+    typedef enum
+    {
+        HAL_OK = 0x00,
+        HAL_ERROR = 0x01,
+        HAL_BUSY = 0x02,
+        HAL_TIMEOUT = 0x03
+    } HAL_StatusTypeDef;
+
+    typedef struct
+    {
+        uint32_t Instance;
+    } DMA_HandleTypeDef;
+
+    // as in the HAL, the *_DMA transfers fail on a handle without a linked channel
+    typedef struct
+    {
+        uint32_t Instance;
+        DMA_HandleTypeDef *hdmatx;
+        DMA_HandleTypeDef *hdmarx;
+    } I2C_HandleTypeDef;
+
+#define I2C_MEMADD_SIZE_8BIT (0x00000001U)
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+
+    HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                       uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+    HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                        uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+    HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                           uint16_t MemAddSize, uint8_t *pData, uint16_t Size);
+    HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                            uint16_t MemAddSize, uint8_t *pData, uint16_t Size);
+    HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData,
+                                              uint16_t Size, uint32_t Timeout);
+
+    // weak in the fake as in the HAL, drivers override them
+    void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c);
+    void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c);
+    void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+
+    void HAL_Delay(uint32_t Delay);
+    uint32_t HAL_GetTick(void);
+
+    // single-threaded host: interrupt masking is a no-op
+    static inline uint32_t __get_PRIMASK(void) { return 0; }
+    static inline void __set_PRIMASK(uint32_t priMask) { (void)priMask; }
+    static inline void __disable_irq(void) {}
+
+#ifdef __cplusplus
+}
+#endif